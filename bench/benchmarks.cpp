@@ -0,0 +1,640 @@
+#include <map>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <benchmark/benchmark.h>
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QSize>
+#include <QTemporaryDir>
+
+#include "filesystem.h"
+#include "hashindex.h"
+#include "imageinfo.h"
+#include "inputscanner.h"
+#include "perceptualhash.h"
+#include "scratchbuffers.h"
+#include "similaritycascade.h"
+#include "syntheticfilesystem.h"
+#include "syntheticcorpus.h"
+
+using myriad::bench::SyntheticCorpus;
+using myriad::processing::FileSystem;
+using myriad::processing::HashIndex;
+using myriad::processing::HashWorkspace;
+using myriad::processing::ImageInfo;
+using myriad::processing::InputScanner;
+using myriad::processing::PopcountTarget;
+using myriad::processing::ScratchBuffers;
+using myriad::processing::SimilarityCascade;
+using myriad::processing::SimilarityThreshold;
+using myriad::processing::SyntheticFileSystem;
+using myriad::processing::WideHash;
+
+namespace {
+
+    /**
+     * The image formats exercised by the decoding benchmarks. These are the formats that Myriad recognises by name
+     * which Qt can also write without any additional image format plugins (GIF support in Qt is read-only).
+     */
+
+    const char * const Formats[] = {"JPEG", "PNG", "BMP"};
+
+    /**
+     * The number of distinct images cycled through when reading.
+     */
+
+    constexpr int ReadCorpusSize = 8;
+
+    /**
+     * The side length of images that are only needed for their hashes.
+     */
+
+    constexpr int CompareImageSide = 64;
+
+    /**
+     * The side length of images that are only needed to exist on disk.
+     */
+
+    constexpr int ScanImageSide = 16;
+
+    /**
+     * The number of images per directory in the scanning corpus.
+     */
+
+    constexpr int ScanFilesPerDir = 100;
+
+    /**
+     * A set of synthetic images on disk that is generated the first time it is needed and then shared between all
+     * runs of the benchmarks that use it, so that generation time is never included in any measurement.
+     */
+
+    struct Corpus {
+
+        QTemporaryDir dir;
+        QStringList paths;
+        qint64 totalSize = 0;
+    };
+
+    const Corpus& corpus(const int count, const int side, const char * const format, const int filesPerDir = 0) {
+
+        using Key = std::tuple<int, int, QString, int>;
+        static std::map<Key, std::unique_ptr<Corpus>> corpora;
+
+        auto& corpus = corpora[Key{count, side, QString::fromLatin1(format), filesPerDir}];
+        if (!corpus) {
+
+            corpus.reset(new Corpus);
+            corpus->paths = SyntheticCorpus{}.write(corpus->dir.path(), count, side, side, format, filesPerDir);
+            for (const auto& path : corpus->paths) {
+                corpus->totalSize += QFileInfo{path}.size();
+            }
+        }
+
+        return *corpus;
+    }
+
+    /**
+     * Reads every image of a corpus, much as ProcessorThread::hashImages() does.
+     */
+
+    std::vector<ImageInfo> readAll(const Corpus& corpus) {
+
+        ScratchBuffers buffers;
+        std::vector<ImageInfo> images(corpus.paths.size());
+
+        for (auto i = 0; i < corpus.paths.size(); ++i) {
+            images[i].read(corpus.paths[i], buffers);
+        }
+
+        return images;
+    }
+
+    /**
+     * Measures the full cost of loading a single image: reading the file, decoding it and computing its hash. The
+     * first argument is an index into Formats, and the second the side length of the (square) images.
+     */
+
+    void BM_ImageInfoRead(benchmark::State& state) {
+
+        const auto * const format = Formats[state.range(0)];
+        const auto side = static_cast<int>(state.range(1));
+        const auto& images = corpus(ReadCorpusSize, side, format);
+
+        ScratchBuffers buffers;
+        ImageInfo info;
+        auto index = 0;
+
+        for (auto _ : state) {
+
+            info.read(images.paths[index], buffers);
+            benchmark::DoNotOptimize(info);
+            index = (index + 1) % ReadCorpusSize;
+        }
+
+        state.SetLabel(format);
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * (images.totalSize / ReadCorpusSize));
+    }
+
+    void readArguments(benchmark::internal::Benchmark * const benchmark) {
+
+        for (auto format = 0; format < static_cast<int>(sizeof Formats / sizeof Formats[0]); ++format) {
+            for (const auto side : {256, 1024, 4096}) {
+                benchmark->Args({format, side});
+            }
+        }
+    }
+
+    BENCHMARK(BM_ImageInfoRead)->Apply(readArguments)->Unit(benchmark::kMillisecond);
+
+    /**
+     * Measures the cost of loading a PNG image with and without a digest of its pixels, so that the cost of the digest
+     * is the difference between the two. The first argument is the side length of the (square) images, and the second
+     * is 1 to take the digest or 0 not to.
+     */
+
+    void BM_DigestPixels(benchmark::State& state) {
+
+        const auto side = static_cast<int>(state.range(0));
+        const auto withPixelDigest = state.range(1) != 0;
+        const auto& images = corpus(ReadCorpusSize, side, "PNG");
+
+        ScratchBuffers buffers;
+        ImageInfo info;
+        auto index = 0;
+
+        for (auto _ : state) {
+
+            info.read(images.paths[index], buffers, FileSystem::local(), false, nullptr, withPixelDigest);
+            benchmark::DoNotOptimize(info);
+            index = (index + 1) % ReadCorpusSize;
+        }
+
+        state.SetLabel(withPixelDigest ? "digest" : "no digest");
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    BENCHMARK(BM_DigestPixels)->Args({1024, 0})->Args({1024, 1})->Args({4096, 0})->Args({4096, 1})
+                              ->Unit(benchmark::kMillisecond);
+
+    /**
+     * The ratio of the side of the full image in a synthetic RAW file to the side of the preview embedded in it, which
+     * is typical of the medium-sized previews that cameras embed.
+     */
+
+    constexpr int RawPreviewRatio = 4;
+
+    /**
+     * Pairs of files that hold the same images: as JPEG files, and as TIFF-based RAW files (named as DNG files) in
+     * which each image is stored at full size alongside a smaller embedded preview. These stand in for camera
+     * originals, whose sensor data Qt can't decode; the full-size JPEG stands in for decoding the full image.
+     */
+
+    struct RawCorpus {
+
+        QTemporaryDir dir;
+        QStringList jpegPaths;
+        QStringList rawPaths;
+    };
+
+    /**
+     * Builds a minimal little-endian TIFF container holding a full-size JPEG image in its first directory and a
+     * reduced-resolution JPEG preview in its second, as RAW files do.
+     */
+
+    QByteArray rawContainer(const QImage& image) {
+
+        const auto encode = [](const QImage& source) {
+
+            QByteArray encoded;
+            QBuffer buffer{&encoded};
+            buffer.open(QIODevice::WriteOnly);
+            source.save(&buffer, "JPEG", 90);
+            return encoded;
+        };
+
+        const auto previewSize = image.size() / RawPreviewRatio;
+        const auto full = encode(image);
+        const auto preview = encode(image.scaled(previewSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+
+        QByteArray data;
+        const auto put16 = [&data](const quint32 value) {
+            data.append(static_cast<char>(value & 0xff)).append(static_cast<char>((value >> 8) & 0xff));
+        };
+        const auto put32 = [&put16](const quint32 value) {
+            put16(value & 0xffff);
+            put16(value >> 16);
+        };
+        const auto putEntry = [&put16, &put32](const quint16 tag, const quint16 type, const quint32 value) {
+
+            put16(tag);
+            put16(type);
+            put32(1);
+            put32(value);
+        };
+
+        // Each directory has six entries, so takes 2 + 6 * 12 + 4 bytes, and the image data follows both of them.
+
+        constexpr quint32 DirectorySize = 2 + 6 * 12 + 4;
+        constexpr quint32 FirstDirectory = 8;
+        constexpr quint32 SecondDirectory = FirstDirectory + DirectorySize;
+        constexpr quint32 FullOffset = SecondDirectory + DirectorySize;
+        const auto previewOffset = FullOffset + static_cast<quint32>(full.size());
+
+        const auto putDirectory = [&](const quint32 subfileType, const QSize& size, const quint32 offset,
+                                      const quint32 length, const quint32 next) {
+
+            put16(6);
+            putEntry(0x00fe, 4, subfileType);
+            putEntry(0x0100, 4, static_cast<quint32>(size.width()));
+            putEntry(0x0101, 4, static_cast<quint32>(size.height()));
+            putEntry(0x0103, 3, 7);
+            putEntry(0x0111, 4, offset);
+            putEntry(0x0117, 4, length);
+            put32(next);
+        };
+
+        data.append("II");
+        put16(42);
+        put32(FirstDirectory);
+        putDirectory(0, image.size(), FullOffset, static_cast<quint32>(full.size()), SecondDirectory);
+        putDirectory(1, previewSize, previewOffset, static_cast<quint32>(preview.size()), 0);
+        data.append(full).append(preview);
+
+        return data;
+    }
+
+    const RawCorpus& rawCorpus(const int side) {
+
+        static std::map<int, std::unique_ptr<RawCorpus>> corpora;
+
+        auto& corpus = corpora[side];
+        if (!corpus) {
+
+            corpus.reset(new RawCorpus);
+            for (auto i = 0; i < ReadCorpusSize; ++i) {
+
+                const auto image = SyntheticCorpus{}.image(i, side, side);
+                const auto basePath = QStringLiteral("%1/%2").arg(corpus->dir.path()).arg(i);
+
+                corpus->jpegPaths << basePath + QStringLiteral(".jpg");
+                image.save(corpus->jpegPaths.last(), "JPEG", 90);
+
+                corpus->rawPaths << basePath + QStringLiteral(".dng");
+                QFile file{corpus->rawPaths.last()};
+                file.open(QIODevice::WriteOnly);
+                file.write(rawContainer(image));
+            }
+        }
+
+        return *corpus;
+    }
+
+    /**
+     * Measures the cost of loading a camera original by hashing the preview embedded in a RAW file, against that of
+     * decoding a JPEG file of the full image, which is the speed-up that the EmbeddedPreviews setting offers. The first
+     * argument is the side length of the full images, and the second is 1 to read the RAW files with their previews or
+     * 0 to read the JPEG files in full.
+     */
+
+    void BM_EmbeddedPreviewRead(benchmark::State& state) {
+
+        const auto side = static_cast<int>(state.range(0));
+        const auto useEmbeddedPreview = state.range(1) != 0;
+        const auto& files = rawCorpus(side);
+        const auto& paths = useEmbeddedPreview ? files.rawPaths : files.jpegPaths;
+
+        ScratchBuffers buffers;
+        ImageInfo info;
+        auto index = 0;
+
+        for (auto _ : state) {
+
+            info.read(paths[index], buffers, useEmbeddedPreview);
+            benchmark::DoNotOptimize(info);
+            index = (index + 1) % ReadCorpusSize;
+        }
+
+        state.SetLabel(useEmbeddedPreview ? "embedded preview" : "full image");
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    BENCHMARK(BM_EmbeddedPreviewRead)->Args({2048, 0})->Args({2048, 1})->Args({4096, 0})->Args({4096, 1})
+                                     ->Unit(benchmark::kMillisecond);
+
+    /**
+     * Measures the cost of hashing an image that has already been decoded, which isolates the hashing arithmetic from
+     * I/O and decoding. The argument is the side length of the image.
+     */
+
+    void BM_DctHash(benchmark::State& state) {
+
+        const auto side = static_cast<int>(state.range(0));
+        const auto image = SyntheticCorpus{}.image(0, side, side);
+
+        HashWorkspace workspace;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(myriad::processing::dctHash(image, workspace));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    BENCHMARK(BM_DctHash)->Arg(256)->Arg(1024)->Arg(4096)->Unit(benchmark::kMicrosecond);
+
+    /**
+     * Measures scanning a block of hashes of a particular width for those within some distance of another, as the
+     * perceptual hash stage of HashIndex::findCandidates() does, but compiled for the generic PopcountTarget (see
+     * BM_FindCandidates for the others). The argument is the number of hashes scanned.
+     */
+
+    template <int Bits>
+    void BM_HammingDistance(benchmark::State& state) {
+
+        std::mt19937_64 generator;
+        std::vector<WideHash<Bits>> hashes(state.range(0));
+        for (auto& hash : hashes) {
+            for (auto& word : hash.words) {
+                word = generator();
+            }
+        }
+
+        const auto target = hashes.front();
+        for (auto _ : state) {
+
+            auto matchCount = 0;
+            for (const auto& hash : hashes) {
+                matchCount += myriad::processing::hammingDistance(hash, target) < Bits / 10;
+            }
+
+            benchmark::DoNotOptimize(matchCount);
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    BENCHMARK_TEMPLATE(BM_HammingDistance, 64)->Arg(4096);
+    BENCHMARK_TEMPLATE(BM_HammingDistance, 128)->Arg(4096);
+    BENCHMARK_TEMPLATE(BM_HammingDistance, 256)->Arg(4096);
+
+    /**
+     * Measures the cost of a single comparison between two hashed images.
+     */
+
+    void BM_ImageInfoDifference(benchmark::State& state) {
+
+        const auto images = readAll(corpus(2, CompareImageSide, "PNG"));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(ImageInfo::difference(images[0], images[1]));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    BENCHMARK(BM_ImageInfoDifference);
+
+    /**
+     * Measures the all-pairs comparison performed by ProcessorThread::compareImages(), whose cost grows quadratically
+     * with the number of images. The argument is the number of images compared.
+     */
+
+    void BM_CompareAllPairs(benchmark::State& state) {
+
+        const auto count = static_cast<int>(state.range(0));
+        const auto images = readAll(corpus(count, CompareImageSide, "PNG"));
+
+        for (auto _ : state) {
+
+            auto similarCount = 0;
+            for (auto i = 0; i < count; ++i) {
+                for (auto j = i + 1; j < count; ++j) {
+                    if (ImageInfo::difference(images[i], images[j]) < SimilarityThreshold) {
+                        ++similarCount;
+                    }
+                }
+            }
+
+            benchmark::DoNotOptimize(similarCount);
+        }
+
+        state.SetItemsProcessed(state.iterations() * count * (count - 1) / 2);
+    }
+
+    BENCHMARK(BM_CompareAllPairs)->Arg(256)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+    /**
+     * Measures the same all-pairs comparison as BM_CompareAllPairs, but performed as ProcessorThread now performs it:
+     * with a SimilarityCascade applied in bulk via a HashIndex. The structural similarity stage is enabled so that its
+     * cost on the surviving pairs is included. The argument pairs are the number of images compared and whether every
+     * orientation of each image is tried.
+     */
+
+    void BM_CompareCascade(benchmark::State& state) {
+
+        const auto count = static_cast<int>(state.range(0));
+        const auto images = readAll(corpus(count, CompareImageSide, "PNG"));
+
+        SimilarityCascade cascade;
+        cascade.differenceHashLimit = 24;
+        cascade.matchOrientations = state.range(1) != 0;
+        cascade.minimumStructuralSimilarity = 0.5f;
+
+        for (auto _ : state) {
+
+            HashIndex index;
+            index.reserve(count);
+            for (const auto& image : images) {
+                index.append(image);
+            }
+
+            auto similarCount = 0;
+            std::vector<HashIndex::Candidate> candidates;
+
+            for (auto i = 0; i < count; ++i) {
+
+                index.findCandidates(images[i], i + 1, cascade, candidates);
+
+                for (const auto& candidate : candidates) {
+                    if (cascade.verify(images[i], images[candidate.index], candidate.orientation)) {
+                        ++similarCount;
+                    }
+                }
+            }
+
+            benchmark::DoNotOptimize(similarCount);
+        }
+
+        state.SetItemsProcessed(state.iterations() * count * (count - 1) / 2);
+    }
+
+    BENCHMARK(BM_CompareCascade)->Args({256, 0})->Args({1024, 0})->Args({4096, 0})->Args({256, 1})->Args({1024, 1})
+                                ->Args({4096, 1})->Unit(benchmark::kMillisecond);
+
+    /**
+     * Measures the first two stages of the cascade alone, as HashIndex::findCandidates() applies them over all pairs,
+     * with the search compiled for each PopcountTarget. Every orientation is tried, and the difference hash stage is
+     * disabled, so that every pair reaches the perceptual hash stage. The argument pairs are the number of images and
+     * the target, as an integer; targets that the processor doesn't support are skipped.
+     */
+
+    void BM_FindCandidates(benchmark::State& state) {
+
+        const auto count = static_cast<int>(state.range(0));
+        const auto target = static_cast<PopcountTarget>(state.range(1));
+        if (static_cast<int>(target) > static_cast<int>(myriad::processing::popcountTarget())) {
+
+            state.SkipWithError("The processor doesn't support this target");
+            return;
+        }
+
+        const auto images = readAll(corpus(count, CompareImageSide, "PNG"));
+
+        SimilarityCascade cascade;
+        cascade.matchOrientations = true;
+
+        HashIndex index{target};
+        index.reserve(count);
+        for (const auto& image : images) {
+            index.append(image);
+        }
+
+        std::vector<HashIndex::Candidate> candidates;
+        for (auto _ : state) {
+
+            auto candidateCount = 0;
+            for (auto i = 0; i < count; ++i) {
+
+                index.findCandidates(images[i], i + 1, cascade, candidates);
+                candidateCount += static_cast<int>(candidates.size());
+            }
+
+            benchmark::DoNotOptimize(candidateCount);
+        }
+
+        state.SetItemsProcessed(state.iterations() * count * (count - 1) / 2);
+    }
+
+    BENCHMARK(BM_FindCandidates)->Args({4096, 0})->Args({4096, 1})->Args({4096, 2})->Unit(benchmark::kMillisecond);
+
+    /**
+     * Measures scanning an input tree for supported images, which is dominated by directory listing, stat() calls and
+     * MIME type detection. The argument is the number of images in the tree.
+     */
+
+    void BM_ScanInputs(benchmark::State& state) {
+
+        const auto count = static_cast<int>(state.range(0));
+        const auto& tree = corpus(count, ScanImageSide, "PNG", ScanFilesPerDir);
+
+        for (auto _ : state) {
+
+            QHash<QString, ImageInfo> images;
+            InputScanner scanner{images, false};
+            scanner.addInput(tree.dir.path());
+            benchmark::DoNotOptimize(images);
+        }
+
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    BENCHMARK(BM_ScanInputs)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+    /**
+     * Gets the peak resident set size of the process so far, in MiB.
+     */
+
+    double peakResidentMiB() {
+
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / 1024.0;
+    }
+
+    /**
+     * Measures scanning a synthetic tree far larger than would be practical to create on disk, which shows how the
+     * cost (and memory use) of scanning and indexing grow with the number of images, independently of any disk. The
+     * tree has 10,000 leaf directories; the argument is the number of images in each.
+     */
+
+    void BM_ScanSyntheticTree(benchmark::State& state) {
+
+        SyntheticFileSystem::Layout layout;
+        layout.depth = 2;
+        layout.fanout = 100;
+        layout.filesPerDir = static_cast<int>(state.range(0));
+
+        const SyntheticFileSystem fileSystem{layout};
+
+        for (auto _ : state) {
+
+            QHash<QString, ImageInfo> images;
+            InputScanner scanner{images, false, fileSystem};
+            scanner.addInput(layout.rootPath);
+            benchmark::DoNotOptimize(images);
+        }
+
+        state.SetItemsProcessed(state.iterations() * fileSystem.fileCount());
+        state.counters["peak_rss_MiB"] = peakResidentMiB();
+    }
+
+    BENCHMARK(BM_ScanSyntheticTree)->Arg(10)->Arg(100)->Arg(1000)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+    /**
+     * Measures reading, decoding and hashing images from memory, which gives the throughput of hashImages() when
+     * disk I/O is taken out of the picture entirely.
+     */
+
+    void BM_HashSyntheticImages(benchmark::State& state) {
+
+        SyntheticFileSystem::Layout layout;
+        layout.depth = 1;
+        layout.fanout = 1;
+        layout.filesPerDir = 64;
+
+        const SyntheticFileSystem fileSystem{layout};
+        const auto dirPath = layout.rootPath + QStringLiteral("/d0/");
+        const auto names = fileSystem.entryNames(dirPath);
+
+        ScratchBuffers buffers;
+        ImageInfo info;
+        auto index = 0;
+
+        for (auto _ : state) {
+
+            info.read(dirPath + names[index], buffers, fileSystem);
+            benchmark::DoNotOptimize(info);
+            index = (index + 1) % names.size();
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    BENCHMARK(BM_HashSyntheticImages)->Unit(benchmark::kMicrosecond);
+}
+
+int main(int argc, char ** argv) {
+
+    // Image format plugins are located via the application object, so one must exist before anything is decoded.
+
+    QCoreApplication app{argc, argv};
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
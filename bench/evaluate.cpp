@@ -0,0 +1,454 @@
+#include <array>
+#include <functional>
+#include <vector>
+
+#include <QByteArray>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QPair>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+#include <KFormat>
+
+#include "cascadesettings.h"
+#include "filesystem.h"
+#include "hashindex.h"
+#include "imageinfo.h"
+#include "inputscanner.h"
+#include "perceptualhash.h"
+#include "perturbations.h"
+#include "scratchbuffers.h"
+#include "settings.h"
+#include "similaritycascade.h"
+#include "syntheticcorpus.h"
+
+using myriad::bench::Perturbation;
+using myriad::bench::SyntheticCorpus;
+using myriad::processing::cascadeFromSettings;
+using myriad::processing::FileSystem;
+using myriad::processing::hammingDistance;
+using myriad::processing::HashIndex;
+using myriad::processing::ImageInfo;
+using myriad::processing::InputScanner;
+using myriad::processing::ScratchBuffers;
+using myriad::processing::SimilarityCascade;
+using myriad::Settings;
+
+namespace {
+
+    /**
+     * ImageInfo::difference() is the Hamming distance between two perceptual hashes divided by their width, so every
+     * difference is one of these many discrete values and distances can be tallied exactly in a histogram.
+     */
+
+    constexpr int DistanceCount = myriad::processing::PerceptualHashBits + 1;
+
+    using Histogram = std::array<qint64, DistanceCount>;
+
+    /**
+     * A pair of images in the evaluation corpus, identified by their indices with the lower index first.
+     */
+
+    using Pair = QPair<int, int>;
+
+    /**
+     * Identifies where an image in the evaluation corpus came from: the base image it was derived from and the
+     * perturbation applied, which is -1 for the unmodified original.
+     */
+
+    struct Origin {
+
+        int base = -1;
+        int perturbation = -1;
+    };
+
+    /**
+     * Gets the Hamming distance between the perceptual hashes of two images, as ImageInfo::difference() measures it.
+     * If @p orientationCount is more than 1, the smallest distance over that many orientations of @p lhs is taken, as
+     * SimilarityCascade does when it matches orientations.
+     */
+
+    int distance(const ImageInfo& lhs, const ImageInfo& rhs, const int orientationCount) {
+
+        auto best = qRound(ImageInfo::difference(lhs, rhs) * (DistanceCount - 1));
+        if (!rhs.perceptualHash().isNull()) {
+            for (auto orientation = 1; orientation < orientationCount; ++orientation) {
+                best = qMin(best, hammingDistance(lhs.perceptualHash(orientation), rhs.perceptualHash()));
+            }
+        }
+
+        return best;
+    }
+
+    /**
+     * Counts the entries of a histogram whose distance would be reported as a duplicate at a given threshold, using
+     * the same strict comparison as ProcessorThread::compareImages().
+     */
+
+    qint64 countBelow(const Histogram& histogram, const double threshold) {
+
+        qint64 count = 0;
+        for (auto d = 0; d < DistanceCount && d < threshold * (DistanceCount - 1); ++d) {
+            count += histogram[d];
+        }
+        return count;
+    }
+
+    /**
+     * Finds the duplicate pairs among a set of images by putting every pair through the whole of a SimilarityCascade,
+     * as ProcessorThread::compareImage() does for each image that appears while inputs are being watched.
+     */
+
+    QSet<Pair> findPairsExhaustively(const std::vector<ImageInfo>& infos, const SimilarityCascade& cascade) {
+
+        QSet<Pair> pairs;
+        for (auto i = 0; i < static_cast<int>(infos.size()); ++i) {
+            for (auto j = i + 1; j < static_cast<int>(infos.size()); ++j) {
+                if (ImageInfo::identicalPixels(infos[i], infos[j]) || cascade.match(infos[i], infos[j]) >= 0) {
+                    pairs.insert(Pair{i, j});
+                }
+            }
+        }
+
+        return pairs;
+    }
+
+    /**
+     * Finds the duplicate pairs among a set of images as ProcessorThread::compareImages() does: images with identical
+     * pixels are paired by their digests, and every image is searched for in bulk in a HashIndex of those after it,
+     * with only the candidates found being verified. Unlike compareImages(), no image is discarded along the way, so
+     * every duplicate pair is reported however the duplicates would have been resolved.
+     */
+
+    QSet<Pair> findPairsWithIndex(const std::vector<ImageInfo>& infos, const SimilarityCascade& cascade) {
+
+        QSet<Pair> pairs;
+        QHash<QByteArray, QVector<int>> pixelGroups;
+        HashIndex index;
+        index.reserve(static_cast<int>(infos.size()));
+
+        for (auto i = 0; i < static_cast<int>(infos.size()); ++i) {
+
+            const auto digest = infos[i].pixelDigest();
+            if (!digest.isEmpty()) {
+
+                auto& group = pixelGroups[digest];
+                for (const auto j : group) {
+                    pairs.insert(Pair{j, i});
+                }
+                group << i;
+            }
+
+            index.append(infos[i]);
+        }
+
+        std::vector<HashIndex::Candidate> candidates;
+        for (auto i = 0; i < static_cast<int>(infos.size()); ++i) {
+
+            index.findCandidates(infos[i], i + 1, cascade, candidates);
+            for (const auto& candidate : candidates) {
+                if (cascade.verify(infos[i], infos[candidate.index], candidate.orientation)) {
+                    pairs.insert(Pair{i, candidate.index});
+                }
+            }
+        }
+
+        return pairs;
+    }
+
+    double rate(const qint64 count, const double seconds) {
+        return seconds > 0.0 ? count / seconds : 0.0;
+    }
+
+    QString ratio(const qint64 numerator, const qint64 denominator) {
+        return denominator > 0 ? QString::number(double(numerator) / denominator, 'f', 4) : QStringLiteral("-");
+    }
+
+    /**
+     * Loads the base images for the evaluation, either from a directory supplied by the user (which is scanned just
+     * as Myriad scans its inputs) or from the synthetic corpus.
+     */
+
+    std::vector<QImage> loadBaseImages(const QString& corpusPath, const int count, const int side) {
+
+        std::vector<QImage> images;
+
+        if (corpusPath.isEmpty()) {
+
+            const SyntheticCorpus corpus;
+            for (auto i = 0; i < count; ++i) {
+                images.push_back(corpus.image(i, side, side));
+            }
+        }
+        else {
+
+            QHash<QString, ImageInfo> found;
+            InputScanner scanner{found, false};
+            scanner.addInput(corpusPath);
+
+            for (const auto& path : scanner.takeScanOrder()) {
+
+                QImage image{path};
+                if (!image.isNull()) {
+                    images.push_back(image.convertToFormat(QImage::Format_RGB32));
+                }
+
+                if (count > 0 && static_cast<int>(images.size()) >= count) {
+                    break;
+                }
+            }
+        }
+
+        return images;
+    }
+}
+
+int main(int argc, char ** argv) {
+
+    QCoreApplication app{argc, argv};
+    QCoreApplication::setApplicationName(QStringLiteral("myriad_eval"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Measures how accurately Myriad detects perturbed copies of images, alongside the throughput of each stage "
+        "of processing."));
+    parser.addHelpOption();
+
+    const QCommandLineOption corpusOption{QStringLiteral("corpus"),
+        QStringLiteral("Use the images found beneath <dir> as base images, instead of synthetic ones."),
+        QStringLiteral("dir")};
+    const QCommandLineOption countOption{QStringLiteral("count"),
+        QStringLiteral("Use at most <n> base images (default 100; 0 for all images in the corpus)."),
+        QStringLiteral("n"), QStringLiteral("100")};
+    const QCommandLineOption sizeOption{QStringLiteral("size"),
+        QStringLiteral("The side length of synthetic base images (default 512)."),
+        QStringLiteral("pixels"), QStringLiteral("512")};
+    const QCommandLineOption csvOption{QStringLiteral("csv"),
+        QStringLiteral("Print the threshold table as comma-separated values.")};
+    const QCommandLineOption orientationsOption{QStringLiteral("orientations"),
+        QStringLiteral("Match rotated and mirrored copies, whatever the MatchOrientations setting says.")};
+    const QCommandLineOption differenceHashLimitOption{QStringLiteral("dhash-limit"),
+        QStringLiteral("Reject pairs whose difference hashes differ in more than <bits> bits (default: the "
+                       "DifferenceHashLimit setting)."),
+        QStringLiteral("bits")};
+    const QCommandLineOption structuralSimilarityOption{QStringLiteral("min-ssim"),
+        QStringLiteral("Reject pairs whose thumbnails have a structural similarity below <percent> (default: the "
+                       "MinimumStructuralSimilarity setting)."),
+        QStringLiteral("percent")};
+    const QCommandLineOption pixelDigestsOption{QStringLiteral("pixel-digests"),
+        QStringLiteral("Pair images with identical pixels by their digests, whatever the PixelDigests setting says.")};
+
+    parser.addOptions({corpusOption, countOption, sizeOption, csvOption, orientationsOption, differenceHashLimitOption,
+                       structuralSimilarityOption, pixelDigestsOption});
+    parser.process(app);
+
+    // The cascade is the one that Myriad itself would apply, with any stages overridden on the command line.
+
+    auto cascade = cascadeFromSettings();
+    if (parser.isSet(orientationsOption)) {
+        cascade.matchOrientations = true;
+    }
+    if (parser.isSet(differenceHashLimitOption)) {
+        cascade.differenceHashLimit = parser.value(differenceHashLimitOption).toInt();
+    }
+    if (parser.isSet(structuralSimilarityOption)) {
+        cascade.minimumStructuralSimilarity = parser.value(structuralSimilarityOption).toInt() / 100.0f;
+    }
+
+    const auto orientationCount = cascade.orientationCount();
+
+    QTextStream out{stdout};
+
+    const auto baseImages = loadBaseImages(parser.value(corpusOption), parser.value(countOption).toInt(),
+                                           parser.value(sizeOption).toInt());
+    if (baseImages.empty()) {
+
+        QTextStream{stderr} << "No base images could be loaded.\n";
+        return 1;
+    }
+
+    // Build the evaluation corpus: each base image is saved losslessly, then once more per perturbation. The origin
+    // of every file is recorded as the ground truth against which detections are scored.
+
+    const auto perturbations = myriad::bench::standardPerturbations();
+    QTemporaryDir dir;
+    QHash<QString, Origin> origins;
+
+    for (auto i = 0; i < static_cast<int>(baseImages.size()); ++i) {
+
+        const auto basePath = QStringLiteral("%1/%2").arg(dir.path()).arg(i, 6, 10, QLatin1Char('0'));
+        baseImages[i].save(basePath + QStringLiteral("-original.png"), "PNG");
+        origins.insert(basePath + QStringLiteral("-original.png"), Origin{i, -1});
+
+        for (auto p = 0; p < static_cast<int>(perturbations.size()); ++p) {
+
+            const auto& perturbation = perturbations[p];
+            const auto image = perturbation.transform ? perturbation.transform(baseImages[i]) : baseImages[i];
+            const auto path = QStringLiteral("%1-%2.%3").arg(basePath, perturbation.name,
+                                                             QString::fromLatin1(perturbation.format).toLower());
+
+            image.save(path, perturbation.format, perturbation.quality);
+            origins.insert(path, Origin{i, p});
+        }
+    }
+
+    // Run each stage of the pipeline in turn, timing each separately.
+
+    QElapsedTimer timer;
+
+    timer.start();
+    QHash<QString, ImageInfo> images;
+    InputScanner scanner{images, false};
+    scanner.addInput(dir.path());
+    const auto paths = scanner.takeScanOrder();
+    const auto scanSeconds = timer.nsecsElapsed() / 1e9;
+
+    timer.start();
+    ScratchBuffers buffers;
+    std::vector<ImageInfo> infos(paths.size());
+    std::vector<Origin> infoOrigins(paths.size());
+    qint64 bytesRead = 0;
+    const auto pixelDigests = parser.isSet(pixelDigestsOption) || Settings::self()->pixelDigests();
+
+    for (auto i = 0; i < paths.size(); ++i) {
+
+        infos[i].read(paths[i], buffers, FileSystem::local(), false, nullptr, pixelDigests);
+        infoOrigins[i] = origins.value(paths[i]);
+        bytesRead += infos[i].fileSize();
+    }
+    const auto hashSeconds = timer.nsecsElapsed() / 1e9;
+
+    // The perceptual hash distance of every pair is tallied first, so that the second stage of the cascade can be
+    // assessed at a range of thresholds. Pairs derived from the same base image are duplicates; all others are not.
+    // Pairs of an original with one of its variants are additionally tallied by perturbation, so that we can see which
+    // kinds of modification are being missed.
+
+    Histogram positives{};
+    Histogram negatives{};
+    std::vector<Histogram> byPerturbation(perturbations.size(), Histogram{});
+
+    for (auto i = 0; i < static_cast<int>(infos.size()); ++i) {
+        for (auto j = i + 1; j < static_cast<int>(infos.size()); ++j) {
+
+            const auto d = distance(infos[i], infos[j], orientationCount);
+            const auto& lhs = infoOrigins[i];
+            const auto& rhs = infoOrigins[j];
+
+            if (lhs.base == rhs.base) {
+
+                ++positives[d];
+                if (lhs.perturbation < 0 || rhs.perturbation < 0) {
+                    ++byPerturbation[qMax(lhs.perturbation, rhs.perturbation)][d];
+                }
+            }
+            else {
+                ++negatives[d];
+            }
+        }
+    }
+
+    // Then the whole cascade is run over the corpus by each of the ways in which Myriad compares images, which should
+    // find exactly the same pairs as each other, and each is scored against the ground truth.
+
+    struct Backend {
+        const char * name;
+        std::function<QSet<Pair>(const std::vector<ImageInfo>&, const SimilarityCascade&)> findPairs;
+    };
+
+    const Backend backends[] = {
+        {"exhaustive", findPairsExhaustively},
+        {"index", findPairsWithIndex}
+    };
+
+    const qint64 imageCount = infos.size();
+    const auto pairCount = imageCount * (imageCount - 1) / 2;
+    const auto positiveCount = countBelow(positives, 2.0);
+    const auto separator = parser.isSet(csvOption) ? QStringLiteral(",") : QStringLiteral("\t");
+
+    out << "Corpus: " << baseImages.size() << " base images, " << paths.size() << " files ("
+        << perturbations.size() << " perturbations per base image)\n";
+    out << "Scanning:  " << QString::number(rate(paths.size(), scanSeconds), 'f', 1) << " files/s\n";
+    out << "Hashing:   " << QString::number(rate(paths.size(), hashSeconds), 'f', 1) << " images/s, "
+        << KFormat{}.formatByteSize(rate(bytesRead, hashSeconds)) << "/s (single thread)\n";
+    out << "Cascade:   dHash limit " << cascade.differenceHashLimit << ", pHash limit " << cascade.perceptualHashLimit()
+        << ", minimum SSIM " << cascade.minimumStructuralSimilarity << ", " << orientationCount
+        << " orientation(s)\n\n";
+
+    out << QStringList{"backend", "comparisons/s", "precision", "recall", "f1", "tp", "fp", "fn"}.join(separator)
+        << '\n';
+
+    std::vector<QSet<Pair>> backendPairs;
+    for (const auto& backend : backends) {
+
+        timer.start();
+        backendPairs.push_back(backend.findPairs(infos, cascade));
+        const auto seconds = timer.nsecsElapsed() / 1e9;
+
+        qint64 truePositives = 0;
+        for (const auto& pair : backendPairs.back()) {
+            if (infoOrigins[pair.first].base == infoOrigins[pair.second].base) {
+                ++truePositives;
+            }
+        }
+
+        const qint64 falsePositives = backendPairs.back().size() - truePositives;
+        const auto falseNegatives = positiveCount - truePositives;
+
+        out << QStringList{
+            QString::fromLatin1(backend.name),
+            QString::number(rate(pairCount, seconds), 'f', 0),
+            ratio(truePositives, truePositives + falsePositives),
+            ratio(truePositives, positiveCount),
+            ratio(2 * truePositives, 2 * truePositives + falsePositives + falseNegatives),
+            QString::number(truePositives),
+            QString::number(falsePositives),
+            QString::number(falseNegatives)
+        }.join(separator) << '\n';
+    }
+
+    auto disagreements = 0;
+    for (const auto& pairs : backendPairs) {
+        disagreements += (pairs - backendPairs.front()).size() + (backendPairs.front() - pairs).size();
+    }
+
+    if (disagreements > 0) {
+        out << "\nThe backends disagree on " << disagreements << " pairs.\n";
+    }
+
+    out << "\nPerceptual hash stage alone, by threshold:\n";
+    out << QStringList{"threshold", "precision", "recall", "f1", "tp", "fp", "fn"}.join(separator) << '\n';
+    for (auto t = 1; t <= 20; ++t) {
+
+        const auto threshold = t * 0.02;
+        const auto truePositives  = countBelow(positives, threshold);
+        const auto falsePositives = countBelow(negatives, threshold);
+        const auto falseNegatives = positiveCount - truePositives;
+
+        out << QStringList{
+            QString::number(threshold, 'f', 2),
+            ratio(truePositives, truePositives + falsePositives),
+            ratio(truePositives, positiveCount),
+            ratio(2 * truePositives, 2 * truePositives + falsePositives + falseNegatives),
+            QString::number(truePositives),
+            QString::number(falsePositives),
+            QString::number(falseNegatives)
+        }.join(separator) << '\n';
+    }
+
+    out << "\nRecall of original/variant pairs by the perceptual hash stage at the current threshold ("
+        << cascade.threshold << "):\n";
+    for (auto p = 0; p < static_cast<int>(perturbations.size()); ++p) {
+
+        const auto& histogram = byPerturbation[p];
+        out << perturbations[p].name << separator
+            << ratio(countBelow(histogram, cascade.threshold), countBelow(histogram, 2.0)) << '\n';
+    }
+
+    return disagreements > 0 ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+#include <QRect>
+#include <QTransform>
+
+#include "perturbations.h"
+
+namespace myriad {
+    namespace bench {
+
+        namespace {
+
+            std::function<QImage(const QImage&)> scaled(const double factor) {
+                return [factor](const QImage& image) {
+
+                    const auto width  = qMax(1, qRound(image.width() * factor));
+                    const auto height = qMax(1, qRound(image.height() * factor));
+                    return image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+                };
+            }
+
+            /**
+             * Crops a fraction of the image's width and height from each of its edges.
+             */
+
+            std::function<QImage(const QImage&)> cropped(const double fraction) {
+                return [fraction](const QImage& image) {
+
+                    const auto dx = qRound(image.width() * fraction);
+                    const auto dy = qRound(image.height() * fraction);
+                    return image.copy(QRect{dx, dy, image.width() - 2 * dx, image.height() - 2 * dy});
+                };
+            }
+
+            /**
+             * Rotates the image clockwise by an angle in degrees.
+             */
+
+            std::function<QImage(const QImage&)> rotated(const int degrees) {
+                return [degrees](const QImage& image) {
+                    return image.transformed(QTransform{}.rotate(degrees));
+                };
+            }
+
+            /**
+             * Mirrors the image horizontally.
+             */
+
+            std::function<QImage(const QImage&)> mirrored() {
+                return [](const QImage& image) {
+                    return image.mirrored(true, false);
+                };
+            }
+
+            /**
+             * Adds a constant to every colour channel of every pixel, clamping the results.
+             */
+
+            std::function<QImage(const QImage&)> brightened(const int delta) {
+                return [delta](const QImage& image) {
+
+                    auto result = image.convertToFormat(QImage::Format_RGB32);
+                    for (auto y = 0; y < result.height(); ++y) {
+
+                        auto * const line = reinterpret_cast<QRgb *>(result.scanLine(y));
+                        for (auto x = 0; x < result.width(); ++x) {
+                            line[x] = qRgb(qBound(0, qRed(line[x]) + delta, 255),
+                                           qBound(0, qGreen(line[x]) + delta, 255),
+                                           qBound(0, qBlue(line[x]) + delta, 255));
+                        }
+                    }
+
+                    return result;
+                };
+            }
+        }
+
+        std::vector<Perturbation> standardPerturbations() {
+
+            return {
+                {QStringLiteral("jpeg-q90"),      {},                "JPEG", 90},
+                {QStringLiteral("jpeg-q75"),      {},                "JPEG", 75},
+                {QStringLiteral("jpeg-q50"),      {},                "JPEG", 50},
+                {QStringLiteral("jpeg-q25"),      {},                "JPEG", 25},
+                {QStringLiteral("scale-50%"),     scaled(0.5),       "PNG",  -1},
+                {QStringLiteral("scale-25%"),     scaled(0.25),      "PNG",  -1},
+                {QStringLiteral("scale-150%"),    scaled(1.5),       "PNG",  -1},
+                {QStringLiteral("crop-2%"),       cropped(0.02),     "PNG",  -1},
+                {QStringLiteral("crop-5%"),       cropped(0.05),     "PNG",  -1},
+                {QStringLiteral("crop-10%"),      cropped(0.1),      "PNG",  -1},
+                {QStringLiteral("brighten-16"),   brightened(16),    "PNG",  -1},
+                {QStringLiteral("darken-16"),     brightened(-16),   "PNG",  -1},
+                {QStringLiteral("convert-bmp"),   {},                "BMP",  -1},
+                {QStringLiteral("scale-50%-q75"), scaled(0.5),       "JPEG", 75},
+                {QStringLiteral("rotate-90"),     rotated(90),       "PNG",  -1},
+                {QStringLiteral("rotate-180"),    rotated(180),      "PNG",  -1},
+                {QStringLiteral("rotate-270"),    rotated(270),      "PNG",  -1},
+                {QStringLiteral("mirror"),        mirrored(),        "PNG",  -1},
+                {QStringLiteral("rotate-90-q75"), rotated(90),       "JPEG", 75}
+            };
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MYRIAD_PERTURBATIONS_H
+#define MYRIAD_PERTURBATIONS_H
+
+#include <functional>
+#include <vector>
+
+#include <QImage>
+#include <QString>
+
+namespace myriad {
+    namespace bench {
+
+        /**
+         * A transformation that produces a near-duplicate of an image, of the kind that Myriad is expected to detect:
+         * the image is optionally modified in memory and then saved in a particular format.
+         */
+
+        struct Perturbation {
+
+            /** A short name identifying the perturbation in reports. */
+            QString name;
+
+            /** Modifies the image in memory, or is empty if the image is saved unmodified. */
+            std::function<QImage(const QImage&)> transform;
+
+            /** The Qt name of the format that the perturbed image is saved in. */
+            const char * format;
+
+            /** The quality passed to QImage::save(), or -1 for the format's default. */
+            int quality;
+        };
+
+        /**
+         * Gets the standard set of perturbations used to evaluate similarity detection: recompression at several JPEG
+         * qualities, downscaling and upscaling, cropping, brightness shifts and lossless format conversion.
+         */
+
+        std::vector<Perturbation> standardPerturbations();
+    }
+}
+
+#endif
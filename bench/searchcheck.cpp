@@ -0,0 +1,199 @@
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include "externalhashsearch.h"
+#include "hashindex.h"
+#include "imageinfo.h"
+#include "perturbations.h"
+#include "scratchbuffers.h"
+#include "similaritycascade.h"
+#include "syntheticcorpus.h"
+
+using myriad::bench::SyntheticCorpus;
+using myriad::processing::ExternalHashSearch;
+using myriad::processing::HashIndex;
+using myriad::processing::ImageInfo;
+using myriad::processing::ScratchBuffers;
+using myriad::processing::SimilarityCascade;
+
+namespace {
+
+    /**
+     * A pair of images, identified by their indices with the lower index first.
+     */
+
+    using Pair = QPair<int, int>;
+
+    /**
+     * A cascade to check the searches with, and the name by which it is reported.
+     */
+
+    struct Configuration {
+
+        const char * name;
+        SimilarityCascade cascade;
+    };
+
+    /**
+     * Gets the cascades that the searches are checked with: the default one, one that matches orientations, and one
+     * loose enough (and with a difference hash limit) that many pairs are found and the first stage rejects some.
+     */
+
+    std::vector<Configuration> configurations() {
+
+        SimilarityCascade orientations;
+        orientations.matchOrientations = true;
+
+        SimilarityCascade loose;
+        loose.differenceHashLimit = 24;
+        loose.matchOrientations = true;
+        loose.threshold = 0.25f;
+
+        return {{"default", SimilarityCascade{}}, {"orientations", orientations}, {"loose", loose}};
+    }
+
+    /**
+     * Finds the pairs that pass the first two stages of a cascade with a HashIndex, as mergeShards() does.
+     */
+
+    QSet<Pair> findPairsInMemory(const std::vector<ImageInfo>& infos, const SimilarityCascade& cascade) {
+
+        HashIndex index;
+        index.reserve(static_cast<int>(infos.size()));
+        for (const auto& info : infos) {
+            index.append(info);
+        }
+
+        QSet<Pair> pairs;
+        std::vector<HashIndex::Candidate> candidates;
+
+        for (auto i = 0; i < static_cast<int>(infos.size()); ++i) {
+
+            index.findCandidates(infos[i], i + 1, cascade, candidates);
+            for (const auto& candidate : candidates) {
+                pairs.insert(Pair{i, candidate.index});
+            }
+        }
+
+        return pairs;
+    }
+
+    /**
+     * Finds the pairs that pass the first two stages of a cascade with an ExternalHashSearch, as
+     * searchShardsExternally() does.
+     * @param ok Set to @c false if the search could not be run.
+     */
+
+    QSet<Pair> findPairsExternally(const std::vector<ImageInfo>& infos, const SimilarityCascade& cascade,
+                                   const qint64 memoryBudget, bool& ok) {
+
+        ExternalHashSearch search{cascade, memoryBudget};
+        for (const auto& info : infos) {
+            ok = search.append(info) && ok;
+        }
+
+        QSet<Pair> pairs;
+        ok = search.findPairs([&pairs](const quint32 image1, const quint32 image2, int, int) {
+            pairs.insert(Pair{static_cast<int>(image1), static_cast<int>(image2)});
+        }) && ok;
+
+        return pairs;
+    }
+}
+
+int main(int argc, char ** argv) {
+
+    QCoreApplication app{argc, argv};
+    QCoreApplication::setApplicationName(QStringLiteral("myriad_searchcheck"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Checks that searching for pairs on disk, as myriad_shard merge --external does, finds exactly the pairs that "
+        "searching in memory does, over a synthetic corpus of perturbed images."));
+    parser.addHelpOption();
+
+    const QCommandLineOption countOption{QStringLiteral("count"),
+        QStringLiteral("Use <n> base images (default 50)."),
+        QStringLiteral("n"), QStringLiteral("50")};
+    const QCommandLineOption sizeOption{QStringLiteral("size"),
+        QStringLiteral("The side length of the base images (default 256)."),
+        QStringLiteral("pixels"), QStringLiteral("256")};
+    const QCommandLineOption memoryOption{QStringLiteral("memory"),
+        QStringLiteral("Give the search on disk a memory budget of <KiB>, small enough by default that it sorts the "
+                       "hashes in several runs (default 16)."),
+        QStringLiteral("KiB"), QStringLiteral("16")};
+
+    parser.addOptions({countOption, sizeOption, memoryOption});
+    parser.process(app);
+
+    QTextStream out{stdout};
+
+    // The corpus is built as myriad_eval builds its own: each base image is saved losslessly, then once more per
+    // perturbation, so that there are pairs at a range of small distances (and in every orientation).
+
+    const SyntheticCorpus corpus;
+    const auto perturbations = myriad::bench::standardPerturbations();
+    const auto baseCount = parser.value(countOption).toInt();
+    const auto side = parser.value(sizeOption).toInt();
+
+    QTemporaryDir dir;
+    QStringList paths;
+
+    for (auto i = 0; i < baseCount; ++i) {
+
+        const auto baseImage = corpus.image(i, side, side);
+        const auto basePath = QStringLiteral("%1/%2").arg(dir.path()).arg(i, 6, 10, QLatin1Char('0'));
+        baseImage.save(basePath + QStringLiteral("-original.png"), "PNG");
+        paths << basePath + QStringLiteral("-original.png");
+
+        for (const auto& perturbation : perturbations) {
+
+            const auto image = perturbation.transform ? perturbation.transform(baseImage) : baseImage;
+            const auto path = QStringLiteral("%1-%2.%3").arg(basePath, perturbation.name,
+                                                             QString::fromLatin1(perturbation.format).toLower());
+
+            image.save(path, perturbation.format, perturbation.quality);
+            paths << path;
+        }
+    }
+
+    ScratchBuffers buffers;
+    std::vector<ImageInfo> infos(paths.size());
+    for (auto i = 0; i < paths.size(); ++i) {
+        infos[i].read(paths[i], buffers);
+    }
+
+    out << "Corpus: " << infos.size() << " images\n";
+
+    const auto memoryBudget = parser.value(memoryOption).toLongLong() * 1024;
+    auto failed = false;
+
+    for (const auto& configuration : configurations()) {
+
+        auto ok = true;
+        const auto inMemory = findPairsInMemory(infos, configuration.cascade);
+        const auto external = findPairsExternally(infos, configuration.cascade, memoryBudget, ok);
+
+        const auto missed = QSet<Pair>(inMemory).subtract(external).size();
+        const auto extra = QSet<Pair>(external).subtract(inMemory).size();
+
+        out << configuration.name << ": " << inMemory.size() << " pairs in memory, " << external.size()
+            << " on disk (" << missed << " missed, " << extra << " extra)";
+        if (!ok) {
+            out << ", search failed";
+        }
+        out << '\n';
+
+        failed = failed || !ok || missed > 0 || extra > 0;
+    }
+
+    out << (failed ? "FAILED" : "OK") << '\n';
+    return failed ? 1 : 0;
+}
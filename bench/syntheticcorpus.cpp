@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <random>
+
+#include <QDir>
+
+#include "syntheticcorpus.h"
+
+namespace myriad {
+    namespace bench {
+
+        namespace {
+
+            /**
+             * The number of rectangles drawn over each image's gradient.
+             */
+
+            constexpr int RectangleCount = 12;
+
+            /**
+             * The fan-out of the upper level of corpus directories.
+             */
+
+            constexpr int DirsPerParent = 16;
+        }
+
+        constexpr quint32 SyntheticCorpus::DefaultSeed;
+
+        SyntheticCorpus::SyntheticCorpus(const quint32 seed)
+            : m_seed{seed} {
+        }
+
+        QImage SyntheticCorpus::image(const int index, const int width, const int height) const {
+
+            // std::mt19937 and std::uniform_int_distribution are used for their fully specified behaviour: unlike
+            // qrand(), the same seed gives the same images on every platform.
+
+            std::mt19937 random{m_seed ^ (static_cast<quint32>(index) * 2654435761u)};
+            const auto channel = [&random] {return static_cast<int>(random() % 256);};
+
+            const auto startColor = qRgb(channel(), channel(), channel());
+            const auto endColor   = qRgb(channel(), channel(), channel());
+
+            QImage image{width, height, QImage::Format_RGB32};
+            for (auto y = 0; y < height; ++y) {
+
+                auto * const line = reinterpret_cast<QRgb *>(image.scanLine(y));
+                for (auto x = 0; x < width; ++x) {
+
+                    const auto t = (x + y) * 255 / qMax(1, width + height - 2);
+                    line[x] = qRgb((qRed(startColor) * (255 - t) + qRed(endColor) * t) / 255,
+                                   (qGreen(startColor) * (255 - t) + qGreen(endColor) * t) / 255,
+                                   (qBlue(startColor) * (255 - t) + qBlue(endColor) * t) / 255);
+                }
+            }
+
+            for (auto i = 0; i < RectangleCount; ++i) {
+
+                const auto below = [&random](const int limit) {
+                    return static_cast<int>(random() % static_cast<quint32>(limit));
+                };
+
+                const auto left   = below(width);
+                const auto top    = below(height);
+                const auto right  = qMin(width, left + 1 + below(width / 2 + 1));
+                const auto bottom = qMin(height, top + 1 + below(height / 2 + 1));
+                const auto color  = qRgb(channel(), channel(), channel());
+
+                for (auto y = top; y < bottom; ++y) {
+
+                    auto * const line = reinterpret_cast<QRgb *>(image.scanLine(y));
+                    std::fill(line + left, line + right, color);
+                }
+            }
+
+            return image;
+        }
+
+        QStringList SyntheticCorpus::write(const QString& dirPath, const int count, const int width, const int height,
+                                           const char * const format, const int filesPerDir) const {
+
+            const auto extension = QString::fromLatin1(format).toLower();
+
+            QStringList paths;
+            paths.reserve(count);
+
+            for (auto i = 0; i < count; ++i) {
+
+                auto imageDirPath = dirPath;
+                if (filesPerDir > 0) {
+
+                    const auto dirIndex = i / filesPerDir;
+                    imageDirPath += QStringLiteral("/%1/%2").arg(dirIndex / DirsPerParent)
+                                                            .arg(dirIndex % DirsPerParent);
+                    QDir{}.mkpath(imageDirPath);
+                }
+
+                const auto path = QStringLiteral("%1/%2.%3").arg(imageDirPath)
+                                                            .arg(i, 8, 10, QLatin1Char('0'))
+                                                            .arg(extension);
+                image(i, width, height).save(path, format);
+                paths << path;
+            }
+
+            return paths;
+        }
+    }
+}
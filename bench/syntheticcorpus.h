@@ -0,0 +1,65 @@
+#ifndef MYRIAD_SYNTHETICCORPUS_H
+#define MYRIAD_SYNTHETICCORPUS_H
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+namespace myriad {
+    namespace bench {
+
+        /**
+         * Generates reproducible synthetic images for benchmarking, so that results can be compared across machines
+         * without any external data. Each image is a function only of the corpus seed and the image's index: a smooth
+         * colour gradient overlaid with a number of solid rectangles, which gives image codecs and perceptual hashes
+         * something realistic to work with (unlike noise, which compresses poorly, or flat colour, which hashes
+         * trivially).
+         */
+
+        class SyntheticCorpus {
+
+        public:
+
+            static constexpr quint32 DefaultSeed = 0x6d797269;
+
+            /**
+             * Constructs a corpus generator.
+             * @param seed The seed from which all images are derived.
+             */
+
+            explicit SyntheticCorpus(quint32 seed = DefaultSeed);
+
+            /**
+             * Generates a single image of the corpus.
+             * @param index The index of the image within the corpus.
+             * @param width The width of the image, in pixels.
+             * @param height The height of the image, in pixels.
+             */
+
+            QImage image(int index, int width, int height) const;
+
+            /**
+             * Writes images of the corpus to disk.
+             * @param dirPath The directory to write images beneath, which must exist.
+             * @param count The number of images to write, starting with index @c 0.
+             * @param width The width of each image, in pixels.
+             * @param height The height of each image, in pixels.
+             * @param format The Qt name of the image format to write (e.g. "JPEG"), which is also used in lower case as
+             * the file extension.
+             * @param filesPerDir If greater than zero, images are spread across subdirectories holding this many images
+             * each, nested two levels deep, so as to resemble a real photo library. Otherwise all images are written
+             * directly into @p dirPath.
+             * @return The paths of the images written, in index order.
+             */
+
+            QStringList write(const QString& dirPath, int count, int width, int height, const char * format,
+                              int filesPerDir = 0) const;
+
+        private:
+
+            const quint32 m_seed;
+        };
+    }
+}
+
+#endif
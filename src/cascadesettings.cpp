@@ -0,0 +1,16 @@
+#include "cascadesettings.h"
+#include "settings.h"
+
+namespace myriad {
+    namespace processing {
+
+        SimilarityCascade cascadeFromSettings() {
+
+            SimilarityCascade cascade;
+            cascade.differenceHashLimit = Settings::self()->differenceHashLimit();
+            cascade.matchOrientations = Settings::self()->matchOrientations();
+            cascade.minimumStructuralSimilarity = Settings::self()->minimumStructuralSimilarity() / 100.0f;
+            return cascade;
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef MYRIAD_CASCADESETTINGS_H
+#define MYRIAD_CASCADESETTINGS_H
+
+#include "similaritycascade.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Builds the SimilarityCascade described by the application settings, so that every program that compares
+         * images (Myriad itself, the shard tool and the evaluation harness) applies the same cascade by default.
+         */
+
+        SimilarityCascade cascadeFromSettings();
+    }
+}
+
+#endif
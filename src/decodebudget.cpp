@@ -0,0 +1,76 @@
+#include <QMutexLocker>
+#include <QSize>
+
+#include "decodebudget.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The number of bytes taken by each pixel of a decoded image: images are decoded to 32 bits per pixel at
+             * most.
+             */
+
+            constexpr qint64 BytesPerPixel = 4;
+
+            /**
+             * The factor by which the file size of an image is multiplied to estimate its decoded size if its header
+             * can't be read. This is generous, since underestimating is what would break the budget.
+             */
+
+            constexpr qint64 UnknownExpansionFactor = 16;
+        }
+
+        DecodeBudget::Lease::Lease(DecodeBudget& budget, const qint64 bytes)
+            : m_budget(budget), m_bytes{budget.acquire(bytes)} {
+        }
+
+        DecodeBudget::Lease::~Lease() {
+            m_budget.release(m_bytes);
+        }
+
+        DecodeBudget::DecodeBudget(const qint64 capacity)
+            : m_available{capacity}, m_capacity{capacity} {
+        }
+
+        qint64 DecodeBudget::acquire(const qint64 bytes) {
+
+            const auto reserved = qBound(qint64{0}, bytes, m_capacity);
+
+            QMutexLocker locker{&m_mutex};
+            const auto ticket = m_nextTicket++;
+
+            while (ticket != m_servingTicket || m_available < reserved) {
+                m_waitCond.wait(&m_mutex);
+            }
+
+            m_available -= reserved;
+            ++m_servingTicket;
+
+            // The next request in line may well fit into what's left, so it must be given the chance to check.
+
+            m_waitCond.wakeAll();
+            return reserved;
+        }
+
+        void DecodeBudget::release(const qint64 bytes) {
+
+            QMutexLocker locker{&m_mutex};
+            m_available += bytes;
+            m_waitCond.wakeAll();
+        }
+
+        qint64 estimatedDecodeSize(const qint64 fileSize, const QSize& imageSize) {
+
+            // The whole file is held in memory alongside the decoded image while it's being read (see ImageInfo::read).
+
+            if (imageSize.isValid()) {
+                return fileSize + BytesPerPixel * imageSize.width() * imageSize.height();
+            }
+
+            return fileSize * UnknownExpansionFactor;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef MYRIAD_DECODEBUDGET_H
+#define MYRIAD_DECODEBUDGET_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtGlobal>
+
+class QSize;
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Limits the total amount of memory that concurrent hashing workers may commit to decoding images at any one
+         * time. Before decoding an image, each worker takes out a Lease on the amount of memory it expects to need (see
+         * estimatedDecodeSize()), blocking until enough of the budget is free. Leases are granted strictly in the order
+         * in which they were requested, so a large image cannot be starved by a stream of small ones.
+         *
+         * Requests larger than the whole budget are reduced to the size of the budget, so such images are still
+         * processed but only ever one at a time; small images carry on being processed alongside each other whenever
+         * there is room for them.
+         */
+
+        class DecodeBudget {
+
+        public:
+
+            /**
+             * A reservation of part of a DecodeBudget, which is held for as long as the Lease object exists.
+             */
+
+            class Lease {
+
+            public:
+
+                /**
+                 * Reserves memory from a DecodeBudget, blocking until enough is available.
+                 * @param budget The budget to reserve memory from.
+                 * @param bytes The amount of memory to reserve.
+                 */
+
+                Lease(DecodeBudget& budget, qint64 bytes);
+
+                Lease(const Lease&) = delete;
+                Lease& operator=(const Lease&) = delete;
+
+                /**
+                 * Returns the reserved memory to the budget.
+                 */
+
+                ~Lease();
+
+            private:
+
+                DecodeBudget& m_budget;
+                const qint64 m_bytes;
+            };
+
+            /**
+             * Constructs a DecodeBudget with all of its capacity available.
+             * @param capacity The total number of bytes that may be leased at any one time.
+             */
+
+            explicit DecodeBudget(qint64 capacity);
+
+        private:
+
+            /**
+             * Blocks until a specified amount of memory can be reserved (and until all earlier requests have been
+             * granted), and then reserves it.
+             * @param bytes The amount of memory requested.
+             * @return The amount of memory actually reserved, which may be less than @p bytes if this exceeds the
+             * capacity of the budget.
+             */
+
+            qint64 acquire(qint64 bytes);
+
+            /**
+             * Returns memory previously reserved by acquire() to the budget.
+             */
+
+            void release(qint64 bytes);
+
+            qint64 m_available;
+            const qint64 m_capacity;
+            QMutex m_mutex;
+            quint64 m_nextTicket = 0;
+            quint64 m_servingTicket = 0;
+            QWaitCondition m_waitCond;
+        };
+
+        /**
+         * Estimates the peak amount of memory that will be needed to read and decode an image, from its file size and
+         * the dimensions recorded in its header. These are read from the start of the file before the rest of it, so
+         * that the memory can be leased before any of it is used.
+         * @param fileSize The size of the image file, in bytes.
+         * @param imageSize The dimensions of the image, or an invalid size if its header couldn't be read.
+         * @return The estimated number of bytes needed to process the image.
+         */
+
+        qint64 estimatedDecodeSize(qint64 fileSize, const QSize& imageSize);
+    }
+}
+
+#endif
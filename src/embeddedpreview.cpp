@@ -0,0 +1,420 @@
+#include <QSet>
+#include <QVector>
+
+#include "embeddedpreview.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The shortest side, in pixels, that a preview must have to be hashed in place of its image. This is well
+             * above the side of the luma image that is hashed, and admits the 160 by 120 thumbnails of EXIF blocks.
+             */
+
+            constexpr int MinimumPreviewSide = 96;
+
+            /**
+             * The largest relative difference between the aspect ratios of a preview and its image for which the
+             * preview is accepted. Previews are rounded to whole JPEG blocks, and RAW images carry a few pixels of
+             * border that their previews don't, so the ratios rarely match exactly.
+             */
+
+            constexpr double MaximumAspectError = 0.02;
+
+            /**
+             * The most image file directories read from a TIFF container, which bounds the work done on a corrupt or
+             * malicious file whose directories point at each other.
+             */
+
+            constexpr int MaximumDirectoryCount = 64;
+
+            /**
+             * The JPEG markers that findEmbeddedPreview() looks for.
+             */
+
+            constexpr quint8 ExifMarker         = 0xe1;
+            constexpr quint8 StartOfImageMarker = 0xd8;
+            constexpr quint8 StartOfScanMarker  = 0xda;
+
+            /**
+             * The TIFF tags that findEmbeddedPreview() reads.
+             */
+
+            enum TiffTag : quint16 {
+                NewSubfileTypeTag              = 0x00fe,
+                ImageWidthTag                  = 0x0100,
+                ImageLengthTag                 = 0x0101,
+                CompressionTag                 = 0x0103,
+                StripOffsetsTag                = 0x0111,
+                StripByteCountsTag             = 0x0117,
+                SubIfdsTag                     = 0x014a,
+                JpegInterchangeFormatTag       = 0x0201,
+                JpegInterchangeFormatLengthTag = 0x0202,
+                ExifIfdTag                     = 0x8769,
+                PixelXDimensionTag             = 0xa002,
+                PixelYDimensionTag             = 0xa003
+            };
+
+            /**
+             * The TIFF compression schemes whose strips hold JPEG data: the original scheme, still used for RAW
+             * previews, and the current one.
+             */
+
+            constexpr quint32 OldJpegCompression = 6;
+            constexpr quint32 JpegCompression    = 7;
+
+            /**
+             * A block of JPEG data within a file, as an offset and a length in bytes.
+             */
+
+            struct JpegBlock {
+                qint64 offset;
+                qint64 length;
+            };
+
+            /**
+             * The parts of a TIFF container that findEmbeddedPreview() needs.
+             */
+
+            struct TiffContents {
+
+                /**
+                 * The JPEG blocks, relative to the start of the TIFF header.
+                 */
+
+                QVector<JpegBlock> jpegBlocks;
+
+                /**
+                 * The dimensions recorded in the EXIF directory, if any.
+                 */
+
+                QSize exifSize;
+
+                /**
+                 * The dimensions of the largest full-resolution directory.
+                 */
+
+                QSize fullSize;
+            };
+
+            /**
+             * Reads integers from a block of TIFF data in whichever byte order it was written in. Reads that would
+             * overrun the block return @c 0, which no caller mistakes for a valid offset or dimension.
+             */
+
+            class TiffData {
+
+            public:
+
+                TiffData(const quint8 * const bytes, const qint64 size, const bool bigEndian)
+                    : m_bigEndian{bigEndian},
+                      m_bytes{bytes},
+                      m_size{size} {}
+
+                quint16 u16(const qint64 offset) const {
+
+                    if (offset < 0 || offset + 2 > m_size) {
+                        return 0;
+                    }
+
+                    const auto * const bytes = m_bytes + offset;
+                    return m_bigEndian ? (bytes[0] << 8) | bytes[1] : (bytes[1] << 8) | bytes[0];
+                }
+
+                quint32 u32(const qint64 offset) const {
+
+                    if (offset < 0 || offset + 4 > m_size) {
+                        return 0;
+                    }
+
+                    const auto * const bytes = m_bytes + offset;
+                    return m_bigEndian
+                         ? (quint32{bytes[0]} << 24) | (quint32{bytes[1]} << 16) | (quint32{bytes[2]} << 8) | bytes[3]
+                         : (quint32{bytes[3]} << 24) | (quint32{bytes[2]} << 16) | (quint32{bytes[1]} << 8) | bytes[0];
+                }
+
+                /**
+                 * Reads one of the values of a directory entry, which are held in the entry itself if they fit in four
+                 * bytes and elsewhere in the data otherwise. Only integer types are understood.
+                 */
+
+                quint32 value(const qint64 entry, const quint32 index) const {
+
+                    const auto type = u16(entry + 2);
+                    const auto count = u32(entry + 4);
+                    const auto valueSize = type == 3 ? 2 : type == 4 || type == 13 ? 4 : 0;
+
+                    if (valueSize == 0 || index >= count) {
+                        return 0;
+                    }
+
+                    const auto valuesOffset = qint64{count} * valueSize <= 4 ? entry + 8 : qint64{u32(entry + 8)};
+                    const auto offset = valuesOffset + qint64{index} * valueSize;
+                    return valueSize == 2 ? u16(offset) : u32(offset);
+                }
+
+            private:
+
+                const bool m_bigEndian;
+                const quint8 * const m_bytes;
+                const qint64 m_size;
+            };
+
+            /**
+             * Gets the dimensions of a JPEG image from its frame header. Only the baseline, extended and progressive
+             * Huffman-coded processes are recognised, as those are the ones that Qt can decode: in particular, the
+             * lossless JPEG data in which many RAW formats store their sensor data is not.
+             * @return The dimensions of the image, or an invalid size if @p bytes doesn't hold a JPEG image that Qt can
+             * decode.
+             */
+
+            QSize jpegFrameSize(const quint8 * const bytes, const qint64 size) {
+
+                if (size < 4 || bytes[0] != 0xff || bytes[1] != StartOfImageMarker) {
+                    return {};
+                }
+
+                qint64 offset = 2;
+                while (offset + 4 <= size) {
+
+                    if (bytes[offset] != 0xff) {
+                        return {};
+                    }
+
+                    const auto marker = bytes[offset + 1];
+                    if (marker == 0xff) {
+                        ++offset;
+                        continue;
+                    }
+
+                    if (marker == 0xc0 || marker == 0xc1 || marker == 0xc2) {
+
+                        if (offset + 9 > size) {
+                            return {};
+                        }
+
+                        const auto height = (bytes[offset + 5] << 8) | bytes[offset + 6];
+                        const auto width = (bytes[offset + 7] << 8) | bytes[offset + 8];
+                        return {width, height};
+                    }
+
+                    if ((marker >= 0xc3 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+                        || marker == StartOfScanMarker) {
+                        return {};
+                    }
+
+                    offset += 2 + ((bytes[offset + 2] << 8) | bytes[offset + 3]);
+                }
+
+                return {};
+            }
+
+            /**
+             * Walks the image file directories of a TIFF container, following the chain of directories from the
+             * header along with any subdirectories and EXIF directory, and gathers the JPEG blocks and dimensions
+             * that they record.
+             * @return @c true if @p bytes starts with a TIFF header; @c false otherwise.
+             */
+
+            bool readTiff(const quint8 * const bytes, const qint64 size, TiffContents& contents) {
+
+                if (size < 8 || !((bytes[0] == 'I' && bytes[1] == 'I') || (bytes[0] == 'M' && bytes[1] == 'M'))) {
+                    return false;
+                }
+
+                const TiffData data{bytes, size, bytes[0] == 'M'};
+                if (data.u16(2) != 42) {
+                    return false;
+                }
+
+                QVector<quint32> pending{data.u32(4)};
+                QSet<quint32> visited;
+
+                while (!pending.isEmpty() && visited.size() < MaximumDirectoryCount) {
+
+                    const auto directory = pending.takeLast();
+                    if (directory == 0 || visited.contains(directory)) {
+                        continue;
+                    }
+
+                    visited.insert(directory);
+
+                    const auto entryCount = data.u16(directory);
+                    const auto entriesEnd = qint64{directory} + 2 + 12 * qint64{entryCount};
+                    if (entriesEnd + 4 > size) {
+                        continue;
+                    }
+
+                    quint32 subfileType = 0;
+                    quint32 compression = 0;
+                    QSize directorySize;
+                    JpegBlock strip{0, 0};
+                    JpegBlock interchange{0, 0};
+                    auto stripCount = 0;
+
+                    for (auto i = 0; i < entryCount; ++i) {
+
+                        const auto entry = qint64{directory} + 2 + 12 * qint64{i};
+                        const auto firstValue = data.value(entry, 0);
+
+                        switch (data.u16(entry)) {
+
+                            case NewSubfileTypeTag:              subfileType = firstValue; break;
+                            case ImageWidthTag:                  directorySize.setWidth(firstValue); break;
+                            case ImageLengthTag:                 directorySize.setHeight(firstValue); break;
+                            case CompressionTag:                 compression = firstValue; break;
+                            case StripByteCountsTag:             strip.length = firstValue; break;
+                            case JpegInterchangeFormatTag:       interchange.offset = firstValue; break;
+                            case JpegInterchangeFormatLengthTag: interchange.length = firstValue; break;
+                            case ExifIfdTag:                     pending << firstValue; break;
+                            case PixelXDimensionTag:             contents.exifSize.setWidth(firstValue); break;
+                            case PixelYDimensionTag:             contents.exifSize.setHeight(firstValue); break;
+
+                            case StripOffsetsTag:
+
+                                strip.offset = firstValue;
+                                stripCount = static_cast<int>(data.u32(entry + 4));
+                                break;
+
+                            case SubIfdsTag:
+
+                                for (quint32 index = 0; index < qMin(data.u32(entry + 4), quint32{16}); ++index) {
+                                    pending << data.value(entry, index);
+                                }
+                                break;
+
+                            default:
+                                break;
+                        }
+                    }
+
+                    pending << data.u32(entriesEnd);
+
+                    if (interchange.offset > 0 && interchange.length > 0) {
+                        contents.jpegBlocks << interchange;
+                    }
+
+                    // A JPEG-compressed image is only usable as a preview if it is stored in a single strip.
+
+                    if ((compression == OldJpegCompression || compression == JpegCompression) && stripCount == 1
+                        && strip.offset > 0 && strip.length > 0) {
+                        contents.jpegBlocks << strip;
+                    }
+
+                    // Bit 0 of the subfile type marks reduced-resolution images, such as previews and thumbnails.
+
+                    if ((subfileType & 1) == 0 && !directorySize.isEmpty()
+                        && qint64{directorySize.width()} * directorySize.height()
+                           > qint64{contents.fullSize.width()} * contents.fullSize.height()) {
+                        contents.fullSize = directorySize;
+                    }
+                }
+
+                return true;
+            }
+
+            /**
+             * Tests whether a preview may be hashed in place of its image, as described for findEmbeddedPreview().
+             */
+
+            bool isSuitablePreview(const QSize& previewSize, const QSize& imageSize) {
+
+                if (previewSize.isEmpty() || imageSize.isEmpty()
+                    || qMin(previewSize.width(), previewSize.height()) < MinimumPreviewSide) {
+                    return false;
+                }
+
+                const auto previewCross = double(previewSize.width()) * imageSize.height();
+                const auto imageCross = double(imageSize.width()) * previewSize.height();
+                return qAbs(previewCross - imageCross) <= MaximumAspectError * previewCross;
+            }
+        }
+
+        bool EmbeddedPreview::isNull() const {
+            return length == 0;
+        }
+
+        EmbeddedPreview findEmbeddedPreview(const char * const data, const int size) {
+
+            const auto * const bytes = reinterpret_cast<const quint8 *>(data);
+
+            // In a JPEG file, the TIFF container is the body of the EXIF segment, and the dimensions of the full image
+            // are those of the file's own frame header.
+
+            qint64 tiffOffset = 0;
+            qint64 tiffSize = size;
+            QSize imageSize;
+
+            if (size >= 4 && bytes[0] == 0xff && bytes[1] == StartOfImageMarker) {
+
+                tiffSize = 0;
+                imageSize = jpegFrameSize(bytes, size);
+
+                qint64 offset = 2;
+                while (offset + 4 <= size && bytes[offset] == 0xff && bytes[offset + 1] != StartOfScanMarker) {
+
+                    const auto length = (bytes[offset + 2] << 8) | bytes[offset + 3];
+                    if (bytes[offset + 1] == ExifMarker && length >= 8 && offset + 2 + length <= size
+                        && qstrncmp(data + offset + 4, "Exif", 5) == 0) {
+
+                        tiffOffset = offset + 10;
+                        tiffSize = length - 8;
+                        break;
+                    }
+
+                    offset += 2 + length;
+                }
+            }
+
+            TiffContents contents;
+            if (!readTiff(bytes + tiffOffset, tiffSize, contents)) {
+                return {};
+            }
+
+            if (!imageSize.isValid()) {
+                imageSize = !contents.exifSize.isEmpty() ? contents.exifSize : contents.fullSize;
+            }
+
+            EmbeddedPreview preview;
+            preview.imageSize = imageSize;
+
+            for (const auto& block : contents.jpegBlocks) {
+
+                if (block.offset + block.length > tiffSize) {
+                    continue;
+                }
+
+                const auto previewSize = jpegFrameSize(bytes + tiffOffset + block.offset, block.length);
+                if (!isSuitablePreview(previewSize, imageSize)) {
+                    continue;
+                }
+
+                if (preview.isNull()
+                    || qint64{previewSize.width()} * previewSize.height()
+                       < qint64{preview.previewSize.width()} * preview.previewSize.height()) {
+
+                    preview.offset = static_cast<int>(tiffOffset + block.offset);
+                    preview.length = static_cast<int>(block.length);
+                    preview.previewSize = previewSize;
+                }
+            }
+
+            return preview;
+        }
+
+        QList<QByteArray> rawMimeTypes() {
+
+            return {
+                "image/x-adobe-dng",
+                "image/x-canon-cr2",
+                "image/x-nikon-nef",
+                "image/x-nikon-nrw",
+                "image/x-samsung-srw",
+                "image/x-sony-arw",
+                "image/x-sony-sr2"
+            };
+        }
+    }
+}
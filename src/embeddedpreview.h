@@ -0,0 +1,81 @@
+#ifndef MYRIAD_EMBEDDEDPREVIEW_H
+#define MYRIAD_EMBEDDEDPREVIEW_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSize>
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * The location of a JPEG preview embedded within an image file, as found by findEmbeddedPreview().
+         */
+
+        struct EmbeddedPreview {
+
+            /**
+             * The offset of the preview's JPEG data within the file, in bytes.
+             */
+
+            int offset = 0;
+
+            /**
+             * The length of the preview's JPEG data, in bytes; 0 if no preview was found.
+             */
+
+            int length = 0;
+
+            /**
+             * The dimensions of the preview, as recorded in its JPEG frame header.
+             */
+
+            QSize previewSize;
+
+            /**
+             * The dimensions of the full image that the preview was made from.
+             */
+
+            QSize imageSize;
+
+            /**
+             * Tests whether the object describes no preview at all.
+             */
+
+            bool isNull() const;
+        };
+
+        /**
+         * Looks through the file data of an image for a JPEG preview of it that may be decoded and hashed in place of
+         * the full image, which is far quicker for large camera originals and the only option for RAW files that Qt
+         * can't decode. Two kinds of container are understood:
+         * - JPEG files, whose EXIF block may hold a thumbnail;
+         * - TIFF files and the RAW formats based on TIFF (such as CR2, NEF, ARW and DNG), whose image file directories
+         *   may hold previews of various sizes alongside the raw sensor data.
+         *
+         * The dimensions of each preview are read from its frame header without decoding it, and a preview is only
+         * accepted if it is large enough to hash reliably and has the same aspect ratio as the full image: this rules
+         * out the letterboxed thumbnails that many cameras embed, as well as any preview whose full image has unknown
+         * dimensions. Of the previews accepted, the smallest is chosen, since it is the quickest to decode.
+         *
+         * The EXIF thumbnail of a JPEG file (or of a plain TIFF file) is found like any other preview, but is often
+         * stale, as editors tend to rewrite an image without regenerating its thumbnail; ImageInfo::read() therefore
+         * only looks for previews in RAW files, which are not edited in place.
+         * @param data The contents of the image file.
+         * @param size The size of @p data, in bytes.
+         * @return The preview chosen, or a null preview if the file has none that is suitable. Either way, its
+         * imageSize holds the dimensions of the full image if the container records them, so that this may be run on
+         * just the start of a file to learn how large a suitable preview could be.
+         */
+
+        EmbeddedPreview findEmbeddedPreview(const char * data, int size);
+
+        /**
+         * Gets a list of the MIME types of the RAW formats that findEmbeddedPreview() understands.
+         */
+
+        QList<QByteArray> rawMimeTypes();
+    }
+}
+
+#endif
@@ -0,0 +1,543 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include <QDir>
+
+#include "externalhashsearch.h"
+#include "imageinfo.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The amount of memory, in bytes, that hashes are gathered in before being written to disk while images
+             * are appended.
+             */
+
+            constexpr qint64 SpillBufferSize = 1024 * 1024;
+
+            /**
+             * Gets the number of values of a chunk of @p width bits that are within @p radius bits of any one value.
+             */
+
+            double ballVolume(const int width, const int radius) {
+
+                double volume = 0;
+                double combinations = 1;
+                for (auto bits = 0; bits <= qMin(radius, width); ++bits) {
+
+                    volume += combinations;
+                    combinations = combinations * (width - bits) / (bits + 1);
+                }
+
+                return volume;
+            }
+
+            /**
+             * Calls a function with every value of @p value with up to @p radius of its lowest @p width bits flipped.
+             * Each set of bits is flipped in descending order, so that it is visited only once.
+             */
+
+            template<typename Visitor>
+            void visitFlips(const quint32 value, const int width, const int radius, const Visitor& visit) {
+
+                visit(value);
+                if (radius > 0) {
+                    for (auto bit = 0; bit < width; ++bit) {
+                        visitFlips(value ^ (quint32{1} << bit), bit, radius - 1, visit);
+                    }
+                }
+            }
+
+            /**
+             * Calls a function with every value of a chunk of @p width bits that is greater than @p value but within
+             * @p radius bits of it. These are the values whose highest flipped bit is clear in @p value.
+             */
+
+            template<typename Visitor>
+            void visitProbeKeys(const quint32 value, const int width, const int radius, const Visitor& visit) {
+
+                if (radius > 0) {
+                    for (auto bit = 0; bit < width; ++bit) {
+                        if ((value & (quint32{1} << bit)) == 0) {
+                            visitFlips(value | (quint32{1} << bit), bit, radius - 1, visit);
+                        }
+                    }
+                }
+            }
+
+            /**
+             * Reads exactly @p size bytes from a device, however many calls to @c read() that takes.
+             */
+
+            bool readFully(QIODevice& device, char * data, qint64 size) {
+
+                while (size > 0) {
+
+                    const auto bytesRead = device.read(data, size);
+                    if (bytesRead <= 0) {
+                        return false;
+                    }
+
+                    data += bytesRead;
+                    size -= bytesRead;
+                }
+
+                return true;
+            }
+        }
+
+        constexpr int ExternalHashSearch::MinChunkBits;
+        constexpr int ExternalHashSearch::MaxChunkBits;
+
+        ExternalHashSearch::ExternalHashSearch(const SimilarityCascade& cascade, const qint64 memoryBudget,
+                                               const QString& workDirPath)
+            : m_cascade{cascade},
+              m_memoryBudget{memoryBudget},
+              m_workDir{(workDirPath.isEmpty() ? QDir::tempPath() : workDirPath)
+                        + QStringLiteral("/myriad-search-XXXXXX")} {
+
+            m_records.setFileName(m_workDir.filePath(QStringLiteral("hashes")));
+            if (!m_workDir.isValid() || !m_records.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+                qWarning("Could not create working files for search in %s", qPrintable(m_workDir.path()));
+            }
+        }
+
+        bool ExternalHashSearch::append(const ImageInfo& image) {
+
+            // Images that couldn't be hashed never match anything, but still take up an index so that the indices of
+            // the others stay in step with the order in which they were appended.
+
+            const auto index = m_imageCount++;
+            if (image.perceptualHash().isNull()) {
+                return true;
+            }
+
+            for (auto orientation = 0; orientation < m_cascade.orientationCount(); ++orientation) {
+
+                Record record;
+                record.hash = image.perceptualHash(orientation);
+                record.differenceHash = image.differenceHash(orientation);
+                record.image = index;
+                record.orientation = static_cast<quint32>(orientation);
+                m_pending.push_back(record);
+            }
+
+            return static_cast<qint64>(m_pending.size() * sizeof(Record)) < SpillBufferSize || flush();
+        }
+
+        void ExternalHashSearch::checkPair(const Record& lhs, const Record& rhs, const int chunk,
+                                           const PairCallback& report) const {
+
+            // Only the first image of each pair is reoriented, as HashIndex::findCandidates() reorients the image being
+            // searched for, so that every pair is judged exactly as it would be in memory. (The difference hashes of
+            // two images in some orientation don't generally differ in as many bits as they do with the orientation
+            // of the other image undone instead.)
+
+            const auto& first = lhs.image < rhs.image ? lhs : rhs;
+            const auto& second = lhs.image < rhs.image ? rhs : lhs;
+
+            if (lhs.image == rhs.image || second.orientation != 0) {
+                return;
+            }
+
+            if (hammingDistance(lhs.differenceHash, rhs.differenceHash) > m_cascade.differenceHashLimit) {
+                return;
+            }
+
+            const auto distance = hammingDistance(lhs.hash, rhs.hash);
+            if (distance > m_cascade.perceptualHashLimit()) {
+                return;
+            }
+
+            for (auto earlierChunk = 0; earlierChunk < chunk; ++earlierChunk) {
+                if (hammingDistance(chunkValue(lhs.hash, earlierChunk), chunkValue(rhs.hash, earlierChunk))
+                    <= m_chunkRadius) {
+                    return;
+                }
+            }
+
+            report(first.image, second.image, static_cast<int>(first.orientation), distance);
+        }
+
+        quint32 ExternalHashSearch::chunkValue(const PerceptualHash& hash, const int chunk) const {
+
+            const auto begin = chunk * PerceptualHashBits / m_chunkCount;
+            const auto end = (chunk + 1) * PerceptualHashBits / m_chunkCount;
+
+            // A chunk may straddle two words of the hash.
+
+            quint64 value = 0;
+            for (auto bit = begin; bit < end;) {
+
+                const auto offset = bit % 64;
+                const auto width = qMin(64 - offset, end - bit);
+                const auto mask = width == 64 ? ~quint64{0} : (quint64{1} << width) - 1;
+
+                value |= ((hash.words[bit / 64] >> offset) & mask) << (bit - begin);
+                bit += width;
+            }
+
+            return static_cast<quint32>(value);
+        }
+
+        int ExternalHashSearch::chunkWidth(const int chunk) const {
+            return (chunk + 1) * PerceptualHashBits / m_chunkCount - chunk * PerceptualHashBits / m_chunkCount;
+        }
+
+        bool ExternalHashSearch::findPairs(const PairCallback& report) {
+
+            const auto limit = m_cascade.perceptualHashLimit();
+            if (limit >= PerceptualHashBits) {
+
+                qWarning("Cannot search for hashes that differ in up to %d of their %d bits", limit,
+                         PerceptualHashBits);
+                return false;
+            }
+
+            if (!flush()) {
+                return false;
+            }
+
+            // Each pass spills every record along with the probes within the chunk radius of it, and compares each
+            // record with those that share its value by chance, of which there are fewer the wider the chunk. The
+            // number of chunks is chosen to make the sum of the two smallest over the whole search.
+
+            const auto recordCount = static_cast<double>(m_records.size() / static_cast<qint64>(sizeof(Record)));
+            auto bestChunkCount = 0;
+            auto bestCost = 0.0;
+
+            for (auto chunkCount = (PerceptualHashBits + MaxChunkBits - 1) / MaxChunkBits;
+                 chunkCount <= qMax(PerceptualHashBits / MinChunkBits, 1); ++chunkCount) {
+
+                m_chunkCount = chunkCount;
+                auto cost = 0.0;
+                for (auto chunk = 0; chunk < chunkCount; ++chunk) {
+
+                    const auto width = chunkWidth(chunk);
+                    cost += ballVolume(width, limit / chunkCount) * (1 + recordCount / std::ldexp(1.0, width));
+                }
+
+                if (bestChunkCount == 0 || cost < bestCost) {
+                    bestChunkCount = chunkCount;
+                    bestCost = cost;
+                }
+            }
+
+            m_chunkCount = bestChunkCount;
+            m_chunkRadius = limit / m_chunkCount;
+
+            for (auto chunk = 0; chunk < m_chunkCount; ++chunk) {
+                if (!runPass(chunk, report)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool ExternalHashSearch::flush() {
+
+            const auto size = static_cast<qint64>(m_pending.size() * sizeof(Record));
+            if (size > 0 && (!m_records.seek(m_records.size())
+                             || m_records.write(reinterpret_cast<const char *>(m_pending.data()), size) != size)) {
+
+                qWarning("Could not write hashes to %s: %s", qPrintable(m_records.fileName()),
+                         qPrintable(m_records.errorString()));
+                return false;
+            }
+
+            m_pending.clear();
+            return true;
+        }
+
+        bool ExternalHashSearch::runPass(const int chunk, const PairCallback& report) {
+
+            const auto lessThan = [](const Entry& lhs, const Entry& rhs) {
+                return lhs.key != rhs.key ? lhs.key < rhs.key : lhs.isProbe < rhs.isProbe;
+            };
+
+            const auto fail = [](const QFile& file) {
+
+                qWarning("Could not read or write %s: %s", qPrintable(file.fileName()), qPrintable(file.errorString()));
+                return false;
+            };
+
+            const auto recordCount = m_records.size() / static_cast<qint64>(sizeof(Record));
+            if (recordCount == 0) {
+                return true;
+            }
+
+            if (!m_records.seek(0)) {
+                return fail(m_records);
+            }
+
+            // First, the entries of each record and its probes are gathered in runs that each fill the memory budget,
+            // and each run is sorted and written out to a file of its own.
+
+            const auto runCapacity = qMax<qint64>(1, m_memoryBudget / static_cast<qint64>(sizeof(Entry)));
+            const auto width = chunkWidth(chunk);
+
+            std::vector<std::unique_ptr<QFile>> runFiles;
+            {
+                std::vector<Entry> buffer;
+
+                const auto writeRun = [this, &buffer, &runFiles, &lessThan, &fail] {
+
+                    std::sort(buffer.begin(), buffer.end(), lessThan);
+
+                    const auto size = static_cast<qint64>(buffer.size() * sizeof(Entry));
+                    auto runFile = std::make_unique<QFile>(
+                        m_workDir.filePath(QStringLiteral("run-%1").arg(static_cast<int>(runFiles.size()))));
+                    if (!runFile->open(QIODevice::ReadWrite | QIODevice::Truncate)
+                        || runFile->write(reinterpret_cast<const char *>(buffer.data()), size) != size
+                        || !runFile->seek(0)) {
+                        return fail(*runFile);
+                    }
+
+                    runFiles.push_back(std::move(runFile));
+                    buffer.clear();
+                    return true;
+                };
+
+                auto writeFailed = false;
+                const auto spill = [runCapacity, &buffer, &writeRun, &writeFailed](const Entry& entry) {
+
+                    if (static_cast<qint64>(buffer.size()) >= runCapacity && !writeFailed) {
+                        writeFailed = !writeRun();
+                    }
+                    buffer.push_back(entry);
+                };
+
+                for (qint64 i = 0; i < recordCount; ++i) {
+
+                    Entry entry;
+                    if (!readFully(m_records, reinterpret_cast<char *>(&entry.record), sizeof(Record))) {
+                        return fail(m_records);
+                    }
+
+                    entry.key = chunkValue(entry.record.hash, chunk);
+                    spill(entry);
+
+                    Entry probe = entry;
+                    probe.isProbe = 1;
+                    visitProbeKeys(entry.key, width, m_chunkRadius, [&probe, &spill](const quint32 key) {
+
+                        probe.key = key;
+                        spill(probe);
+                    });
+
+                    if (writeFailed) {
+                        return false;
+                    }
+                }
+
+                if (!buffer.empty() && !writeRun()) {
+                    return false;
+                }
+            }
+
+            // The runs are then merged, with half of the memory budget shared between their read buffers. Each record
+            // that comes out of the merge is checked against every one before it with the same value, and each probe
+            // against every record with its value, so only the records of one value are held at a time.
+
+            struct Run {
+                QFile * file;
+                std::vector<Entry> buffer;
+                std::size_t position;
+                qint64 remaining;
+            };
+
+            const auto mergeCapacity = qMax<qint64>(1, m_memoryBudget / 2 / static_cast<qint64>(sizeof(Entry)));
+            const auto runBufferCapacity = qMax<qint64>(1, mergeCapacity / static_cast<qint64>(runFiles.size()));
+
+            const auto refill = [runBufferCapacity](Run& run) {
+
+                run.buffer.resize(static_cast<std::size_t>(qMin(runBufferCapacity, run.remaining)));
+                run.position = 0;
+                run.remaining -= run.buffer.size();
+
+                return readFully(*run.file, reinterpret_cast<char *>(run.buffer.data()),
+                                 static_cast<qint64>(run.buffer.size() * sizeof(Entry)));
+            };
+
+            std::vector<Run> runs;
+            std::vector<int> heap;
+
+            for (const auto& runFile : runFiles) {
+
+                runs.push_back({runFile.get(), {}, 0, runFile->size() / static_cast<qint64>(sizeof(Entry))});
+                if (!refill(runs.back())) {
+                    return fail(*runFile);
+                }
+
+                heap.push_back(static_cast<int>(runs.size()) - 1);
+            }
+
+            const auto heapOrder = [&runs, &lessThan](const int lhs, const int rhs) {
+                return lessThan(runs[rhs].buffer[runs[rhs].position], runs[lhs].buffer[runs[lhs].position]);
+            };
+
+            std::make_heap(heap.begin(), heap.end(), heapOrder);
+
+            // The records of a value are held in memory up to the other half of the budget. Beyond that, the rest of
+            // them and all of the value's probes are written to an overflow file, which is searched a block at a time
+            // once the value is complete.
+
+            const auto blockCapacity = qMax<std::size_t>(1, m_memoryBudget / 2 / sizeof(Record));
+            std::vector<Record> block;
+            quint32 blockKey = 0;
+
+            QFile overflow{m_workDir.filePath(QStringLiteral("overflow"))};
+            qint64 overflowRecordCount = 0;
+            auto isOverflowing = false;
+
+            const auto finishValue = [this, chunk, &report, &block, &overflow, &overflowRecordCount, &isOverflowing] {
+
+                const auto finished = !isOverflowing || searchOverflow(block, overflow, overflowRecordCount, chunk,
+                                                                       report);
+                block.clear();
+                isOverflowing = false;
+                return finished;
+            };
+
+            while (!heap.empty()) {
+
+                std::pop_heap(heap.begin(), heap.end(), heapOrder);
+                auto& run = runs[heap.back()];
+                const auto entry = run.buffer[run.position++];
+
+                if (run.position < run.buffer.size()) {
+                    std::push_heap(heap.begin(), heap.end(), heapOrder);
+                }
+                else if (run.remaining > 0) {
+
+                    if (!refill(run)) {
+                        return fail(*run.file);
+                    }
+                    std::push_heap(heap.begin(), heap.end(), heapOrder);
+                }
+                else {
+                    heap.pop_back();
+                }
+
+                if (entry.key != blockKey) {
+
+                    if (!finishValue()) {
+                        return false;
+                    }
+                    blockKey = entry.key;
+                }
+
+                if (!isOverflowing && !entry.isProbe && block.size() >= blockCapacity) {
+
+                    if (!(overflow.isOpen() ? overflow.resize(0) && overflow.seek(0)
+                                            : overflow.open(QIODevice::ReadWrite | QIODevice::Truncate))) {
+                        return fail(overflow);
+                    }
+
+                    overflowRecordCount = 0;
+                    isOverflowing = true;
+                }
+
+                if (isOverflowing) {
+
+                    if (overflow.write(reinterpret_cast<const char *>(&entry.record), sizeof(Record))
+                        != static_cast<qint64>(sizeof(Record))) {
+                        return fail(overflow);
+                    }
+
+                    overflowRecordCount += entry.isProbe ? 0 : 1;
+                    continue;
+                }
+
+                for (const auto& record : block) {
+                    checkPair(record, entry.record, chunk, report);
+                }
+
+                if (!entry.isProbe) {
+                    block.push_back(entry.record);
+                }
+            }
+
+            if (!finishValue()) {
+                return false;
+            }
+
+            for (const auto& runFile : runFiles) {
+                runFile->remove();
+            }
+            overflow.remove();
+
+            return true;
+        }
+
+        bool ExternalHashSearch::searchOverflow(std::vector<Record>& block, QFile& overflow, const qint64 recordCount,
+                                                const int chunk, const PairCallback& report) const {
+
+            const auto fail = [&overflow] {
+
+                qWarning("Could not read or write %s: %s", qPrintable(overflow.fileName()),
+                         qPrintable(overflow.errorString()));
+                return false;
+            };
+
+            if (!overflow.flush()) {
+                return fail();
+            }
+
+            // The file holds the records after the first block, followed by the probes. Every entry after a block is
+            // checked against it, and the next block is then read from the start of those entries, until every record
+            // has been in a block.
+
+            const auto blockCapacity = static_cast<qint64>(block.size());
+            const auto entryCount = overflow.size() / static_cast<qint64>(sizeof(Record));
+            qint64 next = 0;
+
+            for (;;) {
+
+                if (!overflow.seek(next * static_cast<qint64>(sizeof(Record)))) {
+                    return fail();
+                }
+
+                for (auto i = next; i < entryCount; ++i) {
+
+                    Record entry;
+                    if (!readFully(overflow, reinterpret_cast<char *>(&entry), sizeof(Record))) {
+                        return fail();
+                    }
+
+                    for (const auto& record : block) {
+                        checkPair(record, entry, chunk, report);
+                    }
+                }
+
+                if (next >= recordCount) {
+                    return true;
+                }
+
+                block.resize(static_cast<std::size_t>(qMin(blockCapacity, recordCount - next)));
+                if (!overflow.seek(next * static_cast<qint64>(sizeof(Record)))
+                    || !readFully(overflow, reinterpret_cast<char *>(block.data()),
+                                  static_cast<qint64>(block.size() * sizeof(Record)))) {
+                    return fail();
+                }
+
+                for (auto i = 0u; i < block.size(); ++i) {
+                    for (auto j = i + 1; j < block.size(); ++j) {
+                        checkPair(block[i], block[j], chunk, report);
+                    }
+                }
+
+                next += static_cast<qint64>(block.size());
+            }
+        }
+
+        quint32 ExternalHashSearch::size() const {
+            return m_imageCount;
+        }
+    }
+}
@@ -0,0 +1,224 @@
+#ifndef MYRIAD_EXTERNALHASHSEARCH_H
+#define MYRIAD_EXTERNALHASHSEARCH_H
+
+#include <functional>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+#include <QTemporaryDir>
+
+#include "perceptualhash.h"
+#include "similaritycascade.h"
+
+namespace myriad {
+    namespace processing {
+
+        class ImageInfo;
+
+        /**
+         * Finds the pairs of similar images among far more images than fit in memory at once. Only the hashes of each
+         * image are kept, and they are spilled to a file as they are appended; the search itself is a series of
+         * external sorts of that file, so its memory use is mostly fixed by the budget it is given (see below), and all
+         * of its I/O is sequential.
+         *
+         * The search is a form of multi-index hashing. The bits of the perceptual hashes are partitioned into chunks of
+         * between MinChunkBits and MaxChunkBits bits, and if two hashes differ in no more than r bits, then in at
+         * least one of the m chunks they differ in no more than r / m bits (rounded down), the chunk radius. Each
+         * pass takes one chunk and spills an entry for every hash under its value of the chunk, along with a probe
+         * entry under every greater value within the chunk radius of it. Sorting the entries then brings together
+         * every pair of hashes within the chunk radius of each other in that chunk: those with equal values under
+         * their shared value, and the rest where the lesser value's probe meets the greater value's hash. Each such
+         * pair is put through the first two stages of the SimilarityCascade, so the search finds exactly the pairs
+         * that a HashIndex would. Each pair is reported only once in each orientation, from the first pass whose
+         * chunk it is found in.
+         *
+         * The hashes that share a value of a chunk are compared with each other and with the probes that meet them.
+         * Those hashes are held in memory up to half of the budget; the hashes and probes of a value that has more are
+         * spilled to a file of their own and compared a block at a time, so that memory stays within the budget
+         * however many hashes share a value, though the time taken still grows with the square of their number. The
+         * number of chunks is chosen for each search to balance the probes spilled, which multiply quickly as the
+         * chunk radius grows, against the hashes that share values by chance, which are fewer the wider the chunks.
+         * A loose threshold therefore makes the search slower as well as finding more pairs, and featureless images,
+         * whose hashes all share most chunk values, are costly at any threshold.
+         *
+         * The final, structural similarity stage of the cascade needs the images' thumbnails, which the search doesn't
+         * keep, so it is left to the caller.
+         */
+
+        class ExternalHashSearch {
+
+        public:
+
+            /**
+             * The function to which each pair found is reported.
+             * @param image1 The index of the first image, in the order in which images were appended. This is always
+             * the lower of the two indices.
+             * @param image2 The index of the second image.
+             * @param orientation The orientation of the first image in which the pair matched. A pair that matches in
+             * several orientations is reported once for each.
+             * @param distance The Hamming distance between the perceptual hashes of the images in that orientation.
+             */
+
+            using PairCallback = std::function<void(quint32 image1, quint32 image2, int orientation, int distance)>;
+
+            /**
+             * Constructs an empty search.
+             * @param cascade The cascade whose first two stages pairs must pass. If it matches orientations, every
+             * orientation of each image is spilled.
+             * @param memoryBudget The largest amount of memory, in bytes, that the search may use for sorting.
+             * @param workDirPath The directory in which to create the search's working files, or an empty string to
+             * use the system's temporary directory. Besides the hashes themselves, each pass writes an entry for every
+             * hash and probe, which takes up far more space the looser the cascade.
+             */
+
+            ExternalHashSearch(const SimilarityCascade& cascade, qint64 memoryBudget,
+                               const QString& workDirPath = QString{});
+
+            /**
+             * Spills the hashes of an image to disk.
+             * @return @c true if the hashes were written; @c false if they could not be.
+             */
+
+            bool append(const ImageInfo& image);
+
+            /**
+             * Finds every pair of similar images among those appended so far, as described for the class.
+             * @param report The function to call with each pair found. Pairs are reported in no particular order.
+             * @return @c true if the search ran to completion; @c false if its working files could not be written or
+             * read, or if the cascade allows hashes to differ in every bit, so that every pair would match.
+             */
+
+            bool findPairs(const PairCallback& report);
+
+            /**
+             * Gets the number of images appended so far.
+             */
+
+            quint32 size() const;
+
+        private:
+
+            /**
+             * The hashes of one orientation of an image, exactly as they are written to disk.
+             */
+
+            struct Record {
+
+                /**
+                 * The perceptual hash of the image in this orientation.
+                 */
+
+                PerceptualHash hash;
+
+                /**
+                 * The difference hash of the image in this orientation.
+                 */
+
+                quint64 differenceHash = 0;
+
+                /**
+                 * The index of the image.
+                 */
+
+                quint32 image = 0;
+
+                /**
+                 * The orientation of the image in which the hashes were computed.
+                 */
+
+                quint32 orientation = 0;
+            };
+
+            /**
+             * A record spilled under a value of the chunk that a pass sorts by, either its own value or, as a probe,
+             * another within the chunk radius of it.
+             */
+
+            struct Entry {
+
+                /**
+                 * The record.
+                 */
+
+                Record record;
+
+                /**
+                 * The value of the chunk that the entry is sorted under.
+                 */
+
+                quint32 key = 0;
+
+                /**
+                 * Whether the entry is a probe rather than the record's own value, which sorts it after the records
+                 * with that value.
+                 */
+
+                quint32 isProbe = 0;
+            };
+
+            /**
+             * Checks a pair of records that are within the chunk radius of each other in a chunk, reporting them if
+             * they pass the cascade and aren't within the chunk radius in any earlier chunk.
+             */
+
+            void checkPair(const Record& lhs, const Record& rhs, int chunk, const PairCallback& report) const;
+
+            /**
+             * Gets the value of one chunk of a perceptual hash.
+             */
+
+            quint32 chunkValue(const PerceptualHash& hash, int chunk) const;
+
+            /**
+             * Gets the number of bits in a chunk.
+             */
+
+            int chunkWidth(int chunk) const;
+
+            /**
+             * Flushes the hashes spilled so far to disk.
+             */
+
+            bool flush();
+
+            /**
+             * Makes one pass over the spilled hashes: spills their entries and probes for one chunk in sorted runs
+             * that fit within the memory budget, and then merges the runs, checking each record as it is merged
+             * against those before it with the same value.
+             */
+
+            bool runPass(int chunk, const PairCallback& report);
+
+            /**
+             * Checks the records of a value of a chunk that had too many to hold in memory at once.
+             * @param block The records with the value that are held in memory, which have already been checked
+             * against each other; this is reused to hold each later block of records.
+             * @param overflow The file holding the rest of the records with the value, followed by its probes.
+             * @param recordCount The number of records, as opposed to probes, in @p overflow.
+             */
+
+            bool searchOverflow(std::vector<Record>& block, QFile& overflow, qint64 recordCount, int chunk,
+                                const PairCallback& report) const;
+
+            /**
+             * The bounds on the width of a chunk, in bits. Chunks narrower than this share values by chance too
+             * often, and chunks wider than this have too many values within their radius.
+             */
+
+            static constexpr int MinChunkBits = 16;
+            static constexpr int MaxChunkBits = 24;
+
+            const SimilarityCascade m_cascade;
+            int m_chunkCount = 0;
+            int m_chunkRadius = 0;
+            quint32 m_imageCount = 0;
+            const qint64 m_memoryBudget;
+            std::vector<Record> m_pending;
+            QFile m_records;
+            QTemporaryDir m_workDir;
+        };
+    }
+}
+
+#endif
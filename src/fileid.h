@@ -0,0 +1,47 @@
+#ifndef MYRIAD_FILEID_H
+#define MYRIAD_FILEID_H
+
+#include <QHash>
+#include <QPair>
+#include <QtGlobal>
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Identifies a file or directory by the device it resides on and its inode number on that device, rather than by
+         * its path. Every hard link to a file (and every symbolic link that resolves to it) shares the same FileId, so
+         * these can be used to avoid processing the same file more than once and to detect cycles of directory links.
+         * FileIds are obtained as part of a FileStatus, from FileSystem::status().
+         */
+
+        struct FileId {
+
+            /**
+             * Tests whether this FileId is null, as is the case for default-constructed objects and for those that
+             * describe paths that could not be examined.
+             */
+
+            bool isNull() const {
+                return device == 0 && inode == 0;
+            }
+
+            quint64 device = 0;
+            quint64 inode  = 0;
+        };
+
+        inline bool operator==(const FileId& lhs, const FileId& rhs) {
+            return lhs.device == rhs.device && lhs.inode == rhs.inode;
+        }
+
+        inline bool operator!=(const FileId& lhs, const FileId& rhs) {
+            return !(lhs == rhs);
+        }
+
+        inline uint qHash(const FileId& fileId, const uint seed = 0) {
+            return qHash(qMakePair(fileId.device, fileId.inode), seed);
+        }
+    }
+}
+
+#endif
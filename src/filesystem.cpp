@@ -0,0 +1,79 @@
+#include <sys/stat.h>
+
+#include <QDir>
+#include <QFile>
+#include <QMimeDatabase>
+
+#include "filesystem.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * Accesses the local filesystem. Directory listings and MIME type detection are left to Qt, so that they
+             * behave just as they always have; examining files is done with a single stat() call, which provides the
+             * FileId, type, size and modification time all at once.
+             */
+
+            class LocalFileSystem : public FileSystem {
+
+            public:
+
+                QStringList entryNames(const QString& dirPath) const override {
+
+                    QDir dir{dirPath};
+                    dir.setFilter(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+                    return dir.entryList();
+                }
+
+                bool isLocal() const override {
+                    return true;
+                }
+
+                QString mimeTypeName(const QString& path) const override {
+
+                    QMimeDatabase mimeDb;
+                    return mimeDb.mimeTypeForFile(path).name();
+                }
+
+                qint64 read(const QString& path, char * const data, const qint64 maxSize) const override {
+
+                    QFile file{path};
+                    return file.open(QIODevice::ReadOnly) ? file.read(data, maxSize) : -1;
+                }
+
+                FileStatus status(const QString& path) const override {
+
+                    struct stat fileStatus;
+                    if (stat(QFile::encodeName(path).constData(), &fileStatus) != 0) {
+                        return FileStatus{};
+                    }
+
+                    FileStatus result;
+                    result.id.device = fileStatus.st_dev;
+                    result.id.inode  = fileStatus.st_ino;
+                    result.isDir     = S_ISDIR(fileStatus.st_mode);
+                    result.isFile    = S_ISREG(fileStatus.st_mode);
+                    result.size      = fileStatus.st_size;
+
+                    result.lastModified = QDateTime::fromMSecsSinceEpoch(
+                        qint64{fileStatus.st_mtim.tv_sec} * 1000 + fileStatus.st_mtim.tv_nsec / 1000000);
+
+                    return result;
+                }
+            };
+        }
+
+        bool FileSystem::isLocal() const {
+            return false;
+        }
+
+        const FileSystem& FileSystem::local() {
+
+            static const LocalFileSystem fileSystem;
+            return fileSystem;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef MYRIAD_FILESYSTEM_H
+#define MYRIAD_FILESYSTEM_H
+
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+
+#include "fileid.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Describes a file or directory as reported by a FileSystem. Symbolic links are always followed, so a status
+         * describes a link's ultimate target.
+         */
+
+        struct FileStatus {
+
+            /**
+             * Tests whether the path that the status describes exists (and, if it is a symbolic link, is not dangling).
+             */
+
+            bool exists() const {
+                return !id.isNull();
+            }
+
+            FileId id;
+            bool isDir  = false;
+            bool isFile = false;
+            qint64 size = 0;
+            QDateTime lastModified;
+        };
+
+        /**
+         * Abstracts the filesystem operations that Myriad's processing engine performs upon its inputs: enumerating
+         * directories, examining files and reading their contents. The engine normally works with the local
+         * filesystem, but can be given another implementation (such as a SyntheticFileSystem) so that its scaling
+         * behaviour can be measured without a real tree of files on disk.
+         *
+         * Implementations must be safe to use from several threads at once, since images are read by a pool of
+         * workers.
+         */
+
+        class FileSystem {
+
+        public:
+
+            /**
+             * Gets the FileSystem that accesses files on local disk via POSIX calls.
+             */
+
+            static const FileSystem& local();
+
+            virtual ~FileSystem() = default;
+
+            /**
+             * Lists the entries of a directory, in the order in which they should be scanned. As with @c QDir, hidden
+             * entries are skipped, as are the special "." and ".." entries.
+             * @param dirPath The full path of the directory to list.
+             * @return The names (not full paths) of the entries in the directory, or an empty list if it could not be
+             * read.
+             */
+
+            virtual QStringList entryNames(const QString& dirPath) const = 0;
+
+            /**
+             * Tests whether the FileSystem's paths are paths on local disk, to which the optimisations that work with
+             * the kernel's view of files (sorting by physical location, prefetching into the page cache and watching
+             * for changes via inotify) can be applied. Only the local() FileSystem returns @c true.
+             */
+
+            virtual bool isLocal() const;
+
+            /**
+             * Determines the MIME type of a file, by its name and (where the FileSystem supports it) its contents.
+             * @param path The full path of the file to examine.
+             * @return The name of the MIME type, such as "image/png".
+             */
+
+            virtual QString mimeTypeName(const QString& path) const = 0;
+
+            /**
+             * Reads the beginning of a file.
+             * @param path The full path of the file to read.
+             * @param data The buffer to read into.
+             * @param maxSize The maximum number of bytes to read, which must not exceed the size of @p data.
+             * @return The number of bytes read, or -1 if the file could not be read.
+             */
+
+            virtual qint64 read(const QString& path, char * data, qint64 maxSize) const = 0;
+
+            /**
+             * Examines a file or directory.
+             * @param path The full path of the file or directory to examine.
+             * @return A description of the file or directory, which will not exist() if @p path could not be examined.
+             */
+
+            virtual FileStatus status(const QString& path) const = 0;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include <array>
+
+#include "hashindex.h"
+#include "perceptualhash.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The number of images whose difference hash distances are computed at once. This is small enough for the
+             * distances to stay in L1 cache between the two passes over each block.
+             */
+
+            constexpr int BlockSize = 256;
+
+            /**
+             * Rounds a number of images up to a whole number of blocks.
+             */
+
+            int wholeBlocks(const int size) {
+                return (size + BlockSize - 1) / BlockSize * BlockSize;
+            }
+
+            /**
+             * The arguments of a call to HashIndex::findCandidates(), along with the index's arrays of hashes.
+             */
+
+            struct Search {
+
+                const quint64 * differenceHashes;
+                const PerceptualHash * perceptualHashes;
+                int begin;
+                int end;
+                const ImageInfo& image;
+                const SimilarityCascade& cascade;
+                std::vector<HashIndex::Candidate>& candidates;
+            };
+
+            /**
+             * Performs a search, as described for HashIndex::findCandidates(). This is the body of every variant of the
+             * search below, and is inlined into each so that it is compiled for that variant's target.
+             */
+
+            Q_ALWAYS_INLINE void searchBlocks(const Search& search) {
+
+                const auto& image = search.image;
+                const auto differenceLimit = search.cascade.differenceHashLimit;
+                const auto perceptualLimit = search.cascade.perceptualHashLimit();
+                const auto orientationCount = search.cascade.orientationCount();
+
+                std::array<int, BlockSize> distances;
+                std::array<int, BlockSize> bestDistances;
+                std::array<int, BlockSize> bestOrientations;
+
+                // Blocks are aligned to multiples of BlockSize, which the difference hashes are padded to, so that the
+                // distances for every block can be computed by a loop of fixed length that needs no remainder loop
+                // when vectorised. Only the images from the start of the search onwards are then examined.
+
+                for (auto blockBegin = search.begin / BlockSize * BlockSize; blockBegin < search.end;
+                     blockBegin += BlockSize) {
+
+                    const auto first = qMax(search.begin - blockBegin, 0);
+                    const auto blockSize = qMin(BlockSize, search.end - blockBegin);
+                    const auto * const differenceHashes = search.differenceHashes + blockBegin;
+                    const auto * const perceptualHashes = search.perceptualHashes + blockBegin;
+
+                    bestDistances.fill(perceptualLimit + 1);
+
+                    // Each orientation is a further pass over the same block, which is still in L1 cache after the
+                    // first.
+
+                    for (auto orientation = 0; orientation < orientationCount; ++orientation) {
+
+                        const auto differenceHash = image.differenceHash(orientation);
+                        const auto perceptualHash = image.perceptualHash(orientation);
+
+                        // This loop has no branches or dependencies between iterations, so for the Avx512 target it
+                        // is vectorised into eight hashes per instruction; for the Popcnt target, each hash takes a
+                        // single POPCNT.
+
+                        for (auto i = 0; i < BlockSize; ++i) {
+                            distances[i] = hammingDistance(differenceHashes[i], differenceHash);
+                        }
+
+                        for (auto i = first; i < blockSize; ++i) {
+                            if (distances[i] <= differenceLimit && !perceptualHashes[i].isNull()) {
+
+                                const auto distance = hammingDistance(perceptualHashes[i], perceptualHash);
+                                if (distance < bestDistances[i]) {
+                                    bestDistances[i] = distance;
+                                    bestOrientations[i] = orientation;
+                                }
+                            }
+                        }
+                    }
+
+                    for (auto i = first; i < blockSize; ++i) {
+                        if (bestDistances[i] <= perceptualLimit) {
+                            search.candidates.push_back({blockBegin + i, bestOrientations[i]});
+                        }
+                    }
+                }
+            }
+
+            /**
+             * The variants of the search, one for each PopcountTarget.
+             */
+
+            void searchGeneric(const Search& search) {
+                searchBlocks(search);
+            }
+
+#ifdef MYRIAD_POPCOUNT_DISPATCH
+            MYRIAD_TARGET_POPCNT void searchWithPopcnt(const Search& search) {
+                searchBlocks(search);
+            }
+
+            MYRIAD_TARGET_AVX512_POPCOUNT void searchWithAvx512(const Search& search) {
+                searchBlocks(search);
+            }
+#endif
+        }
+
+        void HashIndex::append(const ImageInfo& image) {
+
+            const auto index = size();
+            if (index == static_cast<int>(m_differenceHashes.size())) {
+                m_differenceHashes.resize(index + BlockSize);
+            }
+
+            m_differenceHashes[index] = image.differenceHash();
+            m_perceptualHashes.push_back(image.perceptualHash());
+        }
+
+        HashIndex::HashIndex()
+            : HashIndex{popcountTarget()} {
+        }
+
+        HashIndex::HashIndex(const PopcountTarget popcountTarget)
+            : m_popcountTarget{popcountTarget} {
+        }
+
+        void HashIndex::findCandidates(const ImageInfo& image, const int begin, const SimilarityCascade& cascade,
+                                       std::vector<Candidate>& candidates) const {
+
+            candidates.clear();
+            if (image.perceptualHash().isNull()) {
+                return;
+            }
+
+            const Search search{m_differenceHashes.data(), m_perceptualHashes.data(), begin, size(), image, cascade,
+                                candidates};
+
+#ifdef MYRIAD_POPCOUNT_DISPATCH
+            switch (m_popcountTarget) {
+                case PopcountTarget::Avx512: searchWithAvx512(search); return;
+                case PopcountTarget::Popcnt: searchWithPopcnt(search); return;
+                case PopcountTarget::Generic: break;
+            }
+#endif
+
+            searchGeneric(search);
+        }
+
+        void HashIndex::reserve(const int size) {
+
+            m_differenceHashes.reserve(wholeBlocks(size));
+            m_perceptualHashes.reserve(size);
+        }
+
+        int HashIndex::size() const {
+            return static_cast<int>(m_perceptualHashes.size());
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef MYRIAD_HASHINDEX_H
+#define MYRIAD_HASHINDEX_H
+
+#include <vector>
+
+#include <QtGlobal>
+
+#include "perceptualhash.h"
+#include "similaritycascade.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Stores the hashes of a collection of images in flat arrays, so that one image can be checked against many
+         * others with tight loops over contiguous memory rather than by visiting each ImageInfo in turn. Images are
+         * identified by the order in which they were appended.
+         */
+
+        class HashIndex {
+
+        public:
+
+            /**
+             * An image in the index that matches the image being searched for.
+             */
+
+            struct Candidate {
+
+                /**
+                 * The index of the matching image.
+                 */
+
+                int index;
+
+                /**
+                 * The orientation of the searched-for image in which its perceptual hashes are closest (the first, if
+                 * several are equally close). This is the only orientation in which the pair should be verified, as
+                 * SimilarityCascade::match() verifies it.
+                 */
+
+                int orientation;
+            };
+
+            /**
+             * Constructs an empty index, which searches with kernels compiled for the best PopcountTarget that the
+             * processor supports.
+             */
+
+            HashIndex();
+
+            /**
+             * Constructs an empty index that searches with kernels compiled for a particular PopcountTarget, which the
+             * processor must support. This is for comparing the targets in benchmarks.
+             */
+
+            explicit HashIndex(PopcountTarget popcountTarget);
+
+            /**
+             * Appends an image to the index. Only the hashes of the image's original orientation are stored: when
+             * orientations are matched, it is the image being searched for that is reoriented.
+             * @param image The image to append. If it could not be hashed, it never matches anything.
+             */
+
+            void append(const ImageInfo& image);
+
+            /**
+             * Finds the images whose hashes pass the first two stages of a SimilarityCascade against those of a given
+             * image, in any of the orientations that the cascade tries. Images are checked in blocks: the difference
+             * hash distances for a whole block are computed first, and the perceptual hashes are then only examined
+             * for the (typically few) images that pass.
+             * @param image The image to match. If it could not be hashed, nothing matches.
+             * @param begin The index of the first image to check; all images from here to the end are checked.
+             * @param cascade The cascade whose limits should be applied.
+             * @param candidates Receives the matching images, in ascending order of index. It is cleared first.
+             */
+
+            void findCandidates(const ImageInfo& image, int begin, const SimilarityCascade& cascade,
+                                std::vector<Candidate>& candidates) const;
+
+            /**
+             * Reserves space for a number of images.
+             */
+
+            void reserve(int size);
+
+            /**
+             * Gets the number of images in the index.
+             */
+
+            int size() const;
+
+        private:
+
+            /**
+             * The difference hashes of the images, padded with zeros to a whole number of blocks.
+             */
+
+            std::vector<quint64> m_differenceHashes;
+            std::vector<PerceptualHash> m_perceptualHashes;
+            PopcountTarget m_popcountTarget;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include <utility>
+
+#include <QRunnable>
+
+#include "filesystem.h"
+#include "imagehasher.h"
+#include "imageinfo.h"
+#include "physicalorder.h"
+#include "prefetcher.h"
+#include "scratchbuffers.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * A task that hashes images on a worker thread within a @c QThreadPool. The task is simply a function to be
+             * run, which takes images from a shared queue until the queue is exhausted.
+             */
+
+            class HashingTask : public QRunnable {
+
+            public:
+
+                explicit HashingTask(std::function<void()> function)
+                    : m_function{std::move(function)} {
+                }
+
+                void run() override {
+                    m_function();
+                }
+
+            private:
+
+                const std::function<void()> m_function;
+            };
+
+            /**
+             * The share of the decode budget, as a divisor, that is set aside for what the workers' ScratchBuffers hold
+             * onto between images.
+             */
+
+            constexpr qint64 ScratchShare = 4;
+
+            /**
+             * Gets the retained capacity of each worker's ScratchBuffers, which together take ScratchShare of the
+             * decode budget.
+             */
+
+            qint64 scratchCapacity(const qint64 decodeMemoryBudget, const int threadCount) {
+                return decodeMemoryBudget / (ScratchShare * qMax(threadCount, 1));
+            }
+        }
+
+        ImageHasher::ImageHasher(QStringList paths, QVector<ImageInfo *> imageInfos, const FileSystem& fileSystem,
+                                 const int threadCount, const qint64 decodeMemoryBudget, const bool useEmbeddedPreviews)
+            : m_decodeBudget{decodeMemoryBudget - threadCount * scratchCapacity(decodeMemoryBudget, threadCount)},
+              m_fileSystem(fileSystem),
+              m_imageInfos{std::move(imageInfos)},
+              m_paths{std::move(paths)},
+              m_scratchCapacity{scratchCapacity(decodeMemoryBudget, threadCount)},
+              m_threadCount{threadCount},
+              m_useEmbeddedPreviews{useEmbeddedPreviews} {
+
+            m_workers.setMaxThreadCount(m_threadCount);
+        }
+
+        ImageHasher::~ImageHasher() {
+            m_workers.waitForDone();
+        }
+
+        QStringList ImageHasher::hashingOrder(const QStringList& scanOrder, const FileSystem& fileSystem,
+                                              const bool physicalOrder) {
+            return physicalOrder && fileSystem.isLocal() ? sortByPhysicalLocation(scanOrder) : scanOrder;
+        }
+
+        int ImageHasher::hashedCount() const {
+            return m_hashedCount.load();
+        }
+
+        void ImageHasher::hashQueuedImages() {
+
+            // Each worker owns a set of scratch buffers that it reuses for every image it reads. What these hold
+            // between images is outside any decode lease, so its share of the budget was set aside in advance.
+
+            ScratchBuffers buffers{m_scratchCapacity};
+            for (;;) {
+
+                const auto i = m_nextIndex.fetchAndAddRelaxed(1);
+                if (i >= m_paths.size() || (m_isInterrupted && m_isInterrupted())) {
+                    return;
+                }
+
+                if (m_prefetcher) {
+                    m_prefetcher->setPosition(i);
+                }
+
+                m_imageInfos[i]->read(m_paths[i], buffers, m_fileSystem, m_useEmbeddedPreviews, &m_decodeBudget,
+                                      m_pixelDigests);
+                if (m_imageCallback) {
+                    m_imageCallback(i, buffers);
+                }
+
+                m_hashedCount.ref();
+            }
+        }
+
+        void ImageHasher::setImageCallback(ImageCallback imageCallback) {
+            m_imageCallback = std::move(imageCallback);
+        }
+
+        void ImageHasher::setInterruptionCheck(InterruptionCheck isInterrupted) {
+            m_isInterrupted = std::move(isInterrupted);
+        }
+
+        void ImageHasher::setPixelDigests(const bool pixelDigests) {
+            m_pixelDigests = pixelDigests;
+        }
+
+        void ImageHasher::setPrefetch(const bool prefetch) {
+            m_prefetch = prefetch;
+        }
+
+        void ImageHasher::start() {
+
+            // The Prefetcher works with the kernel's page cache, so it is of no use for any other FileSystem.
+
+            if (m_prefetch && m_fileSystem.isLocal()) {
+
+                m_prefetcher = std::make_unique<Prefetcher>(m_paths);
+                m_prefetcher->start();
+            }
+
+            for (auto i = 0; i < m_threadCount; ++i) {
+                m_workers.start(new HashingTask{[this] {hashQueuedImages();}});
+            }
+        }
+
+        bool ImageHasher::waitForDone(const int msecs) {
+
+            if (!m_workers.waitForDone(msecs)) {
+                return false;
+            }
+
+            m_prefetcher.reset();
+            return true;
+        }
+    }
+}
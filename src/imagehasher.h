@@ -0,0 +1,154 @@
+#ifndef MYRIAD_IMAGEHASHER_H
+#define MYRIAD_IMAGEHASHER_H
+
+#include <functional>
+#include <memory>
+
+#include <QAtomicInt>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+#include "decodebudget.h"
+
+namespace myriad {
+    namespace processing {
+
+        class FileSystem;
+        class ImageInfo;
+        class Prefetcher;
+        class ScratchBuffers;
+
+        /**
+         * Reads and hashes a queue of images on a pool of worker threads, as both ProcessorThread and the shard tool
+         * do. Each worker takes the next image from the queue and reads it with a set of ScratchBuffers of its own,
+         * and the workers' combined memory use is held within a DecodeBudget: a quarter of the budget is set aside for
+         * what the workers' buffers hold onto between images, and the rest is leased out to the images being decoded.
+         * If the FileSystem is local, a Prefetcher can run alongside them, so that files are read from disk while
+         * earlier ones are being decoded.
+         *
+         * The queue is best put in hashingOrder() first.
+         */
+
+        class ImageHasher {
+
+        public:
+
+            using ImageCallback = std::function<void(int index, ScratchBuffers& buffers)>;
+            using InterruptionCheck = std::function<bool()>;
+
+            /**
+             * Constructs an ImageHasher for a queue of images. Nothing is read until start() is called.
+             * @param paths The paths of the images, in the order in which they should be read.
+             * @param imageInfos The objects to read each image into, in the same order as @p paths. Each is written by
+             * only one worker, and they must outlive the ImageHasher.
+             * @param fileSystem The FileSystem to read the images from.
+             * @param threadCount The number of worker threads to read images on.
+             * @param decodeMemoryBudget The largest amount of memory, in bytes, that the workers may use at once for
+             * reading and decoding images, including what their buffers retain between images.
+             * @param useEmbeddedPreviews Whether to hash the previews embedded in camera originals in place of the full
+             * images (see ImageInfo::read()).
+             */
+
+            ImageHasher(QStringList paths, QVector<ImageInfo *> imageInfos, const FileSystem& fileSystem,
+                        int threadCount, qint64 decodeMemoryBudget, bool useEmbeddedPreviews);
+
+            ImageHasher(const ImageHasher&) = delete;
+            ImageHasher& operator=(const ImageHasher&) = delete;
+
+            /**
+             * Destroys the ImageHasher, after waiting for its workers to finish.
+             */
+
+            ~ImageHasher();
+
+            /**
+             * Puts a queue of images into the order in which they should be hashed. This is normally their scan order,
+             * which follows directory order and is thus generally close to their order on disk, but they can be sorted
+             * into precise physical order for the sake of rotational media. Only paths on a local FileSystem can be
+             * sorted, so any others are left in scan order.
+             * @param scanOrder The paths of the images, in the order in which they were scanned.
+             * @param fileSystem The FileSystem that the images lie on.
+             * @param physicalOrder Whether to sort the images into physical order.
+             */
+
+            static QStringList hashingOrder(const QStringList& scanOrder, const FileSystem& fileSystem,
+                                            bool physicalOrder);
+
+            /**
+             * Gets the number of images that have been read so far.
+             */
+
+            int hashedCount() const;
+
+            /**
+             * Sets a function that each worker calls once it has read an image, with the index of the image in the
+             * queue and the worker's scratch buffers, which still hold the image as decoded. It may be called from
+             * several workers at once.
+             */
+
+            void setImageCallback(ImageCallback imageCallback);
+
+            /**
+             * Sets a function that the workers call before reading each image to check whether they should stop early.
+             */
+
+            void setInterruptionCheck(InterruptionCheck isInterrupted);
+
+            /**
+             * Sets whether a digest of the pixels of each image should be taken as it is read (see
+             * ImageInfo::pixelDigest()). This must be set before start() is called.
+             */
+
+            void setPixelDigests(bool pixelDigests);
+
+            /**
+             * Sets whether a Prefetcher should read ahead of the workers. This has no effect unless the FileSystem is
+             * local, and must be set before start() is called.
+             */
+
+            void setPrefetch(bool prefetch);
+
+            /**
+             * Starts the workers.
+             */
+
+            void start();
+
+            /**
+             * Waits for the workers to finish reading the queue (or to be interrupted).
+             * @param msecs The longest time to wait, in milliseconds, or -1 to wait for as long as it takes.
+             * @return @c true if the workers have finished, or @c false if the wait timed out.
+             */
+
+            bool waitForDone(int msecs = -1);
+
+        private:
+
+            /**
+             * Reads images from the queue until it is exhausted or the workers are interrupted. This is run by each of
+             * the workers.
+             */
+
+            void hashQueuedImages();
+
+            DecodeBudget m_decodeBudget;
+            const FileSystem& m_fileSystem;
+            QAtomicInt m_hashedCount{0};
+            ImageCallback m_imageCallback;
+            const QVector<ImageInfo *> m_imageInfos;
+            InterruptionCheck m_isInterrupted;
+            QAtomicInt m_nextIndex{0};
+            const QStringList m_paths;
+            bool m_pixelDigests = false;
+            bool m_prefetch = false;
+            std::unique_ptr<Prefetcher> m_prefetcher;
+            const qint64 m_scratchCapacity;
+            const int m_threadCount;
+            const bool m_useEmbeddedPreviews;
+            QThreadPool m_workers;
+        };
+    }
+}
+
+#endif
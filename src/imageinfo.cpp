@@ -1,45 +1,29 @@
-#include <QDir>
-#include <QFile>
-#include <QFileInfo>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QHash>
 #include <QImage>
 #include <QImageReader>
-#include <QMimeDatabase>
 #include <QString>
-#include <QTemporaryFile>
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-function"
-#include <pHash.h>
-#pragma GCC diagnostic pop
 
+#include "decodebudget.h"
+#include "embeddedpreview.h"
+#include "filesystem.h"
 #include "imageinfo.h"
+#include "imagequality.h"
+#include "perceptualhash.h"
+#include "scratchbuffers.h"
+#include "tracing.h"
 
 namespace myriad {
     namespace processing {
         
         namespace {
             
-            /**
-             * Generates a checksum from the contents of the file at a specified path. 
-             * @param path The filesystem path of the file to check.
-             * @return A checksum of the file at @p path, or @c 0 if this file could not be opened.
-             */
-            
-            quint16 checksumFromPath(const QString& path) {
-                
-                QFile file{path};
-                if (!file.open(QIODevice::ReadOnly)) {
-                    return 0;
-                }
-                
-                const auto rawData  = file.readAll();
-                const auto checksum = qChecksum(rawData, rawData.length());
-                
-                file.close();
-                return checksum;
-            }
-            
             /**
              * Determines the image format code that corresponds to a named MIME type.
              * @param mimeName The name of the MIME type to find the corresponding format code for.
@@ -58,18 +42,90 @@ namespace myriad {
                 return formatsByMimeName.contains(mimeName) ? formatsByMimeName[mimeName] : ImageInfo::Format::Other;
             }
             
-           /**
-            * Determines a code for the image's file format by reading the MIME type of the file
-            * specified by @p path.
-            * @param path The filesystem path of the image to find the file format of.
-            * @return A code describing the image's file format.
-            */
-
-            ImageInfo::Format formatFromPath(const QString& path) {
+            /**
+             * Tests whether an image format stores pixels without loss. GIF counts as lossless here, since although an
+             * image may lose colours on being converted to GIF, a GIF file itself reproduces its pixels exactly.
+             */
+            
+            bool isLossless(const ImageInfo::Format format) {
+                return format == ImageInfo::Format::Bmp || format == ImageInfo::Format::Gif
+                    || format == ImageInfo::Format::Png;
+            }
+            
+            /**
+             * The number of rows of an image that digestPixels() converts to a common pixel format at a time, which
+             * bounds the extra memory needed to digest an image in any other format.
+             */
+            
+            constexpr int DigestStripRows = 64;
+            
+            /**
+             * Generates a digest of the decoded pixels of an image, which is the same for any two images with the same
+             * dimensions and the same colour at every pixel, whatever their file formats. The pixels are normalised to
+             * unpremultiplied 32-bit ARGB (which, for images without an alpha channel, has every alpha value at its
+             * maximum), so images with more than eight bits per channel are compared at eight bits per channel.
+             */
+            
+            QByteArray digestPixels(const QImage& image) {
+                
+                QCryptographicHash digest{QCryptographicHash::Sha1};
+                
+                const qint32 dimensions[] = {image.width(), image.height()};
+                digest.addData(reinterpret_cast<const char *>(dimensions), sizeof(dimensions));
+                
+                const auto rowSize = image.width() * 4;
+                const auto addRows = [&digest, rowSize](const QImage& rows) {
+                    for (auto y = 0; y < rows.height(); ++y) {
+                        digest.addData(reinterpret_cast<const char *>(rows.constScanLine(y)), rowSize);
+                    }
+                };
+                
+                // Most decoders produce one of the two 32-bit formats, whose rows can be digested in place; anything
+                // else is converted a strip at a time.
+                
+                if (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32) {
+                    addRows(image);
+                }
+                else {
+                    for (auto y = 0; y < image.height(); y += DigestStripRows) {
+                        
+                        const auto rowCount = qMin(DigestStripRows, image.height() - y);
+                        addRows(image.copy(0, y, image.width(), rowCount).convertToFormat(QImage::Format_ARGB32));
+                    }
+                }
                 
-                QMimeDatabase mimeDb;
-                const auto mimeName = mimeDb.mimeTypeForFile(path).name();
-                return formatFromMimeName(mimeName);
+                return digest.result();
+            }
+            
+            /**
+             * The number of bytes at the start of a file from which the dimensions of its image are read before the
+             * file is read in full. This is enough to take in the frame header of a JPEG file behind its EXIF and
+             * colour profile blocks, and the directories at the start of a TIFF container.
+             */
+            
+            constexpr int HeaderProbeSize = 256 * 1024;
+            
+            /**
+             * Estimates the memory needed to read and decode an image, as estimatedDecodeSize() does, from the start of
+             * its file alone. The dimensions of the image are taken from its header as Qt reads it or, failing that,
+             * if the image is to be hashed from an embedded preview, from the dimensions of the full image as recorded
+             * by its container, which no suitable preview exceeds.
+             * @param header The data at the start of the file.
+             * @param fileSize The size of the whole file, in bytes.
+             * @param findPreview Whether the image is to be hashed from an embedded preview, if it has one.
+             */
+            
+            qint64 estimateFromHeader(QByteArray& header, const qint64 fileSize, const bool findPreview) {
+                
+                QBuffer device{&header};
+                device.open(QIODevice::ReadOnly);
+                auto imageSize = QImageReader{&device}.size();
+                
+                if (!imageSize.isValid() && findPreview) {
+                    imageSize = findEmbeddedPreview(header.constData(), header.size()).imageSize;
+                }
+                
+                return estimatedDecodeSize(fileSize, imageSize);
             }
         }
         
@@ -77,9 +133,15 @@ namespace myriad {
             
             qint64 fileSize  = 0;
             Format format    = Format::Other;
-            ulong64 hash     = 0;
             quint16 checksum = 0;
             
+            QByteArray pixelDigest;
+            
+            ImageHashes hashes;
+            ImageQuality quality;
+            
+            QDateTime lastModified;
+            
             int width  = 0;
             int height = 0;
         };
@@ -98,19 +160,28 @@ namespace myriad {
         float ImageInfo::difference(const ImageInfo& lhs, const ImageInfo& rhs) {
             
             if (lhs.hasHash() && rhs.hasHash()) {
-                return ph_hamming_distance(lhs.m_data->hash, rhs.m_data->hash) / 64.0;
+                return hammingDistance(lhs.m_data->hashes.dctHashes[0], rhs.m_data->hashes.dctHashes[0])
+                     / double(PerceptualHashBits);
             }
             else {
                 return 1.0;
             }
         }
         
+        quint64 ImageInfo::differenceHash(const int orientation) const {
+            return isNull() ? 0 : m_data->hashes.differenceHashes[orientation];
+        }
+        
         qint64 ImageInfo::fileSize() const {
             return isNull() ? 0 : m_data->fileSize;
         }
         
+        ImageInfo::Format ImageInfo::format() const {
+            return isNull() ? Format::Other : m_data->format;
+        }
+        
         bool ImageInfo::hasHash() const {
-            return !isNull() && m_data->hash != 0;
+            return !isNull() && !m_data->hashes.dctHashes[0].isNull();
         }
         
         int ImageInfo::height() const {
@@ -127,41 +198,186 @@ namespace myriad {
             }
         }
         
+        bool ImageInfo::identicalPixels(const ImageInfo& lhs, const ImageInfo& rhs) {
+            
+            if (!lhs.isNull() && !rhs.isNull()) {
+                return !lhs.m_data->pixelDigest.isEmpty() && lhs.m_data->pixelDigest == rhs.m_data->pixelDigest;
+            }
+            else {
+                return false;
+            }
+        }
+        
         bool ImageInfo::isNull() const {
             return m_data == nullptr;
         }
         
+        QDateTime ImageInfo::lastModified() const {
+            return isNull() ? QDateTime{} : m_data->lastModified;
+        }
+        
+        PerceptualHash ImageInfo::perceptualHash(const int orientation) const {
+            return isNull() ? PerceptualHash{} : m_data->hashes.dctHashes[orientation];
+        }
+        
+        QByteArray ImageInfo::pixelDigest() const {
+            return isNull() ? QByteArray{} : m_data->pixelDigest;
+        }
+        
+        ImageQuality ImageInfo::quality() const {
+            return isNull() ? ImageQuality{} : m_data->quality;
+        }
+        
         void ImageInfo::read(const QString& path) {
             
+            ScratchBuffers buffers;
+            read(path, buffers);
+        }
+        
+        void ImageInfo::read(const QString& path, ScratchBuffers& buffers, const bool useEmbeddedPreview) {
+            read(path, buffers, FileSystem::local(), useEmbeddedPreview);
+        }
+        
+        void ImageInfo::read(const QString& path, ScratchBuffers& buffers, const FileSystem& fileSystem,
+                             const bool useEmbeddedPreview, DecodeBudget * const decodeBudget,
+                             const bool withPixelDigest) {
+            
+            const TraceSpan readSpan{"ImageInfo::read"};
             m_data = std::make_shared<Data>();
-
-            const QFileInfo fileInfo{path};
-            const QImage image{path};
             
-            m_data->checksum = checksumFromPath(path);
-            m_data->fileSize = fileInfo.size();
-            m_data->format   = formatFromPath(path);
+            TraceSpan statSpan{"stat"};
+            const auto status = fileSystem.status(path);
+            m_data->fileSize = status.size;
+            m_data->lastModified = status.lastModified;
+            statSpan.finish();
             
-            m_data->width  = image.width();
-            m_data->height = image.height();
+            TraceSpan mimeSpan{"detect MIME type"};
+            const auto mimeName = fileSystem.mimeTypeName(path);
+            m_data->format = formatFromMimeName(mimeName);
+            mimeSpan.finish();
             
-            // The pHash library only supports JPEG and BMP files, so if the image is not already in one of those
-            // formats, a temporary bitmap file is created and used to calculate the hash value.
+            // With a decode budget, the memory needed for the whole read is leased before the file is read into memory,
+            // so that neither the file data nor the decoded image is ever held outside the budget. The lease is sized
+            // from the header at the start of the file, and is held until the buffers have been trimmed.
             
-            if (m_data->format == Format::Jpeg || m_data->format == Format::Bmp) {
-                ph_dct_imagehash(path.toLatin1(), m_data->hash);
-            }
-            else {
+            static const auto rawTypes = rawMimeTypes();
+            const auto findPreview = useEmbeddedPreview && rawTypes.contains(mimeName.toLatin1());
+            std::unique_ptr<DecodeBudget::Lease> lease;
+            qint64 leasedBytes = 0;
+            
+            if (status.isFile && status.size <= std::numeric_limits<int>::max()) {
                 
-                QTemporaryFile tempBmp{QDir::tempPath() + QLatin1String("/myriad_XXXXXX.bmp")};
-                if (tempBmp.open()) {
+                if (decodeBudget) {
                     
-                    image.save(&tempBmp, "BMP");
-                    tempBmp.close();
+                    TraceSpan headerSpan{"read header"};
+                    auto& header = buffers.fileData(static_cast<int>(qMin(status.size, qint64{HeaderProbeSize})));
+                    header.resize(static_cast<int>(qMax(fileSystem.read(path, header.data(), header.size()),
+                                                        qint64{0})));
+                    leasedBytes = estimateFromHeader(header, status.size, findPreview);
+                    headerSpan.finish();
                     
-                    const auto tempPath = QFileInfo{tempBmp}.filePath();
-                    ph_dct_imagehash(tempPath.toLatin1(), m_data->hash);
+                    const TraceSpan budgetSpan{"wait for decode budget"};
+                    lease = std::make_unique<DecodeBudget::Lease>(*decodeBudget, leasedBytes);
                 }
+                
+                // The file is read into memory once, and both the checksum and the decoded image are generated from
+                // that copy, rather than each opening the file separately. All of the memory involved belongs to the
+                // ScratchBuffers, so can be reused for the next image.
+                
+                TraceSpan fileSpan{"read file"};
+                auto& rawData = buffers.fileData(static_cast<int>(status.size));
+                if (fileSystem.read(path, rawData.data(), rawData.size()) == rawData.size()) {
+                    
+                    fileSpan.finish();
+                    
+                    TraceSpan checksumSpan{"checksum"};
+                    m_data->checksum = qChecksum(rawData.constData(), rawData.size());
+                    checksumSpan.finish();
+                    
+                    // An image whose header, as parsed by the reader that goes on to decode it, needs more than was
+                    // leased is not decoded, rather than break the budget; this can only happen if the header at the
+                    // start of the file was unreadable or misleading.
+                    
+                    TraceSpan decodeSpan{"decode"};
+                    auto& image = buffers.image();
+                    const auto decode = [&image, &status, decodeBudget, leasedBytes](QByteArray& data) {
+                        
+                        QBuffer device{&data};
+                        device.open(QIODevice::ReadOnly);
+                        QImageReader reader{&device};
+                        
+                        const auto size = reader.size();
+                        if (decodeBudget && size.isValid() && estimatedDecodeSize(status.size, size) > leasedBytes) {
+                            return false;
+                        }
+                        
+                        return reader.read(&image);
+                    };
+                    
+                    // If asked to, we decode a preview embedded in a RAW file in place of the full image, and fall back
+                    // to the full image only if there is no suitable preview. Files that Qt can't decode at all (as
+                    // with most RAW formats) are only ever hashed from their previews. The thumbnails of JPEG and
+                    // plain TIFF files are never used, since editors often rewrite an image without regenerating its
+                    // thumbnail, which would then show the image as it was before it was cropped or retouched; RAW
+                    // files are not edited in place, so their previews stay true to them.
+                    
+                    const auto preview = findPreview ? findEmbeddedPreview(rawData.constData(), rawData.size())
+                                                     : EmbeddedPreview{};
+                    auto fromPreview = false;
+                    if (!preview.isNull()) {
+                        
+                        auto previewData = QByteArray::fromRawData(rawData.constData() + preview.offset,
+                                                                   preview.length);
+                        fromPreview = decode(previewData) && image.size() == preview.previewSize;
+                    }
+                    
+                    static const auto decodableMimeTypes = QImageReader::supportedMimeTypes();
+                    if (fromPreview || (decodableMimeTypes.contains(mimeName.toLatin1()) && decode(rawData))) {
+                        
+                        decodeSpan.finish();
+                        
+                        // A preview stands in for its image when hashing, but the image's own dimensions are kept, and
+                        // since its pixels haven't been seen, it has no pixel digest.
+                        
+                        const TraceSpan hashSpan{"hash"};
+                        const auto size = fromPreview ? preview.imageSize : image.size();
+                        m_data->width  = size.width();
+                        m_data->height = size.height();
+                        m_data->hashes = hashImage(image, buffers.hashWorkspace());
+                        if (withPixelDigest && !fromPreview) {
+                            
+                            const TraceSpan digestSpan{"digest pixels"};
+                            m_data->pixelDigest = digestPixels(image);
+                        }
+                        
+                        // Quality is assessed from the file data and the downscaled luma image, both of which are
+                        // still to hand, so that this doesn't need a pass of its own over the file or the image.
+                        
+                        auto& quality = m_data->quality;
+                        quality.pixelCount = qint64{m_data->width} * m_data->height;
+                        quality.lossless = isLossless(m_data->format);
+                        quality.sharpness = lumaSharpness(buffers.hashWorkspace());
+                        if (m_data->format == Format::Jpeg) {
+                            quality.jpegQuality = estimateJpegQuality(rawData.constData(), rawData.size());
+                        }
+                    }
+                }
+            }
+            
+            buffers.trim();
+        }
+        
+        float ImageInfo::structuralSimilarity(const ImageInfo& lhs, const ImageInfo& rhs, const int orientation) {
+            
+            if (lhs.hasHash() && rhs.hasHash()) {
+                
+                const auto& lhsThumbnail = lhs.m_data->hashes.thumbnail;
+                return static_cast<float>(processing::structuralSimilarity(
+                    orientation == 0 ? lhsThumbnail : orientedThumbnail(lhsThumbnail, orientation),
+                    rhs.m_data->hashes.thumbnail));
+            }
+            else {
+                return 0.0f;
             }
         }
         
@@ -173,8 +389,85 @@ namespace myriad {
             return isNull() ? 0 : m_data->width;
         }
         
-        QList<QByteArray> supportedMimeTypes() {
-            return QImageReader::supportedMimeTypes();
+        QDataStream& operator<<(QDataStream& stream, const ImageInfo& imageInfo) {
+            
+            stream << !imageInfo.isNull();
+            if (imageInfo.isNull()) {
+                return stream;
+            }
+            
+            const auto& data = *imageInfo.m_data;
+            stream << data.fileSize << static_cast<qint32>(data.format) << data.checksum << data.pixelDigest
+                   << data.lastModified << qint32{data.width} << qint32{data.height};
+            
+            stream << data.quality.pixelCount << qint32{data.quality.jpegQuality} << data.quality.lossless
+                   << data.quality.sharpness;
+            
+            for (auto orientation = 0; orientation < OrientationCount; ++orientation) {
+                
+                stream << data.hashes.differenceHashes[orientation];
+                for (const auto word : data.hashes.dctHashes[orientation].words) {
+                    stream << word;
+                }
+            }
+            
+            stream.writeRawData(reinterpret_cast<const char *>(data.hashes.thumbnail.data()),
+                                static_cast<int>(data.hashes.thumbnail.size()));
+            return stream;
+        }
+        
+        QDataStream& operator>>(QDataStream& stream, ImageInfo& imageInfo) {
+            
+            auto hasData = false;
+            stream >> hasData;
+            if (!hasData) {
+                
+                imageInfo.setNull();
+                return stream;
+            }
+            
+            auto data = std::make_shared<ImageInfo::Data>();
+            qint32 format = 0;
+            qint32 width = 0;
+            qint32 height = 0;
+            qint32 jpegQuality = 0;
+            
+            stream >> data->fileSize >> format >> data->checksum >> data->pixelDigest >> data->lastModified >> width
+                   >> height;
+            stream >> data->quality.pixelCount >> jpegQuality >> data->quality.lossless >> data->quality.sharpness;
+            
+            data->format = static_cast<ImageInfo::Format>(format);
+            data->width = width;
+            data->height = height;
+            data->quality.jpegQuality = jpegQuality;
+            
+            for (auto orientation = 0; orientation < OrientationCount; ++orientation) {
+                
+                stream >> data->hashes.differenceHashes[orientation];
+                for (auto& word : data->hashes.dctHashes[orientation].words) {
+                    stream >> word;
+                }
+            }
+            
+            stream.readRawData(reinterpret_cast<char *>(data->hashes.thumbnail.data()),
+                               static_cast<int>(data->hashes.thumbnail.size()));
+            
+            imageInfo.m_data = std::move(data);
+            return stream;
+        }
+        
+        QList<QByteArray> supportedMimeTypes(const bool includeRawTypes) {
+            
+            auto mimeTypes = QImageReader::supportedMimeTypes();
+            if (includeRawTypes) {
+                for (const auto& rawMimeType : rawMimeTypes()) {
+                    if (!mimeTypes.contains(rawMimeType)) {
+                        mimeTypes << rawMimeType;
+                    }
+                }
+            }
+            
+            return mimeTypes;
         }
     }
 }
@@ -4,13 +4,29 @@
 #include <memory>
 
 #include <QByteArray>
+#include <QDateTime>
 #include <QList>
 
+#include "imagequality.h"
+#include "perceptualhash.h"
+
+class QDataStream;
 class QString;
 
 namespace myriad {
     namespace processing {
         
+        class DecodeBudget;
+        class FileSystem;
+        class ScratchBuffers;
+        
+        /**
+         * The visual difference between two images below which they are considered to be duplicates.
+         * @see ImageInfo::difference()
+         */
+        
+        constexpr float SimilarityThreshold = 0.1f;
+        
         /**
          * Encapsulates Myriad's internal representation of the images it processes, storing whatever data are needed to
          * compare and appraise them. ImageInfo objects may exist in an uninitialised state if they are constructed
@@ -20,6 +36,20 @@ namespace myriad {
         
         class ImageInfo {
         
+            /**
+             * Writes everything that an ImageInfo object holds to a data stream, so that an image can be compared and
+             * appraised on another machine without being read again. Null objects are written as such.
+             */
+            
+            friend QDataStream& operator<<(QDataStream& stream, const ImageInfo& imageInfo);
+            
+            /**
+             * Reads an ImageInfo object written by operator<<(). The stream must have been written with the same
+             * PerceptualHashBits as it is read with.
+             */
+            
+            friend QDataStream& operator>>(QDataStream& stream, ImageInfo& imageInfo);
+            
         public:
             
             /**
@@ -58,6 +88,32 @@ namespace myriad {
             
             static bool identical(const ImageInfo& lhs, const ImageInfo& rhs);
             
+            /**
+             * Compares digests of the decoded pixels of two images to determine whether they are identical in content,
+             * even if their files differ (as for a PNG and a BMP of the same pixels). If either of these objects is
+             * uninitialised, or its image could not be decoded, @c false is returned.
+             * @return @c true if the images described by @p lhs and @p rhs have the same dimensions and the same
+             * pixels; @c false otherwise.
+             * @see pixelDigest()
+             */
+            
+            static bool identicalPixels(const ImageInfo& lhs, const ImageInfo& rhs);
+            
+            /**
+             * Compares small luma thumbnails of two images pixel by pixel, using the structural similarity (SSIM)
+             * index. This is far more expensive than difference(), so is only used to verify pairs that their hashes
+             * suggest are duplicates. If either of the ImageInfo objects is missing hash information, @c 0.0 is
+             * returned.
+             * @param lhs The first image.
+             * @param rhs The second image.
+             * @param orientation The orientation (as described for OrientationCount) in which @p lhs should be compared
+             * with @p rhs, as found by comparing their hashes.
+             * @return The structural similarity of the images described by @p lhs and @p rhs, which is @c 1.0 for
+             * identical thumbnails and around @c 0.0 for unrelated ones.
+             */
+            
+            static float structuralSimilarity(const ImageInfo& lhs, const ImageInfo& rhs, int orientation = 0);
+            
             /**
              * Constructs a new ImageInfo object, which will be in an uninitialised state (i.e. calls to isValid() will
              * return @c false) until read() is called. 
@@ -75,6 +131,14 @@ namespace myriad {
             
             ~ImageInfo();
             
+            /**
+             * Gets the difference hash (dHash) of the image, a cheap gradient-based hash that is generated alongside
+             * the perceptual hash. Returns @c 0 if the object is in an uninitialised state.
+             * @param orientation The orientation of the image to get the hash of, as described for OrientationCount.
+             */
+            
+            quint64 differenceHash(int orientation = 0) const;
+            
             /**
              * Gets the size of the image file on disk that this ImageInfo object was read from, in bytes. Returns @c 0
              * if the object is in an uninitialised state.
@@ -82,6 +146,13 @@ namespace myriad {
             
             qint64 fileSize() const;
             
+            /**
+             * Gets the file format of the image, as detected from its contents. Returns @c Format::Other if the object
+             * is in an uninitialised state.
+             */
+            
+            Format format() const;
+            
             /**
              * Gets the height of the image described by this ImageInfo object, in pixels. Returns @c 0 if the object is
              * in an uninitialised state.
@@ -97,6 +168,38 @@ namespace myriad {
             
             bool isNull() const;
             
+            /**
+             * Gets the time at which the image file on disk that this ImageInfo object was read from was last modified.
+             * Returns an invalid @c QDateTime if the object is in an uninitialised state.
+             */
+            
+            QDateTime lastModified() const;
+            
+            /**
+             * Gets the DCT-based perceptual hash of the image, as compared (in orientation @c 0) by difference().
+             * Returns the null hash if the object is in an uninitialised state or if the image could not be hashed.
+             * @param orientation The orientation of the image to get the hash of, as described for OrientationCount.
+             */
+            
+            PerceptualHash perceptualHash(int orientation = 0) const;
+            
+            /**
+             * Gets a digest of the image's dimensions and decoded pixels, generated as the image was hashed. Images
+             * with equal digests are identical in content, so can be grouped by their digests without being compared
+             * any further. Returns an empty byte array if the object is in an uninitialised state, if the image could
+             * not be decoded or if it was read without a digest (see read()).
+             */
+            
+            QByteArray pixelDigest() const;
+            
+            /**
+             * Gets the measurements of the image's quality that were taken as it was read, which determine which of a
+             * set of duplicates is best kept. Returns default (minimal) measurements if the object is in an
+             * uninitialised state or if the image could not be decoded.
+             */
+            
+            ImageQuality quality() const;
+            
             /**
              * Populates this ImageInfo object by reading relevant information about a specified image file on disk and
              * generating the perceptual hash that will be used to compare it with other images.
@@ -105,6 +208,42 @@ namespace myriad {
             
             void read(const QString& path);
             
+            /**
+             * Populates this ImageInfo object as read(const QString&) does, but using a caller-provided set of buffers
+             * for all of the working memory involved. Hashing workers use this to avoid allocating afresh for every
+             * image they read.
+             * @param path The path to the image file on disk that this ImageInfo object should describe.
+             * @param buffers The buffers to read, decode and hash the image with.
+             * @param useEmbeddedPreview Whether to hash a JPEG preview embedded in a RAW file (as found by
+             * findEmbeddedPreview()) in place of the full image, where the file has a suitable one. This is far
+             * quicker, and makes RAW files that Qt can't decode hashable, but leaves the image without a
+             * pixelDigest(). Its dimensions are those of the full image either way. The thumbnails embedded in other
+             * files, such as JPEG files, are never used, since they may not have been updated when the image was
+             * edited.
+             */
+            
+            void read(const QString& path, ScratchBuffers& buffers, bool useEmbeddedPreview = false);
+            
+            /**
+             * Populates this ImageInfo object as read(const QString&, ScratchBuffers&, bool) does, but reading the
+             * image from a specified FileSystem rather than from local disk, optionally within a DecodeBudget, and
+             * optionally taking a digest of its pixels.
+             * @param path The path to the image file within @p fileSystem.
+             * @param buffers The buffers to read, decode and hash the image with.
+             * @param fileSystem The filesystem to read the image from.
+             * @param useEmbeddedPreview Whether to hash an embedded preview in place of the full image.
+             * @param decodeBudget The budget to lease the memory needed to decode the image from, or @c nullptr if
+             * decoding shouldn't be limited. The lease is sized from the header at the start of the file, which is
+             * read before the rest of it, and is held from before the file is read until the image has been hashed
+             * and the buffers trimmed. An image that turns out to need more than was leased is not decoded.
+             * @param withPixelDigest Whether to generate a pixelDigest() from the decoded image. This costs a further
+             * pass over its pixels, so is only done if asked for, and never for an image hashed from a preview.
+             */
+            
+            void read(const QString& path, ScratchBuffers& buffers, const FileSystem& fileSystem,
+                      bool useEmbeddedPreview = false, DecodeBudget * decodeBudget = nullptr,
+                      bool withPixelDigest = false);
+            
             /**
              * Sets the ImageInfo object to a null state. Until read() is next called, isNull() will return true, and
              * all property accessors will return initial/default values.
@@ -140,10 +279,12 @@ namespace myriad {
         
         /**
          * Gets a list of all image MIME types supported by Myriad.
+         * @param includeRawTypes Whether to include the RAW formats that can only be hashed from their embedded
+         * previews (see ImageInfo::read()).
          * @return The supported MIME type list.
          */
         
-        QList<QByteArray> supportedMimeTypes();
+        QList<QByteArray> supportedMimeTypes(bool includeRawTypes = false);
     }
 }
 
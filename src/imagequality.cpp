@@ -0,0 +1,152 @@
+#include <array>
+#include <cmath>
+
+#include "imagequality.h"
+#include "perceptualhash.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The example luma quantisation table given in Annex K of the JPEG standard, which the IJG library (and so
+             * nearly every JPEG encoder) scales to implement its quality setting. The order of the entries doesn't
+             * matter here, since only their sum is used.
+             */
+
+            constexpr std::array<int, 64> StandardLumaTable{{
+                16, 11, 10, 16,  24,  40,  51,  61,
+                12, 12, 14, 19,  26,  58,  60,  55,
+                14, 13, 16, 24,  40,  57,  69,  56,
+                14, 17, 22, 29,  51,  87,  80,  62,
+                18, 22, 37, 56,  68, 109, 103,  77,
+                24, 35, 55, 64,  81, 104, 113,  92,
+                49, 64, 78, 87, 103, 121, 120, 101,
+                72, 92, 95, 98, 112, 100, 103,  99
+            }};
+
+            /**
+             * The JPEG markers that estimateJpegQuality() looks for.
+             */
+
+            constexpr quint8 DefineQuantisationTableMarker = 0xdb;
+            constexpr quint8 StartOfImageMarker            = 0xd8;
+            constexpr quint8 StartOfScanMarker             = 0xda;
+
+            /**
+             * Converts the sum of the entries of a luma quantisation table to an IJG quality setting, by inverting the
+             * scaling that the IJG library applies to the standard table.
+             */
+
+            int qualityFromTableSum(const int tableSum) {
+
+                auto standardSum = 0;
+                for (const auto entry : StandardLumaTable) {
+                    standardSum += entry;
+                }
+
+                const auto scale = 100.0 * tableSum / standardSum;
+                const auto quality = scale <= 100.0 ? (200.0 - scale) / 2.0 : 5000.0 / scale;
+                return qBound(1, static_cast<int>(std::lround(quality)), 100);
+            }
+        }
+
+        double ImageQuality::score() const {
+
+            const auto resolution = std::log2(static_cast<double>(qMax<qint64>(pixelCount, 1)));
+            const auto fidelity = lossless ? 1.0 : jpegQuality >= 0 ? jpegQuality / 100.0 : 0.5;
+            return resolution + fidelity + 0.25 * std::log2(1.0 + sharpness);
+        }
+
+        int estimateJpegQuality(const char * const data, const int size) {
+
+            const auto * const bytes = reinterpret_cast<const quint8 *>(data);
+            if (size < 4 || bytes[0] != 0xff || bytes[1] != StartOfImageMarker) {
+                return -1;
+            }
+
+            // Every segment before the image data starts with a marker (0xff followed by a code, possibly after some
+            // 0xff fill bytes) and a two-byte big-endian length that includes the length bytes themselves.
+
+            auto offset = 2;
+            while (offset + 4 <= size) {
+
+                if (bytes[offset] != 0xff) {
+                    return -1;
+                }
+
+                const auto marker = bytes[offset + 1];
+                if (marker == 0xff) {
+                    ++offset;
+                    continue;
+                }
+
+                if (marker == StartOfScanMarker) {
+                    return -1;
+                }
+
+                const auto length = (bytes[offset + 2] << 8) | bytes[offset + 3];
+                const auto segmentEnd = qMin(offset + 2 + length, size);
+
+                if (marker == DefineQuantisationTableMarker) {
+
+                    // A DQT segment may hold several tables, each preceded by a byte giving its precision (8 or 16
+                    // bits per entry) in the upper nibble and its identifier in the lower. Table 0 is for luma.
+
+                    auto tableOffset = offset + 4;
+                    while (tableOffset < segmentEnd) {
+
+                        const auto precision = bytes[tableOffset] >> 4;
+                        const auto tableId = bytes[tableOffset] & 0x0f;
+                        const auto entrySize = precision == 0 ? 1 : 2;
+                        const auto tableEnd = tableOffset + 1 + 64 * entrySize;
+
+                        if (tableEnd > segmentEnd) {
+                            return -1;
+                        }
+
+                        if (tableId == 0) {
+
+                            auto tableSum = 0;
+                            for (auto entry = tableOffset + 1; entry < tableEnd; entry += entrySize) {
+                                tableSum += entrySize == 1 ? bytes[entry] : (bytes[entry] << 8) | bytes[entry + 1];
+                            }
+
+                            return qualityFromTableSum(tableSum);
+                        }
+
+                        tableOffset = tableEnd;
+                    }
+                }
+
+                offset += 2 + length;
+            }
+
+            return -1;
+        }
+
+        float lumaSharpness(const HashWorkspace& workspace) {
+
+            constexpr auto LumaSide = HashWorkspace::LumaSide;
+            constexpr auto CellCount = (LumaSide - 2) * (LumaSide - 2);
+
+            auto sum = 0.0;
+            auto sumOfSquares = 0.0;
+
+            for (auto y = 1; y < LumaSide - 1; ++y) {
+
+                const auto * const row = &workspace.luma[y * LumaSide];
+                for (auto x = 1; x < LumaSide - 1; ++x) {
+
+                    const auto laplacian = 4.0 * row[x] - row[x - 1] - row[x + 1] - row[x - LumaSide] - row[x + LumaSide];
+                    sum += laplacian;
+                    sumOfSquares += laplacian * laplacian;
+                }
+            }
+
+            const auto mean = sum / CellCount;
+            return static_cast<float>(sumOfSquares / CellCount - mean * mean);
+        }
+    }
+}
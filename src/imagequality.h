@@ -0,0 +1,76 @@
+#ifndef MYRIAD_IMAGEQUALITY_H
+#define MYRIAD_IMAGEQUALITY_H
+
+#include <QtGlobal>
+
+namespace myriad {
+    namespace processing {
+
+        struct HashWorkspace;
+
+        /**
+         * The measurements that determine which of a set of duplicate images is the best one to keep. These are all
+         * taken while an image is read and hashed, from the file data and the downscaled luma image that are already in
+         * memory at that point, so assessing quality never requires a second pass over the file.
+         */
+
+        struct ImageQuality {
+
+            /**
+             * Combines the measurements into a single score, of which higher is better. The score is only meaningful
+             * relative to those of other copies of the same image, since sharpness depends on content as well as on
+             * quality:
+             * - Each doubling of the pixel count adds 1.
+             * - Lossless encoding adds 1, and lossy encoding adds up to 1 in proportion to its estimated quality.
+             * - Each doubling of sharpness adds 0.25.
+             */
+
+            double score() const;
+
+            /**
+             * The number of pixels in the image.
+             */
+
+            qint64 pixelCount = 0;
+
+            /**
+             * The estimated JPEG quality from 1 to 100, or -1 if unknown or not a JPEG.
+             */
+
+            int jpegQuality = -1;
+
+            /**
+             * Whether the image's format stores pixels without loss.
+             */
+
+            bool lossless = false;
+
+            /**
+             * The variance of the Laplacian of the downscaled luma image.
+             */
+
+            float sharpness = 0.0f;
+        };
+
+        /**
+         * Estimates the quality setting that a JPEG file was saved with from its luma quantisation table, assuming that
+         * (as is almost universal) the table is a scaled copy of the example table from the JPEG standard, scaled as by
+         * the IJG library.
+         * @param data The contents of the file.
+         * @param size The size of @p data, in bytes.
+         * @return The estimated quality on the IJG scale of 1 to 100, or -1 if no luma quantisation table could be
+         * found before the image data.
+         */
+
+        int estimateJpegQuality(const char * data, int size);
+
+        /**
+         * Measures the sharpness of the luma image held by a workspace as the variance of its discrete Laplacian. Blur
+         * and heavy compression both reduce this, so it distinguishes good copies of an image from poor ones.
+         */
+
+        float lumaSharpness(const HashWorkspace& workspace);
+    }
+}
+
+#endif
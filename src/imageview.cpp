@@ -1,16 +1,54 @@
+#include <QEvent>
+#include <QFileInfo>
 #include <QFormLayout>
 #include <QGridLayout>
 #include <QLabel>
+#include <QMouseEvent>
+#include <QPixmap>
 #include <QStackedLayout>
 #include <QVBoxLayout>
 
+#include <KFormat>
 #include <KLocalizedString>
 
+#include "imageinfo.h"
 #include "imageview.h"
+#include "previewcache.h"
+#include "tilecache.h"
 
 namespace myriad {
     namespace ui {
         
+        namespace {
+            
+            /**
+             * Gets the name of an image format, as displayed in the details of an ImageView.
+             */
+            
+            QString formatName(const processing::ImageInfo::Format format) {
+                
+                switch (format) {
+                    
+                    case processing::ImageInfo::Format::Bmp:
+                        return QStringLiteral("BMP");
+                        
+                    case processing::ImageInfo::Format::Gif:
+                        return QStringLiteral("GIF");
+                        
+                    case processing::ImageInfo::Format::Jpeg:
+                        return QStringLiteral("JPEG");
+                        
+                    case processing::ImageInfo::Format::Png:
+                        return QStringLiteral("PNG");
+                        
+                    case processing::ImageInfo::Format::Other:
+                        break;
+                }
+                
+                return i18n("Other");
+            }
+        }
+        
         /**
          * A widget that groups together the labels used to tabulate the detail info displayed below the image preview
          * in the ImageView.
@@ -38,6 +76,21 @@ namespace myriad {
                 layout->addRow(i18n("File size:"), m_fileSizeLabel = new QLabel{});
             }
             
+            /**
+             * Fills in the labels with the details of an image.
+             */
+            
+            void setImage(const QString& path, const processing::ImageInfo& imageInfo) {
+                
+                const QFileInfo fileInfo{path};
+                m_fileNameLabel->setText(fileInfo.fileName());
+                m_dirLabel->setText(fileInfo.path());
+                m_widthLabel->setText(QString::number(imageInfo.width()));
+                m_heightLabel->setText(QString::number(imageInfo.height()));
+                m_formatLabel->setText(formatName(imageInfo.format()));
+                m_fileSizeLabel->setText(KFormat{}.formatByteSize(imageInfo.fileSize()));
+            }
+            
         private:
             
             QLabel * m_dirLabel;
@@ -74,9 +127,13 @@ namespace myriad {
                 auto * const stackLayout = new QStackedLayout{m_previewStack};
                 stackLayout->setStackingMode(QStackedLayout::StackAll);
                 
+                // Rather than having the label scale its contents, we give it a pixmap of exactly the right size
+                // whenever the widget is resized (see updatePreview()), so that the label never dictates its own size.
+                
                 stackLayout->addWidget(m_previewLabel = new QLabel{});
-                m_previewLabel->setScaledContents(true);
-                m_previewLabel->setMinimumSize(MinHeight, MinHeight);
+                m_previewLabel->setAlignment(Qt::AlignCenter);
+                m_previewLabel->setMinimumSize(MinWidth, MinHeight);
+                m_previewLabel->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
                 
                 stackLayout->addWidget(m_zoomContainer = new QWidget{});
                 stackLayout->setCurrentWidget(m_zoomContainer);
@@ -105,6 +162,64 @@ namespace myriad {
                 m_zoomContainer->hide();
             }
             
+            /**
+             * Sets the image to be previewed.
+             * @param path The path of the image file.
+             * @param imageSize The full size of the image, which the zoom overlay maps the cursor position onto.
+             */
+            
+            void setImage(const QString& path, const QSize& imageSize) {
+                
+                m_path = path;
+                m_imageSize = imageSize;
+                m_zoomLabel->hide();
+                updatePreview();
+            }
+            
+            /**
+             * Sets the cache from which previews are drawn, which the widget doesn't take ownership of.
+             */
+            
+            void setPreviewCache(processing::PreviewCache * const previewCache) {
+                
+                if (m_previewCache) {
+                    m_previewCache->disconnect(this);
+                }
+                
+                m_previewCache = previewCache;
+                if (m_previewCache) {
+                    
+                    connect(m_previewCache, &processing::PreviewCache::previewReady, this, [this](const QString& path) {
+                        if (path == m_path) {
+                            updatePreview();
+                        }
+                    });
+                }
+                
+                updatePreview();
+            }
+            
+            /**
+             * Sets the cache from which zoomed regions are drawn, which the widget doesn't take ownership of.
+             */
+            
+            void setTileCache(processing::TileCache * const tileCache) {
+                
+                if (m_tileCache) {
+                    m_tileCache->disconnect(this);
+                }
+                
+                m_tileCache = tileCache;
+                if (m_tileCache) {
+                    
+                    connect(m_tileCache, &processing::TileCache::regionReady, this, [this](const QString& path) {
+                        if (path == m_path) {
+                            updateZoom(m_zoomPosition);
+                        }
+                    });
+                }
+            }
+            
             /**
              * Shows the preview widget's zoom overlay.
              */
@@ -116,10 +231,108 @@ namespace myriad {
                 m_zoomContainer->show();
             }
             
+            /**
+             * Updates the zoom overlay for a new cursor position, showing the region of the image around the cursor at
+             * full resolution. Only the tiles of the image covering that region are decoded, in the background; the
+             * overlay is updated again once they have been. Images that the tile cache can't decode a region of are
+             * zoomed into from their largest downscaled preview instead. The overlay is hidden if the cursor is outside
+             * the preview, or if the preview is already shown at full resolution.
+             * @param position The position of the cursor, relative to the zoom container (and so to the preview).
+             */
+            
+            void updateZoom(const QPoint& position) {
+                
+                m_zoomPosition = position;
+                if (!m_tileCache || !m_previewRect.contains(position) || m_previewRect.width() >= m_imageSize.width()) {
+                    
+                    m_zoomLabel->hide();
+                    return;
+                }
+                
+                const auto scale = static_cast<double>(m_imageSize.width()) / m_previewRect.width();
+                const auto offset = position - m_previewRect.topLeft();
+                const QPoint centre{static_cast<int>(offset.x() * scale), static_cast<int>(offset.y() * scale)};
+                
+                const QRect zoomRect{centre - QPoint{ZoomSide, ZoomSide} / 2, QSize{ZoomSide, ZoomSide}};
+                const auto region = m_tileCache->decodesRegions(m_path) ? m_tileCache->region(m_path, zoomRect)
+                                                                        : previewRegion(zoomRect);
+                if (region.isNull()) {
+                    
+                    m_zoomLabel->hide();
+                    return;
+                }
+                
+                m_zoomLabel->setPixmap(QPixmap::fromImage(region));
+                m_zoomLabel->show();
+            }
+            
+        protected:
+            
+            void resizeEvent(QResizeEvent * const event) override {
+                
+                QWidget::resizeEvent(event);
+                updatePreview();
+            }
+            
         private:
             
+            /**
+             * Gets a region of the image from the largest level of its downscaled preview that is in memory, scaled up
+             * to the size of the region. This is only worth showing if the preview is larger than the one already on
+             * screen, so a null image is returned if it isn't.
+             * @param rect The region to get, in the image's pixel coordinates.
+             */
+            
+            QImage previewRegion(const QRect& rect) const {
+                
+                const auto preview = m_previewCache
+                    ? m_previewCache->preview(m_path, qMax(m_imageSize.width(), m_imageSize.height()))
+                    : QImage{};
+                if (preview.width() <= m_previewRect.width()) {
+                    return {};
+                }
+                
+                const auto scale = static_cast<double>(preview.width()) / m_imageSize.width();
+                const QRect previewRect{QPoint{qRound(rect.x() * scale), qRound(rect.y() * scale)},
+                                        QSize{qRound(rect.width() * scale), qRound(rect.height() * scale)}};
+                
+                return preview.copy(previewRect).scaled(rect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            }
+            
+            /**
+             * Redraws the preview to fit the current size of the widget. The preview cache provides a preview no more
+             * than about twice the size of the widget, so scaling it here is cheap; if the cache doesn't have a
+             * suitable preview in memory, it shows the closest one that it does have (if any) until previewReady() is
+             * emitted.
+             */
+            
+            void updatePreview() {
+                
+                const auto bounds = m_previewStack->size();
+                const auto preview = m_previewCache && !m_path.isEmpty() && !bounds.isEmpty()
+                    ? m_previewCache->preview(m_path, qMax(bounds.width(), bounds.height()))
+                    : QImage{};
+                
+                if (preview.isNull()) {
+                    
+                    m_previewLabel->clear();
+                    m_previewRect = QRect{};
+                }
+                else {
+                    
+                    const auto scaled = preview.scaled(bounds, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+                    m_previewLabel->setPixmap(QPixmap::fromImage(scaled));
+                    
+                    // The label centres the pixmap, and shares its geometry with the zoom container.
+                    
+                    m_previewRect = QRect{QPoint{0, 0}, scaled.size()};
+                    m_previewRect.moveCenter(m_previewLabel->rect().center());
+                }
+            }
+            
             static constexpr int MinHeight = 50;  /** The minimum pixel height that this image view can be displayed with. */
             static constexpr int MinWidth  = 50;  /** The minimum pixel width that this image view can be displayed with. */
+            static constexpr int ZoomSide  = 200; /** The pixel width and height of the zoom overlay. */
             
             // The hierarchy of widgets and layouts used to display the image preview is somewhat detailed, in order to
             // correctly contain and align both the preview label (which must have fixed but manually changeable size)
@@ -127,6 +340,13 @@ namespace myriad {
             
             QLabel * m_iconLabel = nullptr;  /** Label used to display the overlay icon. */
             
+            QSize m_imageSize;                                    /** The full size of the image being previewed. */
+            QString m_path;                                       /** The path of the image being previewed. */
+            processing::PreviewCache * m_previewCache = nullptr;  /** The cache that previews are drawn from. */
+            QRect m_previewRect;                                  /** Where the preview is drawn within the label. */
+            processing::TileCache * m_tileCache = nullptr;        /** The cache that zoomed regions are drawn from. */
+            QPoint m_zoomPosition;                                /** The cursor position last zoomed in on. */
+            
             QLabel * m_previewLabel;  /** Label used to display the preview itself. */
             QLabel * m_zoomLabel;     /** Label used to dislpay a zoomed preview of the image. */
             
@@ -167,5 +387,44 @@ namespace myriad {
         }
 
         ImageView::~ImageView() = default;
+        
+        bool ImageView::eventFilter(QObject * const watched, QEvent * const event) {
+            
+            // The PreviewWidget's zoom container forwards its events here (see PreviewWidget::PreviewWidget()).
+            
+            if (event->type() == QEvent::MouseMove) {
+                d->m_previewWidget->updateZoom(static_cast<QMouseEvent *>(event)->pos());
+            }
+            else if (event->type() == QEvent::Leave) {
+                d->m_previewWidget->updateZoom(QPoint{-1, -1});
+            }
+            
+            return QFrame::eventFilter(watched, event);
+        }
+        
+        void ImageView::setImage(const QString& path, const processing::ImageInfo& imageInfo) {
+            
+            d->m_titleLabel->setText(QFileInfo{path}.fileName());
+            d->m_detailsWidget->setImage(path, imageInfo);
+            d->m_previewWidget->setImage(path, QSize{imageInfo.width(), imageInfo.height()});
+        }
+        
+        void ImageView::setPreviewCache(processing::PreviewCache * const previewCache) {
+            d->m_previewWidget->setPreviewCache(previewCache);
+        }
+        
+        void ImageView::setTileCache(processing::TileCache * const tileCache) {
+            d->m_previewWidget->setTileCache(tileCache);
+        }
+        
+        void ImageView::setZoomVisible(const bool visible) {
+            
+            if (visible) {
+                d->m_previewWidget->showZoom();
+            }
+            else {
+                d->m_previewWidget->hideZoom();
+            }
+        }
     }
 }
@@ -5,6 +5,13 @@
 #include <QFrame>
 
 namespace myriad {
+    
+    namespace processing {
+        class ImageInfo;
+        class PreviewCache;
+        class TileCache;
+    }
+    
     namespace ui {
         
         /**
@@ -31,6 +38,40 @@ namespace myriad {
             
         ~ImageView();
             
+            /**
+            * Displays an image, along with information about it. The preview is drawn from the preview cache (see
+            * setPreviewCache()), so the image file is never decoded on the GUI thread.
+            * @param path The path of the image file.
+            * @param imageInfo Information about the image, as read when it was hashed.
+            */
+            
+            void setImage(const QString& path, const processing::ImageInfo& imageInfo);
+            
+            /**
+            * Sets the cache from which previews are drawn. The ImageView doesn't take ownership of the cache, which
+            * must outlive it. Until a cache is set, no preview is shown.
+            */
+            
+            void setPreviewCache(processing::PreviewCache * previewCache);
+            
+            /**
+            * Sets the cache from which the full-resolution pixels shown in the zoom overlay are drawn. The ImageView
+            * doesn't take ownership of the cache, which must outlive it. Until a cache is set, no zoom is shown.
+            */
+            
+            void setTileCache(processing::TileCache * tileCache);
+            
+            /**
+            * Sets whether hovering over the preview shows a zoomed view of the image around the cursor, at full
+            * resolution. The zoom overlay is hidden by default.
+            */
+            
+            void setZoomVisible(bool visible);
+            
+        protected:
+            
+            bool eventFilter(QObject * watched, QEvent * event) override;
+            
         private:
             
             class DetailsWidget;
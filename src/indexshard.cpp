@@ -0,0 +1,167 @@
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+
+#include "indexshard.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The magic number that identifies a shard file: "MYSH" in ASCII.
+             */
+
+            constexpr quint32 Magic = 0x4d595348;
+
+            /**
+             * The version of the layout written by IndexShard::save().
+             */
+
+            constexpr quint32 FormatVersion = 2;
+
+            /**
+             * The version of Qt's serialisation format used for shard files, which is fixed so that shards can be
+             * exchanged between machines with different versions of Qt.
+             */
+
+            constexpr auto StreamVersion = QDataStream::Qt_5_4;
+        }
+
+        bool IndexShard::append(const QString& path, const ImageInfo& image) {
+
+            if (m_paths.contains(path)) {
+                return false;
+            }
+
+            m_paths.insert(path);
+            m_entries.push_back({path, image});
+            return true;
+        }
+
+        const std::vector<IndexShard::Entry>& IndexShard::entries() const {
+            return m_entries;
+        }
+
+        bool IndexShard::load(const QString& filePath, const PathMap& pathMap, int * const duplicateCount) {
+
+            auto duplicates = 0;
+            const auto appendImage = [this, &duplicates](const QString& path, const ImageInfo& image) {
+                if (!append(path, image)) {
+                    ++duplicates;
+                }
+            };
+
+            const auto complete = read(filePath, pathMap, appendImage);
+
+            if (duplicateCount) {
+                *duplicateCount = duplicates;
+            }
+
+            return complete;
+        }
+
+        bool IndexShard::read(const QString& filePath, const PathMap& pathMap, const Visitor& visit) {
+
+            QFile file{filePath};
+            if (!file.open(QIODevice::ReadOnly)) {
+
+                qWarning("Could not open shard %s: %s", qPrintable(filePath), qPrintable(file.errorString()));
+                return false;
+            }
+
+            QDataStream stream{&file};
+            stream.setVersion(StreamVersion);
+
+            quint32 magic = 0;
+            quint32 version = 0;
+            qint32 hashBits = 0;
+            qint64 count = 0;
+            stream >> magic >> version >> hashBits >> count;
+
+            if (stream.status() != QDataStream::Ok || magic != Magic || version != FormatVersion) {
+
+                qWarning("%s is not a shard that this version of Myriad can read", qPrintable(filePath));
+                return false;
+            }
+
+            if (hashBits != PerceptualHashBits) {
+
+                qWarning("Shard %s holds %d-bit hashes, but Myriad was built for %d-bit hashes", qPrintable(filePath),
+                         hashBits, PerceptualHashBits);
+                return false;
+            }
+
+            for (qint64 i = 0; i < count; ++i) {
+
+                QString path;
+                ImageInfo image;
+                stream >> path >> image;
+
+                if (stream.status() != QDataStream::Ok) {
+
+                    qWarning("Shard %s is truncated or corrupt after %lld of %lld images", qPrintable(filePath), i,
+                             count);
+                    return false;
+                }
+
+                visit(remapPath(path, pathMap), image);
+            }
+
+            return true;
+        }
+
+        QString IndexShard::remapPath(const QString& path, const PathMap& pathMap) {
+
+            for (const auto& mapping : pathMap) {
+
+                const auto& from = mapping.first;
+                if (path.startsWith(from) && (path.size() == from.size() || path[from.size()] == QLatin1Char('/'))) {
+                    return mapping.second + path.mid(from.size());
+                }
+            }
+
+            return path;
+        }
+
+        void IndexShard::reserve(const int size) {
+
+            m_entries.reserve(size);
+            m_paths.reserve(size);
+        }
+
+        bool IndexShard::save(const QString& filePath) const {
+
+            // Shards are large and slow to build, so the file is replaced atomically: a failed or interrupted save
+            // leaves any earlier shard of the same name intact.
+
+            QSaveFile file{filePath};
+            if (!file.open(QIODevice::WriteOnly)) {
+
+                qWarning("Could not write shard %s: %s", qPrintable(filePath), qPrintable(file.errorString()));
+                return false;
+            }
+
+            QDataStream stream{&file};
+            stream.setVersion(StreamVersion);
+            stream << Magic << FormatVersion << qint32{PerceptualHashBits} << static_cast<qint64>(m_entries.size());
+
+            for (const auto& entry : m_entries) {
+                stream << entry.path << entry.image;
+            }
+
+            if (stream.status() != QDataStream::Ok || !file.commit()) {
+
+                qWarning("Could not write shard %s: %s", qPrintable(filePath), qPrintable(file.errorString()));
+                return false;
+            }
+
+            return true;
+        }
+
+        int IndexShard::size() const {
+            return static_cast<int>(m_entries.size());
+        }
+    }
+}
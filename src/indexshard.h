@@ -0,0 +1,136 @@
+#ifndef MYRIAD_INDEXSHARD_H
+#define MYRIAD_INDEXSHARD_H
+
+#include <functional>
+#include <vector>
+
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include "imageinfo.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * A self-contained index of hashed images that can be written to a file and read back elsewhere. An archive
+         * too large to hash on one machine can be split into disjoint subtrees, each hashed into a shard of its own on
+         * a different machine, and the shards then merged into a single index and searched for duplicates without any
+         * image being read again.
+         *
+         * Paths are stored as they were seen by the machine that built the shard. Since the same files are generally
+         * mounted in different places on different machines, a PathMap can be applied to them as a shard is loaded.
+         * No path appears more than once in a shard: where shards overlap, the first entry for each path is kept.
+         */
+
+        class IndexShard {
+
+        public:
+
+            /**
+             * An image in the shard.
+             */
+
+            struct Entry {
+
+                /**
+                 * The full path of the image.
+                 */
+
+                QString path;
+
+                /**
+                 * The image, as read and hashed by the machine that built the shard.
+                 */
+
+                ImageInfo image;
+            };
+
+            /**
+             * A list of substitutions of path prefixes, each mapping a directory as it was mounted on one machine to
+             * the same directory as it is mounted on another. Each path is remapped by the first substitution whose
+             * prefix is a directory containing it (or is the path itself), if any.
+             */
+
+            using PathMap = QVector<QPair<QString, QString>>;
+
+            /**
+             * The function to which read() passes each image in a shard file, with its path already remapped.
+             */
+
+            using Visitor = std::function<void(const QString& path, const ImageInfo& image)>;
+
+            /**
+             * Reads a shard file an image at a time, without holding more than one image in memory, so that shards of
+             * any size can be processed. Unlike load(), this doesn't check for paths that appear more than once.
+             * @param filePath The path of a file written by save().
+             * @param pathMap The substitutions to apply to the paths read from the file.
+             * @param visit The function to pass each image to.
+             * @return @c true if the file was read in full; @c false if it could not be read, or was written by an
+             * incompatible build of Myriad (with a different width of perceptual hash, for instance).
+             */
+
+            static bool read(const QString& filePath, const PathMap& pathMap, const Visitor& visit);
+
+            /**
+             * Applies a PathMap to a path.
+             * @return @p path with its prefix substituted, or unchanged if no substitution in @p pathMap applies.
+             */
+
+            static QString remapPath(const QString& path, const PathMap& pathMap);
+
+            /**
+             * Adds an image to the shard, unless the shard already holds an image with the same path.
+             * @return @c true if the image was added; @c false if its path was already present.
+             */
+
+            bool append(const QString& path, const ImageInfo& image);
+
+            /**
+             * Gets the images in the shard, in the order in which they were added.
+             */
+
+            const std::vector<Entry>& entries() const;
+
+            /**
+             * Adds the images from a shard file to this shard, as append() does.
+             * @param filePath The path of a file written by save().
+             * @param pathMap The substitutions to apply to the paths read from the file.
+             * @param duplicateCount If not null, receives the number of images in the file that were skipped because
+             * their (remapped) paths were already present.
+             * @return @c true if the file was read in full; @c false otherwise, as for read(). Any images read before a
+             * problem was found are kept.
+             */
+
+            bool load(const QString& filePath, const PathMap& pathMap = {}, int * duplicateCount = nullptr);
+
+            /**
+             * Reserves space for a number of images.
+             */
+
+            void reserve(int size);
+
+            /**
+             * Writes the shard to a file, replacing it atomically if it already exists.
+             * @return @c true if the file was written; @c false otherwise.
+             */
+
+            bool save(const QString& filePath) const;
+
+            /**
+             * Gets the number of images in the shard.
+             */
+
+            int size() const;
+
+        private:
+
+            std::vector<Entry> m_entries;
+            QSet<QString> m_paths;
+        };
+    }
+}
+
+#endif
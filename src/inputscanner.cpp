@@ -0,0 +1,166 @@
+#include <utility>
+
+#include <QDir>
+
+#include "inputscanner.h"
+#include "tracing.h"
+
+namespace myriad {
+    namespace processing {
+
+        InputScanner::InputScanner(QHash<QString, ImageInfo>& images, const bool stayOnFileSystem,
+                                   const FileSystem& fileSystem)
+            : m_fileSystem(fileSystem), m_images(images), m_stayOnFileSystem{stayOnFileSystem} {
+        }
+
+        void InputScanner::addInput(const QString& inputPath) {
+            addInput(inputPath, m_fileSystem.status(inputPath).id.device);
+        }
+
+        void InputScanner::addInput(const QString& inputPath, const quint64 rootDevice) {
+
+            // A single status() call tells us the file's type and FileId, and also whether it exists at all, since it
+            // fails for missing files and dangling symbolic links alike.
+
+            const auto status = m_fileSystem.status(inputPath);
+            const auto& fileId = status.id;
+            if (!status.exists() || (m_stayOnFileSystem && fileId.device != rootDevice)) {
+                return;
+            }
+
+            if (status.isFile) {
+                if (!m_images.contains(inputPath) && !recordLink(inputPath, fileId)
+                    && fileIsSupported(inputPath, m_fileSystem, m_includeRawFiles)) {
+
+                    m_filesById.insert(fileId, inputPath);
+                    m_images.insert(inputPath, ImageInfo{});
+                    m_scanOrder << inputPath;
+
+                    if (m_progressCallback) {
+                        m_progressCallback();
+                    }
+                }
+            }
+            else if (status.isDir) {
+
+                // If we have already scanned this directory by some other path, either a symbolic link has led us back
+                // into a directory that we're part way through scanning (in which case following it would recurse
+                // forever) or there are two links to the same directory (in which case scanning it again would just
+                // add links to images we already have). The recorded path is only trusted while it is still indexed,
+                // since in watch mode a removed directory's inode may be reused by a new one.
+
+                const auto dirPath = QDir::cleanPath(QDir::current().absoluteFilePath(inputPath));
+                const auto scannedPath = m_dirsById.value(fileId);
+                if (!scannedPath.isEmpty() && m_inputDirs.contains(scannedPath)) {
+                    return;
+                }
+
+                TraceSpan listSpan{"list directory"};
+                const auto entryNames = m_fileSystem.entryNames(dirPath);
+                listSpan.finish();
+
+                m_dirsById.insert(fileId, dirPath);
+                m_inputDirs.insert(dirPath);
+
+                if (m_progressCallback) {
+                    m_progressCallback();
+                }
+
+                const auto dirPrefix = dirPath + QLatin1Char('/');
+
+                auto iter = entryNames.constBegin();
+                const auto end = entryNames.constEnd();
+
+                for (; iter != end && !(m_isInterrupted && m_isInterrupted()); ++iter) {
+                    addInput(dirPrefix + *iter, rootDevice);
+                }
+            }
+        }
+
+        const QSet<QString>& InputScanner::inputDirs() const {
+            return m_inputDirs;
+        }
+
+        const QHash<QString, QStringList>& InputScanner::linkedFiles() const {
+            return m_linkedFiles;
+        }
+
+        bool InputScanner::recordLink(const QString& path, const FileId& fileId) {
+
+            // As with directories in addInput(), the path recorded for a FileId is only trusted while it is still
+            // indexed, since a deleted file's inode may since have been reused.
+
+            const auto linkedPath = m_filesById.value(fileId);
+            if (linkedPath.isEmpty() || linkedPath == path || !m_images.contains(linkedPath)) {
+                return false;
+            }
+
+            auto& links = m_linkedFiles[linkedPath];
+            if (!links.contains(path)) {
+
+                links << path;
+                if (m_linkCallback) {
+                    m_linkCallback(QStringList{linkedPath} + links);
+                }
+            }
+
+            return true;
+        }
+
+        void InputScanner::removeDirectory(const QString& dirPath) {
+
+            const auto cleanDirPath = QDir::cleanPath(dirPath);
+            const auto dirPrefix = cleanDirPath + QLatin1Char('/');
+
+            auto imageIter = m_images.begin();
+            while (imageIter != m_images.end()) {
+                if (imageIter.key().startsWith(dirPrefix)) {
+                    imageIter = m_images.erase(imageIter);
+                }
+                else {
+                    ++imageIter;
+                }
+            }
+
+            auto dirIter = m_inputDirs.begin();
+            while (dirIter != m_inputDirs.end()) {
+                if (*dirIter == cleanDirPath || dirIter->startsWith(dirPrefix)) {
+                    dirIter = m_inputDirs.erase(dirIter);
+                }
+                else {
+                    ++dirIter;
+                }
+            }
+        }
+
+        void InputScanner::setIncludeRawFiles(const bool includeRawFiles) {
+            m_includeRawFiles = includeRawFiles;
+        }
+
+        void InputScanner::setInterruptionCheck(InterruptionCheck isInterrupted) {
+            m_isInterrupted = std::move(isInterrupted);
+        }
+
+        void InputScanner::setLinkCallback(LinkCallback linkCallback) {
+            m_linkCallback = std::move(linkCallback);
+        }
+
+        void InputScanner::setProgressCallback(Callback progressCallback) {
+            m_progressCallback = std::move(progressCallback);
+        }
+
+        QStringList InputScanner::takeScanOrder() {
+
+            QStringList scanOrder;
+            scanOrder.swap(m_scanOrder);
+            return scanOrder;
+        }
+
+        bool fileIsSupported(const QString& path, const FileSystem& fileSystem, const bool includeRawFiles) {
+
+            const TraceSpan span{"detect MIME type"};
+            const auto mimeName = fileSystem.mimeTypeName(path);
+            return supportedMimeTypes(includeRawFiles).contains(mimeName.toLatin1());
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef MYRIAD_INPUTSCANNER_H
+#define MYRIAD_INPUTSCANNER_H
+
+#include <functional>
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include "fileid.h"
+#include "filesystem.h"
+#include "imageinfo.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Scans input files and directories for supported images, adding an uninitialised ImageInfo to an index for
+         * each that it finds. Files and directories are tracked by device and inode as well as by path, so each is only
+         * added once however many links lead to it, and cycles of symbolic links are not followed. Files found to be
+         * links to an image that is already indexed are recorded as such rather than being indexed again.
+         *
+         * An InputScanner has no dependencies upon the UI, so it can be driven by a ProcessorThread or used on its own
+         * (as the benchmarks do).
+         */
+
+        class InputScanner {
+
+        public:
+
+            using Callback = std::function<void()>;
+            using InterruptionCheck = std::function<bool()>;
+            using LinkCallback = std::function<void(const QStringList& paths)>;
+
+            /**
+             * Constructs an InputScanner that adds the images it finds to a specified index.
+             * @param images The index to add images to. This must outlive the InputScanner.
+             * @param stayOnFileSystem Whether to skip files and directories that reside on a different device from the
+             * top-level input that they were found within.
+             * @param fileSystem The filesystem to scan. This must outlive the InputScanner.
+             */
+
+            InputScanner(QHash<QString, ImageInfo>& images, bool stayOnFileSystem,
+                         const FileSystem& fileSystem = FileSystem::local());
+
+            /**
+             * Adds a single top-level target to the index. @p inputPath should be a filesystem path to either an image
+             * file (which will be added directly) or a directory (which will be recursively scanned for supported image
+             * files to be added).
+             */
+
+            void addInput(const QString& inputPath);
+
+            /**
+             * Adds a target to the index as addInput(const QString&) does, but as though it had been found within a
+             * top-level input residing on a specified device. This is used when rescanning part of an input tree.
+             * @param inputPath The path of the file or directory to add.
+             * @param rootDevice The device that the top-level input being scanned resides on.
+             */
+
+            void addInput(const QString& inputPath, quint64 rootDevice);
+
+            /**
+             * Gets the clean, absolute paths of all of the directories that have been scanned so far.
+             */
+
+            const QSet<QString>& inputDirs() const;
+
+            /**
+             * Gets the links that have been recorded so far, as a map from the path of each indexed image that has links
+             * to the paths of those links.
+             */
+
+            const QHash<QString, QStringList>& linkedFiles() const;
+
+            /**
+             * Removes from the index every image whose path lies within a specified directory (recursively), along with
+             * any record of that directory and its subdirectories having been scanned.
+             * @param dirPath The full filesystem path of the directory that has been removed.
+             */
+
+            void removeDirectory(const QString& dirPath);
+
+            /**
+             * Sets whether the scanner adds files in the RAW formats that can only be hashed from their embedded
+             * previews. By default, it doesn't.
+             * @see supportedMimeTypes()
+             */
+
+            void setIncludeRawFiles(bool includeRawFiles);
+
+            /**
+             * Sets a function that the scanner calls periodically to check whether it should stop scanning early.
+             */
+
+            void setInterruptionCheck(InterruptionCheck isInterrupted);
+
+            /**
+             * Sets a function that the scanner calls whenever it records a new link, with the path of the indexed image
+             * followed by those of all of its links.
+             */
+
+            void setLinkCallback(LinkCallback linkCallback);
+
+            /**
+             * Sets a function that the scanner calls whenever it adds a file to the index or scans a new directory.
+             */
+
+            void setProgressCallback(Callback progressCallback);
+
+            /**
+             * Gets the paths of all of the images added to the index since this method was last called, in the order in
+             * which they were found.
+             */
+
+            QStringList takeScanOrder();
+
+        private:
+
+            /**
+             * If @p path refers to the same file as an image that is already indexed under a different path, records
+             * @p path as a link to that image.
+             * @param path The full filesystem path of the file.
+             * @param fileId The FileId of the file at @p path.
+             * @return @c true if @p path was recorded as a link; @c false if it should be processed in its own right.
+             */
+
+            bool recordLink(const QString& path, const FileId& fileId);
+
+            QHash<FileId, QString> m_dirsById;
+            QHash<FileId, QString> m_filesById;
+            const FileSystem& m_fileSystem;
+            QHash<QString, ImageInfo>& m_images;
+            bool m_includeRawFiles = false;
+            QSet<QString> m_inputDirs;
+            InterruptionCheck m_isInterrupted;
+            LinkCallback m_linkCallback;
+            QHash<QString, QStringList> m_linkedFiles;
+            Callback m_progressCallback;
+            QStringList m_scanOrder;
+            const bool m_stayOnFileSystem;
+        };
+
+        /**
+         * Uses the MIME type of a file to determine whether it is in a supported format for processing by Myriad.
+         * @param path The full filesystem path to the file to check.
+         * @param fileSystem The filesystem on which the file resides.
+         * @param includeRawFiles Whether files in the RAW formats that can only be hashed from their embedded previews
+         * are supported.
+         * @return @c true if @p path identifies a supported image file; @c false otherwise.
+         */
+
+        bool fileIsSupported(const QString& path, const FileSystem& fileSystem = FileSystem::local(),
+                             bool includeRawFiles = false);
+    }
+}
+
+#endif
@@ -0,0 +1,275 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QStringList>
+
+#include "inputwatcher.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The set of inotify events that Myriad subscribes to for each watched directory. We deliberately avoid
+             * @c IN_MODIFY, which fires repeatedly while a file is being written, and instead wait for
+             * @c IN_CLOSE_WRITE so that files are only reported once they are complete.
+             */
+
+            constexpr uint32_t WatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF
+                                         | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+        }
+
+        InputWatcher::InputWatcher(const int pollInterval, QObject * const parent)
+            : QObject{parent},
+              m_fd{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)} {
+
+            // If no inotify instance is available (for example because the per-user instance limit has been reached),
+            // the watcher still works: every directory simply falls back to being polled.
+
+            if (m_fd >= 0) {
+
+                // QSocketNotifier::activated() is overloaded in some Qt versions, which makes it awkward to connect to
+                // via a member function pointer. So we use the traditional SIGNAL()/SLOT() syntax.
+
+                m_notifier = new QSocketNotifier{m_fd, QSocketNotifier::Read, this};
+                connect(m_notifier, SIGNAL(activated(int)), this, SLOT(readEvents()));
+            }
+
+            m_pollTimer.setInterval(pollInterval);
+            connect(&m_pollTimer, &QTimer::timeout, this, &InputWatcher::pollDirs);
+        }
+
+        InputWatcher::~InputWatcher() {
+            if (m_fd >= 0) {
+                close(m_fd);
+            }
+        }
+
+        void InputWatcher::pollDirs() {
+
+            // Handlers of our signals may start watching further directories, so we determine what has changed before
+            // emitting anything, rather than emitting while iterating over m_polledDirs. A directory's own modification
+            // time only changes when entries are added to or removed from it, so we compare each entry individually in
+            // order to catch files that have been rewritten in place.
+
+            QStringList changedDirs;
+            QStringList removedDirs;
+            QStringList changedFiles;
+            QStringList removedFiles;
+
+            auto iter = m_polledDirs.begin();
+            while (iter != m_polledDirs.end()) {
+
+                const auto dirPath = iter.key();
+                if (!QFileInfo::exists(dirPath)) {
+
+                    removedDirs << dirPath;
+                    iter = m_polledDirs.erase(iter);
+                    continue;
+                }
+
+                const auto previous = iter.value();
+                const auto current = snapshot(dirPath);
+
+                for (auto entry = current.cbegin(); entry != current.cend(); ++entry) {
+
+                    const auto previousEntry = previous.constFind(entry.key());
+                    const auto isNew = previousEntry == previous.cend() || previousEntry->isDir != entry->isDir;
+
+                    if (entry->isDir) {
+                        if (isNew) {
+                            changedDirs << entry.key();
+                        }
+                    }
+                    else if (isNew || previousEntry->size != entry->size
+                             || previousEntry->lastModified != entry->lastModified) {
+                        changedFiles << entry.key();
+                    }
+                }
+
+                for (auto entry = previous.cbegin(); entry != previous.cend(); ++entry) {
+                    if (!current.contains(entry.key())) {
+                        (entry->isDir ? removedDirs : removedFiles) << entry.key();
+                    }
+                }
+
+                iter.value() = current;
+                ++iter;
+            }
+
+            if (m_polledDirs.isEmpty()) {
+                m_pollTimer.stop();
+            }
+
+            for (const auto& dirPath : removedDirs) {
+                emit(directoryRemoved(dirPath));
+            }
+
+            for (const auto& path : removedFiles) {
+                emit(fileRemoved(path));
+            }
+
+            for (const auto& dirPath : changedDirs) {
+                emit(directoryChanged(dirPath));
+            }
+
+            for (const auto& path : changedFiles) {
+                emit(fileChanged(path));
+            }
+        }
+
+        int InputWatcher::polledDirCount() const {
+            return m_polledDirs.size();
+        }
+
+        void InputWatcher::readEvents() {
+
+            // The buffer is aligned for inotify_event so that we can safely reinterpret its contents; it is large enough
+            // to hold many events at once, so most wakeups are served by a single read() call.
+
+            alignas(inotify_event) char buffer[64 * 1024];
+
+            for (;;) {
+
+                const auto length = read(m_fd, buffer, sizeof buffer);
+                if (length <= 0) {
+                    break;
+                }
+
+                for (auto offset = std::ptrdiff_t{0}; offset < length; ) {
+
+                    const auto * const event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                    offset += sizeof(inotify_event) + event->len;
+
+                    // An overflowing event queue means that we have lost some unknown set of events, so the only safe
+                    // thing to do is ask for every watched directory to be rescanned. This is still far cheaper than a
+                    // full rescan of the input tree, since no directory listings beyond those of the watched
+                    // directories themselves are required.
+
+                    if (event->mask & IN_Q_OVERFLOW) {
+
+                        for (const auto& dirPath : m_watchedDirs.values()) {
+                            emit(directoryChanged(dirPath));
+                        }
+                        continue;
+                    }
+
+                    const auto dirPath = m_watchedDirs.value(event->wd);
+                    if (dirPath.isEmpty()) {
+                        continue;
+                    }
+
+                    // A directory that has been moved keeps its watch (under a path that we no longer know), so we
+                    // have to drop the watch explicitly rather than waiting for the kernel to do so. Anything watched
+                    // beneath it has moved too, and is dropped along with it.
+
+                    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+
+                        const auto dirPrefix = dirPath + QLatin1Char('/');
+                        for (const auto watchDescriptor : m_watchedDirs.keys()) {
+
+                            if (watchDescriptor == event->wd
+                                || m_watchedDirs.value(watchDescriptor).startsWith(dirPrefix)) {
+
+                                inotify_rm_watch(m_fd, watchDescriptor);
+                                unwatch(watchDescriptor);
+                            }
+                        }
+
+                        emit(directoryRemoved(dirPath));
+                        continue;
+                    }
+
+                    if (event->mask & IN_IGNORED) {
+
+                        unwatch(event->wd);
+                        continue;
+                    }
+
+                    if (event->len == 0) {
+                        continue;
+                    }
+
+                    const auto path = dirPath + QLatin1Char('/') + QString::fromLocal8Bit(event->name);
+                    if (event->mask & IN_ISDIR) {
+
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                            emit(directoryChanged(path));
+                        }
+                        else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                            emit(directoryRemoved(path));
+                        }
+                    }
+                    else {
+
+                        if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                            emit(fileChanged(path));
+                        }
+                        else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                            emit(fileRemoved(path));
+                        }
+                    }
+                }
+            }
+        }
+
+        InputWatcher::PolledDir InputWatcher::snapshot(const QString& dirPath) {
+
+            QDir dir{dirPath};
+            dir.setFilter(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+
+            PolledDir entries;
+            for (const auto& dirItem : dir.entryInfoList()) {
+                entries.insert(dirItem.absoluteFilePath(), {dirItem.isDir(), dirItem.size(), dirItem.lastModified()});
+            }
+
+            return entries;
+        }
+
+        void InputWatcher::unwatch(const int watchDescriptor) {
+
+            const auto dirPath = m_watchedDirs.take(watchDescriptor);
+            m_watchDescriptors.remove(dirPath);
+        }
+
+        void InputWatcher::watch(const QString& dirPath) {
+
+            const auto cleanPath = QDir::cleanPath(dirPath);
+            if (m_watchDescriptors.contains(cleanPath) || m_polledDirs.contains(cleanPath)) {
+                return;
+            }
+
+            if (m_fd >= 0) {
+
+                const auto watchDescriptor = inotify_add_watch(m_fd, QFile::encodeName(cleanPath).constData(), WatchMask);
+                if (watchDescriptor >= 0) {
+
+                    m_watchedDirs.insert(watchDescriptor, cleanPath);
+                    m_watchDescriptors.insert(cleanPath, watchDescriptor);
+                    return;
+                }
+
+                // ENOSPC indicates that the per-user watch limit (fs.inotify.max_user_watches) has been reached. Any
+                // other failure (e.g. the directory vanishing) is handled identically, since polling will detect a
+                // removed directory on its next pass.
+            }
+
+            m_polledDirs.insert(cleanPath, snapshot(cleanPath));
+            if (!m_pollTimer.isActive()) {
+                m_pollTimer.start();
+            }
+        }
+
+        int InputWatcher::watchedDirCount() const {
+            return m_watchedDirs.size();
+        }
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef MYRIAD_INPUTWATCHER_H
+#define MYRIAD_INPUTWATCHER_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+class QSocketNotifier;
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Subscribes to filesystem change notifications for a set of directories so that a ProcessorThread can keep its
+         * index of images up to date without rescanning its entire input tree. Changes are reported at the level of
+         * individual files wherever the kernel's inotify facility allows this. Directories that cannot be watched
+         * (typically because the per-user watch descriptor limit has been reached) are instead polled at a fixed
+         * interval: the size and modification time of each of their entries is compared against the previous poll, so
+         * that the same file-level signals are emitted for them, including for files that are modified in place.
+         *
+         * Since an InputWatcher delivers its signals via its thread's event loop, it must be created within the thread
+         * that will handle them, and that thread must be running an event loop.
+         */
+
+        class InputWatcher : public QObject {
+        Q_OBJECT
+
+        public:
+
+            /**
+             * Constructs an InputWatcher that is not yet watching any directories.
+             * @param pollInterval The interval, in milliseconds, at which directories that could not be watched via
+             * inotify should be checked for changes.
+             * @param parent The parent object of the InputWatcher.
+             */
+
+            explicit InputWatcher(int pollInterval, QObject * parent = nullptr);
+
+            /**
+             * Releases the inotify instance used by the InputWatcher, along with all of its watches.
+             */
+
+            ~InputWatcher();
+
+            /**
+             * Gets the number of directories that are being polled because they could not be watched via inotify.
+             */
+
+            int polledDirCount() const;
+
+            /**
+             * Starts watching a directory for changes. The directory is not watched recursively: subdirectories should
+             * be passed to this method separately. Calling this with a directory that is already being watched has no
+             * effect.
+             * @param dirPath The full filesystem path of the directory to watch.
+             */
+
+            void watch(const QString& dirPath);
+
+            /**
+             * Gets the number of directories that are being watched via inotify.
+             */
+
+            int watchedDirCount() const;
+
+        signals:
+
+            /**
+             * Emitted when the contents of a directory have changed in a way that could not be described by individual
+             * file notifications, and the directory should therefore be rescanned. This occurs for new subdirectories
+             * that appear within a watched or polled directory and for all watched directories if the kernel's event
+             * queue overflows.
+             * @param dirPath The full filesystem path of the directory to rescan.
+             */
+
+            void directoryChanged(const QString& dirPath);
+
+            /**
+             * Emitted when a watched directory (or a subdirectory of one) has been deleted or moved away.
+             * @param dirPath The full filesystem path that the directory previously occupied.
+             */
+
+            void directoryRemoved(const QString& dirPath);
+
+            /**
+             * Emitted when a file within a watched directory has been created or modified, once the process writing to
+             * it has closed it (or once it has been moved into the directory).
+             * @param path The full filesystem path of the file.
+             */
+
+            void fileChanged(const QString& path);
+
+            /**
+             * Emitted when a file within a watched directory has been deleted or moved away.
+             * @param path The full filesystem path that the file previously occupied.
+             */
+
+            void fileRemoved(const QString& path);
+
+        private slots:
+
+            /**
+             * Reads all pending events from the inotify file descriptor and emits the corresponding signals.
+             */
+
+            void readEvents();
+
+        private:
+
+            /**
+             * The state of a single entry within a polled directory, as recorded by its most recent poll.
+             */
+
+            struct PolledEntry {
+                bool isDir;
+                qint64 size;
+                QDateTime lastModified;
+            };
+
+            /**
+             * The entries of a polled directory, keyed by their full filesystem paths.
+             */
+
+            using PolledDir = QHash<QString, PolledEntry>;
+
+            /**
+             * Checks each of the directories that are being polled for entries that have been added, removed or
+             * modified since the previous poll, emitting the corresponding signals for each.
+             */
+
+            void pollDirs();
+
+            /**
+             * Lists the entries of a polled directory along with their current sizes and modification times.
+             * @param dirPath The full filesystem path of the directory.
+             */
+
+            static PolledDir snapshot(const QString& dirPath);
+
+            /**
+             * Stops watching a directory via inotify, either because it has been removed or because the kernel has
+             * dropped its watch.
+             * @param watchDescriptor The watch descriptor that identified the directory.
+             */
+
+            void unwatch(int watchDescriptor);
+
+            int m_fd = -1;
+            QSocketNotifier * m_notifier = nullptr;
+            QHash<QString, PolledDir> m_polledDirs;
+            QTimer m_pollTimer;
+            QHash<int, QString> m_watchedDirs;
+            QHash<QString, int> m_watchDescriptors;
+        };
+    }
+}
+
+#endif
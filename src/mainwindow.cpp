@@ -5,27 +5,39 @@
 #include <QByteArray>
 #include <QDir>
 #include <QFileDialog>
+#include <QHeaderView>
 #include <QIcon>
+#include <QItemSelectionModel>
+#include <QLabel>
 #include <QList>
 #include <QMimeDatabase>
 #include <QMimeType>
 #include <QPushButton>
 #include <QStandardItemModel>
+#include <QStatusBar>
 #include <QString>
 #include <QStringList>
+#include <QTimer>
 
 #include <KActionCollection>
+#include <KFormat>
 #include <KLocalizedString>
 #include <KMessageBox>
 #include <KStandardAction>
 
 #include "deduplicator.h"
 #include "imageinfo.h"
+#include "imageview.h"
 #include "mainwindow.h"
 #include "merger.h"
+#include "previewcache.h"
 #include "processor.h"
 #include "queueitem.h"
+#include "resultmodel.h"
+#include "resultstore.h"
 #include "settings.h"
+#include "throughputmetrics.h"
+#include "tilecache.h"
 #include "ui_mainwindow.h"
 
 namespace myriad {
@@ -33,6 +45,19 @@ namespace myriad {
         
         namespace {
             
+            /**
+             * The time, in milliseconds, for which transient messages are shown in the status bar.
+             */
+            
+            constexpr int StatusMessageTimeout = 5000;
+            
+            /**
+             * The largest amount of memory, in bytes, used to hold the full-resolution tiles shown by the zoom overlays
+             * of the images under review.
+             */
+            
+            constexpr qint64 TileCacheSize = 64 * 1024 * 1024;
+            
             /**
              * Generates a sequence of glob patterns that represent union of all MIME types named in a specified list.
              * The resulting pattern can be used in a name filter for a @c QFileDialog. Based upon Qt's
@@ -83,7 +108,8 @@ namespace myriad {
 
                 dialog->setFileMode(QFileDialog::ExistingFiles);
                 
-                const auto supportedPatterns = globPatternsForMimeTypes(processing::supportedMimeTypes());
+                const auto supportedPatterns = globPatternsForMimeTypes(
+                    processing::supportedMimeTypes(Settings::self()->embeddedPreviews()));
                 if (!supportedPatterns.isEmpty()) {
                     dialog->setNameFilter("All supported images(" + supportedPatterns + ")");
                 }
@@ -111,6 +137,36 @@ namespace myriad {
                 : q{q} {
             }
             
+            /**
+             * Lists a group of linked input paths under the first of them, replacing any earlier version of the group.
+             * The dock that holds the list is only shown once there is something in it.
+             * @param paths The paths that refer to the same file, starting with the one that was processed.
+             */
+            
+            void addLinkedFiles(const QStringList& paths) {
+                
+                if (paths.isEmpty()) {
+                    return;
+                }
+                
+                auto * item = m_linkedFilesModel.findItems(paths.first()).value(0);
+                if (item) {
+                    item->removeRows(0, item->rowCount());
+                }
+                else {
+                    
+                    item = new QStandardItem{paths.first()};
+                    m_linkedFilesModel.appendRow(item);
+                }
+                
+                for (auto i = 1; i < paths.size(); ++i) {
+                    item->appendRow(new QStandardItem{paths[i]});
+                }
+                
+                m_ui->linkedFilesTreeView->expand(item->index());
+                m_ui->linkedFilesDock->show();
+            }
+            
             /**
              * Adds specified files or folders to the input target list. These will be scanned for duplicates when the
              * main Myriad processing is performed.
@@ -147,6 +203,7 @@ namespace myriad {
                 auto * const addFolderAction    = new QAction{QIcon::fromTheme(QStringLiteral("folder-new")), i18n("Add Fo&lder"), q};
                 auto * const clearTargetsAction = new QAction{QIcon::fromTheme(QStringLiteral("edit-clear-list")), i18n("&Clear All Targets"), q};
                 auto * const processAction      = new QAction{QIcon::fromTheme(QStringLiteral("go-next")), i18n("Start &Processing"), q};
+                auto * const writeTraceAction   = new QAction{QIcon::fromTheme(QStringLiteral("document-save")), i18n("Write &Trace"), q};
                 
                 actions->setDefaultShortcut(addFilesAction,  Qt::CTRL + Qt::Key_O);
                 actions->setDefaultShortcut(addFolderAction, Qt::CTRL + Qt::SHIFT + Qt::Key_O);
@@ -156,11 +213,13 @@ namespace myriad {
                 actions->addAction("add-folder", addFolderAction);
                 actions->addAction("clear",      clearTargetsAction);
                 actions->addAction("process",    processAction);
+                actions->addAction("write-trace", writeTraceAction);
                 
                 connect(addFilesAction,     &QAction::triggered, [this] {addTargets(promptForInputs(configureFileInputDialog));});
                 connect(addFolderAction,    &QAction::triggered, [this] {addTargets(promptForInputs(configureFolderInputDialog));});
                 connect(clearTargetsAction, &QAction::triggered, [this] {clearAllTargets();});
-                connect(processAction,      &QAction::triggered, [this] {m_processor->start(q);});
+                connect(processAction,      &QAction::triggered, [this] {startProcessing();});
+                connect(writeTraceAction,   &QAction::triggered, [this] {writeTrace();});
                 
                 // AFAICT the new Qt signal/slot syntax (using member function pointers and/or lambdas) is not available
                 // for the KStandardAction binding functions. So we use the traditional SLOT() syntax.
@@ -177,8 +236,51 @@ namespace myriad {
                 
                 m_ui->setupUi(q);
                 m_ui->inputsListView->setModel(&m_queueModel);
+                m_ui->linkedFilesTreeView->setModel(&m_linkedFilesModel);
+                m_ui->linkedFilesDock->hide();
+                m_ui->resultsDock->hide();
+                
+                // Duplicates are reviewed by showing the anchor of the selected group beside the selected image (or the
+                // group's first member, if the group itself is selected), with previews and zoomed regions drawn from
+                // caches that both views share.
+                
+                const auto previewCacheSize = qint64{Settings::self()->previewCacheSize()} * 1024 * 1024;
+                m_previewCache = new processing::PreviewCache{processing::PreviewCache::defaultDirPath(),
+                                                              previewCacheSize, q};
+                m_tileCache = new processing::TileCache{TileCacheSize, q};
+                
+                m_anchorImageView = new ImageView{};
+                m_otherImageView  = new ImageView{};
+                
+                for (auto * const imageView : {m_anchorImageView, m_otherImageView}) {
+                    
+                    imageView->setPreviewCache(m_previewCache);
+                    imageView->setTileCache(m_tileCache);
+                    imageView->setZoomVisible(true);
+                    m_ui->resultImagesLayout->addWidget(imageView);
+                }
+                
+                // The results start unsorted, since sorting them means fetching every group from the store at once;
+                // sorting is only turned on once a header is first clicked (see startProcessing()).
+                
+                auto * const resultsHeader = m_ui->resultsTreeView->header();
+                resultsHeader->setSectionsClickable(true);
+                resultsHeader->setSortIndicatorShown(true);
+                resultsHeader->setSortIndicator(-1, Qt::AscendingOrder);
+                
+                // By the time a click is reported, the header has already moved its sort indicator to the clicked
+                // section, which is the column that enabling sorting then sorts by.
+                
+                connect(resultsHeader, &QHeaderView::sectionClicked, [this] {
+                    if (!m_ui->resultsTreeView->isSortingEnabled()) {
+                        m_ui->resultsTreeView->setSortingEnabled(true);
+                    }
+                });
                 
                 m_lastModeRadioButton = m_ui->mergeModeRadioButton;
+                
+                m_metricsLabel = new QLabel{q};
+                q->statusBar()->addPermanentWidget(m_metricsLabel);
 
                 connect(m_ui->deduplicateModeRadioButton, &QRadioButton::toggled, [this] {
                     resetProcessorIfChecked<processing::Deduplicator>(m_ui->deduplicateModeRadioButton);
@@ -215,6 +317,51 @@ namespace myriad {
                 return targetPaths;
             }
             
+            /**
+             * Publishes the duplicates that the processor has collected for review since the last refresh to the result
+             * list. The dock that holds the list is only shown once there is something in it.
+             */
+            
+            void refreshResults() {
+                
+                if (!m_resultModel) {
+                    return;
+                }
+                
+                m_resultModel->refresh();
+                if (m_resultModel->rowCount() > 0) {
+                    m_ui->resultsDock->show();
+                }
+            }
+            
+            /**
+             * Shows a pair of duplicates from the result list for review: the anchor of the group that an index belongs
+             * to, beside the image at the index (or, if the index is that of the group itself, the group's first
+             * member).
+             */
+            
+            void showResult(const QModelIndex& index) {
+                
+                if (!index.isValid() || !m_resultModel) {
+                    return;
+                }
+                
+                const auto groupIndex = index.parent().isValid() ? index.parent() : index.sibling(index.row(), 0);
+                const auto otherIndex = index.parent().isValid() && index.row() > 0
+                    ? index.sibling(index.row(), 0)
+                    : m_resultModel->index(1, 0, groupIndex);
+                
+                const auto showImage = [this](ImageView * const imageView, const QModelIndex& imageIndex) {
+                    
+                    const auto image = imageIndex.data(modelview::ImageRole).toInt();
+                    imageView->setImage(imageIndex.data(modelview::PathRole).toString(),
+                                        m_resultModel->store().imageInfo(image));
+                };
+                
+                showImage(m_anchorImageView, m_resultModel->index(0, 0, groupIndex));
+                showImage(m_otherImageView, otherIndex);
+            }
+            
             /**
              * Restores state information about the main window from the Myriad configuration file, where it should have
              * been saved when the application was last closed. This must be called after the GUI has been created and
@@ -256,6 +403,73 @@ namespace myriad {
                 settings->save();
             }
             
+            /**
+             * Clears the results of any previous run from the window and starts the current processor.
+             */
+            
+            void startProcessing() {
+                
+                m_linkedFilesModel.removeRows(0, m_linkedFilesModel.rowCount());
+                m_processor->start(q);
+                
+                // The view is given the new model before the old one is destroyed, so that it never refers to a model
+                // that no longer exists. Each run's results start unsorted, as the first run's do.
+                
+                m_ui->resultsTreeView->setSortingEnabled(false);
+                m_ui->resultsTreeView->header()->setSortIndicator(-1, Qt::AscendingOrder);
+                
+                auto resultModel = std::make_unique<modelview::ResultModel>(*m_processor->results());
+                m_ui->resultsTreeView->setModel(resultModel.get());
+                m_resultModel = std::move(resultModel);
+                m_ui->resultsDock->hide();
+                
+                connect(m_ui->resultsTreeView->selectionModel(), &QItemSelectionModel::currentChanged,
+                        [this](const QModelIndex& current) {showResult(current);});
+            }
+            
+            /**
+             * Updates the permanent status bar label that shows the throughput of the current processing phase, the
+             * time spent in it so far and, where possible, an estimate of the time remaining.
+             * @param metrics The metrics to display.
+             */
+            
+            void updateMetricsLabel(const processing::MetricsSnapshot& metrics) {
+                
+                const KFormat format;
+                QStringList parts;
+                
+                switch (metrics.phase) {
+                    
+                    case processing::Phase::Scanning:
+                        parts << i18n("%L1 files/s").arg(qRound64(metrics.filesPerSecond));
+                        break;
+                        
+                    case processing::Phase::Hashing:
+                        parts << i18n("%L1 images/s").arg(metrics.hashesPerSecond, 0, 'f', 1)
+                              << i18n("%1/s").arg(format.formatByteSize(metrics.bytesPerSecond));
+                        break;
+                        
+                    case processing::Phase::Comparing:
+                        parts << i18n("%L1 comparisons/s").arg(qRound64(metrics.comparisonsPerSecond));
+                        break;
+                        
+                    default:
+                        m_metricsLabel->clear();
+                        return;
+                }
+                
+                const auto elapsed = metrics.phaseElapsed[static_cast<int>(metrics.phase)];
+                parts << i18n("%1 elapsed").arg(format.formatDuration(static_cast<quint64>(elapsed)));
+                
+                if (metrics.eta >= 0) {
+                    
+                    const auto remaining = static_cast<quint64>(metrics.eta) * 1000;
+                    parts << i18n("about %1 remaining").arg(format.formatDuration(remaining));
+                }
+                
+                m_metricsLabel->setText(parts.join(QStringLiteral(" · ")));
+            }
+            
             /**
              * Updates the status bar text indicating the current processing phase and the number of targets that this
              * processing is acting upon.
@@ -284,6 +498,10 @@ namespace myriad {
                             action = i18n("Comparing");
                             break;
                             
+                        case processing::Phase::Watching:
+                            action = i18n("Watching");
+                            break;
+                            
                         default:
                             action = i18n("Processing");
                             break;
@@ -316,16 +534,52 @@ namespace myriad {
                 }
             }
         
+            /**
+             * Writes the processing spans traced so far to the trace file named in the settings, so that a long run can
+             * be inspected while it is still going. The outcome is reported in the status bar.
+             */
+            
+            void writeTrace() {
+                
+                const auto traceFilePath = Settings::self()->traceFile();
+                if (traceFilePath.isEmpty()) {
+                    q->statusBar()->showMessage(i18n("No trace file is set in the settings."), StatusMessageTimeout);
+                }
+                else if (!m_processor->results()) {
+                    q->statusBar()->showMessage(i18n("Nothing has been traced, as processing hasn't been started."),
+                                                StatusMessageTimeout);
+                }
+                else if (m_processor->writeTrace()) {
+                    q->statusBar()->showMessage(i18n("Wrote trace to %1").arg(traceFilePath), StatusMessageTimeout);
+                }
+                else {
+                    KMessageBox::sorry(q, i18n("Could not write trace to %1").arg(traceFilePath));
+                    return;
+                }
+                
+                // A message shown with a timeout isn't replaced by the status message afterwards, so we restore it
+                // ourselves.
+                
+                QTimer::singleShot(StatusMessageTimeout, q, [this] {updateStatusMessage();});
+            }
+            
             MainWindow * const q;
             
+            ImageView * m_anchorImageView = nullptr;
             int m_inputFileCount   = 0;
             int m_inputFolderCount = 0;
             
             QString m_lastInputDir{QDir::homePath()};
             QRadioButton * m_lastModeRadioButton = nullptr;
+            QStandardItemModel m_linkedFilesModel{0, 1};
+            QLabel * m_metricsLabel = nullptr;
+            ImageView * m_otherImageView = nullptr;
             processing::Phase m_phase = processing::Phase::Idle;
+            processing::PreviewCache * m_previewCache = nullptr;
             std::unique_ptr<processing::Processor> m_processor = std::make_unique<processing::Merger>();
             QStandardItemModel m_queueModel{0, 1};
+            std::unique_ptr<modelview::ResultModel> m_resultModel;
+            processing::TileCache * m_tileCache = nullptr;
             Ui::MainWindow * const m_ui = new Ui::MainWindow;
         };
         
@@ -347,6 +601,10 @@ namespace myriad {
             d->restoreState();
         }
         
+        void MainWindow::addLinkedFiles(const QStringList& paths) {
+            d->addLinkedFiles(paths);
+        }
+        
         QStringList MainWindow::inputs() const {
 
             QStringList result;
@@ -368,25 +626,32 @@ namespace myriad {
             }
         }
         
-        void MainWindow::setComparisonProgress(int progress) {
-            d->m_ui->comparisonProgressBar->setValue(progress);
-        }
-        
-        void MainWindow::setHashingProgress(int progress) {
-            d->m_ui->hashingProgressBar->setValue(progress);
-        }
-        
-        void MainWindow::setInputCount(const int fileCount, const int folderCount) {
-
-            d->m_inputFileCount   = fileCount;
-            d->m_inputFolderCount = folderCount;
-            d->updateStatusMessage();
+        void MainWindow::setMetrics(const processing::MetricsSnapshot& metrics) {
+            
+            d->m_ui->comparisonProgressBar->setValue(metrics.comparisonProgress);
+            d->m_ui->hashingProgressBar->setValue(metrics.hashingProgress);
+            
+            const auto fileCount = static_cast<int>(metrics.filesScanned);
+            const auto folderCount = static_cast<int>(metrics.dirsScanned);
+            if (fileCount != d->m_inputFileCount || folderCount != d->m_inputFolderCount) {
+                
+                d->m_inputFileCount   = fileCount;
+                d->m_inputFolderCount = folderCount;
+                d->updateStatusMessage();
+            }
+            
+            d->updateMetricsLabel(metrics);
+            d->refreshResults();
         }
         
         void MainWindow::setPhase(const processing::Phase phase) {
             
             d->m_phase = phase;
             d->updateStatusMessage();
+            
+            if (phase == processing::Phase::Idle) {
+                d->m_metricsLabel->clear();
+            }
         }
     }
 }
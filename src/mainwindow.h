@@ -9,6 +9,7 @@ class QStringList;
 namespace myriad {
     
     namespace processing {
+        struct MetricsSnapshot;
         enum class Phase;
     }
     
@@ -55,27 +56,23 @@ namespace myriad {
         public slots:
             
             /**
-             * Displays the completion progress of Myriad's image comparison phase.
-             * @param progress The percentage completion to display.
+             * Lists a group of input paths that all refer to the same file on disk, and so were not compared with one
+             * another. If a group starting with the same path is already listed, it is replaced, since the group grows
+             * as further links to the file are found.
+             * @param paths The paths that refer to the same file, starting with the one that was processed.
              */
             
-            void setComparisonProgress(int progress);
+            void addLinkedFiles(const QStringList& paths);
             
             /**
-             * Displays the completion progress of Myriad's image hashing processing phase.
-             * @param progress The percentage completion to display.
+             * Displays the progress of Myriad's processing: the number of files and folders scanned, the completion of
+             * the hashing and comparison phases, and (in the status bar) the current throughput and an estimate of the
+             * time remaining in the current phase. Any duplicates collected for review since the metrics were last
+             * published are added to the result list at the same time.
+             * @param metrics The metrics to display.
              */
             
-            void setHashingProgress(int progress);
-            
-            /**
-             * Sets the number of files and folders that Myriad has currently scanned for processing, and displays this
-             * information in the main UI.
-             * @param fileCount The new file count to display.
-             * @param folderCount The new folder count to display.
-             */
-            
-            void setInputCount(int fileCount, int folderCount);
+            void setMetrics(const myriad::processing::MetricsSnapshot& metrics);
             
             /**
              * Sets the current processing phase that Myriad is executing, and displays this information in the main UI.
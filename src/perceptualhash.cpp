@@ -0,0 +1,496 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <QColor>
+#include <QImage>
+#include <QVector>
+
+#include "perceptualhash.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            constexpr auto LumaSide = HashWorkspace::LumaSide;
+            constexpr auto DctSide  = HashWorkspace::DctSide;
+
+            /**
+             * The number of rows (and of bits per row) in a difference hash.
+             */
+
+            constexpr auto DifferenceHashSide = 8;
+
+            /**
+             * Samples a workspace's luma image at a fractional position, interpolating bilinearly between the four
+             * nearest cells. Positions are clamped to the image.
+             */
+
+            float bilinearLuma(const HashWorkspace& workspace, const float x, const float y) {
+
+                const auto clampedX = qBound(0.0f, x, float(LumaSide - 1));
+                const auto clampedY = qBound(0.0f, y, float(LumaSide - 1));
+
+                const auto x0 = qMin(static_cast<int>(clampedX), LumaSide - 2);
+                const auto y0 = qMin(static_cast<int>(clampedY), LumaSide - 2);
+                const auto fx = clampedX - x0;
+                const auto fy = clampedY - y0;
+
+                const auto * const row0 = &workspace.luma[y0 * LumaSide];
+                const auto * const row1 = row0 + LumaSide;
+
+                const auto top    = row0[x0] + (row0[x0 + 1] - row0[x0]) * fx;
+                const auto bottom = row1[x0] + (row1[x0 + 1] - row1[x0]) * fx;
+                return top + (bottom - top) * fy;
+            }
+
+            /**
+             * The orthonormal DCT-II basis for a signal of length HashWorkspace::LumaSide, stored row-major so that
+             * each row holds one basis function.
+             */
+
+            using DctMatrix = std::array<float, LumaSide * LumaSide>;
+
+            /**
+             * Computes the DCT basis matrix. This is only done once, when first needed.
+             */
+
+            DctMatrix createDctMatrix() {
+
+                DctMatrix matrix;
+                const auto pi = std::acos(-1.0);
+
+                for (auto u = 0; u < LumaSide; ++u) {
+
+                    const auto scale = std::sqrt((u == 0 ? 1.0 : 2.0) / LumaSide);
+                    for (auto x = 0; x < LumaSide; ++x) {
+                        matrix[u * LumaSide + x] = static_cast<float>(scale * std::cos(pi * (2 * x + 1) * u / (2 * LumaSide)));
+                    }
+                }
+
+                return matrix;
+            }
+
+            /**
+             * Computes the low-frequency DCT coefficients of the luma image held by a workspace, storing them in its
+             * @c coefficients member.
+             */
+
+            void computeDctCoefficients(HashWorkspace& workspace) {
+
+                static const auto dctMatrix = createDctMatrix();
+
+                // The 2D DCT is separable, and we only need coefficients 1 to DctSide in each direction (the DC terms
+                // carry nothing but overall brightness), so we transform the columns for just those frequencies first
+                // and then transform the rows of the much smaller result.
+
+                for (auto u = 0; u < DctSide; ++u) {
+
+                    const auto * const basis = &dctMatrix[(u + 1) * LumaSide];
+                    auto * const dctRow = &workspace.dctRows[u * LumaSide];
+
+                    std::fill(dctRow, dctRow + LumaSide, 0.0f);
+                    for (auto y = 0; y < LumaSide; ++y) {
+
+                        const auto * const lumaRow = &workspace.luma[y * LumaSide];
+                        for (auto x = 0; x < LumaSide; ++x) {
+                            dctRow[x] += basis[y] * lumaRow[x];
+                        }
+                    }
+                }
+
+                for (auto u = 0; u < DctSide; ++u) {
+
+                    const auto * const dctRow = &workspace.dctRows[u * LumaSide];
+                    for (auto v = 0; v < DctSide; ++v) {
+
+                        const auto * const basis = &dctMatrix[(v + 1) * LumaSide];
+
+                        auto coefficient = 0.0f;
+                        for (auto x = 0; x < LumaSide; ++x) {
+                            coefficient += dctRow[x] * basis[x];
+                        }
+
+                        workspace.coefficients[u * DctSide + v] = coefficient;
+                    }
+                }
+            }
+
+            /**
+             * Generates a DCT hash from a set of coefficients, with one bit recording whether each coefficient lies
+             * above their median.
+             * @param coefficients The coefficients to hash.
+             * @param workspace Scratch space, whose @c sorted member is overwritten.
+             */
+
+            PerceptualHash hashFromCoefficients(const std::array<float, DctSide * DctSide>& coefficients,
+                                                HashWorkspace& workspace) {
+
+                workspace.sorted = coefficients;
+                const auto middle = workspace.sorted.begin() + workspace.sorted.size() / 2;
+                std::nth_element(workspace.sorted.begin(), middle, workspace.sorted.end());
+                const auto median = *middle;
+
+                PerceptualHash hash;
+                for (auto i = 0; i < PerceptualHashBits; ++i) {
+                    if (coefficients[i] > median) {
+                        hash.words[i / 64] |= quint64{1} << (i % 64);
+                    }
+                }
+
+                return hash;
+            }
+
+            /**
+             * Calculates the luma of a colour value, ignoring its alpha channel.
+             */
+
+            inline float lumaFromRgb(const QRgb rgb) {
+                return 0.299f * qRed(rgb) + 0.587f * qGreen(rgb) + 0.114f * qBlue(rgb);
+            }
+
+            /**
+             * Maps a position in an image in some orientation onto the position in the original image that it is taken
+             * from, as described for OrientationCount.
+             * @param orientation The orientation.
+             * @param last The largest coordinate in the image (which must be square).
+             * @param x The horizontal coordinate, which is updated in place.
+             * @param y The vertical coordinate, which is updated in place.
+             */
+
+            template <typename T>
+            void sourcePosition(const int orientation, const T last, T& x, T& y) {
+
+                if (orientation & 1) {
+                    x = last - x;
+                }
+                if (orientation & 2) {
+                    y = last - y;
+                }
+                if (orientation & 4) {
+                    std::swap(x, y);
+                }
+            }
+
+            /**
+             * Tests whether downscaleLuma() can read pixels of a particular format directly from an image's scan lines,
+             * without first converting the image to another format.
+             */
+
+            bool isDirectlyReadable(const QImage::Format format) {
+                switch (format) {
+
+                    case QImage::Format_RGB32:
+                    case QImage::Format_ARGB32:
+                    case QImage::Format_ARGB32_Premultiplied:
+                    case QImage::Format_Grayscale8:
+                    case QImage::Format_Indexed8:
+                    case QImage::Format_RGB888:
+                        return true;
+
+                    default:
+                        return false;
+                }
+            }
+        }
+
+        constexpr int HashWorkspace::LumaSide;
+        constexpr int HashWorkspace::DctSide;
+
+        PerceptualHash dctHash(const QImage& image, HashWorkspace& workspace) {
+
+            if (image.isNull()) {
+                return {};
+            }
+
+            downscaleLuma(image, workspace);
+            return dctHashFromLuma(workspace);
+        }
+
+        PerceptualHash dctHashFromLuma(HashWorkspace& workspace) {
+
+            computeDctCoefficients(workspace);
+            return hashFromCoefficients(workspace.coefficients, workspace);
+        }
+
+        OrientedPerceptualHashes dctHashesFromLuma(HashWorkspace& workspace) {
+
+            computeDctCoefficients(workspace);
+
+            OrientedPerceptualHashes hashes;
+            hashes[0] = hashFromCoefficients(workspace.coefficients, workspace);
+
+            for (auto orientation = 1; orientation < OrientationCount; ++orientation) {
+
+                // Row u and column v of the coefficients hold frequencies u + 1 and v + 1, so the coefficients that
+                // change sign when mirroring are those with an even index.
+
+                const auto transpose = (orientation & 4) != 0;
+                for (auto u = 0; u < DctSide; ++u) {
+                    for (auto v = 0; v < DctSide; ++v) {
+
+                        const auto mirrored = ((orientation & 1) && v % 2 == 0) != ((orientation & 2) && u % 2 == 0);
+                        const auto coefficient = workspace.coefficients[transpose ? v * DctSide + u : u * DctSide + v];
+                        workspace.oriented[u * DctSide + v] = mirrored ? -coefficient : coefficient;
+                    }
+                }
+
+                hashes[orientation] = hashFromCoefficients(workspace.oriented, workspace);
+            }
+
+            return hashes;
+        }
+
+        quint64 differenceHashFromLuma(const HashWorkspace& workspace, const int orientation) {
+
+            // Each row of 9 samples gives 8 bits. The samples are taken bilinearly at the centres of a 9x8 grid laid
+            // over the luma image, which is itself already area-averaged, so no detail is aliased.
+
+            constexpr auto SampleColumns = DifferenceHashSide + 1;
+
+            quint64 hash = 0;
+            quint64 bit  = 1;
+
+            for (auto row = 0; row < DifferenceHashSide; ++row) {
+
+                std::array<float, SampleColumns> samples;
+                const auto y = (row + 0.5f) * LumaSide / DifferenceHashSide - 0.5f;
+
+                for (auto column = 0; column < SampleColumns; ++column) {
+                    auto sourceX = (column + 0.5f) * LumaSide / SampleColumns - 0.5f;
+                    auto sourceY = y;
+                    sourcePosition(orientation, float(LumaSide - 1), sourceX, sourceY);
+                    samples[column] = bilinearLuma(workspace, sourceX, sourceY);
+                }
+
+                for (auto column = 0; column < DifferenceHashSide; ++column) {
+
+                    if (samples[column + 1] > samples[column]) {
+                        hash |= bit;
+                    }
+                    bit <<= 1;
+                }
+            }
+
+            return hash;
+        }
+
+        OrientedHashes differenceHashesFromLuma(const HashWorkspace& workspace) {
+
+            OrientedHashes hashes;
+            for (auto orientation = 0; orientation < OrientationCount; ++orientation) {
+                hashes[orientation] = differenceHashFromLuma(workspace, orientation);
+            }
+
+            return hashes;
+        }
+
+        void downscaleLuma(const QImage& image, HashWorkspace& workspace) {
+
+            // Formats that we can't read directly are rare in practice (the image plugins for all of the common formats
+            // decode to one of those that we can), so the allocation that a conversion entails is acceptable here.
+
+            const auto source = isDirectlyReadable(image.format()) ? image : image.convertToFormat(QImage::Format_RGB32);
+            const auto width  = source.width();
+            const auto height = source.height();
+            const auto format = source.format();
+
+            // The luma of each palette entry of an indexed image is worked out once, into the workspace, rather than
+            // copying the image's colour table and converting an entry for every pixel.
+
+            if (format == QImage::Format_Indexed8) {
+
+                const auto colorCount = source.colorCount();
+                for (auto i = 0; i < static_cast<int>(workspace.paletteLuma.size()); ++i) {
+                    workspace.paletteLuma[i] = i < colorCount ? lumaFromRgb(source.color(i)) : 0.0f;
+                }
+            }
+
+            workspace.luma.fill(0.0f);
+            workspace.lumaWeights.fill(0.0f);
+
+            auto& columnCells = workspace.columnCells;
+            columnCells.resize(width);
+            for (auto x = 0; x < width; ++x) {
+                columnCells[x] = x * LumaSide / width;
+            }
+
+            for (auto y = 0; y < height; ++y) {
+
+                const auto cellOffset = (y * LumaSide / height) * LumaSide;
+                auto * const lumaRow   = &workspace.luma[cellOffset];
+                auto * const weightRow = &workspace.lumaWeights[cellOffset];
+                const auto * const line = source.constScanLine(y);
+
+                switch (format) {
+
+                    case QImage::Format_Grayscale8:
+                        for (auto x = 0; x < width; ++x) {
+                            lumaRow[columnCells[x]] += line[x];
+                            weightRow[columnCells[x]] += 1.0f;
+                        }
+                        break;
+
+                    case QImage::Format_Indexed8:
+                        for (auto x = 0; x < width; ++x) {
+                            lumaRow[columnCells[x]] += workspace.paletteLuma[line[x]];
+                            weightRow[columnCells[x]] += 1.0f;
+                        }
+                        break;
+
+                    case QImage::Format_RGB888:
+                        for (auto x = 0; x < width; ++x) {
+                            lumaRow[columnCells[x]] += lumaFromRgb(qRgb(line[3 * x], line[3 * x + 1], line[3 * x + 2]));
+                            weightRow[columnCells[x]] += 1.0f;
+                        }
+                        break;
+
+                    default: {
+
+                        const auto * const pixels = reinterpret_cast<const QRgb *>(line);
+                        for (auto x = 0; x < width; ++x) {
+                            lumaRow[columnCells[x]] += lumaFromRgb(pixels[x]);
+                            weightRow[columnCells[x]] += 1.0f;
+                        }
+                        break;
+                    }
+                }
+            }
+
+            for (auto cellY = 0; cellY < LumaSide; ++cellY) {
+                for (auto cellX = 0; cellX < LumaSide; ++cellX) {
+
+                    const auto cell = cellY * LumaSide + cellX;
+                    if (workspace.lumaWeights[cell] > 0.0f) {
+                        workspace.luma[cell] /= workspace.lumaWeights[cell];
+                    }
+                    else {
+
+                        // No source pixel fell within this cell, which happens when the image is smaller than the
+                        // downscaled image in that dimension.
+
+                        const auto x = (2 * cellX + 1) * width / (2 * LumaSide);
+                        const auto y = (2 * cellY + 1) * height / (2 * LumaSide);
+                        workspace.luma[cell] = lumaFromRgb(source.pixel(x, y));
+                    }
+                }
+            }
+        }
+
+        ImageHashes hashImage(const QImage& image, HashWorkspace& workspace) {
+
+            ImageHashes hashes;
+            if (image.isNull()) {
+                return hashes;
+            }
+
+            downscaleLuma(image, workspace);
+
+            hashes.dctHashes        = dctHashesFromLuma(workspace);
+            hashes.differenceHashes = differenceHashesFromLuma(workspace);
+            hashes.thumbnail        = thumbnailFromLuma(workspace);
+            return hashes;
+        }
+
+        Thumbnail orientedThumbnail(const Thumbnail& thumbnail, const int orientation) {
+
+            Thumbnail oriented;
+            for (auto y = 0; y < ThumbnailSide; ++y) {
+                for (auto x = 0; x < ThumbnailSide; ++x) {
+
+                    auto sourceX = x;
+                    auto sourceY = y;
+                    sourcePosition(orientation, ThumbnailSide - 1, sourceX, sourceY);
+                    oriented[y * ThumbnailSide + x] = thumbnail[sourceY * ThumbnailSide + sourceX];
+                }
+            }
+
+            return oriented;
+        }
+
+        PopcountTarget popcountTarget() {
+
+#ifdef MYRIAD_POPCOUNT_DISPATCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("avx512vl")) {
+                return PopcountTarget::Avx512;
+            }
+            if (__builtin_cpu_supports("popcnt")) {
+                return PopcountTarget::Popcnt;
+            }
+#endif
+
+            return PopcountTarget::Generic;
+        }
+
+        double structuralSimilarity(const Thumbnail& lhs, const Thumbnail& rhs) {
+
+            // The standard SSIM constants for 8-bit data: (0.01 * 255)^2 and (0.03 * 255)^2.
+
+            constexpr auto C1 = 6.5025;
+            constexpr auto C2 = 58.5225;
+            constexpr auto WindowSide   = 8;
+            constexpr auto WindowStride = 4;
+            constexpr auto WindowPixels = WindowSide * WindowSide;
+
+            auto total = 0.0;
+            auto windowCount = 0;
+
+            for (auto top = 0; top + WindowSide <= ThumbnailSide; top += WindowStride) {
+                for (auto left = 0; left + WindowSide <= ThumbnailSide; left += WindowStride) {
+
+                    // The sums are accumulated in integers over fixed-length rows, which compilers vectorise well.
+
+                    int sumL = 0, sumR = 0, sumLL = 0, sumRR = 0, sumLR = 0;
+                    for (auto y = top; y < top + WindowSide; ++y) {
+
+                        const auto * const rowL = &lhs[y * ThumbnailSide + left];
+                        const auto * const rowR = &rhs[y * ThumbnailSide + left];
+
+                        for (auto x = 0; x < WindowSide; ++x) {
+
+                            const int l = rowL[x];
+                            const int r = rowR[x];
+                            sumL  += l;
+                            sumR  += r;
+                            sumLL += l * l;
+                            sumRR += r * r;
+                            sumLR += l * r;
+                        }
+                    }
+
+                    const auto meanL = double(sumL) / WindowPixels;
+                    const auto meanR = double(sumR) / WindowPixels;
+                    const auto varianceL  = double(sumLL) / WindowPixels - meanL * meanL;
+                    const auto varianceR  = double(sumRR) / WindowPixels - meanR * meanR;
+                    const auto covariance = double(sumLR) / WindowPixels - meanL * meanR;
+
+                    total += ((2 * meanL * meanR + C1) * (2 * covariance + C2))
+                           / ((meanL * meanL + meanR * meanR + C1) * (varianceL + varianceR + C2));
+                    ++windowCount;
+                }
+            }
+
+            return total / windowCount;
+        }
+
+        Thumbnail thumbnailFromLuma(const HashWorkspace& workspace) {
+
+            Thumbnail thumbnail;
+            for (auto y = 0; y < ThumbnailSide; ++y) {
+
+                const auto * const row0 = &workspace.luma[2 * y * LumaSide];
+                const auto * const row1 = row0 + LumaSide;
+
+                for (auto x = 0; x < ThumbnailSide; ++x) {
+
+                    const auto mean = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1]) * 0.25f;
+                    thumbnail[y * ThumbnailSide + x] = static_cast<quint8>(qBound(0.0f, mean + 0.5f, 255.0f));
+                }
+            }
+
+            return thumbnail;
+        }
+    }
+}
@@ -0,0 +1,362 @@
+#ifndef MYRIAD_PERCEPTUALHASH_H
+#define MYRIAD_PERCEPTUALHASH_H
+
+#include <array>
+#include <vector>
+
+#include <QtGlobal>
+
+class QImage;
+
+// The width of the perceptual hashes generated for images, which must be the square of a whole number of DCT
+// coefficients per side. This is normally set by the MYRIAD_HASH_BITS CMake option.
+
+#ifndef MYRIAD_HASH_BITS
+#define MYRIAD_HASH_BITS 64
+#endif
+
+// The baseline x86-64 target has no popcount instruction, so __builtin_popcountll compiles to a library call unless
+// the code around it is compiled for a richer target. Kernels that count differing bits in bulk are therefore compiled
+// once more for each of these targets, and the best that the processor supports is chosen at run time (see
+// popcountTarget()). Other compilers and architectures only get the generic kernels.
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MYRIAD_POPCOUNT_DISPATCH
+#define MYRIAD_TARGET_POPCNT __attribute__((target("popcnt")))
+#define MYRIAD_TARGET_AVX512_POPCOUNT __attribute__((target("popcnt,avx512f,avx512vl,avx512vpopcntdq")))
+#endif
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * A hash of a fixed number of bits, which is stored as an array of 64-bit words so that all of the kernels
+         * working on it can be specialised for its width at compile time. The all-zero hash is reserved to mean that
+         * no hash could be generated.
+         */
+
+        template <int Bits>
+        struct WideHash {
+
+            static_assert(Bits > 0 && Bits % 64 == 0, "hashes must be made up of whole 64-bit words");
+            static constexpr int WordCount = Bits / 64;
+
+            /**
+             * Tests whether this is the all-zero hash.
+             */
+
+            bool isNull() const {
+
+                quint64 bits = 0;
+                for (const auto word : words) {
+                    bits |= word;
+                }
+                return bits == 0;
+            }
+
+            /**
+             * The bits of the hash, least significant word first.
+             */
+
+            std::array<quint64, WordCount> words{};
+        };
+
+        /**
+         * The width of the perceptual hashes generated for images.
+         */
+
+        constexpr int PerceptualHashBits = MYRIAD_HASH_BITS;
+
+        /**
+         * The type of the perceptual hashes generated for images.
+         */
+
+        using PerceptualHash = WideHash<PerceptualHashBits>;
+
+        /**
+         * Calculates the side length of the square of DCT coefficients that gives a hash of a particular width, or
+         * @c 0 if there is no such square.
+         */
+
+        constexpr int dctSideForBits(const int bits) {
+
+            auto side = 1;
+            while (side * side < bits) {
+                ++side;
+            }
+            return side * side == bits ? side : 0;
+        }
+
+        /**
+         * The scratch space needed to generate a perceptual hash from a decoded image. All of the intermediate buffers
+         * are either of fixed size or only ever grow, so a HashWorkspace that is reused across many images settles into
+         * performing no allocations at all.
+         */
+
+        struct HashWorkspace {
+
+            /**
+             * The side length of the downscaled luma image that is hashed.
+             */
+
+            static constexpr int LumaSide = 32;
+
+            /**
+             * The side length of the block of DCT coefficients kept, each of which gives one bit of the hash.
+             */
+
+            static constexpr int DctSide = dctSideForBits(PerceptualHashBits);
+
+            static_assert(DctSide > 0 && DctSide < LumaSide, "MYRIAD_HASH_BITS must be 64, 256 or 576");
+
+            /**
+             * The luma of the image being hashed, downscaled to LumaSide pixels square.
+             */
+
+            std::array<float, LumaSide * LumaSide> luma;
+
+            /**
+             * The number of source pixels summed into each cell of @c luma.
+             */
+
+            std::array<float, LumaSide * LumaSide> lumaWeights;
+
+            /**
+             * The luma of each entry of the colour table of an indexed image, so that it needn't be converted for every
+             * pixel.
+             */
+
+            std::array<float, 256> paletteLuma;
+
+            /**
+             * The luma image after the DCT has been applied to its rows.
+             */
+
+            std::array<float, DctSide * LumaSide> dctRows;
+
+            /**
+             * The low-frequency DCT coefficients of the luma image.
+             */
+
+            std::array<float, DctSide * DctSide> coefficients;
+
+            /**
+             * The DCT coefficients of the luma image as they would be for some other orientation of the image.
+             */
+
+            std::array<float, DctSide * DctSide> oriented;
+
+            /**
+             * A copy of @c coefficients that is partially sorted to find their median.
+             */
+
+            std::array<float, DctSide * DctSide> sorted;
+
+            /**
+             * The column of @c luma that each column of the source image is summed into.
+             */
+
+            std::vector<int> columnCells;
+        };
+
+        /**
+         * The number of orientations in which every image is hashed: the four rotations by multiples of 90 degrees and
+         * their mirror images. In orientation @c k, the pixel at (x, y) is taken from the original image at (x', y'),
+         * where x' and y' are x and y mirrored if bits 0 and 1 of @c k are set respectively, and then swapped if bit 2
+         * is set. Orientation @c 0 is thus the image as decoded.
+         */
+
+        constexpr int OrientationCount = 8;
+
+        /**
+         * A hash of an image in each of its orientations, indexed by orientation.
+         */
+
+        using OrientedHashes = std::array<quint64, OrientationCount>;
+
+        /**
+         * A perceptual hash of an image in each of its orientations, indexed by orientation.
+         */
+
+        using OrientedPerceptualHashes = std::array<PerceptualHash, OrientationCount>;
+
+        /**
+         * The side length of the luma thumbnails kept for structural similarity checks.
+         */
+
+        constexpr int ThumbnailSide = HashWorkspace::LumaSide / 2;
+
+        /**
+         * A small 8-bit luma image, stored row-major.
+         */
+
+        using Thumbnail = std::array<quint8, ThumbnailSide * ThumbnailSide>;
+
+        /**
+         * Everything that is derived from a single downscaled image for the purpose of comparing it with others.
+         */
+
+        struct ImageHashes {
+
+            /**
+             * The gradient hashes generated by differenceHashesFromLuma().
+             */
+
+            OrientedHashes differenceHashes{};
+
+            /**
+             * The DCT hashes generated by dctHashesFromLuma().
+             */
+
+            OrientedPerceptualHashes dctHashes{};
+
+            /**
+             * The thumbnail generated by thumbnailFromLuma().
+             */
+
+            Thumbnail thumbnail{};
+        };
+
+        /**
+         * Generates a perceptual hash of an image, by a scheme modelled on pHash's DCT hash: the image is reduced to a
+         * 32x32 luma image, the lowest HashWorkspace::DctSide square of non-DC coefficients of its discrete cosine
+         * transform is computed, and each bit of the hash records whether one of these lies above their median; wider
+         * hashes keep more coefficients. The hashes are not compatible with pHash's, even at 64 bits: the luma weights
+         * and the area-averaging downscale differ from pHash's, and there is no 7x7 mean filter before it, so hashes
+         * stored in shards can only be compared with other hashes made by Myriad.
+         * @param image The decoded image to hash.
+         * @param workspace Scratch space for the computation. On return, its @c luma member holds the downscaled luma
+         * image.
+         * @return The perceptual hash of @p image, or the null hash if @p image is null.
+         */
+
+        PerceptualHash dctHash(const QImage& image, HashWorkspace& workspace);
+
+        /**
+         * Generates the DCT hash of the luma image already held by a workspace, as dctHash() does.
+         */
+
+        PerceptualHash dctHashFromLuma(HashWorkspace& workspace);
+
+        /**
+         * Generates the DCT hash of the luma image already held by a workspace in every orientation. The coefficients
+         * are only computed once: transposing an image transposes its DCT coefficients, and mirroring it negates those
+         * of odd frequency in the mirrored direction, so the coefficients for each other orientation are just a
+         * permutation of the originals with some signs flipped.
+         */
+
+        OrientedPerceptualHashes dctHashesFromLuma(HashWorkspace& workspace);
+
+        /**
+         * Generates a 64-bit gradient ("dHash") of the luma image already held by a workspace. The luma image is
+         * resampled to 9x8, and each bit records whether brightness increases from one sample to the next along a row.
+         * This is much less discriminating than the DCT hash, but it is independent of it, so requiring both to match
+         * weeds out pairs that only one of them mistakes for duplicates.
+         * @param workspace The workspace holding the luma image.
+         * @param orientation The orientation in which to hash the luma image.
+         */
+
+        quint64 differenceHashFromLuma(const HashWorkspace& workspace, int orientation = 0);
+
+        /**
+         * Generates the difference hash of the luma image already held by a workspace in every orientation. Since the
+         * samples are taken from the luma image by position, reorienting it costs nothing beyond the sampling itself.
+         */
+
+        OrientedHashes differenceHashesFromLuma(const HashWorkspace& workspace);
+
+        /**
+         * Generates every hash of an image from a single downscale: its DCT and difference hashes in every orientation
+         * and its thumbnail. All are zero if @p image is null.
+         */
+
+        ImageHashes hashImage(const QImage& image, HashWorkspace& workspace);
+
+        /**
+         * Reorients a thumbnail.
+         * @param thumbnail The thumbnail to reorient.
+         * @param orientation The orientation to transform @p thumbnail into, as described for OrientationCount.
+         */
+
+        Thumbnail orientedThumbnail(const Thumbnail& thumbnail, int orientation);
+
+        /**
+         * Calculates the mean structural similarity (SSIM) index of two thumbnails, over 8x8 windows at a stride of 4.
+         * @return A value of at most @c 1.0, which is reached only by identical thumbnails. Unrelated images score
+         * close to @c 0.0.
+         */
+
+        double structuralSimilarity(const Thumbnail& lhs, const Thumbnail& rhs);
+
+        /**
+         * Reduces the luma image already held by a workspace to a Thumbnail, by averaging each 2x2 block.
+         */
+
+        Thumbnail thumbnailFromLuma(const HashWorkspace& workspace);
+
+        /**
+         * Reduces an image to a HashWorkspace::LumaSide square luma image, stored in @p workspace, by averaging the
+         * luma of all of the pixels that fall within each cell. Images smaller than this are point-sampled instead.
+         * @param image The decoded image to reduce, which must not be null.
+         * @param workspace Scratch space that receives the result in its @c luma member.
+         */
+
+        void downscaleLuma(const QImage& image, HashWorkspace& workspace);
+
+        /**
+         * The targets for which kernels that count differing bits in bulk are compiled, as described for
+         * MYRIAD_POPCOUNT_DISPATCH.
+         */
+
+        enum class PopcountTarget {
+            Generic,
+            Popcnt,
+            Avx512
+        };
+
+        /**
+         * Gets the best PopcountTarget that the processor supports: Avx512 if it has the AVX-512 VPOPCNTDQ extension
+         * (which counts the bits of eight words at once), Popcnt if it has the scalar POPCNT instruction, and Generic
+         * otherwise or if the kernels aren't dispatched at all.
+         */
+
+        PopcountTarget popcountTarget();
+
+        /**
+         * Counts the number of bits that differ between two hashes. This is a single instruction only where it is
+         * inlined into a kernel compiled for a target with POPCNT; anywhere else it is a library call, which is fine
+         * for comparing one pair at a time.
+         */
+
+        inline int hammingDistance(const quint64 lhs, const quint64 rhs) {
+            return __builtin_popcountll(lhs ^ rhs);
+        }
+
+        /**
+         * Counts the number of bits that differ between two wide hashes. The word count is a compile-time constant, so
+         * the loop is fully unrolled; inlined into a kernel compiled for the Avx512 target, the words are combined
+         * with vector XOR and popcount instructions.
+         */
+
+        template <int Bits>
+        inline int hammingDistance(const WideHash<Bits>& lhs, const WideHash<Bits>& rhs) {
+
+            auto distance = 0;
+            for (auto i = 0; i < WideHash<Bits>::WordCount; ++i) {
+                distance += __builtin_popcountll(lhs.words[i] ^ rhs.words[i]);
+            }
+            return distance;
+        }
+
+        /**
+         * Counts the number of bits that differ between two 64-bit wide hashes, exactly as for plain 64-bit hashes.
+         */
+
+        template <>
+        inline int hammingDistance(const WideHash<64>& lhs, const WideHash<64>& rhs) {
+            return __builtin_popcountll(lhs.words[0] ^ rhs.words[0]);
+        }
+    }
+}
+
+#endif
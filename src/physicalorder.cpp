@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QFile>
+
+#include "physicalorder.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * Codes describing how precisely the physical location of a file is known, in order of decreasing
+             * precision. Within a device, files located more precisely are read first.
+             */
+
+            enum class Precision {
+                Extent,
+                Inode,
+                ScanOrder
+            };
+
+            /**
+             * The key by which files are sorted into physical order.
+             */
+
+            struct LayoutKey {
+
+                quint64 device = 0;
+                Precision precision = Precision::ScanOrder;
+                quint64 position = 0;
+                int scanIndex = 0;
+            };
+
+            bool operator<(const LayoutKey& lhs, const LayoutKey& rhs) {
+                return std::tie(lhs.device, lhs.precision, lhs.position, lhs.scanIndex)
+                     < std::tie(rhs.device, rhs.precision, rhs.position, rhs.scanIndex);
+            }
+
+            /**
+             * Uses the FIEMAP ioctl to find the physical offset on disk of the first extent of an open file.
+             * @param fd A file descriptor for the file to examine.
+             * @param offset Set to the physical offset of the file's first extent, in bytes, if this can be found.
+             * @return @c true if the offset was found; @c false if FIEMAP is unsupported or the file has no extent with a
+             * known physical location.
+             */
+
+            bool firstExtentOffset(const int fd, quint64& offset) {
+
+                // struct fiemap ends with a flexible array of extents, so we allocate room for exactly one of these
+                // alongside it.
+
+                alignas(fiemap) char buffer[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+                auto * const map = reinterpret_cast<fiemap *>(buffer);
+
+                map->fm_start = 0;
+                map->fm_length = FIEMAP_MAX_OFFSET;
+                map->fm_extent_count = 1;
+
+                if (ioctl(fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0) {
+                    return false;
+                }
+
+                const auto& extent = map->fm_extents[0];
+                if (extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE)) {
+                    return false;
+                }
+
+                offset = extent.fe_physical;
+                return true;
+            }
+
+            /**
+             * Determines the key by which a file should be sorted into physical order.
+             * @param path The path of the file.
+             * @param scanIndex The position of @p path within the list being sorted.
+             */
+
+            LayoutKey layoutKeyFromPath(const QString& path, const int scanIndex) {
+
+                LayoutKey key;
+                key.scanIndex = scanIndex;
+
+                const auto fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    return key;
+                }
+
+                struct stat status;
+                if (fstat(fd, &status) == 0) {
+
+                    key.device = status.st_dev;
+                    if (firstExtentOffset(fd, key.position)) {
+                        key.precision = Precision::Extent;
+                    }
+                    else {
+                        key.precision = Precision::Inode;
+                        key.position = status.st_ino;
+                    }
+                }
+
+                close(fd);
+                return key;
+            }
+        }
+
+        QStringList sortByPhysicalLocation(const QStringList& paths) {
+
+            std::vector<LayoutKey> keys;
+            keys.reserve(paths.size());
+
+            for (auto i = 0; i < paths.size(); ++i) {
+                keys.push_back(layoutKeyFromPath(paths[i], i));
+            }
+
+            std::sort(keys.begin(), keys.end());
+
+            QStringList sortedPaths;
+            sortedPaths.reserve(paths.size());
+
+            for (const auto& key : keys) {
+                sortedPaths << paths[key.scanIndex];
+            }
+
+            return sortedPaths;
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef MYRIAD_PHYSICALORDER_H
+#define MYRIAD_PHYSICALORDER_H
+
+#include <QStringList>
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Reorders a list of files so that reading them in sequence moves through each disk in a single sweep, rather
+         * than seeking back and forth across it. This makes a large difference to throughput on rotational media, for
+         * which the order of a directory listing (let alone of a hash table) bears little relation to where each file's
+         * data actually reside.
+         *
+         * Files are grouped by device, then ordered by the physical offset of their first extent as reported by the
+         * FIEMAP ioctl. Files for which FIEMAP is unavailable (e.g. on filesystems that don't implement it, or for data
+         * stored inline in the inode) are ordered by inode number instead, which most filesystems allocate roughly in
+         * step with data blocks. Files that cannot be examined at all keep their position relative to one another in
+         * @p paths.
+         *
+         * @param paths The paths to reorder, which should be in the order in which they were found when scanning (i.e.
+         * directory order), since this is used as the final fallback.
+         * @return The paths from @p paths, in physical order.
+         */
+
+        QStringList sortByPhysicalLocation(const QStringList& paths);
+    }
+}
+
+#endif
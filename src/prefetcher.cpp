@@ -0,0 +1,178 @@
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutexLocker>
+
+#include "prefetcher.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The number of seconds of reading, at the throughput measured so far, that the prefetcher tries to keep
+             * queued ahead of the consumer.
+             */
+
+            constexpr double LeadTime = 2.0;
+
+            /**
+             * The most files that are queued ahead of the consumer at once, which limits the window when files are
+             * tiny.
+             */
+
+            constexpr int MaxFilesAhead = 256;
+
+            /**
+             * The most bytes that are queued ahead of the consumer at once, however fast the storage is.
+             */
+
+            constexpr qint64 MaxBytesAhead = 256 * 1024 * 1024;
+
+            /**
+             * The fewest bytes that are queued ahead of the consumer, however slow the storage is.
+             */
+
+            constexpr qint64 MinBytesAhead = 8 * 1024 * 1024;
+
+            /**
+             * The size of the smallest file whose read time is used to measure throughput: smaller files are dominated
+             * by seek and open times, so don't give useful timings.
+             */
+
+            constexpr qint64 MinSampleSize = 64 * 1024;
+
+            /**
+             * The weight given to each new throughput sample in the exponential moving average of throughput.
+             */
+
+            constexpr double SampleWeight = 0.2;
+
+            /**
+             * Asks the kernel to read the whole of a file into the page cache.
+             * @param path The path of the file to prefetch.
+             * @return The size of the file in bytes, or @c 0 if it could not be opened.
+             */
+
+            qint64 prefetchFile(const QString& path) {
+
+                const auto fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    return 0;
+                }
+
+                qint64 size = 0;
+
+                struct stat status;
+                if (fstat(fd, &status) == 0) {
+
+                    // readahead() doesn't return until the data have been queued for reading, which is what lets us
+                    // measure throughput. Not every filesystem supports it, though, so we fall back to the purely
+                    // advisory (and asynchronous) posix_fadvise() where it fails.
+
+                    size = status.st_size;
+                    if (readahead(fd, 0, static_cast<size_t>(size)) != 0) {
+                        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                    }
+                }
+
+                close(fd);
+                return size;
+            }
+        }
+
+        Prefetcher::Prefetcher(QStringList paths)
+            : m_endOffsets{0}, m_paths{std::move(paths)} {
+        }
+
+        Prefetcher::~Prefetcher() {
+            stop();
+        }
+
+        qint64 Prefetcher::bytesAhead() const {
+            return m_endOffsets[m_issued] - m_endOffsets[qMin(m_position, m_issued)];
+        }
+
+        void Prefetcher::run() {
+
+            for (;;) {
+
+                QString path;
+                {
+                    QMutexLocker locker{&m_mutex};
+                    while (!m_stopped && m_issued < m_paths.size()
+                        && (m_issued - m_position >= MaxFilesAhead || bytesAhead() >= targetBytesAhead())) {
+
+                        m_waitCond.wait(&m_mutex);
+                    }
+
+                    // Files that the consumer has already reached are no longer worth prefetching; we record them as
+                    // empty so that they don't count towards the window.
+
+                    while (m_issued < m_position && m_issued < m_paths.size()) {
+                        m_endOffsets.append(m_endOffsets.last());
+                        ++m_issued;
+                    }
+
+                    if (m_stopped || m_issued >= m_paths.size()) {
+                        return;
+                    }
+
+                    path = m_paths[m_issued];
+                }
+
+                QElapsedTimer timer;
+                timer.start();
+
+                const auto size = prefetchFile(path);
+                const auto elapsed = timer.nsecsElapsed();
+
+                QMutexLocker locker{&m_mutex};
+                m_endOffsets.append(m_endOffsets.last() + size);
+                ++m_issued;
+
+                if (size >= MinSampleSize && elapsed > 0) {
+
+                    const auto sample = static_cast<double>(size) * 1.0e9 / static_cast<double>(elapsed);
+                    m_throughput = m_throughput > 0.0 ? (1.0 - SampleWeight) * m_throughput + SampleWeight * sample
+                                                      : sample;
+                }
+            }
+        }
+
+        void Prefetcher::setPosition(const int index) {
+
+            QMutexLocker locker{&m_mutex};
+            if (index > m_position) {
+
+                m_position = index;
+                m_waitCond.wakeAll();
+            }
+        }
+
+        void Prefetcher::stop() {
+            {
+                QMutexLocker locker{&m_mutex};
+                m_stopped = true;
+                m_waitCond.wakeAll();
+            }
+
+            wait();
+        }
+
+        qint64 Prefetcher::targetBytesAhead() const {
+
+            if (m_throughput <= 0.0) {
+                return MinBytesAhead;
+            }
+
+            return qBound(MinBytesAhead, static_cast<qint64>(m_throughput * LeadTime), MaxBytesAhead);
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef MYRIAD_PREFETCHER_H
+#define MYRIAD_PREFETCHER_H
+
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * A thread that reads ahead of a hashing worker through a queue of files, asking the kernel to pull each of
+         * them into the page cache before the worker opens it. This lets disk I/O for upcoming files overlap with the
+         * decoding and hashing of the current one, so that the worker rarely has to wait on the disk.
+         *
+         * The distance that the Prefetcher runs ahead is measured in bytes rather than files, and adapts to the read
+         * throughput it observes: it aims to keep roughly LeadTime worth of reading queued up, within fixed bounds.
+         * Running ahead any further would only risk the page cache evicting prefetched data before it is used.
+         */
+
+        class Prefetcher : public QThread {
+
+        public:
+
+            /**
+             * Constructs a Prefetcher for a specified hashing queue. The Prefetcher does nothing until start() is
+             * called.
+             * @param paths The paths of the files to prefetch, in the order in which they will be read.
+             */
+
+            explicit Prefetcher(QStringList paths);
+
+            /**
+             * Interrupts the Prefetcher and waits for it to finish.
+             */
+
+            ~Prefetcher();
+
+            /**
+             * Informs the Prefetcher that the consumer is about to read a certain file, so that it can move its window
+             * forward accordingly. Positions only ever move forwards: passing an index lower than one passed previously
+             * has no effect.
+             * @param index The index of the file (within the queue passed to the constructor) that is about to be read.
+             */
+
+            void setPosition(int index);
+
+            /**
+             * Stops the Prefetcher as soon as it has finished with the file it is currently prefetching, and waits for
+             * it to finish.
+             */
+
+            void stop();
+
+        protected:
+
+            /**
+             * Prefetches files from the queue, keeping within the current window ahead of the consumer's position,
+             * until either the whole queue has been prefetched or stop() is called.
+             */
+
+            void run() override final;
+
+        private:
+
+            /**
+             * Gets the number of bytes that have been prefetched but not yet reached by the consumer. The mutex must be
+             * held when this is called.
+             */
+
+            qint64 bytesAhead() const;
+
+            /**
+             * Gets the number of bytes that the Prefetcher should currently aim to keep ahead of the consumer, based
+             * upon the throughput it has measured so far. The mutex must be held when this is called.
+             */
+
+            qint64 targetBytesAhead() const;
+
+            QVector<qint64> m_endOffsets;
+            int m_issued = 0;
+            QMutex m_mutex;
+            const QStringList m_paths;
+            int m_position = 0;
+            bool m_stopped = false;
+            double m_throughput = 0.0;
+            QWaitCondition m_waitCond;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,303 @@
+#include <functional>
+#include <limits>
+#include <utility>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "imageinfo.h"
+#include "previewcache.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The quality with which opaque previews are saved to disk.
+             */
+
+            constexpr int PreviewJpegQuality = 85;
+
+            /**
+             * A task that loads previews on a worker thread within a @c QThreadPool.
+             */
+
+            class LoadingTask : public QRunnable {
+
+            public:
+
+                explicit LoadingTask(std::function<void()> function)
+                    : m_function{std::move(function)} {
+                }
+
+                void run() override {
+                    m_function();
+                }
+
+            private:
+
+                const std::function<void()> m_function;
+            };
+
+            /**
+             * Gets the name under which the previews of a particular version of an image are stored in the disk tier.
+             * This covers the file's size and modification time as well as its path, so that previews of an image that
+             * has since changed are never used (and, being unreachable, are eventually cleared out with the rest of the
+             * user's cache).
+             */
+
+            QString diskKey(const QString& path, const qint64 fileSize, const QDateTime& lastModified) {
+
+                QCryptographicHash hash{QCryptographicHash::Sha1};
+                hash.addData(path.toUtf8());
+                hash.addData(QByteArray::number(fileSize));
+                hash.addData(QByteArray::number(lastModified.toMSecsSinceEpoch() / 1000));
+                return QString::fromLatin1(hash.result().toHex());
+            }
+
+            /**
+             * Gets the path of the file holding one level of an image's pyramid in the disk tier.
+             */
+
+            QString levelFilePath(const QString& dirPath, const QString& key, const int level) {
+                return dirPath + QLatin1Char('/') + key + QLatin1Char('-') + QString::number(level);
+            }
+
+            /**
+             * Gets the number of levels needed by the pyramid of an image of a certain size: enough that the highest
+             * level is the image itself or larger than any view that it would need to fill.
+             */
+
+            int levelCountForSize(const QSize& size) {
+
+                const auto longestSide = qMax(size.width(), size.height());
+
+                auto levelCount = 1;
+                while (levelCount < PreviewCache::LevelCount && PreviewCache::levelSide(levelCount - 1) < longestSide) {
+                    ++levelCount;
+                }
+
+                return levelCount;
+            }
+
+            /**
+             * Saves a preview to the disk tier, atomically so that other readers never see a partially written file.
+             * Previews are saved as JPEG to keep the disk tier small, unless they need an alpha channel.
+             */
+
+            void saveLevel(const QImage& image, const QString& filePath) {
+
+                const auto hasAlpha = image.hasAlphaChannel();
+
+                QSaveFile file{filePath};
+                if (!file.open(QIODevice::WriteOnly) || !image.save(&file, hasAlpha ? "PNG" : "JPG",
+                                                                    hasAlpha ? -1 : PreviewJpegQuality)
+                    || !file.commit()) {
+                    qWarning("Could not write preview file %s", qPrintable(filePath));
+                }
+            }
+
+            /**
+             * Scales an image down to fit one level of a pyramid, or returns it unchanged if it already fits. Large
+             * reductions are made in two steps, a fast one to twice the final size followed by a smooth one, which
+             * looks almost as good as smoothing the whole way at a fraction of the cost.
+             */
+
+            QImage scaledToLevel(const QImage& image, const int level) {
+
+                const auto side = PreviewCache::levelSide(level);
+                const auto longestSide = qMax(image.width(), image.height());
+
+                if (longestSide <= side) {
+                    return image;
+                }
+
+                const auto intermediate = longestSide > 4 * side
+                    ? image.scaled(2 * side, 2 * side, Qt::KeepAspectRatio, Qt::FastTransformation)
+                    : image;
+
+                return intermediate.scaled(side, side, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            }
+        }
+
+        constexpr int PreviewCache::LevelCount;
+        constexpr int PreviewCache::SmallestSide;
+
+        PreviewCache::PreviewCache(const QString& dirPath, const qint64 memoryBudget, QObject * const parent)
+            : QObject{parent},
+              m_dirPath{dirPath},
+              m_images{static_cast<int>(qMin<qint64>(memoryBudget / 1024, std::numeric_limits<int>::max()))} {
+
+            QDir{}.mkpath(m_dirPath);
+
+            qRegisterMetaType<QVector<QImage>>();
+            connect(this, &PreviewCache::pyramidLoaded, this, &PreviewCache::storePyramid);
+        }
+
+        PreviewCache::~PreviewCache() {
+            m_workers.waitForDone();
+        }
+
+        QString PreviewCache::defaultDirPath() {
+            return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/previews");
+        }
+
+        int PreviewCache::levelForSide(const int side) {
+
+            auto level = 0;
+            while (level < LevelCount - 1 && levelSide(level) < side) {
+                ++level;
+            }
+
+            return level;
+        }
+
+        int PreviewCache::levelSide(const int level) {
+            return SmallestSide << level;
+        }
+
+        void PreviewCache::load(const QString& path, const int level) {
+
+            m_pendingPaths << path;
+            m_workers.start(new LoadingTask{[this, path, level] {
+
+                const QFileInfo fileInfo{path};
+                const auto key = diskKey(path, fileInfo.size(), fileInfo.lastModified());
+
+                // Reading the size of the image only requires its header, so we can find out how many levels its
+                // pyramid has (and so whether the level we want exists) without decoding it.
+
+                QImageReader reader{path};
+                const auto size = reader.size();
+                const auto levelCount = size.isValid() ? levelCountForSize(size) : LevelCount;
+                const auto wantedLevel = qMin(level, levelCount - 1);
+
+                QVector<QImage> levels;
+                for (auto i = 0; i <= wantedLevel; ++i) {
+
+                    QImage image;
+                    if (!image.load(levelFilePath(m_dirPath, key, i))) {
+                        break;
+                    }
+                    levels << image;
+                }
+
+                if (levels.size() > wantedLevel) {
+
+                    emit(pyramidLoaded(path, levels, levelCount, true));
+                    return;
+                }
+
+                // Whatever lower levels we found can be shown while the rest of the pyramid is generated.
+
+                if (!levels.isEmpty()) {
+                    emit(pyramidLoaded(path, levels, levelCount, false));
+                }
+
+                // The whole pyramid is generated from a single decode at the size of its highest level, which plugins
+                // that support scaled decoding can produce far more cheaply than the full image.
+
+                const auto topSide = levelSide(levelCount - 1);
+                if (size.isValid() && qMax(size.width(), size.height()) > topSide) {
+                    reader.setScaledSize(size.scaled(topSide, topSide, Qt::KeepAspectRatio));
+                }
+
+                QImage decoded;
+                if (!reader.read(&decoded)) {
+
+                    emit(pyramidLoaded(path, {}, levelCount, true));
+                    return;
+                }
+
+                levels.resize(levelCount);
+                levels[levelCount - 1] = scaledToLevel(decoded, levelCount - 1);
+                for (auto i = levelCount - 2; i >= 0; --i) {
+                    levels[i] = scaledToLevel(levels[i + 1], i);
+                }
+
+                for (auto i = 0; i < levelCount; ++i) {
+                    saveLevel(levels[i], levelFilePath(m_dirPath, key, i));
+                }
+
+                levels.resize(wantedLevel + 1);
+                emit(pyramidLoaded(path, levels, levelCount, true));
+            }});
+        }
+
+        QImage PreviewCache::preview(const QString& path, const int side) {
+
+            const auto wantedLevel = qMin(levelForSide(side), m_levelCounts.value(path, LevelCount) - 1);
+            if (const auto * const image = m_images.object({path, wantedLevel})) {
+                return *image;
+            }
+
+            if (!m_pendingPaths.contains(path) && !m_unreadablePaths.contains(path)) {
+                load(path, wantedLevel);
+            }
+
+            // Until the level we want is available, we show the closest one we have, preferring larger levels (which
+            // will merely be scaled down a little further) to smaller ones.
+
+            for (auto level = wantedLevel + 1; level < LevelCount; ++level) {
+                if (const auto * const image = m_images.object({path, level})) {
+                    return *image;
+                }
+            }
+
+            for (auto level = wantedLevel - 1; level >= 0; --level) {
+                if (const auto * const image = m_images.object({path, level})) {
+                    return *image;
+                }
+            }
+
+            return {};
+        }
+
+        void PreviewCache::seed(const QString& dirPath, const QString& path, const ImageInfo& imageInfo,
+                                const QImage& decoded) {
+
+            if (decoded.isNull()) {
+                return;
+            }
+
+            const auto key = diskKey(path, imageInfo.fileSize(), imageInfo.lastModified());
+            const auto filePath = levelFilePath(dirPath, key, 0);
+            if (!QFile::exists(filePath)) {
+
+                QDir{}.mkpath(dirPath);
+                saveLevel(scaledToLevel(decoded, 0), filePath);
+            }
+        }
+
+        void PreviewCache::storePyramid(const QString& path, const QVector<QImage>& levels, const int levelCount,
+                                        const bool finished) {
+
+            m_levelCounts[path] = levelCount;
+            if (finished) {
+                m_pendingPaths.remove(path);
+            }
+
+            if (levels.isEmpty()) {
+
+                m_unreadablePaths << path;
+                return;
+            }
+
+            for (auto level = 0; level < levels.size(); ++level) {
+
+                const auto& image = levels[level];
+                m_images.insert({path, level}, new QImage{image}, image.bytesPerLine() * image.height() / 1024);
+            }
+
+            emit(previewReady(path));
+        }
+    }
+}
@@ -0,0 +1,176 @@
+#ifndef MYRIAD_PREVIEWCACHE_H
+#define MYRIAD_PREVIEWCACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+namespace myriad {
+    namespace processing {
+
+        class ImageInfo;
+
+        /**
+         * Caches downscaled previews of images so that they can be displayed without decoding (let alone scaling) the
+         * original files on the GUI thread. Each image has a small pyramid of previews, whose longest sides are
+         * successive doublings of that of the smallest, so that a view of any size can be drawn from a preview that is
+         * only a little larger than itself.
+         *
+         * Previews are kept in two tiers: a size-limited in-memory cache, and a directory on disk that persists between
+         * runs. A preview that is in neither is generated in the background from a single decode of the original,
+         * which asks the image plugin for a reduced size where it can decode one cheaply (as the JPEG plugin can). The
+         * smallest level can also be written to the disk tier while images are hashed, from the image that was decoded
+         * to hash it, by seed(); it is then shown in place of the larger levels while they are generated.
+         *
+         * A PreviewCache must be used from the thread that it lives in, except for seed(), which may be called from
+         * any thread.
+         */
+
+        class PreviewCache : public QObject {
+        Q_OBJECT
+
+        public:
+
+            /**
+             * The number of levels in each image's pyramid.
+             */
+
+            static constexpr int LevelCount = 4;
+
+            /**
+             * The longest side of the smallest level, in pixels.
+             */
+
+            static constexpr int SmallestSide = 256;
+
+            /**
+             * Gets the default location of the disk tier, within the user's cache directory.
+             */
+
+            static QString defaultDirPath();
+
+            /**
+             * Gets the lowest level of the pyramid whose previews are at least a certain size, or the highest level if
+             * none is that large.
+             */
+
+            static int levelForSide(int side);
+
+            /**
+             * Gets the longest side of the previews at one level of the pyramid, in pixels.
+             */
+
+            static int levelSide(int level);
+
+            /**
+             * Writes the smallest level of an image's pyramid to the disk tier, unless it is already there, from a
+             * decoded copy of the image that is already in memory. This is thread-safe.
+             * @param dirPath The directory holding the disk tier.
+             * @param path The path of the image.
+             * @param imageInfo The image's details, as read alongside @p decoded.
+             * @param decoded The decoded image. Nothing is written if this is null.
+             */
+
+            static void seed(const QString& dirPath, const QString& path, const ImageInfo& imageInfo,
+                             const QImage& decoded);
+
+            /**
+             * Constructs an empty cache.
+             * @param dirPath The directory holding the disk tier, which is created if necessary.
+             * @param memoryBudget The largest amount of memory that the in-memory tier may use, in bytes.
+             * @param parent The parent object of the cache.
+             */
+
+            PreviewCache(const QString& dirPath, qint64 memoryBudget, QObject * parent = nullptr);
+
+            /**
+             * Destroys the cache, after waiting for any previews that are being generated.
+             */
+
+            ~PreviewCache();
+
+            /**
+             * Gets the preview of an image that best suits a view of a particular size, if it is in memory. If it
+             * isn't, it is loaded or generated in the background, and previewReady() is emitted once it has been;
+             * meanwhile, the closest level that is in memory is returned.
+             * @param path The path of the image.
+             * @param side The longest side of the view that the preview will be drawn in, in pixels.
+             * @return The preview, or a null image if there is no level of the image's pyramid in memory yet.
+             */
+
+            QImage preview(const QString& path, int side);
+
+        signals:
+
+            /**
+             * Emitted once a level of an image's pyramid that preview() didn't have in memory has been loaded.
+             * @param path The path of the image.
+             */
+
+            void previewReady(const QString& path);
+
+            /**
+             * Emitted by a background task once it has loaded or generated some of the levels of an image's pyramid.
+             * This is only used to pass the levels back to the thread that the cache lives in.
+             * @param path The path of the image.
+             * @param levels The levels, lowest first. This is empty if the image couldn't be read.
+             * @param levelCount The number of levels in the image's full pyramid, which is fewer than LevelCount if the
+             * image is too small to need them all.
+             * @param finished Whether the task is done. A task that has to generate the level it was asked for first
+             * reports any lower levels that it found on disk, so that they can be shown in the meantime.
+             */
+
+            void pyramidLoaded(const QString& path, const QVector<QImage>& levels, int levelCount, bool finished);
+
+        private:
+
+            /**
+             * Starts loading a level of an image's pyramid in the background, from the disk tier if it is there or by
+             * generating the pyramid otherwise. Any lower levels that are on disk are loaded first.
+             */
+
+            void load(const QString& path, int level);
+
+            /**
+             * Stores levels that have been loaded in the background in the in-memory tier.
+             */
+
+            void storePyramid(const QString& path, const QVector<QImage>& levels, int levelCount, bool finished);
+
+            const QString m_dirPath;
+
+            /**
+             * The in-memory tier, keyed by path and level.
+             */
+
+            QCache<QPair<QString, int>, QImage> m_images;
+
+            /**
+             * The number of levels in each loaded image's pyramid.
+             */
+
+            QHash<QString, int> m_levelCounts;
+
+            /**
+             * Images that are being loaded in the background.
+             */
+
+            QSet<QString> m_pendingPaths;
+
+            /**
+             * Images that couldn't be read, so aren't retried.
+             */
+
+            QSet<QString> m_unreadablePaths;
+            QThreadPool m_workers;
+        };
+    }
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include "processor.h"
 #include "processorthread.h"
 #include "settings.h"
+#include "throughputmetrics.h"
 
 namespace myriad {
     namespace processing {
@@ -31,6 +32,7 @@ namespace myriad {
                 static auto registered = false;
                 if (!registered) {
                 
+                    qRegisterMetaType<myriad::processing::MetricsSnapshot>("myriad::processing::MetricsSnapshot");
                     qRegisterMetaType<myriad::processing::Phase>("myriad::processing::Phase");
                     registered = true;
                 }
@@ -51,6 +53,10 @@ namespace myriad {
             return m_thread && m_thread->isRunning();
         }
 
+        const ResultStore * Processor::results() const {
+            return m_thread ? &m_thread->results() : nullptr;
+        }
+        
         void Processor::saveState(Settings * const settings) const {
             settings->setProcessingMode(settingsMode());
         }
@@ -61,10 +67,9 @@ namespace myriad {
             
             m_thread = createThread(mainWindow);
             
+            QObject::connect(m_thread, &ProcessorThread::linkedFilesFound, mainWindow, &ui::MainWindow::addLinkedFiles);
             QObject::connect(m_thread, &ProcessorThread::phaseChanged, mainWindow, &ui::MainWindow::setPhase);
-            QObject::connect(m_thread, &ProcessorThread::inputCountChanged, mainWindow, &ui::MainWindow::setInputCount);
-            QObject::connect(m_thread, &ProcessorThread::hashingProgressChanged, mainWindow, &ui::MainWindow::setHashingProgress);
-            QObject::connect(m_thread, &ProcessorThread::comparisonProgressChanged, mainWindow, &ui::MainWindow::setComparisonProgress);
+            QObject::connect(m_thread, &ProcessorThread::metricsChanged, mainWindow, &ui::MainWindow::setMetrics);
             
             m_thread->start();
         }
@@ -89,5 +94,9 @@ namespace myriad {
                 return true;
             }
         }
+        
+        bool Processor::writeTrace() const {
+            return m_thread && m_thread->writeTrace();
+        }
     }
 }
@@ -19,17 +19,20 @@ namespace myriad {
     namespace processing {
         
         class ProcessorThread;
+        class ResultStore;
         
         /**
          * Codes that identify what phase of execution Myriad is current in. @c Idle is the state when no worker thread
-         * is running; the other three states correspond to various actions performed by the worker thread.
+         * is running; the other states correspond to various actions performed by the worker thread. @c Watching is only
+         * entered when watch mode is enabled, after the initial comparison has completed.
          */
         
         enum class Phase {
            Idle,
            Scanning,
            Hashing,
-           Comparing
+           Comparing,
+           Watching
         };
         
         /**
@@ -113,6 +116,14 @@ namespace myriad {
             
             bool isBusy() const;
             
+            /**
+             * Gets the duplicates collected for review by the Processor's most recently started worker thread, which
+             * go on being added to while it runs.
+             * @return The thread's results, or @c nullptr if no thread has been started.
+             */
+            
+            const ResultStore * results() const;
+            
             /**
              * Saves state information about the current processing mode to the application settings so that they can be
              * restored upon the next run.
@@ -140,6 +151,15 @@ namespace myriad {
             
             bool stopThen(std::function<void()> callback);
             
+            /**
+             * Writes the spans traced so far by the Processor's worker thread to the trace file configured in the
+             * settings, without waiting for the thread to finish.
+             * @return @c true if the trace file was written; @c false if no thread has been started, if the thread was
+             * started without a trace file, or if the trace file could not be written.
+             */
+            
+            bool writeTrace() const;
+            
         private:
             
             /**
@@ -1,12 +1,28 @@
+#include <vector>
+
 #include <QDir>
-#include <QFileInfo>
-#include <QMimeDatabase>
+#include <QMetaMethod>
 #include <QMutexLocker>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
 
+#include "cascadesettings.h"
+#include "filesystem.h"
+#include "hashindex.h"
+#include "imagehasher.h"
 #include "imageinfo.h"
+#include "inputscanner.h"
+#include "inputwatcher.h"
 #include "mainwindow.h"
+#include "previewcache.h"
 #include "processor.h"
 #include "processorthread.h"
+#include "scratchbuffers.h"
+#include "settings.h"
+#include "throughputmetrics.h"
+#include "tracing.h"
 
 namespace myriad {
     namespace processing {
@@ -14,160 +30,354 @@ namespace myriad {
         namespace {
             
             /**
-             * Uses the MIME type of a file on disk to determine whether it is in a supported format for processing by
-             * Myriad.
-             * @param path The full filesystem path to the file to check.
-             * @return @c true if @p path identifies a supported image file; @c false otherwise.
+             * The period, in milliseconds, at which a thread running an event loop in watch mode checks whether an
+             * interruption has been requested.
              */
             
-            bool fileIsSupported(const QString& path) {
-                
-                QMimeDatabase mimeDb;
-                const auto mimeName = mimeDb.mimeTypeForFile(path).name();
-                return supportedMimeTypes().contains(mimeName.toLatin1());
+            constexpr int InterruptionCheckPeriod = 250;
+            
+            /**
+             * The period, in milliseconds, at which a thread that is waiting for a duplicate to be resolved checks
+             * whether an interruption has been requested.
+             */
+            
+            constexpr unsigned long ResolutionCheckPeriod = 100;
+            
+            /**
+             * The minimum period, in milliseconds, between rewrites of the metrics file.
+             */
+            
+            constexpr qint64 MetricsFilePeriod = 1000;
+            
+            /**
+             * The period, in milliseconds, at which metricsChanged() is emitted while the thread is running.
+             */
+            
+            constexpr int PublishPeriod = 100;
+            
+            /**
+             * Tests whether a path refers to an entry that lies directly within a specified directory (as opposed to
+             * within one of its subdirectories).
+             * @param path The full path of the entry to check.
+             * @param dirPrefix The full path of the directory, including a trailing separator.
+             */
+            
+            bool isDirectChild(const QString& path, const QString& dirPrefix) {
+                return path.startsWith(dirPrefix) && path.indexOf(QLatin1Char('/'), dirPrefix.size()) == -1;
             }
             
             /**
-             * Calculates @p numerator / @p denominator as a percentage, rounded to the nearest 1%.
+             * Gets the path of the directory that contains an entry, without examining the filesystem.
+             * @param path The full, clean path of the entry.
              */
             
-            int intPercentage(const int numerator, const int denominator) {
-                return static_cast<int>(100.0f * static_cast<float>(numerator) / static_cast<float>(denominator) + 0.5f);
+            QString parentPath(const QString& path) {
+                
+                const auto separator = path.lastIndexOf(QLatin1Char('/'));
+                return separator > 0 ? path.left(separator) : QStringLiteral("/");
             }
         }
         
-        ProcessorThread::ProcessorThread(ui::MainWindow * const mainWindow)
-            : QThread{mainWindow}, m_mainWindow{mainWindow} {
-        }
-        
-        void ProcessorThread::addInput(const QString& inputPath) {
+        ProcessorThread::ProcessorThread(ui::MainWindow * const mainWindow, const FileSystem& fileSystem)
+            : QThread{mainWindow},
+              m_cascade{cascadeFromSettings()},
+              m_decodeMemoryBudget{qint64{Settings::self()->decodeMemoryBudget()} * 1024 * 1024},
+              m_deferReview{Settings::self()->deferReview()},
+              m_fileSystem(fileSystem),
+              m_hashingThreadCount{Settings::self()->hashingThreads() > 0 ? Settings::self()->hashingThreads()
+                                                                           : QThread::idealThreadCount()},
+              m_mainWindow{mainWindow},
+              m_metricsFilePath{Settings::self()->metricsFile()},
+              m_physicalHashingOrder{Settings::self()->hashingOrder() == Settings::EnumHashingOrder::Physical},
+              m_pixelDigests{Settings::self()->pixelDigests()},
+              m_prefetch{Settings::self()->prefetch()},
+              m_previewCacheDirPath{Settings::self()->seedPreviewCache() ? PreviewCache::defaultDirPath() : QString{}},
+              m_resolutionLog{Settings::self()->resolutionLogFile()},
+              m_resolutionPolicy{ResolutionPolicy::fromRules(Settings::self()->resolutionRules())},
+              m_scanner{m_images, Settings::self()->stayOnFileSystem(), m_fileSystem},
+              m_traceFilePath{Settings::self()->traceFile()},
+              m_useEmbeddedPreviews{Settings::self()->embeddedPreviews()},
+              m_watchInputs{Settings::self()->watchInputs()},
+              m_watchPollInterval{Settings::self()->watchPollInterval() * 1000} {
             
-            const QFileInfo fileInfo{inputPath};
-            if (fileInfo.exists()) {
-
-                if (fileInfo.isFile()) {
-                    if (fileIsSupported(inputPath) && !m_images.contains(inputPath)) {
-                        
-                        m_images.insert(inputPath, ImageInfo{});
-                        emitInputCount();
-                    }
-                }
-                else if (fileInfo.isDir()) {
-                    
-                    QDir dir{inputPath};
-                    dir.setFilter(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
-                    
-                    const auto dirItems = dir.entryInfoList();
-                    ++m_inputFolderCount;
-                    emitInputCount();
-                    
-                    auto iter = dirItems.constBegin();
-                    const auto end = dirItems.constEnd();
-                    
-                    for (; iter != end && !isInterruptionRequested(); ++iter) {
-                        addInput(iter->absoluteFilePath());
-                    }
-                }
-            }
+            m_scanner.setIncludeRawFiles(m_useEmbeddedPreviews);
+            m_scanner.setInterruptionCheck([this] {return isInterruptionRequested();});
+            m_scanner.setProgressCallback([this] {updateInputCount();});
+            
+            // The timer belongs to the thread that constructed this object, rather than to the processing thread, so
+            // that snapshots are published at the same rate however busy the processing thread is. The started() and
+            // finished() signals are emitted from the processing thread, so these connections are queued.
+            
+            m_publishTimer.setInterval(PublishPeriod);
+            connect(&m_publishTimer, &QTimer::timeout, this, [this] {publishMetrics();});
+            connect(this, &QThread::started, &m_publishTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+            connect(this, &QThread::finished, this, [this] {
+                m_publishTimer.stop();
+                publishMetrics(true);
+            });
         }
         
+        // Even though we don't take any action within the destructor, it is necessary to define it explicitly here. If
+        // we don't, the compiler provides an inline version in the header file, at which point the InputWatcher type
+        // used by the m_watcher pointer is incomplete.
+        
+        ProcessorThread::~ProcessorThread() = default;
+        
         void ProcessorThread::addInputs(const QStringList& inputPaths) {
+            
+            const TraceSpan span{"scan inputs"};
             for (const auto& inputPath : inputPaths) {
-                addInput(inputPath);
+                m_scanner.addInput(inputPath);
             }
         }
         
-        void ProcessorThread::compareImages() {
+        void ProcessorThread::compareImage(const QString& path) {
             
-            auto comparisonsMade = 0;
-            const auto totalComparisonCount = comparisonCount();
-            auto lastComparisonProgress = 0;
+            const TraceSpan span{"compare image"};
+            const auto iter1 = m_images.find(path);
+            if (iter1 == m_images.end() || iter1.value().isNull()) {
+                return;
+            }
             
-            auto iter1 = m_images.constBegin();
-            const auto end = m_images.constEnd();
+            auto& imageInfo1 = iter1.value();
             
-            for (; iter1 != end && !isInterruptionRequested(); ++iter1) {
+            auto iter2 = m_images.begin();
+            const auto end = m_images.end();
+            
+            for (; iter2 != end && !isInterruptionRequested(); ++iter2) {
                 
-                const auto& imageInfo1 = iter1.value();
-                if (imageInfo1.isNull()) {
+                auto& imageInfo2 = iter2.value();
+                if (iter2 == iter1 || imageInfo2.isNull()) {
                     continue;
                 }
                 
-                auto iter2 = iter1;
-                ++iter2;
+                // Images with identical pixels are duplicates whatever the cascade would make of them, and are
+                // recognised from their digests alone.
+                
+                const auto orientation = ImageInfo::identicalPixels(imageInfo1, imageInfo2)
+                                       ? 0 : m_cascade.match(imageInfo1, imageInfo2);
+                if (orientation >= 0) {
+                    handleDuplicate(iter1.key(), imageInfo1, iter2.key(), imageInfo2, orientation);
+                }
+                
+                // As in compareImages(), the image being compared may have been deleted while the thread was paused.
+                
+                if (imageInfo1.isNull()) {
+                    break;
+                }
+            }
+        }
+        
+        void ProcessorThread::compareImages() {
+            
+            const TraceSpan span{"compare images"};
+            qint64 comparisonsMade = 0;
+            m_metrics.setComparisonCounts(comparisonsMade, comparisonCount());
+            
+            // The hashes are copied into a HashIndex so that each image can be checked against all of those after it
+            // in bulk. m_images is not modified while we compare (images are only ever set to null), so the iterators
+            // into it remain valid throughout.
+            
+            using Entry = QHash<QString, ImageInfo>::iterator;
+            
+            QVector<Entry> entries;
+            HashIndex index;
+            
+            entries.reserve(m_images.size());
+            index.reserve(m_images.size());
+            
+            // Before that, images with identical pixels are grouped by their pixel digests in a single pass. Only the
+            // first image of each group goes into the index; the others are handled as duplicates of it straight
+            // away, and take no part in the perceptual comparison. If the first image of a group is discarded, the
+            // next to survive takes its place.
+            
+            QHash<QByteArray, Entry> pixelGroups;
+            pixelGroups.reserve(m_images.size());
+            
+            for (auto iter = m_images.begin(); iter != m_images.end() && !isInterruptionRequested(); ++iter) {
+                
+                auto& imageInfo = iter.value();
+                const auto digest = imageInfo.pixelDigest();
+                const auto group = digest.isEmpty() ? pixelGroups.end() : pixelGroups.find(digest);
                 
-                for (; iter2 != end && !isInterruptionRequested(); ++iter2) {
+                if (group != pixelGroups.end() && !group.value().value().isNull()) {
                     
-                    const auto& imageInfo2 = iter2.value();
-                    if (imageInfo2.isNull()) {
+                    handleDuplicate(group.value().key(), group.value().value(), iter.key(), imageInfo, 0);
+                    if (imageInfo.isNull() || !group.value().value().isNull()) {
                         continue;
                     }
+                }
+                
+                if (!digest.isEmpty()) {
+                    pixelGroups.insert(digest, iter);
+                }
+                
+                entries << iter;
+                index.append(imageInfo);
+            }
+            
+            std::vector<HashIndex::Candidate> candidates;
+            const auto imageCount = entries.size();
+            const auto totalComparisonCount = qint64{imageCount} * (imageCount - 1) / 2;
+            m_metrics.setComparisonCounts(comparisonsMade, totalComparisonCount);
+            
+            for (auto i = 0; i < imageCount && !isInterruptionRequested(); ++i) {
+                
+                auto& imageInfo1 = entries[i].value();
+                if (!imageInfo1.isNull()) {
                     
-                    if (ImageInfo::difference(imageInfo1, imageInfo2) < 0.1) {
-                        QMutexLocker locker(&m_mutex);
-                        m_waitCond.wait(&m_mutex);
-                    }
-                    
-                    ++comparisonsMade;
-                    const auto progress = intPercentage(comparisonsMade, totalComparisonCount);
-                    if (progress > lastComparisonProgress) {
-                        emit(comparisonProgressChanged(progress));
-                        lastComparisonProgress = progress;
-                    }
+                    index.findCandidates(imageInfo1, i + 1, m_cascade, candidates);
+                }
+                else {
+                    candidates.clear();
+                }
+                
+                for (const auto& candidate : candidates) {
                     
-                    // It is possible for the image represented by imageInfo (and pointed to by iter1) to have been
-                    // deleted (and the ImageInfo object invalidated) while the thread was paused, so we check for this
-                    // case and move on to the next iteration of the outer loop if so.
+                    // Either image may have been deleted (and its ImageInfo object invalidated) while the thread was
+                    // paused for an earlier pair, or discarded by the resolution of one. If the first has gone, we move
+                    // on to the next iteration of the outer loop.
                     
-                    if (imageInfo1.isNull()) {
+                    if (imageInfo1.isNull() || isInterruptionRequested()) {
                         break;
                     }
+                    
+                    const auto& entry2 = entries[candidate.index];
+                    auto& imageInfo2 = entry2.value();
+                    if (imageInfo2.isNull() || !m_cascade.verify(imageInfo1, imageInfo2, candidate.orientation)) {
+                        continue;
+                    }
+                    
+                    handleDuplicate(entries[i].key(), imageInfo1, entry2.key(), imageInfo2, candidate.orientation);
                 }
+                
+                comparisonsMade += imageCount - i - 1;
+                m_metrics.setComparisonCounts(comparisonsMade, totalComparisonCount);
             }
         }
         
-        int ProcessorThread::comparisonCount() {
-            const auto imageCount = m_images.size();
+        qint64 ProcessorThread::comparisonCount() const {
+            const qint64 imageCount = m_images.size();
             return imageCount * (imageCount - 1) / 2;
         }
         
-        void ProcessorThread::emitInputCount(const bool force) {
+        void ProcessorThread::emitLinkedFiles() {
+            
+            const auto& linkedFiles = m_scanner.linkedFiles();
+            for (auto iter = linkedFiles.constBegin(); iter != linkedFiles.constEnd(); ++iter) {
+                emit(linkedFilesFound(QStringList{iter.key()} + iter.value()));
+            }
+        }
+        
+        void ProcessorThread::enterPhase(const Phase phase) {
             
-            // Since the input count changes very quickly, we wind up with a huge queue of backed-up signals if we emit
-            // an inputCountChanged() every time we scan a new file or folder. To mitigate this, we enforce a delay 
-            // between emissions unless the force parameter is set (e.g. to ensure that a count is emitted once scanning
-            // completes).
+            m_metrics.setPhase(phase);
+            emit(phaseChanged(phase));
+        }
+        
+        void ProcessorThread::handleDuplicate(const QString& path1, ImageInfo& imageInfo1, const QString& path2,
+                                              ImageInfo& imageInfo2, const int orientation) {
+            
+            const auto distance = hammingDistance(imageInfo1.perceptualHash(orientation), imageInfo2.perceptualHash());
+            const auto resolution = m_resolutionPolicy.resolve(path1, imageInfo1, path2, imageInfo2, distance);
+            
+            // Pausing for a pair that nothing is going to resolve would block the thread forever, so unless something
+            // is listening for duplicateFound(), undecided pairs are collected for review as if review were deferred.
+            
+            const auto isReviewedLive = !m_deferReview
+                && isSignalConnected(QMetaMethod::fromSignal(&ProcessorThread::duplicateFound));
+            
+            if (resolution.decision == ResolutionPolicy::Decision::Undecided && !isReviewedLive) {
+                
+                m_results.addPair(path1, imageInfo1, path2, imageInfo2, distance);
+                return;
+            }
+            
+            if (resolution.decision == ResolutionPolicy::Decision::Undecided) {
+                
+                // m_resumed is reset before the signal is emitted, so that a resume() that arrives before we start
+                // waiting isn't lost. The mutex isn't held while emitting, in case a receiver resumes us directly.
+                
+                const TraceSpan waitSpan{"await resolution"};
+                m_mutex.lock();
+                m_resumed = false;
+                m_mutex.unlock();
+                
+                emit(duplicateFound(imageInfo1, imageInfo2));
+                
+                QMutexLocker locker(&m_mutex);
+                while (!m_resumed && !isInterruptionRequested()) {
+                    m_waitCond.wait(&m_mutex, ResolutionCheckPeriod);
+                }
+                return;
+            }
             
-            constexpr qint64 EmissionPeriod = 20;
-            if (force || !m_countEmissionTimer.isValid() || m_countEmissionTimer.elapsed() >= EmissionPeriod) {
+            const auto keepFirst = resolution.decision == ResolutionPolicy::Decision::KeepFirst;
+            const auto& keptPath = keepFirst ? path1 : path2;
+            const auto& discardedPath = keepFirst ? path2 : path1;
+            const auto rule = m_resolutionPolicy.ruleText(resolution.rule);
             
-                emit(inputCountChanged(inputFileCount(), inputFolderCount()));
-                m_countEmissionTimer.start();
+            if (m_resolutionLog.isOpen()) {
+                m_resolutionLog.write(QStringLiteral("%1\t%2\t%3\n").arg(keptPath, discardedPath, rule).toUtf8());
             }
+            
+            emit(duplicateResolved(keptPath, discardedPath, rule));
+            
+            // The discarded image takes no further part in comparison, just as if it had been deleted.
+            
+            (keepFirst ? imageInfo2 : imageInfo1).setNull();
         }
         
         void ProcessorThread::hashImages() {
             
-            auto numImagesHashed = 0;
-            auto lastHashingProgress = 0;
+            // Images are hashed in the order in which they were scanned, which follows directory order and is thus
+            // generally far closer to their order on disk than that of m_images. They can optionally be sorted into
+            // precise physical order for the sake of rotational media.
             
-            auto iter = m_images.begin();
-            const auto end = m_images.end();
+            const TraceSpan span{"hash images"};
+            const auto scanOrder = m_scanner.takeScanOrder();
             
-            for (; iter != end && !isInterruptionRequested(); ++iter) {
+            TraceSpan orderSpan{"sort by physical location"};
+            const auto paths = ImageHasher::hashingOrder(scanOrder, m_fileSystem, m_physicalHashingOrder);
+            orderSpan.finish();
             
-                const auto& path = iter.key();
-                auto& imageInfo = iter.value();
+            // The workers write directly into the ImageInfo objects stored in m_images. This is safe because each
+            // object is written by only one worker, and m_images itself is not modified (and so cannot rehash or
+            // detach) until all of the workers have finished.
+            
+            QVector<ImageInfo *> imageInfos;
+            imageInfos.reserve(paths.size());
+            for (const auto& path : paths) {
+                imageInfos << &m_images[path];
+            }
+            
+            m_metrics.setHashTotal(paths.size());
+            
+            ImageHasher hasher{paths, imageInfos, m_fileSystem, m_hashingThreadCount, m_decodeMemoryBudget,
+                               m_useEmbeddedPreviews};
+            hasher.setPixelDigests(m_pixelDigests);
+            hasher.setPrefetch(m_prefetch);
+            hasher.setInterruptionCheck([this] {return isInterruptionRequested();});
+            hasher.setImageCallback([&](const int i, ScratchBuffers& buffers) {
                 
-                imageInfo.read(path);
-                ++numImagesHashed;
+                // The decoded image is still in the scratch buffers, so we can seed the preview cache from it without
+                // decoding the file again. (A width of zero means that the image couldn't be decoded, in which case
+                // the buffers may still hold the previous one. Nor do we seed the cache from an embedded preview
+                // smaller than the image it stands in for.)
                 
-                const auto progress = intPercentage(numImagesHashed, inputFileCount());
-                if (progress > lastHashingProgress) {
-                    emit(hashingProgressChanged(progress));
-                    lastHashingProgress = progress;
+                const auto& decoded = buffers.image();
+                if (!m_previewCacheDirPath.isEmpty() && imageInfos[i]->width() > 0
+                    && decoded.width() == imageInfos[i]->width() && decoded.height() == imageInfos[i]->height()) {
+                    
+                    const TraceSpan previewSpan{"seed preview cache"};
+                    PreviewCache::seed(m_previewCacheDirPath, paths[i], *imageInfos[i], decoded);
                 }
-            }
+                
+                m_metrics.addImageHashed(imageInfos[i]->fileSize());
+            });
+            
+            hasher.start();
+            hasher.waitForDone();
         }
         
         int ProcessorThread::inputFileCount() const {
@@ -175,27 +385,286 @@ namespace myriad {
         }
         
         int ProcessorThread::inputFolderCount() const {
-            return m_inputFolderCount;
+            return m_scanner.inputDirs().size();
+        }
+        
+        void ProcessorThread::publishMetrics(const bool force) {
+            
+            const auto metrics = m_metrics.sample();
+            emit(metricsChanged(metrics));
+            
+            if (m_metricsFilePath.isEmpty()
+                || (!force && m_metricsFileTimer.isValid() && m_metricsFileTimer.elapsed() < MetricsFilePeriod)) {
+                return;
+            }
+            
+            m_metricsFileTimer.start();
+            
+            // The file is replaced atomically so that a collector reading it never sees a partially written file.
+            
+            QSaveFile file{m_metricsFilePath};
+            if (file.open(QIODevice::WriteOnly)) {
+                file.write(metrics.toPrometheusText());
+                file.commit();
+            }
+        }
+        
+        void ProcessorThread::removeDirectory(const QString& dirPath) {
+            
+            m_scanner.removeDirectory(dirPath);
+            updateInputCount();
+        }
+        
+        void ProcessorThread::rescanDirectory(const QString& dirPath) {
+            
+            const TraceSpan span{"rescan directory"};
+            const auto cleanDirPath = QDir::cleanPath(dirPath);
+            const auto dirPrefix = cleanDirPath + QLatin1Char('/');
+            
+            if (!m_fileSystem.status(cleanDirPath).isDir) {
+                removeDirectory(cleanDirPath);
+                return;
+            }
+            
+            // A directory that we haven't seen before must be a new subdirectory of one of our inputs (directories
+            // elsewhere are ignored). Since nothing within it has been indexed yet, we scan it recursively just as we
+            // would have done during the initial scanning phase, then hash and compare everything that was found.
+            
+            const auto& inputDirs = m_scanner.inputDirs();
+            if (!inputDirs.contains(cleanDirPath)) {
+                
+                const auto parentDirPath = parentPath(cleanDirPath);
+                if (!inputDirs.contains(parentDirPath)) {
+                    return;
+                }
+                
+                m_scanner.takeScanOrder();
+                m_scanner.addInput(cleanDirPath, m_fileSystem.status(parentDirPath).id.device);
+                
+                for (const auto& inputDir : inputDirs) {
+                    if (inputDir == cleanDirPath || inputDir.startsWith(dirPrefix)) {
+                        m_watcher->watch(inputDir);
+                    }
+                }
+                
+                for (const auto& path : m_scanner.takeScanOrder()) {
+                    updateImage(path);
+                }
+                
+                return;
+            }
+            
+            QSet<QString> presentPaths;
+            const auto entryNames = m_fileSystem.entryNames(cleanDirPath);
+            
+            for (const auto& entryName : entryNames) {
+                
+                if (isInterruptionRequested()) {
+                    return;
+                }
+                
+                const auto path = dirPrefix + entryName;
+                const auto status = m_fileSystem.status(path);
+                presentPaths.insert(path);
+                
+                if (status.isDir) {
+                    if (!inputDirs.contains(path)) {
+                        rescanDirectory(path);
+                    }
+                }
+                else {
+                    
+                    const auto existing = m_images.value(path);
+                    if (existing.isNull() || existing.lastModified() != status.lastModified
+                        || existing.fileSize() != status.size) {
+                        updateImage(path);
+                    }
+                }
+            }
+            
+            // Anything that we previously indexed directly within this directory but that is no longer present must
+            // have been removed without us being notified (as happens when the kernel's event queue overflows).
+            
+            QStringList removedDirs;
+            for (const auto& inputDir : inputDirs) {
+                if (isDirectChild(inputDir, dirPrefix) && !presentPaths.contains(inputDir)) {
+                    removedDirs << inputDir;
+                }
+            }
+            
+            for (const auto& removedDir : removedDirs) {
+                removeDirectory(removedDir);
+            }
+            
+            auto iter = m_images.begin();
+            while (iter != m_images.end()) {
+                if (isDirectChild(iter.key(), dirPrefix) && !presentPaths.contains(iter.key())) {
+                    iter = m_images.erase(iter);
+                }
+                else {
+                    ++iter;
+                }
+            }
+            
+            updateInputCount();
+        }
+        
+        const ResultStore& ProcessorThread::results() const {
+            return m_results;
         }
         
         void ProcessorThread::resume() {
+            
+            QMutexLocker locker(&m_mutex);
+            m_resumed = true;
             m_waitCond.wakeAll();
         }
         
         void ProcessorThread::run() {
             
-            emit(phaseChanged(Phase::Scanning));
-            emitInputCount(true);
-            addInputs(m_mainWindow->inputs());
-            emitInputCount(true);
+            const auto inputPaths = m_mainWindow->inputs();
+            
+            if (!m_traceFilePath.isEmpty()) {
+                
+                Tracer::clear();
+                Tracer::setEnabled(true);
+            }
             
-            emit(phaseChanged(Phase::Hashing));
-            emit(hashingProgressChanged(0));
+            enterPhase(Phase::Scanning);
+            addInputs(inputPaths);
+            updateInputCount();
+            emitLinkedFiles();
+            
+            enterPhase(Phase::Hashing);
             hashImages();
             
-            emit(phaseChanged(Phase::Comparing));
-            emit(comparisonProgressChanged(0));
+            // Resolutions are appended to the log, so that runs over different inputs (or interrupted runs) build up
+            // a single record.
+            
+            if (!m_resolutionLog.fileName().isEmpty()
+                && !m_resolutionLog.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+                qWarning("Could not open resolution log %s", qPrintable(m_resolutionLog.fileName()));
+            }
+            
+            enterPhase(Phase::Comparing);
             compareImages();
+            writeTrace();
+            
+            if (m_watchInputs && m_fileSystem.isLocal() && !isInterruptionRequested()) {
+                
+                enterPhase(Phase::Watching);
+                watchInputs(inputPaths);
+                writeTrace();
+            }
+            
+            Tracer::setEnabled(false);
+        }
+        
+        void ProcessorThread::updateImage(const QString& path) {
+            
+            if (!m_images.contains(path)) {
+                
+                // Files that appear alongside an input file (rather than within an input directory) are not inputs
+                // themselves, and are only reported because we have to watch the whole of the input file's directory.
+                
+                const auto dirPath = parentPath(path);
+                if (!m_scanner.inputDirs().contains(dirPath)) {
+                    return;
+                }
+                
+                // The scanner leaves unsupported files and links to images that are already indexed out of the index,
+                // so in either of these cases there's nothing more to do.
+                
+                m_scanner.addInput(path, m_fileSystem.status(dirPath).id.device);
+                m_scanner.takeScanOrder();
+                
+                if (!m_images.contains(path)) {
+                    return;
+                }
+            }
+            
+            ScratchBuffers buffers;
+            auto& imageInfo = m_images[path];
+            imageInfo.read(path, buffers, m_fileSystem, m_useEmbeddedPreviews, nullptr, m_pixelDigests);
+            m_metrics.addImageHashed(imageInfo.fileSize());
+            updateInputCount();
+            compareImage(path);
+        }
+        
+        void ProcessorThread::updateInputCount() {
+            m_metrics.setScanCounts(inputFileCount(), inputFolderCount());
+        }
+        
+        void ProcessorThread::watchInputs(const QStringList& inputPaths) {
+            
+            m_watcher = std::make_unique<InputWatcher>(m_watchPollInterval);
+            
+            // Links found during the initial scan are reported all at once by emitLinkedFiles(), but from here on each
+            // is reported as soon as it appears.
+            
+            m_scanner.setLinkCallback([this](const QStringList& paths) {
+                emit(linkedFilesFound(paths));
+            });
+            
+            connect(m_watcher.get(), &InputWatcher::directoryChanged, [this](const QString& dirPath) {
+                rescanDirectory(dirPath);
+            });
+            
+            connect(m_watcher.get(), &InputWatcher::directoryRemoved, [this](const QString& dirPath) {
+                removeDirectory(dirPath);
+            });
+            
+            connect(m_watcher.get(), &InputWatcher::fileChanged, [this](const QString& path) {
+                updateImage(path);
+            });
+            
+            connect(m_watcher.get(), &InputWatcher::fileRemoved, [this](const QString& path) {
+                if (m_images.remove(path) > 0) {
+                    updateInputCount();
+                }
+            });
+            
+            for (const auto& inputDir : m_scanner.inputDirs()) {
+                m_watcher->watch(inputDir);
+            }
+            
+            for (const auto& inputPath : inputPaths) {
+                
+                const auto cleanInputPath = QDir::cleanPath(inputPath);
+                if (m_fileSystem.status(cleanInputPath).isFile) {
+                    m_watcher->watch(parentPath(cleanInputPath));
+                }
+            }
+            
+            // QThread::requestInterruption() doesn't stop a running event loop, so we check for interruptions
+            // ourselves. Doing this on a timer is cheap enough not to matter when the thread is otherwise idle.
+            
+            QTimer interruptionTimer;
+            connect(&interruptionTimer, &QTimer::timeout, [this] {
+                if (isInterruptionRequested()) {
+                    quit();
+                }
+            });
+            
+            interruptionTimer.start(InterruptionCheckPeriod);
+            exec();
+            
+            m_watcher.reset();
+        }
+        
+        bool ProcessorThread::writeTrace() {
+            
+            if (m_traceFilePath.isEmpty()) {
+                return false;
+            }
+            
+            if (!Tracer::writeChromeTrace(m_traceFilePath)) {
+                
+                qWarning("Could not write trace to %s", qPrintable(m_traceFilePath));
+                return false;
+            }
+            
+            return true;
         }
     }
 }
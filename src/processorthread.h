@@ -1,17 +1,26 @@
 #ifndef MYRIAD_PROCESSORTHREAD_H
 #define MYRIAD_PROCESSORTHREAD_H
 
+#include <memory>
+
 #include <QElapsedTimer>
+#include <QFile>
 #include <QHash>
 #include <QMutex>
 #include <QSet>
 #include <QString>
+#include <QStringList>
 #include <QThread>
+#include <QTimer>
 #include <QWaitCondition>
 
+#include "filesystem.h"
 #include "imageinfo.h"
-
-class QStringList;
+#include "inputscanner.h"
+#include "resolutionpolicy.h"
+#include "resultstore.h"
+#include "similaritycascade.h"
+#include "throughputmetrics.h"
 
 namespace myriad {
     
@@ -22,6 +31,7 @@ namespace myriad {
     namespace processing {
         
         enum class Phase;
+        class InputWatcher;
         
         /**
          * A base class for threads that provides functionality for processing a collection of input images for
@@ -38,9 +48,25 @@ namespace myriad {
              * Constructs the thread.
              * @param mainWindow The main window that provides input data for this thread and displays information about
              * it as it executes. This will take ownership of the thread.
+             * @param fileSystem The filesystem through which inputs are scanned and read. The optimisations that depend
+             * on the kernel's view of files, and watching the inputs for changes, are only applied if it isLocal().
              */
         
-            explicit ProcessorThread(ui::MainWindow * parent);
+            explicit ProcessorThread(ui::MainWindow * mainWindow, const FileSystem& fileSystem = FileSystem::local());
+            
+            /**
+             * Destroys the thread, along with any InputWatcher it may have been using.
+             */
+            
+            ~ProcessorThread();
+            
+            /**
+             * Gets the duplicates that the thread has collected for review. Duplicates are collected if review is
+             * deferred in the settings or nothing is connected to duplicateFound(); otherwise, each is reported via
+             * duplicateFound() instead. The store may be read while the thread is running.
+             */
+            
+            const ResultStore& results() const;
             
             /**
              * Causes the thread to continue its processing once an image duplication it previously detected (signalled
@@ -56,19 +82,23 @@ namespace myriad {
             
             void run() override final;
             
-        signals:
-            
             /**
-             * Emitted when the percentage progress of the thread's image comparison changes.
-             * @param progress The completion percentage of the comparison process.
+             * Writes every span traced so far to the trace file configured in the settings, if any, so that it can be
+             * loaded into chrome://tracing or Perfetto. The file is rewritten each time this is called. Since spans are
+             * recorded thread-safely, this may be called from any thread while the thread is running, in order to look
+             * at a long run without waiting for it to finish.
+             * @return @c true if the trace file was written; @c false if none is configured or it could not be written.
              */
             
-            void comparisonProgressChanged(int progress);
+            bool writeTrace();
+            
+        signals:
             
             /**
              * Emitted when the processor thread encounters a pair of duplicate images and must await a resolution to
              * the duplication before continuing. When this signal is emitted, the thread will pause until resume() is
-             * called.
+             * called (or an interruption is requested). If review is deferred in the settings, or nothing is connected
+             * to this signal, it is never emitted, and such pairs are collected in results() instead.
              * @param imageInfo1 A description of the first image in the duplicate pair.
              * @param imageInfo2 A description of the second image in the duplicate pair.
              */
@@ -76,20 +106,37 @@ namespace myriad {
             void duplicateFound(const ImageInfo& imageInfo1, const ImageInfo& imageInfo2);
             
             /**
-             * Emitted when the percentage progress of the thread's image hash generation changes.
-             * @param progress The completion percentage of the hashing process.
+             * Emitted when the processor thread encounters a pair of duplicate images that is resolved by the
+             * ResolutionPolicy configured in the settings, without waiting for a person to resolve it. The discarded
+             * image takes no further part in comparison. Unlike duplicateFound(), this does not pause the thread.
+             * @param keptPath The path of the image that should be kept.
+             * @param discardedPath The path of the image that should be discarded.
+             * @param rule The text of the rule that resolved the pair.
              */
             
-            void hashingProgressChanged(int progress);
+            void duplicateResolved(const QString& keptPath, const QString& discardedPath, const QString& rule);
             
             /**
-             * Emitted when the number of files or folders scanned by the thread as inputs changes (including once when
-             * the scanning process is initially started).
-             * @param fileCount The number of files that have been scanned by the thread so far.
-             * @param folderCount The number of folders that have been scanned by the thread so far.
+             * Emitted when the thread finds that several of its input paths refer to the same file on disk (via hard
+             * links, or symbolic links that resolve to the same file). Such files are trivially identical, so only the
+             * first of them is hashed and compared; the others are reported here without any further processing.
+             * @param paths The paths that all refer to the same file, starting with the one that is being processed.
              */
             
-            void inputCountChanged(int fileCount, int folderCount);
+            void linkedFilesFound(const QStringList& paths);
+            
+            /**
+             * Emitted at a fixed period while the thread runs, and once more when it finishes, with its progress
+             * through the current phase and its throughput. This is the thread's only channel for progress: the
+             * processing thread and its workers merely update counters, so the cost of reporting doesn't depend upon
+             * how many workers there are or how many inputs they process. Unlike the thread's other signals, this is
+             * emitted from the thread that owns the ProcessorThread object (normally the GUI thread), rather than from
+             * the processing thread itself.
+             * @param metrics The thread's counters, progress, rates and estimated time remaining at the time of
+             * emission.
+             */
+            
+            void metricsChanged(const myriad::processing::MetricsSnapshot& metrics);
             
             /**
              * Emitted when the type of processing being done by the thread changes (including once when the thread is
@@ -102,22 +149,29 @@ namespace myriad {
         private:
             
             /**
-             * Adds a single target to the thread, which will be processed for duplicates when it is launched.
-             * @p inputPath should be a filesystem path to either an image file (which will be added directly) or a
-             * directory (which will be recursively scanned for supported image files to be added).
+             * Adds a list of targets to the thread, each of which should be a filesystem path to either an image file
+             * (which will be added directly) or a directory (which will be recursively scanned for supported image files
+             * to be added).
+             * @see InputScanner::addInput()
              */
             
-            void addInput(const QString& inputPath);
-        
+            void addInputs(const QStringList& inputPaths);
+            
             /**
-             * Repeatedly calls addInput() to add a list of targets to the thread.
+             * Compares the perceptual hash of a single image with that of every other image known to the thread,
+             * waiting for each duplication to be resolved as compareImages() does. This is used in watch mode, where
+             * individual images are added or modified after the main comparison has completed.
+             * @param path The path of the image to compare, which must already have been hashed.
              */
             
-            void addInputs(const QStringList& inputPaths);
+            void compareImage(const QString& path);
             
             /**
-             * Compares every perceptual hash generated by hashImages() with every other, emitting a @c duplicateFound
-             * signal and waiting for that duplication to be resolved whenever a duplicate pair is found.
+             * Compares every image hashed by hashImages() with every other, passing each duplicate pair found to
+             * handleDuplicate(). If pixel digests are enabled in the settings, images with identical pixels are first
+             * grouped by their digests, in time linear in the number of images. The remaining pairs are put through
+             * the SimilarityCascade configured in the settings: the hash stages are applied in bulk via a HashIndex,
+             * and only the surviving candidates are verified individually.
              */
             
             void compareImages();
@@ -128,19 +182,42 @@ namespace myriad {
              * @return The number of comparisons that will be made.
              */
 
-            int comparisonCount();
+            qint64 comparisonCount() const;
+            
+            /**
+             * Emits a linkedFilesFound() signal for each group of linked files found while scanning.
+             */
+            
+            void emitLinkedFiles();
+            
+            /**
+             * Moves the thread into a new phase of processing, emitting phaseChanged().
+             */
+            
+            void enterPhase(Phase phase);
             
             /**
-             * Emits the inputCountChanged() signal with appropriate values for the number of files and folders scanned
-             * so far. This method may skip input count emissions if too many are requested too near each other in time;
-             * to force an emission, set @p force to @c true.
+             * Handles a pair of images that have been found to be duplicates. If the ResolutionPolicy configured in the
+             * settings decides the pair, the resolution is written to the resolution log, a duplicateResolved() signal
+             * is emitted and the discarded image is set to null. Otherwise, if review is deferred (or nothing is
+             * connected to duplicateFound()), the pair is added to the thread's results; if not, a duplicateFound()
+             * signal is emitted and the thread waits for the pair to be resolved by a person.
+             * @param path1 The path of the first image.
+             * @param imageInfo1 The first image, as stored in the thread's index.
+             * @param path2 The path of the second image.
+             * @param imageInfo2 The second image, as stored in the thread's index.
+             * @param orientation The orientation of @p imageInfo1 in which the images matched.
              */
             
-            void emitInputCount(bool force = false);
+            void handleDuplicate(const QString& path1, ImageInfo& imageInfo1, const QString& path2,
+                                 ImageInfo& imageInfo2, int orientation);
             
             /**
-             * Scans through all image files previously passed to addInput() and generates a perceptual hash for each so
-             * that they may subsequently be compared efficiently.
+             * Scans through all image files previously passed to addInputs() and generates a perceptual hash for each so
+             * that they may subsequently be compared efficiently. Images are hashed in scan order, or in physical order on
+             * disk if so configured, by a pool of worker threads whose combined memory use is held within a
+             * DecodeBudget. Unless disabled in the settings, a Prefetcher runs alongside so that files are read from disk
+             * while earlier ones are being decoded.
              */
             
             void hashImages();
@@ -158,12 +235,89 @@ namespace myriad {
             
             int inputFolderCount() const;
             
-            QElapsedTimer m_countEmissionTimer;
+            /**
+             * Samples the thread's ThroughputMetrics, emits the result via metricsChanged() and, if enough time has
+             * passed since it was last written, writes it to the metrics file configured in the settings, if any. This
+             * is called by m_publishTimer, in the thread that owns the ProcessorThread object.
+             * @param force Whether to write the metrics file regardless of when it was last written.
+             */
+            
+            void publishMetrics(bool force = false);
+            
+            /**
+             * Removes from the thread's index every image whose path lies within a specified directory (recursively),
+             * along with any record of that directory and its subdirectories having been scanned.
+             * @param dirPath The full filesystem path of the directory that has been removed.
+             */
+            
+            void removeDirectory(const QString& dirPath);
+            
+            /**
+             * Rescans a single directory that the InputWatcher has reported as changed, without recursing into any of
+             * its subdirectories that have been scanned previously. New and modified images are hashed and compared;
+             * images that no longer exist are removed; new subdirectories are scanned recursively and watched.
+             * @param dirPath The full filesystem path of the directory to rescan.
+             */
+            
+            void rescanDirectory(const QString& dirPath);
+            
+            /**
+             * Hashes a new or modified image and compares it with every other image known to the thread. Files that are
+             * not supported, or that lie outside of the directories being watched, are ignored.
+             * @param path The full filesystem path of the image.
+             */
+            
+            void updateImage(const QString& path);
+            
+            /**
+             * Records the number of files and folders scanned so far in the thread's metrics. This costs no more than a
+             * couple of atomic stores, so it can be called after every file scanned.
+             */
+            
+            void updateInputCount();
+            
+            /**
+             * Keeps the thread's index of images up to date by watching its input directories for filesystem changes,
+             * hashing and comparing images as they are created or modified and removing those that are deleted. This
+             * runs an event loop in the thread, and returns once an interruption has been requested.
+             * @param inputPaths The inputs that were passed to addInputs(). The parent directories of any of these that
+             * are files are watched so that modifications to those files can be detected.
+             */
+            
+            void watchInputs(const QStringList& inputPaths);
+            
+            const SimilarityCascade m_cascade;
+            const qint64 m_decodeMemoryBudget;
+            const bool m_deferReview;
+            const FileSystem& m_fileSystem;
+            const int m_hashingThreadCount;
             QHash<QString, ImageInfo> m_images;
-            int m_inputFolderCount = 0;
             const ui::MainWindow * const m_mainWindow;
+            ThroughputMetrics m_metrics;
+            const QString m_metricsFilePath;
+            QElapsedTimer m_metricsFileTimer;
             QMutex m_mutex;
+            const bool m_physicalHashingOrder;
+            const bool m_pixelDigests;
+            const bool m_prefetch;
+            const QString m_previewCacheDirPath;
+            QTimer m_publishTimer;
+            QFile m_resolutionLog;
+            const ResolutionPolicy m_resolutionPolicy;
+            ResultStore m_results;
+            
+            /**
+             * Whether resume() has been called since the last duplicateFound() signal. This is guarded by @c m_mutex.
+             */
+            
+            bool m_resumed = false;
+            InputScanner m_scanner;
+            const QString m_traceFilePath;
+            const bool m_useEmbeddedPreviews;
             QWaitCondition m_waitCond;
+            std::unique_ptr<InputWatcher> m_watcher;
+            const bool m_watchInputs;
+            const int m_watchPollInterval;
         };
     }
 }
@@ -1,4 +1,5 @@
 #include <QFileInfo>
+#include <QHash>
 #include <QIcon>
 #include <QMimeDatabase>
 #include <QMimeType>
@@ -12,16 +13,27 @@ namespace myriad {
         namespace {
             
             /**
-             * Determines the MIME type of the resource indicated by the specified path, and returns the name of the
-             * icon associated with that MIME type.
-             * @param path The filesystem path indicating the resource to find the icon name for.
-             * @return The name of the icon for the resource at @p path.
+             * Determines the MIME type of the resource indicated by the specified path, and returns the icon associated
+             * with that MIME type. The type is determined from the path alone (and whether it refers to a directory),
+             * without reading the file. Icons are cached by MIME type, since loading them from the theme is expensive
+             * and a queue generally contains only a handful of different types.
+             * @param path The filesystem path indicating the resource to find the icon for.
+             * @return The icon for the resource at @p path.
              */
             
-            QString iconNameFromPath(const QString& path) {
+            QIcon iconFromPath(const QString& path) {
+                
+                static QHash<QString, QIcon> iconsByMimeName;
                 
                 QMimeDatabase mimeDb;
-                return mimeDb.mimeTypeForFile(path).iconName();
+                const auto mimeType = mimeDb.mimeTypeForFile(QFileInfo{path}, QMimeDatabase::MatchExtension);
+                
+                auto iter = iconsByMimeName.find(mimeType.name());
+                if (iter == iconsByMimeName.end()) {
+                    iter = iconsByMimeName.insert(mimeType.name(), QIcon::fromTheme(mimeType.iconName()));
+                }
+                
+                return iter.value();
             }
             
             /**
@@ -44,9 +56,19 @@ namespace myriad {
             switch (role) {
                 
                 case Qt::DecorationRole:
-                    return QIcon::fromTheme(m_iconName);
+                    
+                    if (!m_iconResolved) {
+                        
+                        m_icon = iconFromPath(m_path);
+                        m_iconResolved = true;
+                    }
+                    return m_icon;
 
                 case Qt::DisplayRole:
+                    
+                    if (m_name.isNull()) {
+                        m_name = nameFromPath(m_path);
+                    }
                     return m_name;
                     
                 case PathRole:
@@ -77,8 +99,11 @@ namespace myriad {
 
         void QueueItem::setPath(const QString& path) {
 
-            m_iconName = iconNameFromPath(path);
-            m_name = nameFromPath(path);
+            // The name and icon are worked out lazily by data().
+
+            m_icon = QIcon{};
+            m_iconResolved = false;
+            m_name = QString{};
             m_path = path;
         }
 
@@ -1,6 +1,7 @@
 #ifndef MYRIAD_QUEUEITEM_H
 #define MYRIAD_QUEUEITEM_H
 
+#include <QIcon>
 #include <QStandardItem>
 #include <QString>
 #include <QVariant>
@@ -10,11 +11,14 @@ namespace myriad {
         
         /**
          * Unique codes that can be used to identify the various roles handled by all custom @c QStandardItem subclasses
-         * used by Myriad (currently just QueueItem, but defined outside of that class for the sake of extensibility).
+         * used by Myriad (currently just QueueItem, but defined outside of that class for the sake of extensibility)
+         * and by ResultModel. @c ImageRole gives the index of an image within the processing::ResultStore shown by a
+         * ResultModel.
          */
         
         enum Role {
-            PathRole = Qt::UserRole + 0b1
+            PathRole  = Qt::UserRole + 0b1,
+            ImageRole = Qt::UserRole + 0b10
         };
         
         /**
@@ -46,7 +50,9 @@ namespace myriad {
             /**
             * Gets data associated with this item, which may be a full path usable in file operations (if Role::PathRole
             * is specified), a file or directory name only (if Qt::DisplayRole is specified) or an icon (if
-            * Qt::DecorationRole is specified).
+            * Qt::DecorationRole is specified). The name and icon are only worked out the first time that they are
+            * asked for, which is generally when the item is first painted, so that adding thousands of items to a
+            * queue doesn't mean looking up thousands of MIME types and icons up front.
             * @param role The type of data to obtain.
             * @return The path, name or icon of the file or directory represented by this item.
             */
@@ -79,8 +85,23 @@ namespace myriad {
             
             void setPath(const QString& path);
             
-            QString m_iconName;
-            QString m_name;
+            /**
+             * The item's icon, once it has been looked up.
+             */
+
+            mutable QIcon m_icon;
+
+            /**
+             * Whether m_icon has been looked up.
+             */
+
+            mutable bool m_iconResolved = false;
+
+            /**
+             * The item's file or directory name, once it has been worked out.
+             */
+
+            mutable QString m_name;
             QString m_path;
         };
     }
@@ -0,0 +1,227 @@
+#include <QDir>
+#include <QHash>
+#include <QRegularExpression>
+
+#include "resolutionpolicy.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * Compares two values of any ordered type, returning the sign of their difference.
+             */
+
+            template <typename T>
+            int sign(const T& lhs, const T& rhs) {
+                return lhs < rhs ? -1 : rhs < lhs ? 1 : 0;
+            }
+        }
+
+        int ResolutionPolicy::compare(const Rule& rule, const QString& path1, const ImageInfo& image1,
+                                      const QString& path2, const ImageInfo& image2) {
+
+            switch (rule.criterion) {
+
+                case Criterion::BestQuality: {
+
+                    const auto difference = image1.quality().score() - image2.quality().score();
+                    return difference >= rule.margin ? 1 : difference <= -rule.margin ? -1 : 0;
+                }
+
+                case Criterion::Format: {
+
+                    // Unlisted formats have an index of -1, which we move to the end of the list.
+
+                    const auto rank1 = rule.formats.indexOf(image1.format());
+                    const auto rank2 = rule.formats.indexOf(image2.format());
+                    return sign(rank2 < 0 ? rule.formats.size() : rank2, rank1 < 0 ? rule.formats.size() : rank1);
+                }
+
+                case Criterion::Largest:
+                    return sign(qint64{image1.width()} * image1.height(), qint64{image2.width()} * image2.height());
+
+                case Criterion::LargestFile:
+                    return sign(image1.fileSize(), image2.fileSize());
+
+                case Criterion::Newest:
+                    return sign(image1.lastModified(), image2.lastModified());
+
+                case Criterion::Oldest:
+                    return sign(image2.lastModified(), image1.lastModified());
+
+                case Criterion::Under:
+                    return sign(path1.startsWith(rule.dirPrefix), path2.startsWith(rule.dirPrefix));
+            }
+
+            return 0;
+        }
+
+        ResolutionPolicy ResolutionPolicy::fromRules(const QStringList& rules) {
+
+            ResolutionPolicy policy;
+            for (const auto& text : rules) {
+
+                const auto trimmed = text.trimmed();
+                if (trimmed.isEmpty() || trimmed.startsWith(QLatin1Char('#'))) {
+                    continue;
+                }
+
+                Rule rule;
+                if (parseRule(trimmed, rule)) {
+                    policy.m_rules.push_back(rule);
+                }
+                else {
+                    qWarning("Ignoring invalid resolution rule: %s", qPrintable(trimmed));
+                }
+            }
+
+            return policy;
+        }
+
+        bool ResolutionPolicy::isEmpty() const {
+            return m_rules.empty();
+        }
+
+        bool ResolutionPolicy::parseRule(const QString& text, Rule& rule) {
+
+            static const QHash<QString, Criterion> criteria{
+                {QStringLiteral("best-quality"), Criterion::BestQuality},
+                {QStringLiteral("format"),       Criterion::Format},
+                {QStringLiteral("largest"),      Criterion::Largest},
+                {QStringLiteral("largest-file"), Criterion::LargestFile},
+                {QStringLiteral("newest"),       Criterion::Newest},
+                {QStringLiteral("oldest"),       Criterion::Oldest},
+                {QStringLiteral("under"),        Criterion::Under}
+            };
+
+            static const QHash<QString, Condition> conditions{
+                {QStringLiteral("exact"),           Exact},
+                {QStringLiteral("identical"),       Identical},
+                {QStringLiteral("same-dimensions"), SameDimensions},
+                {QStringLiteral("same-pixels"),     SamePixels}
+            };
+
+            static const QHash<QString, ImageInfo::Format> formats{
+                {QStringLiteral("bmp"),   ImageInfo::Format::Bmp},
+                {QStringLiteral("gif"),   ImageInfo::Format::Gif},
+                {QStringLiteral("jpeg"),  ImageInfo::Format::Jpeg},
+                {QStringLiteral("jpg"),   ImageInfo::Format::Jpeg},
+                {QStringLiteral("png"),   ImageInfo::Format::Png},
+                {QStringLiteral("other"), ImageInfo::Format::Other}
+            };
+
+            // The directory given to "under" may contain spaces, so we split off any conditions before splitting the
+            // rest of the rule into words.
+
+            static const QRegularExpression conditionSeparator{QStringLiteral("\\s+if\\s+")};
+            static const QRegularExpression whitespace{QStringLiteral("\\s+")};
+
+            const auto parts = text.split(conditionSeparator);
+            if (parts.size() > 2) {
+                return false;
+            }
+
+            const auto words = parts[0].split(whitespace, QString::SkipEmptyParts);
+            if (words.size() < 2 || words[0] != QLatin1String("keep") || !criteria.contains(words[1])) {
+                return false;
+            }
+
+            rule.text = text;
+            rule.criterion = criteria[words[1]];
+            const auto arguments = words.mid(2);
+
+            switch (rule.criterion) {
+
+                case Criterion::BestQuality: {
+
+                    auto ok = arguments.isEmpty();
+                    rule.margin = ok ? 0.5 : arguments[0].toDouble(&ok);
+                    if (!ok || arguments.size() > 1 || rule.margin < 0.0) {
+                        return false;
+                    }
+                    break;
+                }
+
+                case Criterion::Format:
+
+                    if (arguments.isEmpty()) {
+                        return false;
+                    }
+
+                    for (const auto& argument : arguments) {
+
+                        const auto format = argument.toLower();
+                        if (!formats.contains(format)) {
+                            return false;
+                        }
+                        rule.formats << formats[format];
+                    }
+                    break;
+
+                case Criterion::Under: {
+
+                    const auto dirPath = parts[0].section(QLatin1String("under"), 1).trimmed();
+                    if (dirPath.isEmpty()) {
+                        return false;
+                    }
+
+                    rule.dirPrefix = QDir::cleanPath(dirPath) + QLatin1Char('/');
+                    break;
+                }
+
+                default:
+
+                    if (!arguments.isEmpty()) {
+                        return false;
+                    }
+                    break;
+            }
+
+            if (parts.size() == 2) {
+
+                for (const auto& condition : parts[1].split(QStringLiteral(" and "), QString::SkipEmptyParts)) {
+
+                    const auto name = condition.trimmed();
+                    if (!conditions.contains(name)) {
+                        return false;
+                    }
+                    rule.conditions |= conditions[name];
+                }
+            }
+
+            return true;
+        }
+
+        ResolutionPolicy::Resolution ResolutionPolicy::resolve(const QString& path1, const ImageInfo& image1,
+                                                               const QString& path2, const ImageInfo& image2,
+                                                               const int distance) const {
+
+            for (auto index = 0; index < static_cast<int>(m_rules.size()); ++index) {
+
+                const auto& rule = m_rules[index];
+
+                if (((rule.conditions & Exact) && distance != 0)
+                    || ((rule.conditions & Identical)
+                        && (image1.fileSize() != image2.fileSize() || !ImageInfo::identical(image1, image2)))
+                    || ((rule.conditions & SameDimensions)
+                        && (image1.width() != image2.width() || image1.height() != image2.height()))
+                    || ((rule.conditions & SamePixels) && !ImageInfo::identicalPixels(image1, image2))) {
+                    continue;
+                }
+
+                const auto preference = compare(rule, path1, image1, path2, image2);
+                if (preference != 0) {
+                    return {preference > 0 ? Decision::KeepFirst : Decision::KeepSecond, index};
+                }
+            }
+
+            return {};
+        }
+
+        QString ResolutionPolicy::ruleText(const int rule) const {
+            return m_rules[rule].text;
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef MYRIAD_RESOLUTIONPOLICY_H
+#define MYRIAD_RESOLUTIONPOLICY_H
+
+#include <vector>
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "imageinfo.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * An ordered list of rules that decide which of a pair of duplicate images should be kept, so that duplicates
+         * can be resolved without anyone having to look at them. Each rule is written on a single line, as
+         *
+         *     keep <criterion> [if <condition> [and <condition>]...]
+         *
+         * where the criteria are:
+         * - @c largest: the image with more pixels;
+         * - @c largest-file: the larger file;
+         * - @c oldest or @c newest: the file modified least or most recently;
+         * - <tt>best-quality [margin]</tt>: the image whose ImageQuality score is higher, by at least @c margin
+         *   (default 0.5);
+         * - <tt>format <format>...</tt>: the image whose format (@c bmp, @c gif, @c jpeg, @c png or @c other) comes
+         *   first in the list, unlisted formats coming last;
+         * - <tt>under <directory></tt>: the image within the directory, if only one of them is;
+         *
+         * and the conditions are:
+         * - @c exact: the perceptual hashes of the images are identical;
+         * - @c identical: the files are byte-for-byte identical;
+         * - @c same-dimensions: the images have the same width and height;
+         * - @c same-pixels: the images have identical decoded pixels, even if their files differ. This can only hold
+         *   if the images were read with pixel digests (see ImageInfo::pixelDigest()).
+         *
+         * The rules are tried in order. The first whose conditions hold and whose criterion tells the images apart
+         * decides the pair; if none does, the pair is left for a person to resolve.
+         */
+
+        class ResolutionPolicy {
+
+        public:
+
+            /**
+             * The outcome of applying a ResolutionPolicy to a pair of images.
+             */
+
+            enum class Decision {
+                Undecided,
+                KeepFirst,
+                KeepSecond
+            };
+
+            /**
+             * A decision, along with the index of the rule that made it (or @c -1 if the pair is undecided).
+             */
+
+            struct Resolution {
+                Decision decision = Decision::Undecided;
+                int rule = -1;
+            };
+
+            /**
+             * Parses a policy from a list of rules, as described for the class. Rules that cannot be parsed are
+             * ignored with a warning; empty lines and lines starting with @c # are skipped silently.
+             */
+
+            static ResolutionPolicy fromRules(const QStringList& rules);
+
+            /**
+             * Tests whether the policy has no rules.
+             */
+
+            bool isEmpty() const;
+
+            /**
+             * Decides which of a pair of duplicate images to keep.
+             * @param path1 The path of the first image.
+             * @param image1 The first image.
+             * @param path2 The path of the second image.
+             * @param image2 The second image.
+             * @param distance The Hamming distance between the perceptual hashes of the images, in the orientation in
+             * which they were matched.
+             */
+
+            Resolution resolve(const QString& path1, const ImageInfo& image1, const QString& path2,
+                               const ImageInfo& image2, int distance) const;
+
+            /**
+             * Gets the text of one of the policy's rules, as it was given to fromRules().
+             */
+
+            QString ruleText(int rule) const;
+
+        private:
+
+            /**
+             * The criteria by which a rule can choose between two images.
+             */
+
+            enum class Criterion {
+                BestQuality,
+                Format,
+                Largest,
+                LargestFile,
+                Newest,
+                Oldest,
+                Under
+            };
+
+            /**
+             * Flags for the conditions under which a rule applies.
+             */
+
+            enum Condition {
+                Exact          = 0x1,
+                Identical      = 0x2,
+                SameDimensions = 0x4,
+                SamePixels     = 0x8
+            };
+
+            /**
+             * A single parsed rule.
+             */
+
+            struct Rule {
+
+                /**
+                 * The rule as it was written.
+                 */
+
+                QString text;
+
+                /**
+                 * The criterion that the rule chooses by.
+                 */
+
+                Criterion criterion = Criterion::Largest;
+
+                /**
+                 * The Condition flags that must all hold.
+                 */
+
+                int conditions = 0;
+
+                /**
+                 * The margin for @c BestQuality.
+                 */
+
+                double margin = 0.0;
+
+                /**
+                 * The formats for @c Format, most preferred first.
+                 */
+
+                QVector<ImageInfo::Format> formats;
+
+                /**
+                 * The directory for @c Under, with a trailing separator.
+                 */
+
+                QString dirPrefix;
+            };
+
+            /**
+             * Compares a pair of images by a rule's criterion, without regard to its conditions.
+             * @return A positive number if the first image should be kept, a negative number if the second should be,
+             * or @c 0 if the criterion doesn't tell them apart.
+             */
+
+            static int compare(const Rule& rule, const QString& path1, const ImageInfo& image1, const QString& path2,
+                               const ImageInfo& image2);
+
+            /**
+             * Parses a single rule.
+             * @return @c true if @p text was a valid rule, in which case it has been parsed into @p rule; @c false
+             * otherwise.
+             */
+
+            static bool parseRule(const QString& text, Rule& rule);
+
+            std::vector<Rule> m_rules;
+        };
+    }
+}
+
+#endif
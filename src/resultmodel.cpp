@@ -0,0 +1,515 @@
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
+#include <KFormat>
+#include <KLocalizedString>
+
+#include "queueitem.h"
+#include "resultmodel.h"
+#include "resultstore.h"
+
+namespace myriad {
+    namespace modelview {
+
+        namespace {
+
+            /**
+             * The internal ID given to the indices of top-level rows. The indices of child rows have the index of their
+             * group within the store, plus one, as their internal ID.
+             */
+
+            constexpr quintptr GroupId = 0;
+
+            /**
+             * Determines whether one group comes before another in a sort order, given their keys. Groups with equal
+             * keys are kept in order of their indices in the store, so that every group has exactly one place in the
+             * order and can be inserted there by a binary search.
+             */
+
+            template<typename Key>
+            bool precedes(const Key& lhsKey, const Key& rhsKey, const int lhs, const int rhs,
+                          const Qt::SortOrder order) {
+
+                if (lhsKey < rhsKey || rhsKey < lhsKey) {
+                    return order == Qt::AscendingOrder ? lhsKey < rhsKey : rhsKey < lhsKey;
+                }
+
+                return lhs < rhs;
+            }
+        }
+
+        constexpr int ResultModel::FetchBatchSize;
+        constexpr int ResultModel::InsertionLimit;
+
+        ResultModel::ResultModel(const processing::ResultStore& store, QObject * const parent)
+            : QAbstractItemModel{parent},
+              m_store{store} {
+        }
+
+        void ResultModel::appendGroups(const std::vector<int>& groups) {
+
+            if (groups.empty()) {
+                return;
+            }
+
+            const auto firstRow = static_cast<int>(m_groups.size());
+            beginInsertRows({}, firstRow, firstRow + static_cast<int>(groups.size()) - 1);
+            for (const auto group : groups) {
+
+                m_rows[group] = static_cast<int>(m_groups.size());
+                m_groups.push_back(group);
+            }
+            endInsertRows();
+        }
+
+        void ResultModel::applySort() {
+
+            if (m_sortColumn < 0) {
+                return;
+            }
+
+            // The sort keys are gathered up front, so that the store need not be locked for every comparison. Groups
+            // are fetched in order of their indices in the store, so the keys can be held in a plain vector.
+
+            const auto sortGroups = [this](const auto& keys) {
+                rearrangeGroups([this, &keys] {
+                    std::sort(m_groups.begin(), m_groups.end(), [this, &keys](const int lhs, const int rhs) {
+                        return precedes(keys[lhs], keys[rhs], lhs, rhs, m_sortOrder);
+                    });
+                });
+            };
+
+            if (m_sortColumn == NameColumn) {
+
+                std::vector<QString> names(m_fetchedCount);
+                for (const auto group : m_groups) {
+                    names[group] = m_store.fileName(m_store.group(group).anchor);
+                }
+                sortGroups(names);
+            }
+            else {
+
+                // Directories are ranked by path once, so that groups can then be compared by rank.
+
+                std::vector<int> dirRanks;
+                if (m_sortColumn == DirectoryColumn) {
+
+                    std::vector<QString> dirPaths(m_store.dirCount());
+                    for (auto dir = 0u; dir < dirPaths.size(); ++dir) {
+                        dirPaths[dir] = m_store.dirPath(dir);
+                    }
+
+                    std::vector<int> dirs(dirPaths.size());
+                    std::iota(dirs.begin(), dirs.end(), 0);
+                    std::sort(dirs.begin(), dirs.end(), [&dirPaths](const int lhs, const int rhs) {
+                        return dirPaths[lhs] < dirPaths[rhs];
+                    });
+
+                    dirRanks.resize(dirs.size());
+                    for (auto rank = 0u; rank < dirs.size(); ++rank) {
+                        dirRanks[dirs[rank]] = rank;
+                    }
+                }
+
+                std::vector<qint64> keys(m_fetchedCount);
+                for (const auto group : m_groups) {
+
+                    const auto stored = m_store.group(group);
+                    keys[group] = m_sortColumn == DistanceColumn ? stored.maxDistance
+                                : m_sortColumn == SizeColumn     ? stored.totalSize
+                                                                 : dirRanks[m_store.dir(stored.anchor)];
+                }
+                sortGroups(keys);
+            }
+        }
+
+        bool ResultModel::canFetchMore(const QModelIndex& parent) const {
+            return !parent.isValid() && m_store.groupCount() > m_fetchedCount;
+        }
+
+        int ResultModel::columnCount(const QModelIndex&) const {
+            return ColumnCount;
+        }
+
+        QVariant ResultModel::data(const QModelIndex& index, const int role) const {
+
+            if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::TextAlignmentRole && role != PathRole
+                                     && role != ImageRole)) {
+                return {};
+            }
+
+            if (role == Qt::TextAlignmentRole) {
+
+                return index.column() == DistanceColumn || index.column() == SizeColumn
+                    ? QVariant{static_cast<int>(Qt::AlignRight | Qt::AlignVCenter)}
+                    : QVariant{};
+            }
+
+            // Group rows show their anchor image, but the largest distance and combined size of the whole group.
+
+            auto image = 0;
+            auto distance = 0;
+            qint64 size = 0;
+
+            if (index.internalId() == GroupId) {
+
+                const auto group = m_store.group(m_groups[index.row()]);
+                image = group.anchor;
+                distance = group.maxDistance;
+                size = group.totalSize;
+            }
+            else if (imageAt(index, image, distance)) {
+                size = m_store.fileSize(image);
+            }
+            else {
+                return {};
+            }
+
+            if (role == PathRole) {
+                return m_store.path(image);
+            }
+
+            if (role == ImageRole) {
+                return image;
+            }
+
+            switch (index.column()) {
+
+                case NameColumn:
+                    return m_store.fileName(image);
+
+                case DistanceColumn:
+                    return distance;
+
+                case SizeColumn:
+                    return KFormat{}.formatByteSize(size);
+
+                case DirectoryColumn:
+                    return m_store.dirPath(m_store.dir(image));
+            }
+
+            return {};
+        }
+
+        std::vector<int> ResultModel::fetchGroups(const int count) {
+
+            // Groups that have already been merged into others are skipped, and the members of the rest are counted
+            // now, so that the rows announced for them are exactly those that rowCount() reports until refresh().
+
+            std::vector<int> groups;
+            for (auto group = m_fetchedCount; group < m_fetchedCount + count; ++group) {
+
+                const auto stored = m_store.group(group);
+                m_memberCounts.push_back(stored.memberCount);
+                m_rows.push_back(-1);
+                if (stored.mergedInto < 0) {
+                    groups.push_back(group);
+                }
+            }
+
+            m_fetchedCount += qMax(count, 0);
+            return groups;
+        }
+
+        void ResultModel::fetchMore(const QModelIndex& parent) {
+
+            if (parent.isValid()) {
+                return;
+            }
+
+            // Once the model has been sorted, every group is fetched at once, since any group that hasn't been fetched
+            // might belong anywhere in the order. Fetching only copies indices, so this is cheap even for very large
+            // result sets; what the model avoids is touching the groups' data before it is displayed.
+
+            const auto remainingCount = m_store.groupCount() - m_fetchedCount;
+            const auto groups = fetchGroups(m_sortColumn < 0 ? qMin(remainingCount, FetchBatchSize) : remainingCount);
+
+            // A few groups are inserted straight into their places in the order. Each insertion costs views time in
+            // proportion to the number of rows, though, so a larger batch is appended and then placed all at once.
+
+            if (m_sortColumn >= 0 && static_cast<int>(groups.size()) <= InsertionLimit) {
+                for (const auto group : groups) {
+                    insertGroup(group);
+                }
+                return;
+            }
+
+            appendGroups(groups);
+            if (m_sortColumn >= 0) {
+                placeGroups(groups);
+            }
+        }
+
+        QVariant ResultModel::headerData(const int section, const Qt::Orientation orientation, const int role) const {
+
+            if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+                return {};
+            }
+
+            switch (section) {
+
+                case NameColumn:
+                    return i18n("Name");
+
+                case DistanceColumn:
+                    return i18n("Distance");
+
+                case SizeColumn:
+                    return i18n("Size");
+
+                case DirectoryColumn:
+                    return i18n("Directory");
+            }
+
+            return {};
+        }
+
+        bool ResultModel::imageAt(const QModelIndex& index, int& image, int& distance) const {
+
+            if (index.internalId() == GroupId) {
+                return false;
+            }
+
+            // The first child of each group is its anchor, and the rest are its members.
+
+            const auto group = static_cast<int>(index.internalId() - 1);
+            if (index.row() == 0) {
+
+                image = m_store.group(group).anchor;
+                distance = 0;
+            }
+            else {
+
+                const auto member = m_store.member(group, index.row() - 1);
+                image = member.image;
+                distance = member.distance;
+            }
+
+            return true;
+        }
+
+        QModelIndex ResultModel::index(const int row, const int column, const QModelIndex& parent) const {
+
+            if (row < 0 || row >= rowCount(parent) || column < 0 || column >= ColumnCount) {
+                return {};
+            }
+
+            return parent.isValid() ? createIndex(row, column, static_cast<quintptr>(m_groups[parent.row()]) + 1)
+                                    : createIndex(row, column, GroupId);
+        }
+
+        void ResultModel::insertGroup(const int group) {
+
+            const auto position = std::lower_bound(m_groups.begin(), m_groups.end(), group,
+                                                   [this](const int lhs, const int rhs) {return lessThan(lhs, rhs);});
+            const auto row = static_cast<int>(position - m_groups.begin());
+
+            beginInsertRows({}, row, row);
+            m_groups.insert(position, group);
+            for (auto laterRow = row; laterRow < static_cast<int>(m_groups.size()); ++laterRow) {
+                m_rows[m_groups[laterRow]] = laterRow;
+            }
+            endInsertRows();
+        }
+
+        bool ResultModel::isInPlace(const int group) const {
+
+            const auto row = m_rows[group];
+            return (row == 0 || lessThan(m_groups[row - 1], group))
+                && (row == static_cast<int>(m_groups.size()) - 1 || lessThan(group, m_groups[row + 1]));
+        }
+
+        bool ResultModel::lessThan(const int lhs, const int rhs) const {
+
+            const auto lhsGroup = m_store.group(lhs);
+            const auto rhsGroup = m_store.group(rhs);
+
+            switch (m_sortColumn) {
+
+                case NameColumn:
+                    return precedes(m_store.fileName(lhsGroup.anchor), m_store.fileName(rhsGroup.anchor), lhs, rhs,
+                                    m_sortOrder);
+
+                case DistanceColumn:
+                    return precedes(lhsGroup.maxDistance, rhsGroup.maxDistance, lhs, rhs, m_sortOrder);
+
+                case SizeColumn:
+                    return precedes(lhsGroup.totalSize, rhsGroup.totalSize, lhs, rhs, m_sortOrder);
+            }
+
+            const auto lhsDirPath = m_store.dirPath(m_store.dir(lhsGroup.anchor));
+            const auto rhsDirPath = m_store.dirPath(m_store.dir(rhsGroup.anchor));
+            return precedes(lhsDirPath, rhsDirPath, lhs, rhs, m_sortOrder);
+        }
+
+        QModelIndex ResultModel::parent(const QModelIndex& index) const {
+
+            if (!index.isValid() || index.internalId() == GroupId) {
+                return {};
+            }
+
+            const auto row = m_rows[index.internalId() - 1];
+            return row < 0 ? QModelIndex{} : createIndex(row, 0, GroupId);
+        }
+
+        void ResultModel::placeGroups(std::vector<int> groups) {
+
+            if (groups.empty()) {
+                return;
+            }
+
+            // Every other group is already in order, so each of these can be merged into them at the place found by
+            // a binary search, without looking up the keys of the rest.
+
+            std::sort(groups.begin(), groups.end(), [this](const int lhs, const int rhs) {return lessThan(lhs, rhs);});
+
+            rearrangeGroups([this, &groups] {
+
+                std::vector<bool> isPlaced(m_fetchedCount);
+                for (const auto group : groups) {
+                    isPlaced[group] = true;
+                }
+
+                std::vector<int> others;
+                others.reserve(m_groups.size() - groups.size());
+                std::copy_if(m_groups.begin(), m_groups.end(), std::back_inserter(others),
+                             [&isPlaced](const int group) {return !isPlaced[group];});
+
+                m_groups.clear();
+                auto next = others.cbegin();
+                for (const auto group : groups) {
+
+                    const auto position = std::lower_bound(next, others.cend(), group,
+                                                           [this](const int lhs, const int rhs) {
+                                                               return lessThan(lhs, rhs);
+                                                           });
+                    m_groups.insert(m_groups.end(), next, position);
+                    m_groups.push_back(group);
+                    next = position;
+                }
+                m_groups.insert(m_groups.end(), next, others.cend());
+            });
+        }
+
+        void ResultModel::rearrangeGroups(const std::function<void()>& rearrange) {
+
+            emit(layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint));
+
+            // Children are identified by their group rather than by their group's row, so only persistent indices of
+            // top-level rows need to be moved.
+
+            const auto oldIndices = persistentIndexList();
+            std::vector<int> oldGroups;
+            oldGroups.reserve(oldIndices.size());
+            for (const auto& index : oldIndices) {
+                oldGroups.push_back(index.internalId() == GroupId ? m_groups[index.row()] : -1);
+            }
+
+            rearrange();
+
+            for (auto row = 0u; row < m_groups.size(); ++row) {
+                m_rows[m_groups[row]] = row;
+            }
+
+            QModelIndexList newIndices;
+            newIndices.reserve(oldIndices.size());
+            for (auto i = 0; i < oldIndices.size(); ++i) {
+                newIndices << (oldGroups[i] >= 0 ? createIndex(m_rows[oldGroups[i]], oldIndices[i].column(), GroupId)
+                                                 : oldIndices[i]);
+            }
+
+            changePersistentIndexList(oldIndices, newIndices);
+            emit(layoutChanged({}, QAbstractItemModel::VerticalSortHint));
+        }
+
+        int ResultModel::rowCount(const QModelIndex& parent) const {
+
+            if (!parent.isValid()) {
+                return static_cast<int>(m_groups.size());
+            }
+
+            if (parent.internalId() != GroupId || parent.column() != 0) {
+                return 0;
+            }
+
+            return m_memberCounts[m_groups[parent.row()]] + 1;
+        }
+
+        void ResultModel::refresh() {
+
+            auto changedGroups = m_store.changedGroups(m_revision);
+            std::sort(changedGroups.begin(), changedGroups.end());
+            changedGroups.erase(std::unique(changedGroups.begin(), changedGroups.end()), changedGroups.end());
+
+            // Groups that haven't been fetched yet have nothing to publish: they will be counted when they are.
+
+            std::vector<int> updatedGroups;
+            for (const auto group : changedGroups) {
+
+                if (group >= m_fetchedCount || m_rows[group] < 0) {
+                    continue;
+                }
+
+                const auto row = m_rows[group];
+                const auto stored = m_store.group(group);
+
+                if (stored.mergedInto >= 0) {
+
+                    beginRemoveRows({}, row, row);
+                    m_groups.erase(m_groups.begin() + row);
+                    m_rows[group] = -1;
+                    for (auto laterRow = row; laterRow < static_cast<int>(m_groups.size()); ++laterRow) {
+                        m_rows[m_groups[laterRow]] = laterRow;
+                    }
+                    endRemoveRows();
+                    continue;
+                }
+
+                // Members are only ever appended to a group, so those published already keep their rows.
+
+                const auto groupIndex = createIndex(row, 0, GroupId);
+                if (stored.memberCount > m_memberCounts[group]) {
+
+                    beginInsertRows(groupIndex, m_memberCounts[group] + 1, stored.memberCount);
+                    m_memberCounts[group] = stored.memberCount;
+                    endInsertRows();
+                }
+
+                emit(dataChanged(groupIndex, createIndex(row, ColumnCount - 1, GroupId)));
+                updatedGroups.push_back(group);
+            }
+
+            // Rather than sorting every group again, only the updated groups are placed again, and only if the order
+            // has been broken. The rest of the groups kept their keys, and so their order, so the order can only be
+            // broken next to an updated group.
+
+            if (m_sortColumn >= 0
+                && !std::all_of(updatedGroups.begin(), updatedGroups.end(),
+                                [this](const int group) {return isInPlace(group);})) {
+                placeGroups(updatedGroups);
+            }
+
+            if (canFetchMore({}) && (m_sortColumn >= 0 || static_cast<int>(m_groups.size()) < FetchBatchSize)) {
+                fetchMore({});
+            }
+        }
+
+        void ResultModel::sort(const int column, const Qt::SortOrder order) {
+
+            if (column < 0 || column >= ColumnCount) {
+                return;
+            }
+
+            m_sortColumn = column;
+            m_sortOrder = order;
+
+            appendGroups(fetchGroups(m_store.groupCount() - m_fetchedCount));
+            applySort();
+        }
+
+        const processing::ResultStore& ResultModel::store() const {
+            return m_store;
+        }
+    }
+}
@@ -0,0 +1,252 @@
+#ifndef MYRIAD_RESULTMODEL_H
+#define MYRIAD_RESULTMODEL_H
+
+#include <functional>
+#include <vector>
+
+#include <QAbstractItemModel>
+
+namespace myriad {
+
+    namespace processing {
+        class ResultStore;
+    }
+
+    namespace modelview {
+
+        /**
+         * A tree model over the groups of duplicates in a processing::ResultStore, for display in a result list. Each
+         * group is a top-level row, showing its anchor image, and has a child row for every image in the group
+         * (starting with the anchor).
+         *
+         * The model holds nothing about a group but its index in the store, its current row and the number of members
+         * that it has published, and fetches groups from the store lazily, a batch at a time, as a view scrolls
+         * towards the end of those fetched so far. Each cell is looked up in the store only as it is displayed, so
+         * even a result set of hundreds of thousands of groups scrolls smoothly and takes up only a few MB in the
+         * model.
+         *
+         * Since the store is filled by another thread, the model never reports more rows than it has announced to its
+         * views: the members of each group are counted when the group is fetched, and groups that the store has changed
+         * since then (by adding members, or merging them into other groups) are only updated by refresh(), with the
+         * appropriate insertion and removal notifications.
+         */
+
+        class ResultModel : public QAbstractItemModel {
+        Q_OBJECT
+
+        public:
+
+            /**
+             * The columns of the model.
+             */
+
+            enum Column {
+
+                /**
+                 * The file name of the image.
+                 */
+
+                NameColumn,
+
+                /**
+                 * The distance of the image from the anchor, or the largest such distance.
+                 */
+
+                DistanceColumn,
+
+                /**
+                 * The size of the image file, or the combined size of the group's files.
+                 */
+
+                SizeColumn,
+
+                /**
+                 * The directory containing the image.
+                 */
+
+                DirectoryColumn,
+                ColumnCount
+            };
+
+            /**
+             * Constructs an empty model over a result store. Groups are only fetched from the store when a view asks
+             * for them.
+             * @param store The store to display the results of, which must outlive the model.
+             * @param parent The parent object of the model.
+             */
+
+            explicit ResultModel(const processing::ResultStore& store, QObject * parent = nullptr);
+
+            bool canFetchMore(const QModelIndex& parent) const override;
+            int columnCount(const QModelIndex& parent = QModelIndex{}) const override;
+
+            /**
+             * Gets the data for a cell of the model. Besides the display text of each column, this provides the full
+             * path of the image in a row (under Role::PathRole) and its index in the store (under Role::ImageRole).
+             */
+
+            QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+            void fetchMore(const QModelIndex& parent) override;
+            QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+            QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex{}) const override;
+            QModelIndex parent(const QModelIndex& index) const override;
+
+            /**
+             * Publishes the changes that the store has made to the groups fetched so far, and fetches the first batch
+             * of groups if none have been fetched yet (or every group, if the model is sorted). If the model is sorted,
+             * new groups are inserted into their places in the order, and groups whose keys have changed are moved to
+             * theirs, without sorting the rest again. This must be called from the thread that the model lives in,
+             * which is normally done whenever the processing thread publishes its progress.
+             */
+
+            void refresh();
+
+            int rowCount(const QModelIndex& parent = QModelIndex{}) const override;
+
+            /**
+             * Sorts the groups by a column. Only the groups are sorted; the images within each group stay in the order
+             * in which they were found, and groups with equal keys stay in the order in which they were found. Since
+             * sorting has to take every group into account, this fetches any groups that haven't been fetched yet
+             * (which only copies their indices), and groups that the store gains later are inserted into place as they
+             * are fetched. The model starts unsorted, so a view should only enable sorting when asked to.
+             */
+
+            void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+            /**
+             * Gets the store that the model displays the results of.
+             */
+
+            const processing::ResultStore& store() const;
+
+        private:
+
+            /**
+             * Adds rows for fetched groups after those of the groups fetched before.
+             */
+
+            void appendGroups(const std::vector<int>& groups);
+
+            /**
+             * Sorts the groups fetched so far by the current sort column, if there is one, updating any persistent
+             * indices that refer to them.
+             */
+
+            void applySort();
+
+            /**
+             * Fetches groups from the store, after those fetched so far, without giving them rows.
+             * @param count The number of groups to fetch.
+             * @return The fetched groups that haven't been merged into others, which are the ones to give rows.
+             */
+
+            std::vector<int> fetchGroups(int count);
+
+            /**
+             * Finds the image shown in a child row, along with its distance from the anchor of its group.
+             * @return @c true if @p index refers to a child row, in which case @p image and @p distance have
+             * been set; @c false otherwise.
+             */
+
+            bool imageAt(const QModelIndex& index, int& image, int& distance) const;
+
+            /**
+             * Adds a row for a fetched group at its place in the order, which the other groups must be in.
+             */
+
+            void insertGroup(int group);
+
+            /**
+             * Determines whether a group's row is in order with the rows either side of it.
+             */
+
+            bool isInPlace(int group) const;
+
+            /**
+             * Determines whether one group comes before another in the current sort order. The keys are looked up in
+             * the store, so this is for placing a few groups; applySort() gathers the keys of all groups instead.
+             */
+
+            bool lessThan(int lhs, int rhs) const;
+
+            /**
+             * Moves groups to their places in the order, which every other group must be in, updating any persistent
+             * indices that refer to them.
+             */
+
+            void placeGroups(std::vector<int> groups);
+
+            /**
+             * Rearranges the rows of the groups as a layout change, updating any persistent indices that refer to them.
+             * @param rearrange Reorders the groups in m_groups; their rows are updated to match.
+             */
+
+            void rearrangeGroups(const std::function<void()>& rearrange);
+
+            /**
+             * The number of groups fetched from the store at a time.
+             */
+
+            static constexpr int FetchBatchSize = 1000;
+
+            /**
+             * The largest number of groups fetched at once that are inserted into a sorted model one by one, rather
+             * than appended and then placed in a single layout change.
+             */
+
+            static constexpr int InsertionLimit = 64;
+
+            /**
+             * The number of the store's groups that have been fetched, including any that were skipped because they
+             * had already been merged into other groups.
+             */
+
+            int m_fetchedCount = 0;
+
+            /**
+             * The indices of the fetched groups, in row order.
+             */
+
+            std::vector<int> m_groups;
+
+            /**
+             * The number of members of each fetched group that have been published, by store index.
+             */
+
+            std::vector<int> m_memberCounts;
+
+            /**
+             * The number of changes to the store's groups that have been published.
+             */
+
+            int m_revision = 0;
+
+            /**
+             * The row of each fetched group, by store index, or @c -1 for groups that have been merged into others.
+             */
+
+            std::vector<int> m_rows;
+
+            /**
+             * The column sorted by, or -1 if unsorted.
+             */
+
+            int m_sortColumn = -1;
+
+            /**
+             * The direction of the sort.
+             */
+
+            Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
+
+            /**
+             * The store that the results are fetched from.
+             */
+
+            const processing::ResultStore& m_store;
+        };
+    }
+}
+
+#endif
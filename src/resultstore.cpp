@@ -0,0 +1,207 @@
+#include <QReadLocker>
+#include <QWriteLocker>
+
+#include "resultstore.h"
+
+namespace myriad {
+    namespace processing {
+
+        void ResultStore::addMember(const int group, const int image, const int distance) {
+
+            auto& stored = m_groups[group];
+            ++stored.group.memberCount;
+            stored.group.maxDistance = qMax(stored.group.maxDistance, distance);
+            stored.group.totalSize += m_images[image].imageInfo.fileSize();
+            stored.members.push_back({image, distance});
+
+            m_images[image].parent = findRoot(stored.group.anchor);
+        }
+
+        void ResultStore::addPair(const QString& path1, const ImageInfo& image1, const QString& path2,
+                                  const ImageInfo& image2, const int distance) {
+
+            const QWriteLocker locker{&m_lock};
+
+            const auto index1 = imageIndex(path1, image1);
+            const auto index2 = imageIndex(path2, image2);
+            const auto group1 = m_images[findRoot(index1)].group;
+            const auto group2 = m_images[findRoot(index2)].group;
+
+            if (group1 < 0 && group2 < 0) {
+
+                StoredGroup stored;
+                stored.group.anchor = index1;
+                stored.group.totalSize = m_images[index1].imageInfo.fileSize();
+                m_groups.push_back(stored);
+
+                m_images[index1].group = static_cast<int>(m_groups.size()) - 1;
+                addMember(m_images[index1].group, index2, distance);
+            }
+            else if (group2 < 0) {
+
+                addMember(group1, index2, distance);
+                m_changes.push_back(group1);
+            }
+            else if (group1 < 0) {
+
+                addMember(group2, index1, distance);
+                m_changes.push_back(group2);
+            }
+            else if (group1 == group2) {
+
+                auto& group = m_groups[group1].group;
+                group.maxDistance = qMax(group.maxDistance, distance);
+                m_changes.push_back(group1);
+            }
+            else {
+
+                const auto memberCount1 = m_groups[group1].group.memberCount;
+                const auto memberCount2 = m_groups[group2].group.memberCount;
+                const auto mergeFirst = memberCount1 < memberCount2
+                    || (memberCount1 == memberCount2 && group1 > group2);
+
+                mergeGroup(mergeFirst ? group1 : group2, mergeFirst ? group2 : group1, distance);
+            }
+        }
+
+        std::vector<int> ResultStore::changedGroups(int& revision) const {
+
+            const QReadLocker locker{&m_lock};
+
+            const auto first = m_changes.begin() + qBound(0, revision, static_cast<int>(m_changes.size()));
+            revision = static_cast<int>(m_changes.size());
+            return {first, m_changes.end()};
+        }
+
+        int ResultStore::dir(const int image) const {
+
+            const QReadLocker locker{&m_lock};
+            return m_images[image].dir;
+        }
+
+        int ResultStore::dirCount() const {
+
+            const QReadLocker locker{&m_lock};
+            return m_dirPaths.size();
+        }
+
+        QString ResultStore::dirPath(const int dir) const {
+
+            const QReadLocker locker{&m_lock};
+            return m_dirPaths[dir];
+        }
+
+        QString ResultStore::fileName(const int image) const {
+
+            const QReadLocker locker{&m_lock};
+            return m_images[image].fileName;
+        }
+
+        qint64 ResultStore::fileSize(const int image) const {
+
+            const QReadLocker locker{&m_lock};
+            return m_images[image].imageInfo.fileSize();
+        }
+
+        int ResultStore::findRoot(int image) {
+
+            while (m_images[image].parent != image) {
+
+                auto& parent = m_images[image].parent;
+                parent = m_images[parent].parent;
+                image = parent;
+            }
+
+            return image;
+        }
+
+        ResultStore::Group ResultStore::group(const int group) const {
+
+            const QReadLocker locker{&m_lock};
+            return m_groups[group].group;
+        }
+
+        int ResultStore::groupCount() const {
+
+            const QReadLocker locker{&m_lock};
+            return static_cast<int>(m_groups.size());
+        }
+
+        ImageInfo ResultStore::imageInfo(const int image) const {
+
+            const QReadLocker locker{&m_lock};
+            return m_images[image].imageInfo;
+        }
+
+        int ResultStore::imageIndex(const QString& path, const ImageInfo& imageInfo) {
+
+            const auto iter = m_imageIndices.constFind(path);
+            if (iter != m_imageIndices.constEnd()) {
+                return iter.value();
+            }
+
+            // Paths are split at their last separator, so that the directory part can be shared.
+
+            const auto separator = path.lastIndexOf(QLatin1Char('/'));
+            const auto dirPath = path.left(separator);
+
+            auto dirIter = m_dirs.constFind(dirPath);
+            if (dirIter == m_dirs.constEnd()) {
+
+                dirIter = m_dirs.insert(dirPath, m_dirPaths.size());
+                m_dirPaths << dirPath;
+            }
+
+            const auto index = static_cast<int>(m_images.size());
+
+            Image image;
+            image.fileName = path.mid(separator + 1);
+            image.dir = dirIter.value();
+            image.imageInfo = imageInfo;
+            image.parent = index;
+
+            m_images.push_back(image);
+            m_imageIndices.insert(path, index);
+            return index;
+        }
+
+        ResultStore::Member ResultStore::member(const int group, const int member) const {
+
+            const QReadLocker locker{&m_lock};
+            return m_groups[group].members[member];
+        }
+
+        void ResultStore::mergeGroup(const int from, const int into, const int distance) {
+
+            // Members are copied rather than moved, since readers that haven't caught up with the merge may still
+            // read them from the merged group.
+
+            const auto fromRoot = findRoot(m_groups[from].group.anchor);
+            const auto intoRoot = findRoot(m_groups[into].group.anchor);
+
+            auto& merged = m_groups[from];
+            auto& stored = m_groups[into];
+            merged.group.mergedInto = into;
+
+            stored.members.push_back({merged.group.anchor, distance});
+            stored.members.insert(stored.members.end(), merged.members.begin(), merged.members.end());
+            stored.group.memberCount += merged.group.memberCount + 1;
+            stored.group.maxDistance = qMax(qMax(stored.group.maxDistance, merged.group.maxDistance), distance);
+            stored.group.totalSize += merged.group.totalSize;
+
+            m_images[fromRoot].parent = intoRoot;
+            m_images[fromRoot].group = -1;
+
+            m_changes.push_back(into);
+            m_changes.push_back(from);
+        }
+
+        QString ResultStore::path(const int image) const {
+
+            const QReadLocker locker{&m_lock};
+
+            const auto& stored = m_images[image];
+            return m_dirPaths[stored.dir] + QLatin1Char('/') + stored.fileName;
+        }
+    }
+}
@@ -0,0 +1,297 @@
+#ifndef MYRIAD_RESULTSTORE_H
+#define MYRIAD_RESULTSTORE_H
+
+#include <vector>
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+#include "imageinfo.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * A compact record of the duplicates found by a ProcessorThread, for review once comparison has finished.
+         * Duplicates are recorded in groups: each group holds every image that is linked to its anchor (the first image
+         * of the pair that started it) by a chain of duplicate pairs, however the pairs happened to be found. Images
+         * are grouped with a disjoint-set forest, so a pair that links two groups merges them into one.
+         *
+         * Nothing is stored per image beyond what a result list needs to display, sort by and show for review: a file
+         * name, a directory (shared with the other images in the same directory), a distance, the two indices that
+         * place it in its group and its ImageInfo (which shares its data with the processing thread's copy, rather
+         * than duplicating it). Groups and their members refer to images by index, so that each costs only a few
+         * bytes, and readers can page through a result set of hundreds of thousands of groups without anything being
+         * copied out of the store but what they display.
+         *
+         * Groups are only ever added, and are never removed or reordered: a group that is merged into another keeps its
+         * index and its members, and is marked as merged, so readers can catch up with changes at their own pace (see
+         * changedGroups()). Results are added by the processing thread while they are read by the UI, so all methods
+         * are thread-safe.
+         */
+
+        class ResultStore {
+
+        public:
+
+            /**
+             * A group of duplicates, as seen by readers.
+             */
+
+            struct Group {
+
+                /**
+                 * The index of the group's anchor image.
+                 */
+
+                int anchor = 0;
+
+                /**
+                 * The number of images in the group besides the anchor.
+                 */
+
+                int memberCount = 0;
+
+                /**
+                 * The largest distance of any of the pairs that linked the group's images together.
+                 */
+
+                int maxDistance = 0;
+
+                /**
+                 * The index of the group that this one has been merged into, or @c -1 if it hasn't been. The members of
+                 * a merged group are left in place, but are also members of the group that it was merged into.
+                 */
+
+                int mergedInto = -1;
+
+                /**
+                 * The combined file size of every image in the group.
+                 */
+
+                qint64 totalSize = 0;
+            };
+
+            /**
+             * A member of a group, other than its anchor.
+             */
+
+            struct Member {
+
+                /**
+                 * The index of the member's image.
+                 */
+
+                int image = 0;
+
+                /**
+                 * The Hamming distance between the perceptual hashes of the pair through which the member joined the
+                 * group. (For the anchor of a group that was merged into this one, it is that of the pair that linked
+                 * the two groups.)
+                 */
+
+                int distance = 0;
+            };
+
+            /**
+             * Records a pair of duplicate images. If neither image is in a group yet, a new group is started with the
+             * first as its anchor; if one of them is, the other is added to its group; and if they are in different
+             * groups, the smaller group is merged into the larger one (or the later into the earlier, if they are the
+             * same size). Members are only ever appended to a group, so the members that a reader has already seen
+             * keep their indices.
+             * @param path1 The path of the first image.
+             * @param image1 The first image.
+             * @param path2 The path of the second image.
+             * @param image2 The second image.
+             * @param distance The Hamming distance between the perceptual hashes of the images.
+             */
+
+            void addPair(const QString& path1, const ImageInfo& image1, const QString& path2, const ImageInfo& image2,
+                         int distance);
+
+            /**
+             * Gets the groups that have changed since a reader last asked, by gaining members, by being merged into
+             * another group or by a pair within them being recorded. Groups that have been started since then are not
+             * included, since they can be found from groupCount().
+             * @param revision The number of changes that the reader has already seen, which should start at @c 0 and
+             * is updated to the number of changes made so far.
+             * @return The indices of the changed groups, in the order in which they changed, with a group appearing
+             * once for every change to it.
+             */
+
+            std::vector<int> changedGroups(int& revision) const;
+
+            /**
+             * Gets the index of the directory containing an image. Every image in the same directory has the same
+             * index.
+             */
+
+            int dir(int image) const;
+
+            /**
+             * Gets the number of distinct directories containing the images recorded so far.
+             */
+
+            int dirCount() const;
+
+            /**
+             * Gets the path of a directory.
+             * @param dir The index of the directory, as returned by dir().
+             */
+
+            QString dirPath(int dir) const;
+
+            /**
+             * Gets the file name of an image, without its directory.
+             */
+
+            QString fileName(int image) const;
+
+            /**
+             * Gets the size of an image file, in bytes.
+             */
+
+            qint64 fileSize(int image) const;
+
+            /**
+             * Gets the details of an image, as read when it was hashed.
+             */
+
+            ImageInfo imageInfo(int image) const;
+
+            /**
+             * Gets one of the groups of duplicates.
+             * @param group The index of the group, which must be less than groupCount().
+             */
+
+            Group group(int group) const;
+
+            /**
+             * Gets the number of groups of duplicates recorded so far.
+             */
+
+            int groupCount() const;
+
+            /**
+             * Gets one of the members of a group of duplicates, other than its anchor.
+             * @param group The index of the group.
+             * @param member The index of the member within the group, which must be less than the group's
+             * Group::memberCount.
+             */
+
+            Member member(int group, int member) const;
+
+            /**
+             * Gets the full path of an image.
+             */
+
+            QString path(int image) const;
+
+        private:
+
+            /**
+             * An image that belongs to one or more groups.
+             */
+
+            struct Image {
+
+                /**
+                 * The file name of the image.
+                 */
+
+                QString fileName;
+
+                /**
+                 * The index of the image's directory in m_dirPaths.
+                 */
+
+                int dir = 0;
+
+                /**
+                 * The details of the image, as read when it was hashed.
+                 */
+
+                ImageInfo imageInfo;
+
+                /**
+                 * The parent of the image in the disjoint-set forest, which is the image itself for the root of each
+                 * group's tree.
+                 */
+
+                int parent = 0;
+
+                /**
+                 * The index of the image's group, if it is the root of that group's tree, or @c -1 otherwise.
+                 */
+
+                int group = -1;
+            };
+
+            /**
+             * A group of duplicates, as stored.
+             */
+
+            struct StoredGroup {
+
+                /**
+                 * The group itself.
+                 */
+
+                Group group;
+
+                /**
+                 * The members of the group, other than its anchor, in the order in which they joined it.
+                 */
+
+                std::vector<Member> members;
+            };
+
+            /**
+             * Adds an image to a group, with the image (which must not be in any group yet) as a child of the root of
+             * the group's tree. The store must be locked for writing.
+             */
+
+            void addMember(int group, int image, int distance);
+
+            /**
+             * Finds the root of the tree containing an image in the disjoint-set forest, halving the path to it along
+             * the way. The store must be locked for writing.
+             */
+
+            int findRoot(int image);
+
+            /**
+             * Finds the index of an image, adding it to the store if it isn't there already. The store must be locked
+             * for writing.
+             */
+
+            int imageIndex(const QString& path, const ImageInfo& imageInfo);
+
+            /**
+             * Merges one group into another, appending the anchor and members of the first to the members of the
+             * second. The store must be locked for writing.
+             * @param from The group to merge, which is marked as merged but otherwise left intact.
+             * @param into The group to merge it into.
+             * @param distance The distance of the pair that linked the two groups.
+             */
+
+            void mergeGroup(int from, int into, int distance);
+
+            /**
+             * The index of the group affected by every change made to an existing group, in order.
+             */
+
+            std::vector<int> m_changes;
+            QVector<QString> m_dirPaths;
+            QHash<QString, int> m_dirs;
+            std::vector<StoredGroup> m_groups;
+            QHash<QString, int> m_imageIndices;
+            std::vector<Image> m_images;
+            mutable QReadWriteLock m_lock;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include <limits>
+
+#include "scratchbuffers.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The capacity of the smallest class of file buffer, in bytes.
+             */
+
+            constexpr int MinFileDataCapacity = 64 * 1024;
+
+            /**
+             * The retained capacity of buffers constructed without one, in bytes: a file buffer of up to 64 MiB and a
+             * decoded image of up to 256 MiB are kept.
+             */
+
+            constexpr qint64 DefaultRetainedCapacity = 320 * 1024 * 1024;
+
+            /**
+             * Gets the size class that a buffer of a certain size belongs to: the smallest power of two that is at least
+             * as large (and no smaller than MinFileDataCapacity).
+             */
+
+            int sizeClass(const int size) {
+
+                auto capacity = MinFileDataCapacity;
+                while (capacity < size && capacity <= std::numeric_limits<int>::max() / 2) {
+                    capacity *= 2;
+                }
+
+                return qMax(capacity, size);
+            }
+        }
+
+        ScratchBuffers::ScratchBuffers()
+            : ScratchBuffers{DefaultRetainedCapacity} {
+        }
+
+        ScratchBuffers::ScratchBuffers(const qint64 retainedCapacity)
+            : m_retainedCapacity{retainedCapacity} {
+        }
+
+        QByteArray& ScratchBuffers::fileData(const int size) {
+
+            if (m_fileData.capacity() < size) {
+
+                m_fileData.clear();
+                m_fileData.reserve(sizeClass(size));
+            }
+
+            m_fileData.resize(size);
+            return m_fileData;
+        }
+
+        HashWorkspace& ScratchBuffers::hashWorkspace() {
+            return m_hashWorkspace;
+        }
+
+        QImage& ScratchBuffers::image() {
+            return m_image;
+        }
+
+        void ScratchBuffers::trim() {
+
+            const auto maxFileData = m_retainedCapacity / 4;
+            if (m_fileData.capacity() > maxFileData) {
+                m_fileData = QByteArray{};
+            }
+
+            if (qint64{m_image.bytesPerLine()} * m_image.height() > m_retainedCapacity - maxFileData) {
+                m_image = QImage{};
+            }
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef MYRIAD_SCRATCHBUFFERS_H
+#define MYRIAD_SCRATCHBUFFERS_H
+
+#include <QByteArray>
+#include <QImage>
+
+#include "perceptualhash.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * The working memory needed to read, decode and hash an image, gathered together so that a single hashing
+         * worker can reuse it for every image it processes rather than allocating afresh each time. Once a worker has
+         * seen a few images, reading another of a similar size performs essentially no allocations at all:
+         * - The file buffer grows in power-of-two size classes, so it settles at a size that fits most files.
+         * - The decode target is reused by Qt's image plugins whenever the next image has the same dimensions and
+         *   format, as is typical of a set of photos from the same camera.
+         * - The hashing workspace has fixed size.
+         *
+         * Buffers that have grown very large (to accommodate some exceptional image) are released by trim() rather than
+         * being held onto for the rest of the run, so that what the buffers hold between images never exceeds their
+         * retained capacity. Workers that decode within a DecodeBudget set this aside from the budget, since it is
+         * memory that no lease accounts for.
+         */
+
+        class ScratchBuffers {
+
+        public:
+
+            /**
+             * Constructs a set of buffers with the default retained capacity, which is enough to hold onto the buffers
+             * for a photo of a few hundred megapixels.
+             */
+
+            ScratchBuffers();
+
+            /**
+             * Constructs a set of buffers with a specified retained capacity. None of the buffers are allocated until
+             * they are first used.
+             * @param retainedCapacity The most memory, in bytes, that trim() leaves the buffers holding onto. A quarter
+             * of this may be kept for file data, and the rest for the decoded image.
+             */
+
+            explicit ScratchBuffers(qint64 retainedCapacity);
+
+            /**
+             * Gets a buffer of a specified size into which a file may be read, growing the underlying allocation only
+             * if it is too small.
+             * @param size The number of bytes needed.
+             * @return The buffer, which will have exactly @p size bytes of undefined contents.
+             */
+
+            QByteArray& fileData(int size);
+
+            /**
+             * Gets the workspace used to generate perceptual hashes.
+             */
+
+            HashWorkspace& hashWorkspace();
+
+            /**
+             * Gets the image that decoded image data should be read into.
+             */
+
+            QImage& image();
+
+            /**
+             * Releases any buffers that have grown larger than the retained capacity allows. This should be called once
+             * each image has been finished with.
+             */
+
+            void trim();
+
+        private:
+
+            QByteArray m_fileData;
+            HashWorkspace m_hashWorkspace;
+            QImage m_image;
+            const qint64 m_retainedCapacity;
+        };
+    }
+}
+
+#endif
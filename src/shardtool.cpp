@@ -0,0 +1,846 @@
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+#include "cascadesettings.h"
+#include "externalhashsearch.h"
+#include "filesystem.h"
+#include "hashindex.h"
+#include "imagehasher.h"
+#include "imageinfo.h"
+#include "indexshard.h"
+#include "inputscanner.h"
+#include "perceptualhash.h"
+#include "settings.h"
+#include "similaritycascade.h"
+
+using myriad::processing::cascadeFromSettings;
+using myriad::processing::ExternalHashSearch;
+using myriad::processing::FileSystem;
+using myriad::processing::HashIndex;
+using myriad::processing::ImageHasher;
+using myriad::processing::ImageInfo;
+using myriad::processing::IndexShard;
+using myriad::processing::InputScanner;
+using myriad::processing::SimilarityCascade;
+using myriad::Settings;
+
+namespace {
+
+    /**
+     * The period, in milliseconds, at which progress is reported while images are hashed.
+     */
+
+    constexpr int ProgressPeriod = 1000;
+
+    /**
+     * How a shard is built.
+     */
+
+    struct BuildOptions {
+
+        /**
+         * The largest amount of memory, in bytes, that may be used at once for decoding images.
+         */
+
+        qint64 decodeMemoryBudget;
+
+        /**
+         * Whether to read images in physical order on disk rather than in scan order.
+         */
+
+        bool physicalOrder;
+
+        /**
+         * Whether to take a digest of the pixels of each image.
+         */
+
+        bool pixelDigests;
+
+        /**
+         * Whether to read images into the page cache ahead of hashing them.
+         */
+
+        bool prefetch;
+
+        /**
+         * Whether to skip files and directories on a different filesystem from the input they were found within.
+         */
+
+        bool stayOnFileSystem;
+
+        /**
+         * The number of worker threads to hash images on.
+         */
+
+        int threadCount;
+
+        /**
+         * Whether to hash the previews embedded in camera originals in place of the full images.
+         */
+
+        bool useEmbeddedPreviews;
+    };
+
+    /**
+     * Scans a set of inputs just as Myriad does, hashes every image found just as ProcessorThread does, and writes the
+     * result to a shard file.
+     */
+
+    int buildShard(const QStringList& inputPaths, const QString& outputPath, const BuildOptions& options) {
+
+        QTextStream err{stderr};
+
+        QHash<QString, ImageInfo> images;
+        InputScanner scanner{images, options.stayOnFileSystem};
+        scanner.setIncludeRawFiles(options.useEmbeddedPreviews);
+        for (const auto& inputPath : inputPaths) {
+            scanner.addInput(QFileInfo{inputPath}.absoluteFilePath());
+        }
+
+        const auto paths = ImageHasher::hashingOrder(scanner.takeScanOrder(), FileSystem::local(),
+                                                     options.physicalOrder);
+        err << "Found " << paths.size() << " images in " << scanner.inputDirs().size() << " directories\n";
+
+        std::vector<ImageInfo> infos(paths.size());
+        QVector<ImageInfo *> imageInfos;
+        imageInfos.reserve(paths.size());
+        for (auto& info : infos) {
+            imageInfos << &info;
+        }
+
+        ImageHasher hasher{paths, imageInfos, FileSystem::local(), options.threadCount, options.decodeMemoryBudget,
+                           options.useEmbeddedPreviews};
+        hasher.setPixelDigests(options.pixelDigests);
+        hasher.setPrefetch(options.prefetch);
+        hasher.start();
+
+        while (!hasher.waitForDone(ProgressPeriod)) {
+            err << "Hashed " << hasher.hashedCount() << " of " << paths.size() << " images\n";
+            err.flush();
+        }
+
+        IndexShard shard;
+        shard.reserve(paths.size());
+        for (auto i = 0; i < paths.size(); ++i) {
+            shard.append(paths[i], infos[i]);
+        }
+
+        if (!shard.save(outputPath)) {
+            return 1;
+        }
+
+        err << "Wrote " << shard.size() << " images to " << outputPath << '\n';
+        return 0;
+    }
+
+    /**
+     * Opens the file to which duplicate pairs are written.
+     * @param file The file to open.
+     * @param path The path of the file, or an empty string for standard output.
+     */
+
+    bool openPairsFile(QFile& file, const QString& path) {
+
+        if (path.isEmpty()) {
+            return file.open(stdout, QIODevice::WriteOnly);
+        }
+
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+
+            QTextStream{stderr} << "Could not write " << path << ": " << file.errorString() << '\n';
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Loads a set of shards into a single index, optionally writing the merged index to a shard file of its own, and
+     * searches it for duplicates in the same way as ProcessorThread::compareImages(). Each duplicate pair is written
+     * as a line of tab-separated values: the Hamming distance between the images' perceptual hashes, followed by the
+     * paths of the two images.
+     */
+
+    int mergeShards(const QStringList& shardPaths, const IndexShard::PathMap& pathMap, const QString& outputPath,
+                    const QString& pairsPath, const SimilarityCascade& cascade) {
+
+        QTextStream err{stderr};
+
+        IndexShard merged;
+        for (const auto& shardPath : shardPaths) {
+
+            const auto previousSize = merged.size();
+            auto duplicateCount = 0;
+            if (!merged.load(shardPath, pathMap, &duplicateCount)) {
+                return 1;
+            }
+
+            err << "Loaded " << merged.size() - previousSize << " images from " << shardPath;
+            if (duplicateCount > 0) {
+                err << " (skipping " << duplicateCount << " already loaded from earlier shards)";
+            }
+            err << '\n';
+        }
+
+        if (!outputPath.isEmpty() && !merged.save(outputPath)) {
+            return 1;
+        }
+
+        QFile pairsFile;
+        if (!openPairsFile(pairsFile, pairsPath)) {
+            return 1;
+        }
+
+        QTextStream pairs{&pairsFile};
+
+        // Images from every shard go into one HashIndex, so pairs that span shards are found exactly as pairs within
+        // a shard are, from the hashes alone.
+
+        const auto& entries = merged.entries();
+        const auto imageCount = static_cast<int>(entries.size());
+
+        HashIndex index;
+        index.reserve(imageCount);
+        for (const auto& entry : entries) {
+            index.append(entry.image);
+        }
+
+        std::vector<HashIndex::Candidate> candidates;
+        auto pairCount = 0;
+
+        for (auto i = 0; i < imageCount; ++i) {
+
+            const auto& image1 = entries[i].image;
+            index.findCandidates(image1, i + 1, cascade, candidates);
+
+            for (const auto& candidate : candidates) {
+
+                const auto& image2 = entries[candidate.index].image;
+                if (!cascade.verify(image1, image2, candidate.orientation)) {
+                    continue;
+                }
+
+                pairs << myriad::processing::hammingDistance(image1.perceptualHash(candidate.orientation),
+                                                             image2.perceptualHash())
+                      << '\t' << entries[i].path << '\t' << entries[candidate.index].path << '\n';
+                ++pairCount;
+            }
+        }
+
+        pairs.flush();
+        err << "Found " << pairCount << " duplicate pairs among " << imageCount << " images\n";
+        return 0;
+    }
+
+    /**
+     * Sorts records of any size by a key in bounded memory. Records are gathered until they fill the memory budget,
+     * and each such run is then sorted and written to a file of its own; once every record has been added, the runs
+     * are merged as the records are read back. Keys are compared byte by byte, so numbers should be written to them
+     * big-endian (as QDataStream writes them) to be sorted by value.
+     */
+
+    class ExternalSorter {
+
+    public:
+
+        /**
+         * Constructs an empty sorter.
+         * @param workDir The directory in which to write the runs, which must outlive the sorter.
+         * @param name The name to give the files of the runs, which must be unique within @p workDir.
+         * @param memoryBudget The largest amount of memory, in bytes, that records may take up before being written.
+         */
+
+        ExternalSorter(const QTemporaryDir& workDir, const QString& name, const qint64 memoryBudget)
+            : m_memoryBudget{memoryBudget},
+              m_name{name},
+              m_workDir(workDir) {
+        }
+
+        ~ExternalSorter() {
+            for (const auto& run : m_runs) {
+                run.file->remove();
+            }
+        }
+
+        /**
+         * Adds a record, writing a run if the memory budget is full.
+         * @return @c true if the record was added; @c false if a run could not be written.
+         */
+
+        bool add(const QByteArray& key, const QByteArray& value) {
+
+            if (m_hasFailed) {
+                return false;
+            }
+
+            m_records.push_back({key, value});
+            m_recordSize += static_cast<qint64>(sizeof(Record)) + key.size() + value.size();
+            return m_recordSize < m_memoryBudget || writeRun();
+        }
+
+        /**
+         * Determines whether a run could not be written or read.
+         */
+
+        bool hasFailed() const {
+            return m_hasFailed;
+        }
+
+        /**
+         * Reads the next record in order of key, once sort() has been called.
+         * @return @c true if a record was read; @c false if every record has been read, or if a run could not be read
+         * (see hasFailed()).
+         */
+
+        bool next(QByteArray& key, QByteArray& value) {
+
+            if (m_hasFailed || m_heap.empty()) {
+                return false;
+            }
+
+            const auto runOrder = [this](const int lhs, const int rhs) {return isAfter(lhs, rhs);};
+
+            std::pop_heap(m_heap.begin(), m_heap.end(), runOrder);
+            auto& run = m_runs[m_heap.back()];
+            key = std::move(run.record.key);
+            value = std::move(run.record.value);
+
+            if (run.remaining == 0) {
+                m_heap.pop_back();
+            }
+            else if (readRecord(run)) {
+                std::push_heap(m_heap.begin(), m_heap.end(), runOrder);
+            }
+
+            return !m_hasFailed;
+        }
+
+        /**
+         * Writes the last run and starts merging the runs, after which no more records can be added.
+         * @return @c true if the runs are ready to be read; @c false if any could not be written or read.
+         */
+
+        bool sort() {
+
+            if (m_hasFailed || (!m_records.empty() && !writeRun())) {
+                return false;
+            }
+
+            for (auto i = 0; i < static_cast<int>(m_runs.size()); ++i) {
+
+                auto& run = m_runs[i];
+                if (!run.file->seek(0)) {
+                    return fail(*run.file);
+                }
+
+                if (run.remaining > 0 && readRecord(run)) {
+                    m_heap.push_back(i);
+                }
+            }
+
+            std::make_heap(m_heap.begin(), m_heap.end(), [this](const int lhs, const int rhs) {
+                return isAfter(lhs, rhs);
+            });
+
+            return !m_hasFailed;
+        }
+
+    private:
+
+        /**
+         * A record, as it is held in memory.
+         */
+
+        struct Record {
+            QByteArray key;
+            QByteArray value;
+        };
+
+        /**
+         * A sorted run, along with the next record to be merged from it.
+         */
+
+        struct Run {
+            std::unique_ptr<QFile> file;
+            std::unique_ptr<QDataStream> stream;
+            qint64 remaining;
+            Record record;
+        };
+
+        /**
+         * Reports that a run could not be written or read, after which the sorter reads and adds no more records.
+         */
+
+        bool fail(const QFile& file) {
+
+            qWarning("Could not read or write %s: %s", qPrintable(file.fileName()), qPrintable(file.errorString()));
+            m_hasFailed = true;
+            return false;
+        }
+
+        /**
+         * Determines whether the next record of one run comes after that of another, which puts the run with the
+         * first record at the top of the heap.
+         */
+
+        bool isAfter(const int lhs, const int rhs) const {
+            return m_runs[rhs].record.key < m_runs[lhs].record.key;
+        }
+
+        /**
+         * Reads the next record of a run, which must have one left.
+         */
+
+        bool readRecord(Run& run) {
+
+            *run.stream >> run.record.key >> run.record.value;
+            --run.remaining;
+            return run.stream->status() == QDataStream::Ok || fail(*run.file);
+        }
+
+        /**
+         * Sorts the records held in memory and writes them out as a run.
+         */
+
+        bool writeRun() {
+
+            std::sort(m_records.begin(), m_records.end(), [](const Record& lhs, const Record& rhs) {
+                return lhs.key < rhs.key;
+            });
+
+            const auto filePath = m_workDir.filePath(
+                QStringLiteral("%1-%2").arg(m_name).arg(static_cast<int>(m_runs.size())));
+
+            Run run{std::make_unique<QFile>(filePath), {}, static_cast<qint64>(m_records.size()), {}};
+            if (!run.file->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+                return fail(*run.file);
+            }
+
+            run.stream = std::make_unique<QDataStream>(run.file.get());
+            for (const auto& record : m_records) {
+                *run.stream << record.key << record.value;
+            }
+
+            if (run.stream->status() != QDataStream::Ok) {
+                return fail(*run.file);
+            }
+
+            m_runs.push_back(std::move(run));
+            m_records.clear();
+            m_recordSize = 0;
+            return true;
+        }
+
+        bool m_hasFailed = false;
+        std::vector<int> m_heap;
+        const qint64 m_memoryBudget;
+        const QString m_name;
+        std::vector<Record> m_records;
+        qint64 m_recordSize = 0;
+        std::vector<Run> m_runs;
+        const QTemporaryDir& m_workDir;
+    };
+
+    /**
+     * Makes a sort key for an ExternalSorter from a series of numbers, which sorts by each number in turn.
+     */
+
+    QByteArray numericKey(const std::initializer_list<quint32> numbers) {
+
+        QByteArray key;
+        QDataStream stream{&key, QIODevice::WriteOnly};
+        for (const auto number : numbers) {
+            stream << number;
+        }
+
+        return key;
+    }
+
+    /**
+     * Searches a set of shards for duplicates as mergeShards() does, but in bounded memory, so that shards of any
+     * combined size can be searched. The hashes are streamed from the shards into an ExternalHashSearch, and the pairs
+     * that pass its stages of the cascade are sorted on disk by their images. The shards, whose images are numbered in
+     * the order in which they are read, are then streamed twice more: once to join each pair with the path and image
+     * of its first image, after which the pairs are sorted by their second images, and once to join them with their
+     * second images and put them through the final stage. The pairs that pass are sorted by their paths to write each
+     * pair of paths only once.
+     */
+
+    int searchShardsExternally(const QStringList& shardPaths, const IndexShard::PathMap& pathMap,
+                               const QString& pairsPath, const SimilarityCascade& cascade, const qint64 memoryBudget,
+                               const QString& workDirPath) {
+
+        QTextStream err{stderr};
+
+        const auto workDirParent = workDirPath.isEmpty() ? QDir::tempPath() : workDirPath;
+        QTemporaryDir workDir{workDirParent + QStringLiteral("/myriad-pairs-XXXXXX")};
+        if (!workDir.isValid()) {
+
+            err << "Could not create working files in " << workDirParent << '\n';
+            return 1;
+        }
+
+        // The hash search runs while the pairs that it finds are sorted, so the two share the memory budget; after
+        // that, one sorter fills its memory at a time, while another's runs are merged from disk.
+
+        const auto sortBudget = memoryBudget / 2;
+
+        ExternalHashSearch search{cascade, memoryBudget - sortBudget, workDirPath};
+        auto spillFailed = false;
+        const auto spillImage = [&search, &spillFailed](const QString&, const ImageInfo& image) {
+            spillFailed = spillFailed || !search.append(image);
+        };
+
+        for (const auto& shardPath : shardPaths) {
+
+            const auto previousSize = search.size();
+            if (!IndexShard::read(shardPath, pathMap, spillImage) || spillFailed) {
+                return 1;
+            }
+
+            err << "Spilled " << search.size() - previousSize << " images from " << shardPath << '\n';
+        }
+
+        // A pair can be found in more than one orientation. Sorting the pairs by distance and then orientation after
+        // their images puts the closest orientation of each pair first (the lowest, if several are equally close, as
+        // HashIndex::findCandidates() chooses), so that only the first of each pair need be kept.
+
+        ExternalSorter byImages{workDir, QStringLiteral("images"), sortBudget};
+        const auto spillPair = [&byImages](const quint32 image1, const quint32 image2, const int orientation,
+                                           const int distance) {
+            byImages.add(numericKey({image1, image2, static_cast<quint32>(distance),
+                                     static_cast<quint32>(orientation)}), {});
+        };
+
+        if (!search.findPairs(spillPair) || !byImages.sort()) {
+            return 1;
+        }
+
+        struct Pair {
+            quint32 image1;
+            quint32 image2;
+            quint32 distance;
+            quint32 orientation;
+        };
+
+        Pair pair{};
+        auto hasPair = false;
+
+        const auto nextPair = [&byImages, &pair, &hasPair] {
+
+            const auto previous = pair;
+            const auto hadPair = hasPair;
+
+            QByteArray key;
+            QByteArray value;
+            while ((hasPair = byImages.next(key, value))) {
+
+                QDataStream stream{key};
+                stream >> pair.image1 >> pair.image2 >> pair.distance >> pair.orientation;
+                if (!hadPair || pair.image1 != previous.image1 || pair.image2 != previous.image2) {
+                    return;
+                }
+            }
+        };
+
+        // The pairs are in order of their first images, as the images are in the shards, so each pair's first image
+        // is picked out as the shards are read. The pair is then sorted by its second image, carrying the first.
+
+        ExternalSorter bySecondImage{workDir, QStringLiteral("second"), sortBudget};
+        quint32 index = 0;
+
+        const auto pickFirst = [&bySecondImage, &pair, &hasPair, &nextPair, &index](const QString& path,
+                                                                                   const ImageInfo& image) {
+
+            for (; hasPair && pair.image1 == index; nextPair()) {
+
+                QByteArray value;
+                QDataStream stream{&value, QIODevice::WriteOnly};
+                stream << pair.distance << pair.orientation << path << image;
+                bySecondImage.add(numericKey({pair.image2, pair.image1}), value);
+            }
+
+            ++index;
+        };
+
+        nextPair();
+        for (const auto& shardPath : shardPaths) {
+            if (!IndexShard::read(shardPath, pathMap, pickFirst)) {
+                return 1;
+            }
+        }
+
+        if (byImages.hasFailed() || !bySecondImage.sort()) {
+            return 1;
+        }
+
+        // Shards that overlap hold some paths more than once, which mergeShards() skips as it loads them. Here, an
+        // image paired with its own copy is skipped, and the pairs that pass are sorted by their paths, so that copies
+        // of the same pair of paths come together and only the first is written.
+
+        ExternalSorter byPaths{workDir, QStringLiteral("paths"), sortBudget};
+        QByteArray key;
+        QByteArray value;
+        auto hasEntry = bySecondImage.next(key, value);
+        index = 0;
+
+        const auto pickSecond = [&cascade, &bySecondImage, &byPaths, &key, &value, &hasEntry, &index](
+                                    const QString& path2, const ImageInfo& image2) {
+
+            for (; hasEntry; hasEntry = bySecondImage.next(key, value)) {
+
+                quint32 second = 0;
+                QDataStream{key} >> second;
+                if (second != index) {
+                    break;
+                }
+
+                quint32 distance = 0;
+                quint32 orientation = 0;
+                QString path1;
+                ImageInfo image1;
+
+                QDataStream stream{value};
+                stream >> distance >> orientation >> path1 >> image1;
+
+                if (path1 == path2 || !cascade.verify(image1, image2, static_cast<int>(orientation))) {
+                    continue;
+                }
+
+                QByteArray line;
+                QDataStream{&line, QIODevice::WriteOnly} << distance << path1 << path2;
+                byPaths.add(qMin(path1, path2).toUtf8() + '\0' + qMax(path1, path2).toUtf8(), line);
+            }
+
+            ++index;
+        };
+
+        for (const auto& shardPath : shardPaths) {
+            if (!IndexShard::read(shardPath, pathMap, pickSecond)) {
+                return 1;
+            }
+        }
+
+        if (bySecondImage.hasFailed() || !byPaths.sort()) {
+            return 1;
+        }
+
+        QFile pairsFile;
+        if (!openPairsFile(pairsFile, pairsPath)) {
+            return 1;
+        }
+
+        QTextStream pairs{&pairsFile};
+        QByteArray previousKey;
+        auto pairCount = 0;
+
+        while (byPaths.next(key, value)) {
+
+            if (pairCount > 0 && key == previousKey) {
+                continue;
+            }
+
+            quint32 distance = 0;
+            QString path1;
+            QString path2;
+
+            QDataStream stream{value};
+            stream >> distance >> path1 >> path2;
+
+            pairs << distance << '\t' << path1 << '\t' << path2 << '\n';
+            previousKey = key;
+            ++pairCount;
+        }
+
+        pairs.flush();
+        if (byPaths.hasFailed()) {
+            return 1;
+        }
+
+        err << "Found " << pairCount << " duplicate pairs among " << search.size() << " images\n";
+        return 0;
+    }
+
+    /**
+     * Parses the values of the --map option, each of the form <tt>from=to</tt>.
+     * @return @c true if every value could be parsed; @c false otherwise.
+     */
+
+    bool parsePathMap(const QStringList& values, IndexShard::PathMap& pathMap) {
+
+        for (const auto& value : values) {
+
+            const auto separator = value.indexOf(QLatin1Char('='));
+            if (separator <= 0 || separator == value.size() - 1) {
+                return false;
+            }
+
+            pathMap.append({QDir::cleanPath(value.left(separator)), QDir::cleanPath(value.mid(separator + 1))});
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char ** argv) {
+
+    QCoreApplication app{argc, argv};
+    QCoreApplication::setApplicationName(QStringLiteral("myriad_shard"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Builds shards of Myriad's image index and merges them.\n\n"
+        "  build: hashes the images beneath the given inputs into a shard file.\n"
+        "  merge: merges the given shard files into one index and searches it for duplicates, writing each pair "
+        "found as a line of tab-separated values: the distance between the images, then their paths.\n\n"
+        "Each machine can build a shard from its own part of an archive, and any machine can then merge them. "
+        "Several shards can equally be built on one machine, to try this out locally."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("command"), QStringLiteral("Either build or merge."));
+    parser.addPositionalArgument(QStringLiteral("paths"),
+        QStringLiteral("The inputs to hash (for build) or the shards to merge (for merge)."),
+        QStringLiteral("paths..."));
+
+    const QCommandLineOption outputOption{{QStringLiteral("o"), QStringLiteral("output")},
+        QStringLiteral("Write the shard (for build) or the merged index (for merge) to <file>."),
+        QStringLiteral("file")};
+    const QCommandLineOption threadsOption{QStringLiteral("threads"),
+        QStringLiteral("Hash images on <n> worker threads, or 0 for one per processor core (default: the "
+                       "HashingThreads setting)."),
+        QStringLiteral("n")};
+    const QCommandLineOption decodeBudgetOption{QStringLiteral("decode-budget"),
+        QStringLiteral("Use at most <MiB> of memory at once for decoding images (default: the DecodeMemoryBudget "
+                       "setting)."),
+        QStringLiteral("MiB")};
+    const QCommandLineOption embeddedPreviewsOption{QStringLiteral("embedded-previews"),
+        QStringLiteral("Hash the JPEG previews embedded in RAW files in place of the full images, whatever the "
+                       "EmbeddedPreviews setting says.")};
+    const QCommandLineOption pixelDigestsOption{QStringLiteral("pixel-digests"),
+        QStringLiteral("Take a digest of the pixels of each image, whatever the PixelDigests setting says.")};
+    const QCommandLineOption oneFileSystemOption{QStringLiteral("one-file-system"),
+        QStringLiteral("Skip files and directories on a different filesystem from the input they were found within, "
+                       "whatever the StayOnFileSystem setting says.")};
+    const QCommandLineOption mapOption{QStringLiteral("map"),
+        QStringLiteral("Remap paths beneath <from> (as mounted where a shard was built) to lie beneath <to>. May be "
+                       "given more than once."),
+        QStringLiteral("from=to")};
+    const QCommandLineOption pairsOption{QStringLiteral("pairs"),
+        QStringLiteral("Write duplicate pairs to <file> rather than to standard output."), QStringLiteral("file")};
+    const QCommandLineOption differenceHashLimitOption{QStringLiteral("dhash-limit"),
+        QStringLiteral("Reject pairs whose difference hashes differ in more than <bits> bits (default: the "
+                       "DifferenceHashLimit setting)."),
+        QStringLiteral("bits")};
+    const QCommandLineOption minimumSsimOption{QStringLiteral("min-ssim"),
+        QStringLiteral("Reject pairs whose thumbnails have a structural similarity below <percent> (default: the "
+                       "MinimumStructuralSimilarity setting)."),
+        QStringLiteral("percent")};
+    const QCommandLineOption orientationsOption{QStringLiteral("orientations"),
+        QStringLiteral("Match rotated and mirrored copies, whatever the MatchOrientations setting says.")};
+    const QCommandLineOption externalOption{QStringLiteral("external"),
+        QStringLiteral("Search the shards on disk, in bounded memory, rather than loading them into memory. This "
+                       "cannot be combined with --output.")};
+    const QCommandLineOption memoryOption{QStringLiteral("memory"),
+        QStringLiteral("With --external, use at most <MiB> of memory for sorting hashes and pairs (default 1024)."),
+        QStringLiteral("MiB"), QStringLiteral("1024")};
+    const QCommandLineOption workDirOption{QStringLiteral("work-dir"),
+        QStringLiteral("With --external, keep working files in <dir> (default: the temporary directory)."),
+        QStringLiteral("dir")};
+
+    parser.addOptions({outputOption, threadsOption, decodeBudgetOption, embeddedPreviewsOption, pixelDigestsOption,
+                       oneFileSystemOption, mapOption, pairsOption, differenceHashLimitOption, minimumSsimOption,
+                       orientationsOption, externalOption, memoryOption, workDirOption});
+    parser.process(app);
+
+    QTextStream err{stderr};
+
+    auto arguments = parser.positionalArguments();
+    const auto command = arguments.isEmpty() ? QString{} : arguments.takeFirst();
+
+    if (command == QLatin1String("build")) {
+
+        if (arguments.isEmpty() || !parser.isSet(outputOption)) {
+
+            err << "build needs at least one input and an --output file.\n";
+            return 1;
+        }
+
+        // Anything not given on the command line is taken from the settings, so that a shard is built just as the
+        // application would hash the same images.
+
+        const auto threadCount = parser.isSet(threadsOption) ? parser.value(threadsOption).toInt()
+                                                             : Settings::self()->hashingThreads();
+        const auto decodeBudget = parser.isSet(decodeBudgetOption) ? parser.value(decodeBudgetOption).toLongLong()
+                                                                   : qint64{Settings::self()->decodeMemoryBudget()};
+
+        BuildOptions options;
+        options.decodeMemoryBudget = decodeBudget * 1024 * 1024;
+        options.physicalOrder = Settings::self()->hashingOrder() == Settings::EnumHashingOrder::Physical;
+        options.pixelDigests = parser.isSet(pixelDigestsOption) || Settings::self()->pixelDigests();
+        options.prefetch = Settings::self()->prefetch();
+        options.stayOnFileSystem = parser.isSet(oneFileSystemOption) || Settings::self()->stayOnFileSystem();
+        options.threadCount = threadCount > 0 ? threadCount : QThread::idealThreadCount();
+        options.useEmbeddedPreviews = parser.isSet(embeddedPreviewsOption) || Settings::self()->embeddedPreviews();
+
+        return buildShard(arguments, parser.value(outputOption), options);
+    }
+
+    if (command == QLatin1String("merge")) {
+
+        if (arguments.isEmpty()) {
+
+            err << "merge needs at least one shard.\n";
+            return 1;
+        }
+
+        IndexShard::PathMap pathMap;
+        if (!parsePathMap(parser.values(mapOption), pathMap)) {
+
+            err << "Each --map must be of the form <from>=<to>.\n";
+            return 1;
+        }
+
+        auto cascade = cascadeFromSettings();
+        if (parser.isSet(orientationsOption)) {
+            cascade.matchOrientations = true;
+        }
+        if (parser.isSet(differenceHashLimitOption)) {
+            cascade.differenceHashLimit = parser.value(differenceHashLimitOption).toInt();
+        }
+        if (parser.isSet(minimumSsimOption)) {
+            cascade.minimumStructuralSimilarity = parser.value(minimumSsimOption).toInt() / 100.0f;
+        }
+
+        if (parser.isSet(externalOption)) {
+
+            if (parser.isSet(outputOption)) {
+
+                err << "--output cannot be combined with --external.\n";
+                return 1;
+            }
+
+            return searchShardsExternally(arguments, pathMap, parser.value(pairsOption), cascade,
+                                          parser.value(memoryOption).toLongLong() * 1024 * 1024,
+                                          parser.value(workDirOption));
+        }
+
+        return mergeShards(arguments, pathMap, parser.value(outputOption), parser.value(pairsOption), cascade);
+    }
+
+    parser.showHelp(1);
+}
@@ -0,0 +1,58 @@
+#include <cmath>
+
+#include "perceptualhash.h"
+#include "similaritycascade.h"
+
+namespace myriad {
+    namespace processing {
+
+        bool SimilarityCascade::isDuplicate(const ImageInfo& lhs, const ImageInfo& rhs) const {
+            return match(lhs, rhs) >= 0;
+        }
+
+        int SimilarityCascade::match(const ImageInfo& lhs, const ImageInfo& rhs) const {
+
+            if (lhs.perceptualHash().isNull() || rhs.perceptualHash().isNull()) {
+                return -1;
+            }
+
+            // The orientation is chosen exactly as HashIndex::findCandidates() chooses it, so that a pair is judged the
+            // same way whether it is matched alone or found in bulk.
+
+            auto bestDistance = perceptualHashLimit() + 1;
+            auto bestOrientation = -1;
+
+            for (auto orientation = 0; orientation < orientationCount(); ++orientation) {
+
+                if (hammingDistance(lhs.differenceHash(orientation), rhs.differenceHash()) <= differenceHashLimit) {
+
+                    const auto distance = hammingDistance(lhs.perceptualHash(orientation), rhs.perceptualHash());
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        bestOrientation = orientation;
+                    }
+                }
+            }
+
+            return bestOrientation >= 0 && verify(lhs, rhs, bestOrientation) ? bestOrientation : -1;
+        }
+
+        int SimilarityCascade::orientationCount() const {
+            return matchOrientations ? OrientationCount : 1;
+        }
+
+        int SimilarityCascade::perceptualHashLimit() const {
+
+            // ImageInfo::difference() is the number of differing bits divided by the hash width, and duplicates are
+            // those strictly below the threshold, so this is the largest bit count for which that quotient is below the
+            // threshold.
+
+            return static_cast<int>(std::ceil(threshold * PerceptualHashBits)) - 1;
+        }
+
+        bool SimilarityCascade::verify(const ImageInfo& lhs, const ImageInfo& rhs, const int orientation) const {
+            return minimumStructuralSimilarity <= 0.0f
+                || ImageInfo::structuralSimilarity(lhs, rhs, orientation) >= minimumStructuralSimilarity;
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef MYRIAD_SIMILARITYCASCADE_H
+#define MYRIAD_SIMILARITYCASCADE_H
+
+#include "imageinfo.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * The sequence of tests through which a pair of images must pass to be reported as duplicates, from cheapest
+         * to most expensive:
+         *
+         * 1. Their difference hashes must differ in at most @c differenceHashLimit bits. This stage can be disabled by
+         *    setting the limit to 64.
+         * 2. Their perceptual hashes must be closer than @c threshold, as measured by ImageInfo::difference().
+         * 3. The structural similarity of their thumbnails must be at least @c minimumStructuralSimilarity. This
+         *    stage can be disabled by setting the minimum to 0.
+         *
+         * If @c matchOrientations is set, the first image of the pair is also tried in each of its other orientations,
+         * so that rotated and mirrored copies are found. Of the orientations that pass the first two stages, only the
+         * one in which the perceptual hashes are closest (the first such, if several are equally close) is verified,
+         * and the pair passes if it passes there.
+         *
+         * The first two stages are usually applied in bulk by a HashIndex, and the last to the few pairs that survive.
+         */
+
+        struct SimilarityCascade {
+
+            /**
+             * Applies the whole cascade to a pair of images.
+             * @return @c true if @p lhs and @p rhs pass every stage of the cascade; @c false otherwise.
+             */
+
+            bool isDuplicate(const ImageInfo& lhs, const ImageInfo& rhs) const;
+
+            /**
+             * Applies the whole cascade to a pair of images, as isDuplicate() does, but reports the orientation in
+             * which they matched.
+             * @return The orientation of @p lhs in which the pair passed every stage of the cascade, chosen as
+             * described for SimilarityCascade, or @c -1 if the pair didn't pass.
+             */
+
+            int match(const ImageInfo& lhs, const ImageInfo& rhs) const;
+
+            /**
+             * Gets the number of orientations of the first image of each pair that should be tried: all of them if
+             * @c matchOrientations is set, and only the first otherwise.
+             */
+
+            int orientationCount() const;
+
+            /**
+             * Gets the largest number of bits in which two perceptual hashes may differ and still pass the second
+             * stage of the cascade.
+             */
+
+            int perceptualHashLimit() const;
+
+            /**
+             * Applies the final, verification stage of the cascade to a pair of images that have already passed the
+             * earlier stages.
+             * @param lhs The first image.
+             * @param rhs The second image.
+             * @param orientation The orientation of @p lhs in which the pair passed the earlier stages.
+             */
+
+            bool verify(const ImageInfo& lhs, const ImageInfo& rhs, int orientation = 0) const;
+
+            int differenceHashLimit = 64;
+            bool matchOrientations = false;
+            float minimumStructuralSimilarity = 0.0f;
+            float threshold = SimilarityThreshold;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include <cstring>
+#include <utility>
+
+#include <QBuffer>
+#include <QImage>
+#include <QMimeDatabase>
+#include <QMutexLocker>
+#include <QVector>
+
+#include "syntheticfilesystem.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The device number reported for every synthetic file, chosen to be unlikely to clash with a real one.
+             */
+
+            constexpr quint64 SyntheticDevice = 0x5359'4e54;
+
+            /**
+             * The side length of the images made by the default content generator.
+             */
+
+            constexpr int DefaultImageSide = 64;
+
+            /**
+             * The number of digits in synthetic file names.
+             */
+
+            constexpr int FileNameDigits = 6;
+
+            QByteArray defaultContent(const int contentIndex) {
+
+                QImage image{DefaultImageSide, DefaultImageSide, QImage::Format_RGB32};
+                for (auto y = 0; y < image.height(); ++y) {
+
+                    auto * const line = reinterpret_cast<QRgb *>(image.scanLine(y));
+                    for (auto x = 0; x < image.width(); ++x) {
+                        line[x] = qRgb((x * 4 + contentIndex * 37) % 256, (y * 4 + contentIndex * 91) % 256,
+                                       ((x ^ y) * 4 + contentIndex * 13) % 256);
+                    }
+                }
+
+                QByteArray data;
+                QBuffer buffer{&data};
+                buffer.open(QIODevice::WriteOnly);
+                image.save(&buffer, "BMP");
+                return data;
+            }
+        }
+
+        SyntheticFileSystem::SyntheticFileSystem(Layout layout, ContentGenerator generator)
+            : m_layout(std::move(layout)),
+              m_generator{generator ? std::move(generator) : ContentGenerator{defaultContent}},
+              m_contents(static_cast<std::size_t>(qMax(1, m_layout.distinctContents))),
+              m_lastModified{QDateTime::fromMSecsSinceEpoch(0)} {
+        }
+
+        const QByteArray& SyntheticFileSystem::content(const qint64 fileIndex) const {
+
+            // Generated contents are never replaced or removed, so references to them remain valid once the lock is
+            // released.
+
+            QMutexLocker locker{&m_contentsMutex};
+
+            auto& content = m_contents[static_cast<std::size_t>(fileIndex % static_cast<qint64>(m_contents.size()))];
+            if (content.isNull()) {
+                content = m_generator(static_cast<int>(fileIndex % static_cast<qint64>(m_contents.size())));
+            }
+
+            return content;
+        }
+
+        QStringList SyntheticFileSystem::entryNames(const QString& dirPath) const {
+
+            const auto node = locate(dirPath);
+            if (!node.isValid || node.isFile) {
+                return {};
+            }
+
+            QStringList names;
+            if (node.level < m_layout.depth) {
+
+                names.reserve(m_layout.fanout);
+                for (auto i = 0; i < m_layout.fanout; ++i) {
+                    names << QStringLiteral("d%1").arg(i);
+                }
+            }
+            else {
+
+                names.reserve(m_layout.filesPerDir);
+                for (auto i = 0; i < m_layout.filesPerDir; ++i) {
+                    names << QStringLiteral("f%1.%2").arg(i, FileNameDigits, 10, QLatin1Char('0'))
+                                                     .arg(m_layout.extension);
+                }
+            }
+
+            return names;
+        }
+
+        qint64 SyntheticFileSystem::fileCount() const {
+
+            qint64 dirCount = 1;
+            for (auto level = 0; level < m_layout.depth; ++level) {
+                dirCount *= m_layout.fanout;
+            }
+
+            return dirCount * m_layout.filesPerDir;
+        }
+
+        const SyntheticFileSystem::Layout& SyntheticFileSystem::layout() const {
+            return m_layout;
+        }
+
+        SyntheticFileSystem::Node SyntheticFileSystem::locate(const QString& path) const {
+
+            // Paths are parsed rather than looked up, which is what allows the tree to be arbitrarily large. Each
+            // directory component narrows the index down by a factor of the fanout, just like the digits of a number.
+
+            Node node;
+            if (!path.startsWith(m_layout.rootPath)) {
+                return node;
+            }
+
+            const auto relativePath = path.midRef(m_layout.rootPath.size());
+            if (!relativePath.isEmpty() && !relativePath.startsWith(QLatin1Char('/'))) {
+                return node;
+            }
+
+            const auto components = relativePath.split(QLatin1Char('/'), QString::SkipEmptyParts);
+            for (const auto& component : components) {
+
+                auto ok = false;
+                if (node.level < m_layout.depth) {
+
+                    const auto i = component.startsWith(QLatin1Char('d')) ? component.mid(1).toInt(&ok) : -1;
+                    if (!ok || i < 0 || i >= m_layout.fanout || node.isFile) {
+                        return Node{};
+                    }
+
+                    node.index = node.index * m_layout.fanout + i;
+                    ++node.level;
+                }
+                else {
+
+                    const auto suffix = QLatin1Char('.') + m_layout.extension;
+                    const auto name = component.endsWith(suffix) ? component.left(component.size() - suffix.size())
+                                                                 : QStringRef{};
+
+                    const auto i = name.startsWith(QLatin1Char('f')) ? name.mid(1).toInt(&ok) : -1;
+                    if (!ok || i < 0 || i >= m_layout.filesPerDir || node.isFile) {
+                        return Node{};
+                    }
+
+                    node.index = node.index * m_layout.filesPerDir + i;
+                    node.isFile = true;
+                }
+            }
+
+            node.isValid = true;
+            return node;
+        }
+
+        QString SyntheticFileSystem::mimeTypeName(const QString& path) const {
+
+            QMimeDatabase mimeDb;
+            return mimeDb.mimeTypeForFile(path, QMimeDatabase::MatchExtension).name();
+        }
+
+        qint64 SyntheticFileSystem::read(const QString& path, char * const data, const qint64 maxSize) const {
+
+            const auto node = locate(path);
+            if (!node.isValid || !node.isFile) {
+                return -1;
+            }
+
+            const auto& fileContent = content(node.index);
+            const auto size = qMin<qint64>(maxSize, fileContent.size());
+            std::memcpy(data, fileContent.constData(), static_cast<std::size_t>(size));
+            return size;
+        }
+
+        FileStatus SyntheticFileSystem::status(const QString& path) const {
+
+            const auto node = locate(path);
+            if (!node.isValid) {
+                return FileStatus{};
+            }
+
+            // Inodes are numbered so that those of files and of directories at each level never coincide, and are
+            // never zero (which would make the FileId null).
+
+            FileStatus result;
+            result.id.device = SyntheticDevice;
+            result.id.inode  = node.isFile ? (quint64{1} << 62) + static_cast<quint64>(node.index) + 1
+                                           : (quint64{static_cast<quint64>(node.level) + 1} << 48)
+                                             + static_cast<quint64>(node.index);
+            result.isDir  = !node.isFile;
+            result.isFile = node.isFile;
+            result.size   = node.isFile ? content(node.index).size() : 0;
+            result.lastModified = m_lastModified;
+            return result;
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef MYRIAD_SYNTHETICFILESYSTEM_H
+#define MYRIAD_SYNTHETICFILESYSTEM_H
+
+#include <functional>
+#include <vector>
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+#include "filesystem.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * A read-only FileSystem whose directory tree and file contents are fabricated on demand rather than stored,
+         * so that trees of many millions of images cost no memory beyond what the engine itself uses to process them.
+         *
+         * The tree is a complete one: beneath the root lie @c depth levels of directories, each directory having
+         * @c fanout subdirectories, and each directory at the bottom level holds @c filesPerDir images. So a tree with a
+         * depth of 2, a fanout of 100 and 1000 files per directory has ten million images, at paths such as
+         * <tt>/synthetic/d42/d7/f000123.bmp</tt>. Paths outside of this tree do not exist.
+         *
+         * The contents of the images come from a generator function, which is called at most once for each of a fixed
+         * number of distinct contents; image @c i is given content <tt>i % distinctContents</tt>.
+         */
+
+        class SyntheticFileSystem : public FileSystem {
+
+        public:
+
+            /**
+             * Generates the encoded contents of an image file. It is called at most once for each content index.
+             */
+
+            using ContentGenerator = std::function<QByteArray(int contentIndex)>;
+
+            /**
+             * Describes the shape of a synthetic tree.
+             */
+
+            struct Layout {
+
+                QString rootPath{QStringLiteral("/synthetic")};
+                int depth = 2;
+                int fanout = 10;
+                int filesPerDir = 100;
+                int distinctContents = 64;
+
+                /** The file extension given to every image, which determines its MIME type. */
+                QString extension{QStringLiteral("bmp")};
+            };
+
+            /**
+             * Constructs a synthetic filesystem.
+             * @param layout The shape of the tree to fabricate.
+             * @param generator The function that generates image contents. If this is empty, each image is a small
+             * uncompressed bitmap of a distinct colour gradient, which suits the default "bmp" extension.
+             */
+
+            explicit SyntheticFileSystem(Layout layout, ContentGenerator generator = {});
+
+            /**
+             * Gets the total number of images in the tree.
+             */
+
+            qint64 fileCount() const;
+
+            /**
+             * Gets the layout that the tree was constructed with.
+             */
+
+            const Layout& layout() const;
+
+            QStringList entryNames(const QString& dirPath) const override;
+            QString mimeTypeName(const QString& path) const override;
+            qint64 read(const QString& path, char * data, qint64 maxSize) const override;
+            FileStatus status(const QString& path) const override;
+
+        private:
+
+            /**
+             * The position of a path within the tree.
+             */
+
+            struct Node {
+
+                bool isValid = false;
+                bool isFile = false;
+
+                /** The number of directory levels below the root at which the node lies (0 for the root itself). */
+                int level = 0;
+
+                /** The index of the node amongst all nodes at its level, or for files, amongst all files. */
+                qint64 index = 0;
+            };
+
+            /**
+             * Gets the content of an image, generating it if this hasn't been done already.
+             */
+
+            const QByteArray& content(qint64 fileIndex) const;
+
+            /**
+             * Determines where in the tree a path lies, if anywhere.
+             */
+
+            Node locate(const QString& path) const;
+
+            const Layout m_layout;
+            const ContentGenerator m_generator;
+            mutable std::vector<QByteArray> m_contents;
+            mutable QMutex m_contentsMutex;
+            const QDateTime m_lastModified;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,242 @@
+#include <QMutexLocker>
+#include <QString>
+
+#include "throughputmetrics.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The weight given to the most recent interval when updating a smoothed rate. Lower values give steadier
+             * rates (and so steadier ETAs) at the cost of reacting more slowly to genuine changes in throughput.
+             */
+
+            constexpr double RateSmoothing = 0.3;
+
+            /**
+             * The minimum interval, in milliseconds, over which rates are measured.
+             */
+
+            constexpr qint64 MinRateInterval = 250;
+
+            /**
+             * The names under which phases are exported as Prometheus labels, indexed by the integer value of the phase.
+             */
+
+            const char * const PhaseNames[PhaseCount] = {"idle", "scanning", "hashing", "comparing", "watching"};
+
+            /**
+             * Calculates @p done / @p total as a percentage, rounded to the nearest 1% and capped at 100%, or zero if
+             * @p total is zero.
+             */
+
+            int percentage(const qint64 done, const qint64 total) {
+                return total > 0 ? qMin(100, qRound(100.0 * done / total)) : 0;
+            }
+
+            double smoothedRate(const double previousRate, const qint64 delta, const double seconds) {
+
+                const auto rate = delta / seconds;
+                return previousRate > 0.0 ? previousRate + RateSmoothing * (rate - previousRate) : rate;
+            }
+
+            void appendMetric(QByteArray& text, const char * const name, const char * const type,
+                              const char * const help, const QByteArray& value) {
+
+                text += QByteArray{"# HELP "} + name + ' ' + help + '\n';
+                text += QByteArray{"# TYPE "} + name + ' ' + type + '\n';
+                text += QByteArray{name} + ' ' + value + '\n';
+            }
+        }
+
+        QByteArray MetricsSnapshot::toPrometheusText() const {
+
+            QByteArray text;
+
+            // The scan counts are those of the inputs as they stand, which fall when watching finds files removed, so
+            // they are gauges rather than counters.
+
+            appendMetric(text, "myriad_files_scanned", "gauge", "Image files among the inputs found by scanning.",
+                         QByteArray::number(filesScanned));
+            appendMetric(text, "myriad_directories_scanned", "gauge", "Directories among the inputs found by scanning.",
+                         QByteArray::number(dirsScanned));
+            appendMetric(text, "myriad_images_hashed_total", "counter", "Images read and hashed.",
+                         QByteArray::number(imagesHashed));
+            appendMetric(text, "myriad_read_bytes_total", "counter", "Bytes of image data read while hashing.",
+                         QByteArray::number(bytesRead));
+            appendMetric(text, "myriad_comparisons_total", "counter", "Pairs of image hashes compared.",
+                         QByteArray::number(comparisonsMade));
+
+            appendMetric(text, "myriad_hash_queue_depth", "gauge", "Images waiting to be hashed.",
+                         QByteArray::number(hashQueueDepth));
+            appendMetric(text, "myriad_comparison_queue_depth", "gauge", "Comparisons remaining in the current pass.",
+                         QByteArray::number(comparisonQueueDepth));
+
+            appendMetric(text, "myriad_files_per_second", "gauge", "Smoothed rate of files found while scanning.",
+                         QByteArray::number(filesPerSecond));
+            appendMetric(text, "myriad_read_bytes_per_second", "gauge", "Smoothed rate of image data read.",
+                         QByteArray::number(bytesPerSecond));
+            appendMetric(text, "myriad_hashes_per_second", "gauge", "Smoothed rate of images hashed.",
+                         QByteArray::number(hashesPerSecond));
+            appendMetric(text, "myriad_comparisons_per_second", "gauge", "Smoothed rate of hash comparisons.",
+                         QByteArray::number(comparisonsPerSecond));
+
+            appendMetric(text, "myriad_phase_eta_seconds", "gauge",
+                         "Estimated time until the current phase completes, or -1 if unknown.", QByteArray::number(eta));
+
+            text += "# HELP myriad_phase_elapsed_seconds Time spent in each processing phase.\n";
+            text += "# TYPE myriad_phase_elapsed_seconds counter\n";
+            for (auto i = 0; i < PhaseCount; ++i) {
+                text += QByteArray{"myriad_phase_elapsed_seconds{phase=\""} + PhaseNames[i] + "\"} "
+                      + QByteArray::number(phaseElapsed[i] / 1000.0) + '\n';
+            }
+
+            text += "# HELP myriad_phase Whether each processing phase is the current one.\n";
+            text += "# TYPE myriad_phase gauge\n";
+            for (auto i = 0; i < PhaseCount; ++i) {
+                text += QByteArray{"myriad_phase{phase=\""} + PhaseNames[i] + "\"} "
+                      + (static_cast<int>(phase) == i ? '1' : '0') + '\n';
+            }
+
+            return text;
+        }
+
+        ThroughputMetrics::ThroughputMetrics() {
+            m_clock.start();
+        }
+
+        void ThroughputMetrics::addImageHashed(const qint64 bytesRead) {
+
+            m_bytesRead.fetch_add(bytesRead, std::memory_order_relaxed);
+            m_imagesHashed.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        MetricsSnapshot ThroughputMetrics::sample() {
+
+            auto snapshot = m_lastSample;
+
+            {
+                const QMutexLocker locker{&m_phaseMutex};
+
+                snapshot.phase = m_phase;
+                snapshot.phaseElapsed = m_phaseElapsed;
+                snapshot.phaseElapsed[static_cast<int>(m_phase)] += m_clock.elapsed() - m_phaseStart;
+            }
+
+            if (snapshot.phase != m_lastSample.phase) {
+
+                snapshot.bytesPerSecond       = 0.0;
+                snapshot.comparisonsPerSecond = 0.0;
+                snapshot.filesPerSecond       = 0.0;
+                snapshot.hashesPerSecond      = 0.0;
+                m_rateTimer.invalidate();
+            }
+
+            snapshot.bytesRead       = m_bytesRead.load(std::memory_order_relaxed);
+            snapshot.comparisonsMade = m_comparisonsMade.load(std::memory_order_relaxed);
+            snapshot.dirsScanned     = m_dirsScanned.load(std::memory_order_relaxed);
+            snapshot.filesScanned    = m_filesScanned.load(std::memory_order_relaxed);
+            snapshot.imagesHashed    = m_imagesHashed.load(std::memory_order_relaxed);
+
+            // The counters are read independently, so a pass that starts while we sample may leave them momentarily
+            // inconsistent with one another; the clamping here keeps that from showing.
+
+            const auto comparisonPassMade  = m_comparisonPassMade.load(std::memory_order_relaxed);
+            const auto comparisonPassTotal = m_comparisonPassTotal.load(std::memory_order_relaxed);
+            const auto hashPassMade        = snapshot.imagesHashed - m_hashPassStart.load(std::memory_order_relaxed);
+            const auto hashPassTotal       = m_hashPassTotal.load(std::memory_order_relaxed);
+
+            snapshot.comparisonQueueDepth = qMax<qint64>(0, comparisonPassTotal - comparisonPassMade);
+            snapshot.hashQueueDepth       = qMax<qint64>(0, hashPassTotal - hashPassMade);
+
+            snapshot.comparisonProgress = percentage(comparisonPassMade, comparisonPassTotal);
+            snapshot.hashingProgress    = percentage(hashPassMade, hashPassTotal);
+
+            // Rates are only updated once a measurable amount of time has passed, since dividing by a tiny interval
+            // would produce wildly noisy values. Until then, the previous rates are carried over unchanged.
+
+            const auto elapsed = m_rateTimer.isValid() ? m_rateTimer.elapsed() : 0;
+            if (elapsed >= MinRateInterval) {
+
+                const auto seconds = elapsed / 1000.0;
+                const auto& base = m_rateBase;
+
+                snapshot.bytesPerSecond = smoothedRate(snapshot.bytesPerSecond, snapshot.bytesRead - base.bytesRead,
+                                                       seconds);
+                snapshot.comparisonsPerSecond = smoothedRate(snapshot.comparisonsPerSecond,
+                                                             snapshot.comparisonsMade - base.comparisonsMade, seconds);
+                snapshot.filesPerSecond = smoothedRate(snapshot.filesPerSecond,
+                                                       qMax(snapshot.filesScanned - base.filesScanned, qint64{0}),
+                                                       seconds);
+                snapshot.hashesPerSecond = smoothedRate(snapshot.hashesPerSecond,
+                                                        snapshot.imagesHashed - base.imagesHashed, seconds);
+            }
+
+            if (!m_rateTimer.isValid() || elapsed >= MinRateInterval) {
+
+                m_rateBase = snapshot;
+                m_rateTimer.start();
+            }
+
+            switch (snapshot.phase) {
+
+                case Phase::Hashing:
+                    snapshot.eta = snapshot.hashesPerSecond > 0.0
+                                 ? static_cast<qint64>(snapshot.hashQueueDepth / snapshot.hashesPerSecond) : -1;
+                    break;
+
+                case Phase::Comparing:
+                    snapshot.eta = snapshot.comparisonsPerSecond > 0.0
+                                 ? static_cast<qint64>(snapshot.comparisonQueueDepth / snapshot.comparisonsPerSecond)
+                                 : -1;
+                    break;
+
+                default:
+                    snapshot.eta = -1;
+                    break;
+            }
+
+            m_lastSample = snapshot;
+            return snapshot;
+        }
+
+        void ThroughputMetrics::setComparisonCounts(const qint64 made, const qint64 total) {
+
+            // Each call to compareImages() or compareImage() is a separate pass with its own count, so when a new pass
+            // starts we fold the previous one into the base of the cumulative total.
+
+            const auto previousMade = m_comparisonPassMade.load(std::memory_order_relaxed);
+            if (made < previousMade) {
+                m_comparisonPassBase += previousMade;
+            }
+
+            m_comparisonPassTotal.store(total, std::memory_order_relaxed);
+            m_comparisonPassMade.store(made, std::memory_order_relaxed);
+            m_comparisonsMade.store(m_comparisonPassBase + made, std::memory_order_relaxed);
+        }
+
+        void ThroughputMetrics::setHashTotal(const qint64 total) {
+
+            m_hashPassStart.store(m_imagesHashed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_hashPassTotal.store(total, std::memory_order_relaxed);
+        }
+
+        void ThroughputMetrics::setPhase(const Phase phase) {
+
+            const QMutexLocker locker{&m_phaseMutex};
+
+            const auto now = m_clock.elapsed();
+            m_phaseElapsed[static_cast<int>(m_phase)] += now - m_phaseStart;
+            m_phaseStart = now;
+            m_phase = phase;
+        }
+
+        void ThroughputMetrics::setScanCounts(const qint64 fileCount, const qint64 dirCount) {
+
+            m_filesScanned.store(fileCount, std::memory_order_relaxed);
+            m_dirsScanned.store(dirCount, std::memory_order_relaxed);
+        }
+    }
+}
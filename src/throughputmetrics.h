@@ -0,0 +1,158 @@
+#ifndef MYRIAD_THROUGHPUTMETRICS_H
+#define MYRIAD_THROUGHPUTMETRICS_H
+
+#include <array>
+#include <atomic>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <QMutex>
+
+#include "processor.h"
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * The number of values in the Phase enumeration.
+         */
+
+        constexpr int PhaseCount = static_cast<int>(Phase::Watching) + 1;
+
+        /**
+         * A point-in-time view of a ProcessorThread's throughput, suitable for passing between threads by value.
+         * Totals are cumulative over the whole run; rates are smoothed over the last few seconds.
+         */
+
+        struct MetricsSnapshot {
+
+            /**
+             * Formats the snapshot in the Prometheus text exposition format, as read by (for example) the textfile
+             * collector of the Prometheus node exporter.
+             */
+
+            QByteArray toPrometheusText() const;
+
+            Phase phase = Phase::Idle;
+
+            qint64 bytesRead       = 0;
+            qint64 comparisonsMade = 0;
+            qint64 dirsScanned     = 0;
+            qint64 filesScanned    = 0;
+            qint64 imagesHashed    = 0;
+
+            qint64 comparisonQueueDepth = 0;
+            qint64 hashQueueDepth       = 0;
+
+            /**
+             * The percentage completion of the current comparison pass.
+             */
+
+            int comparisonProgress = 0;
+
+            /**
+             * The percentage completion of the current hashing pass.
+             */
+
+            int hashingProgress = 0;
+
+            double bytesPerSecond       = 0.0;
+            double comparisonsPerSecond = 0.0;
+            double filesPerSecond       = 0.0;
+            double hashesPerSecond      = 0.0;
+
+            /** The time spent in each phase so far, in milliseconds, indexed by the integer value of the phase. */
+            std::array<qint64, PhaseCount> phaseElapsed{};
+
+            /** The estimated number of seconds until the current phase completes, or -1 if no estimate is possible. */
+            qint64 eta = -1;
+        };
+
+        /**
+         * Keeps the rolling counters from which MetricsSnapshot objects are generated. Updating a counter is no more
+         * than an atomic store, so the processing thread and its workers may do so as often as they like from any
+         * thread, and snapshots are taken separately, at whatever cadence suits whoever displays them. The add*() and
+         * set*() methods may be called from any thread, but setComparisonCounts() must always be called from the same
+         * one, as must sample().
+         */
+
+        class ThroughputMetrics {
+
+        public:
+
+            /**
+             * Constructs a set of metrics with every counter at zero, in the idle phase.
+             */
+
+            ThroughputMetrics();
+
+            /**
+             * Records that an image has been hashed.
+             * @param bytesRead The size of the image file, all of which has been read.
+             */
+
+            void addImageHashed(qint64 bytesRead);
+
+            /**
+             * Generates a snapshot of the current counters, updating the smoothed rates with the progress made since
+             * the previous call. The rates are reset whenever the phase has changed since the previous call, since the
+             * throughput of one phase says nothing about that of the next.
+             */
+
+            MetricsSnapshot sample();
+
+            /**
+             * Sets the number of comparisons made so far during the current comparison pass, and how many that pass
+             * will make in total.
+             */
+
+            void setComparisonCounts(qint64 made, qint64 total);
+
+            /**
+             * Starts a hashing pass, setting the number of images that it is to hash. The depth of the hashing queue
+             * and the pass's progress are derived from the number of images hashed since.
+             */
+
+            void setHashTotal(qint64 total);
+
+            /**
+             * Sets the phase that the processing thread is in, accumulating the time spent in the previous phase.
+             */
+
+            void setPhase(Phase phase);
+
+            /**
+             * Sets the number of files and folders that have been scanned as inputs so far. These may fall as well as
+             * rise, as watching finds inputs removed.
+             */
+
+            void setScanCounts(qint64 fileCount, qint64 dirCount);
+
+        private:
+
+            std::atomic<qint64> m_bytesRead{0};
+            QElapsedTimer m_clock;
+            qint64 m_comparisonPassBase = 0;
+            std::atomic<qint64> m_comparisonPassMade{0};
+            std::atomic<qint64> m_comparisonPassTotal{0};
+            std::atomic<qint64> m_comparisonsMade{0};
+            std::atomic<qint64> m_dirsScanned{0};
+            std::atomic<qint64> m_filesScanned{0};
+            std::atomic<qint64> m_hashPassStart{0};
+            std::atomic<qint64> m_hashPassTotal{0};
+            std::atomic<qint64> m_imagesHashed{0};
+            MetricsSnapshot m_lastSample;
+            Phase m_phase = Phase::Idle;
+            std::array<qint64, PhaseCount> m_phaseElapsed{};
+            QMutex m_phaseMutex;
+            qint64 m_phaseStart = 0;
+            MetricsSnapshot m_rateBase;
+            QElapsedTimer m_rateTimer;
+        };
+    }
+}
+
+Q_DECLARE_METATYPE(myriad::processing::MetricsSnapshot)
+
+#endif
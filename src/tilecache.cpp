@@ -0,0 +1,241 @@
+#include <functional>
+#include <limits>
+#include <utility>
+
+#include <QFileInfo>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QPainter>
+#include <QRunnable>
+
+#include "tilecache.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * A task that decodes tiles on a worker thread within a @c QThreadPool.
+             */
+
+            class DecodingTask : public QRunnable {
+
+            public:
+
+                explicit DecodingTask(std::function<void()> function)
+                    : m_function{std::move(function)} {
+                }
+
+                void run() override {
+                    m_function();
+                }
+
+            private:
+
+                const std::function<void()> m_function;
+            };
+
+            /**
+             * Converts a block of tiles to the region of an image that it covers, in pixels.
+             */
+
+            QRect pixelRect(const QRect& tiles, const QSize& imageSize) {
+
+                const QRect rect{tiles.x() * TileCache::TileSide, tiles.y() * TileCache::TileSide,
+                                 tiles.width() * TileCache::TileSide, tiles.height() * TileCache::TileSide};
+
+                return rect & QRect{QPoint{0, 0}, imageSize};
+            }
+
+            /**
+             * Converts a region of an image, in pixels, to the block of tiles that covers it.
+             */
+
+            QRect tileRect(const QRect& rect) {
+                return {QPoint{rect.left() / TileCache::TileSide, rect.top() / TileCache::TileSide},
+                        QPoint{rect.right() / TileCache::TileSide, rect.bottom() / TileCache::TileSide}};
+            }
+        }
+
+        constexpr int TileCache::TileSide;
+
+        TileCache::TileCache(const qint64 memoryBudget, QObject * const parent)
+            : QObject{parent},
+              m_tiles{static_cast<int>(qMin<qint64>(memoryBudget / 1024, std::numeric_limits<int>::max()))} {
+
+            qRegisterMetaType<QVector<QImage>>();
+            qRegisterMetaType<QVector<QPoint>>();
+            connect(this, &TileCache::tilesDecoded, this, &TileCache::storeTiles);
+        }
+
+        TileCache::~TileCache() {
+            m_workers.waitForDone();
+        }
+
+        bool TileCache::decodesRegions(const QString& path) const {
+
+            const auto iter = m_images.constFind(path);
+            return iter == m_images.constEnd() || (iter.value().canClip && iter.value().size.isValid());
+        }
+
+        void TileCache::decodeTiles(const QString& path, const QRect& rect) {
+
+            m_pendingPaths << path;
+            m_workers.start(new DecodingTask{[this, path, rect] {
+
+                const QFileInfo fileInfo{path};
+
+                // Reading the size of the image and whether it can be clipped only requires its header. An image that
+                // can't be clipped is left alone, rather than decoded in full.
+
+                QImageReader reader{path};
+                auto imageSize = reader.size();
+                const auto canClip = reader.supportsOption(QImageIOHandler::ClipRect);
+                const auto clippedRect = rect & QRect{QPoint{0, 0}, imageSize};
+
+                QVector<QPoint> positions;
+                QVector<QImage> tiles;
+
+                if (canClip && !clippedRect.isEmpty()) {
+
+                    const auto block = tileRect(clippedRect);
+                    const auto decodedRect = pixelRect(block, imageSize);
+                    reader.setClipRect(decodedRect);
+
+                    QImage decoded;
+                    if (reader.read(&decoded)) {
+
+                        // The decoded image's origin lies at the top left of the clip rectangle.
+
+                        for (auto row = block.top(); row <= block.bottom(); ++row) {
+                            for (auto column = block.left(); column <= block.right(); ++column) {
+
+                                const auto tileArea = pixelRect(QRect{column, row, 1, 1}, imageSize);
+                                positions << QPoint{column, row};
+                                tiles << decoded.copy(tileArea.translated(-decodedRect.topLeft()));
+                            }
+                        }
+                    }
+                    else {
+
+                        // The image is treated as unreadable, so that it isn't decoded again for every request.
+
+                        qWarning("Could not decode tiles of %s: %s", qPrintable(path),
+                                 qPrintable(reader.errorString()));
+                        imageSize = QSize{};
+                    }
+                }
+
+                emit(tilesDecoded(path, fileInfo.size(), fileInfo.lastModified(), imageSize, canClip, positions,
+                                  tiles));
+            }});
+        }
+
+        void TileCache::invalidate(const QString& path) {
+
+            m_images.remove(path);
+
+            const auto keys = m_tiles.keys();
+            for (const auto& key : keys) {
+                if (key.first == path) {
+                    m_tiles.remove(key);
+                }
+            }
+        }
+
+        QImage TileCache::region(const QString& path, const QRect& rect) {
+
+            // Examining the file costs a single stat() call, which is cheap enough to make on every request, so tiles
+            // of a file that has since changed are never shown.
+
+            const QFileInfo fileInfo{path};
+            auto iter = m_images.constFind(path);
+            if (iter != m_images.constEnd()
+                && (iter.value().fileSize != fileInfo.size() || iter.value().lastModified != fileInfo.lastModified())) {
+
+                invalidate(path);
+                iter = m_images.constEnd();
+            }
+
+            if (iter == m_images.constEnd()) {
+
+                if (!m_pendingPaths.contains(path)) {
+                    decodeTiles(path, rect);
+                }
+                return {};
+            }
+
+            const auto& image = iter.value();
+            const auto clippedRect = rect & QRect{QPoint{0, 0}, image.size};
+            if (!image.canClip || clippedRect.isEmpty()) {
+                return {};
+            }
+
+            // Any missing tiles are decoded together, as a single block, since decoding a clip rectangle costs much
+            // the same however wide it is.
+
+            const auto tiles = tileRect(clippedRect);
+
+            QRect missingTiles;
+            for (auto row = tiles.top(); row <= tiles.bottom(); ++row) {
+                for (auto column = tiles.left(); column <= tiles.right(); ++column) {
+                    if (!m_tiles.contains({path, {column, row}})) {
+                        missingTiles |= QRect{column, row, 1, 1};
+                    }
+                }
+            }
+
+            if (!missingTiles.isNull() && !m_pendingPaths.contains(path)) {
+                decodeTiles(path, pixelRect(missingTiles, image.size));
+            }
+
+            if (missingTiles == tiles) {
+                return {};
+            }
+
+            QImage region{clippedRect.size(), QImage::Format_ARGB32_Premultiplied};
+            region.fill(Qt::transparent);
+
+            QPainter painter{&region};
+            for (auto row = tiles.top(); row <= tiles.bottom(); ++row) {
+                for (auto column = tiles.left(); column <= tiles.right(); ++column) {
+                    if (const auto * const tile = m_tiles.object({path, {column, row}})) {
+                        painter.drawImage(QPoint{column * TileSide, row * TileSide} - clippedRect.topLeft(), *tile);
+                    }
+                }
+            }
+
+            painter.end();
+            return region;
+        }
+
+        void TileCache::storeTiles(const QString& path, const qint64 fileSize, const QDateTime& lastModified,
+                                   const QSize& imageSize, const bool canClip, const QVector<QPoint>& positions,
+                                   const QVector<QImage>& tiles) {
+
+            m_pendingPaths.remove(path);
+
+            const auto iter = m_images.constFind(path);
+            if (iter != m_images.constEnd()
+                && (iter.value().fileSize != fileSize || iter.value().lastModified != lastModified)) {
+                invalidate(path);
+            }
+
+            auto& image = m_images[path];
+            image.fileSize = fileSize;
+            image.lastModified = lastModified;
+            image.size = imageSize;
+            image.canClip = canClip;
+
+            for (auto i = 0; i < tiles.size(); ++i) {
+
+                const auto& tile = tiles[i];
+                m_tiles.insert({path, {positions[i].x(), positions[i].y()}}, new QImage{tile},
+                               tile.bytesPerLine() * tile.height() / 1024);
+            }
+
+            emit(regionReady(path));
+        }
+    }
+}
@@ -0,0 +1,188 @@
+#ifndef MYRIAD_TILECACHE_H
+#define MYRIAD_TILECACHE_H
+
+#include <QCache>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QPair>
+#include <QPoint>
+#include <QRect>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Serves regions of images at full resolution, as needed to zoom in on part of an image, without decoding any
+         * more of the image than necessary. Images are divided into square tiles, which are decoded on demand and kept
+         * in a least-recently-used cache bounded by their size in bytes, so panning around a zoomed view mostly reuses
+         * tiles that have already been decoded, and memory use is bounded however large the image is.
+         *
+         * Missing tiles are decoded in the background, with a clip rectangle. The JPEG plugin supports one: it stops
+         * decoding at the bottom of the clip rectangle and only holds a few rows of the full image in memory at a
+         * time, so even a region at the bottom of a huge JPEG costs no more than a single pass over the file, and a
+         * region near the top costs far less. Images whose plugins can't clip are never decoded by the cache, since
+         * that would mean decoding the whole image for every miss; views should zoom into a downscaled preview of
+         * them instead (see decodesRegions()).
+         *
+         * Tiles are only used while the file that they were decoded from has the same size and modification time, so
+         * an image that is changed on disk is decoded afresh. A TileCache must be used from the thread that it lives
+         * in.
+         */
+
+        class TileCache : public QObject {
+        Q_OBJECT
+
+        public:
+
+            /**
+             * The length of the sides of each tile, in pixels.
+             */
+
+            static constexpr int TileSide = 256;
+
+            /**
+             * Constructs an empty cache.
+             * @param memoryBudget The largest amount of memory that cached tiles may use, in bytes.
+             * @param parent The parent object of the cache.
+             */
+
+            explicit TileCache(qint64 memoryBudget, QObject * parent = nullptr);
+
+            /**
+             * Destroys the cache, after waiting for any tiles that are being decoded.
+             */
+
+            ~TileCache();
+
+            /**
+             * Tests whether the cache decodes regions of an image, which it only does if the image can be read and its
+             * plugin can decode a clip rectangle. This is @c true for images whose header hasn't been read yet.
+             */
+
+            bool decodesRegions(const QString& path) const;
+
+            /**
+             * Gets a region of an image at full resolution, as far as its tiles are in memory. Any tiles that aren't
+             * are decoded in the background, and regionReady() is emitted once they have been.
+             * @param path The path of the image.
+             * @param rect The region to get, in the image's pixel coordinates.
+             * @return The part of the region that lies within the image, with any tiles that aren't in memory left
+             * transparent, or a null image if none of its tiles are in memory yet (or if the image can't be read or
+             * clipped).
+             */
+
+            QImage region(const QString& path, const QRect& rect);
+
+        signals:
+
+            /**
+             * Emitted once tiles that region() didn't have in memory have been decoded.
+             * @param path The path of the image.
+             */
+
+            void regionReady(const QString& path);
+
+            /**
+             * Emitted by a background task once it has read an image's header and decoded some of its tiles. This is
+             * only used to pass the tiles back to the thread that the cache lives in.
+             * @param path The path of the image.
+             * @param fileSize The size of the file that the tiles were decoded from.
+             * @param lastModified The modification time of the file that the tiles were decoded from.
+             * @param imageSize The size of the image, which is invalid if its header couldn't be read.
+             * @param canClip Whether the image's plugin can decode a clip rectangle.
+             * @param positions The column and row of each decoded tile.
+             * @param tiles The decoded tiles, in the same order as @p positions.
+             */
+
+            void tilesDecoded(const QString& path, qint64 fileSize, const QDateTime& lastModified,
+                              const QSize& imageSize, bool canClip, const QVector<QPoint>& positions,
+                              const QVector<QImage>& tiles);
+
+        private:
+
+            /**
+             * What the cache knows about an image, besides its tiles.
+             */
+
+            struct Image {
+
+                /**
+                 * The size of the file when its header was read.
+                 */
+
+                qint64 fileSize = 0;
+
+                /**
+                 * The modification time of the file when its header was read.
+                 */
+
+                QDateTime lastModified;
+
+                /**
+                 * The size of the image, which is invalid if its header couldn't be read.
+                 */
+
+                QSize size;
+
+                /**
+                 * Whether the image's plugin can decode a clip rectangle.
+                 */
+
+                bool canClip = true;
+            };
+
+            /**
+             * Identifies a tile by the path of its image, along with its column and row.
+             */
+
+            using TileKey = QPair<QString, QPair<int, int>>;
+
+            /**
+             * Starts decoding a block of tiles of an image in the background, reading the image's header first.
+             * @param path The path of the image.
+             * @param rect The region of the image, in pixels, whose tiles should be decoded. This is clipped to the
+             * image once its size is known.
+             */
+
+            void decodeTiles(const QString& path, const QRect& rect);
+
+            /**
+             * Forgets an image's header and tiles, because its file has changed since they were read.
+             */
+
+            void invalidate(const QString& path);
+
+            /**
+             * Stores tiles that have been decoded in the background, and the header of the image they came from.
+             */
+
+            void storeTiles(const QString& path, qint64 fileSize, const QDateTime& lastModified, const QSize& imageSize,
+                            bool canClip, const QVector<QPoint>& positions, const QVector<QImage>& tiles);
+
+            QHash<QString, Image> m_images;
+
+            /**
+             * Images whose tiles are being decoded in the background. Only one block of each image is decoded at a
+             * time; the view asks again for whatever it still lacks once regionReady() is emitted.
+             */
+
+            QSet<QString> m_pendingPaths;
+
+            /**
+             * The tiles in memory, at a cost of their size in KiB.
+             */
+
+            QCache<TileKey, QImage> m_tiles;
+            QThreadPool m_workers;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QSaveFile>
+#include <QString>
+
+#include "tracing.h"
+
+namespace myriad {
+    namespace processing {
+
+        namespace {
+
+            /**
+             * The number of spans that each thread's ring buffer can hold. At 24 bytes per span, this comes to
+             * 1.5 MiB for each thread recording at once, which is enough for the last few thousand images hashed by
+             * that thread.
+             */
+
+            constexpr std::size_t RingCapacity = 64 * 1024;
+
+            struct Span {
+
+                const char * name;
+                qint64 start;
+                qint64 end;
+            };
+
+            /**
+             * The spans recorded by a single thread. Only the owning thread writes to the buffer, so the mutex is
+             * uncontended except while a trace is being written or cleared.
+             */
+
+            struct ThreadBuffer {
+
+                explicit ThreadBuffer(const int threadIndex)
+                    : threadIndex{threadIndex}, spans(RingCapacity) {
+                }
+
+                const int threadIndex;
+                std::mutex mutex;
+                std::vector<Span> spans;
+                quint64 recordedCount = 0;
+            };
+
+            /**
+             * Holds every buffer that has been recorded into. Buffers are shared with their threads rather than owned
+             * by them, so that the spans recorded by threads that have since exited (such as pool workers) still appear
+             * in the trace. The buffer of a thread that has exited is put on the free list and handed to the next thread
+             * that starts recording, so there are only ever as many buffers as there have been recording threads at
+             * once, however many pools come and go; the new thread's spans overwrite the oldest of the old thread's as
+             * its ring fills.
+             */
+
+            struct Registry {
+
+                std::mutex mutex;
+                std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+                std::vector<std::shared_ptr<ThreadBuffer>> freeBuffers;
+            };
+
+            Registry& registry() {
+
+                static Registry registry;
+                return registry;
+            }
+
+            /**
+             * Holds a thread's buffer for as long as the thread runs, and returns it to the registry's free list when
+             * the thread exits. Spans are written straight into the ring, so there is nothing to flush.
+             */
+
+            struct BufferOwner {
+
+                ~BufferOwner() {
+
+                    if (buffer) {
+
+                        auto& reg = registry();
+                        std::lock_guard<std::mutex> locker{reg.mutex};
+                        reg.freeBuffers.push_back(std::move(buffer));
+                    }
+                }
+
+                std::shared_ptr<ThreadBuffer> buffer;
+            };
+
+            ThreadBuffer& threadBuffer() {
+
+                thread_local BufferOwner owner;
+                if (!owner.buffer) {
+
+                    auto& reg = registry();
+                    std::lock_guard<std::mutex> locker{reg.mutex};
+
+                    if (!reg.freeBuffers.empty()) {
+
+                        owner.buffer = std::move(reg.freeBuffers.back());
+                        reg.freeBuffers.pop_back();
+                    }
+                    else {
+
+                        owner.buffer = std::make_shared<ThreadBuffer>(static_cast<int>(reg.buffers.size()) + 1);
+                        reg.buffers.push_back(owner.buffer);
+                    }
+                }
+
+                return *owner.buffer;
+            }
+
+            /**
+             * Formats a time in nanoseconds as the microseconds expected by the trace event format.
+             */
+
+            QByteArray microseconds(const qint64 nanoseconds) {
+                return QByteArray::number(nanoseconds / 1000.0, 'f', 3);
+            }
+        }
+
+        std::atomic<bool> Tracer::s_enabled{false};
+
+        void Tracer::clear() {
+
+            auto& reg = registry();
+            std::lock_guard<std::mutex> registryLocker{reg.mutex};
+
+            for (const auto& buffer : reg.buffers) {
+
+                std::lock_guard<std::mutex> bufferLocker{buffer->mutex};
+                buffer->recordedCount = 0;
+            }
+        }
+
+        qint64 Tracer::now() {
+
+            using namespace std::chrono;
+
+            static const auto epoch = steady_clock::now();
+            return duration_cast<nanoseconds>(steady_clock::now() - epoch).count();
+        }
+
+        void Tracer::record(const char * const name, const qint64 start, const qint64 end) {
+
+            auto& buffer = threadBuffer();
+            std::lock_guard<std::mutex> locker{buffer.mutex};
+
+            buffer.spans[buffer.recordedCount % RingCapacity] = Span{name, start, end};
+            ++buffer.recordedCount;
+        }
+
+        void Tracer::setEnabled(const bool enabled) {
+
+            // Establish the epoch before any span can start, so that no span ever has a negative start time.
+
+            now();
+            s_enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        bool Tracer::writeChromeTrace(const QString& path) {
+
+            const auto pid = QByteArray::number(QCoreApplication::applicationPid());
+
+            QByteArray json{"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["};
+            auto firstEvent = true;
+
+            const auto appendEvent = [&json, &firstEvent](const QByteArray& event) {
+
+                if (!firstEvent) {
+                    json += ",\n";
+                }
+
+                json += event;
+                firstEvent = false;
+            };
+
+            auto& reg = registry();
+            std::lock_guard<std::mutex> registryLocker{reg.mutex};
+
+            for (const auto& buffer : reg.buffers) {
+
+                std::lock_guard<std::mutex> bufferLocker{buffer->mutex};
+                if (buffer->recordedCount == 0) {
+                    continue;
+                }
+
+                const auto tid = QByteArray::number(buffer->threadIndex);
+                appendEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+                            + ",\"args\":{\"name\":\"Thread " + tid + "\"}}");
+
+                // Once the ring has wrapped around, its oldest surviving span is the one that will next be overwritten.
+
+                const auto count = std::min<quint64>(buffer->recordedCount, RingCapacity);
+                for (auto i = buffer->recordedCount - count; i < buffer->recordedCount; ++i) {
+
+                    const auto& span = buffer->spans[i % RingCapacity];
+                    appendEvent("{\"name\":\"" + QByteArray{span.name} + "\",\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":"
+                                + tid + ",\"ts\":" + microseconds(span.start) + ",\"dur\":"
+                                + microseconds(span.end - span.start) + "}");
+                }
+            }
+
+            json += "]}\n";
+
+            QSaveFile file{path};
+            return file.open(QIODevice::WriteOnly) && file.write(json) == json.size() && file.commit();
+        }
+    }
+}
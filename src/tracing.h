@@ -0,0 +1,125 @@
+#ifndef MYRIAD_TRACING_H
+#define MYRIAD_TRACING_H
+
+#include <atomic>
+
+#include <QtGlobal>
+
+class QString;
+
+namespace myriad {
+    namespace processing {
+
+        /**
+         * Collects timed spans of work from any number of threads so that they can be exported in the Chrome trace
+         * event format and inspected in chrome://tracing or Perfetto. Each thread records into a ring buffer of its own,
+         * so recording never contends with other threads; once a buffer is full, its oldest spans are overwritten. When
+         * a thread exits, its buffer is handed on to the next thread to start recording, so a thread in the trace may
+         * stand for several threads that ran one after another.
+         *
+         * Tracing is disabled by default, in which case a TraceSpan costs only a single relaxed atomic load, so spans
+         * can be left in place in production code.
+         */
+
+        class Tracer {
+
+        public:
+
+            /**
+             * Discards every span recorded so far, by all threads.
+             */
+
+            static void clear();
+
+            /**
+             * Gets whether spans are currently being recorded.
+             */
+
+            static bool isEnabled() {
+                return s_enabled.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Gets the current time, in nanoseconds since an arbitrary fixed point, on the clock used for all spans.
+             */
+
+            static qint64 now();
+
+            /**
+             * Records a completed span in the calling thread's ring buffer. TraceSpan should normally be used instead.
+             * @param name The name of the span, which must remain valid for the lifetime of the program (in practice,
+             * a string literal).
+             * @param start The time at which the span started, as returned by now().
+             * @param end The time at which the span ended, as returned by now().
+             */
+
+            static void record(const char * name, qint64 start, qint64 end);
+
+            /**
+             * Starts or stops recording spans. Spans that have already been recorded are kept either way.
+             */
+
+            static void setEnabled(bool enabled);
+
+            /**
+             * Writes every recorded span to a file in the Chrome trace event (JSON) format.
+             * @param path The filesystem path of the file to write, which is replaced if it already exists.
+             * @return @c true if the file was written successfully; @c false otherwise.
+             */
+
+            static bool writeChromeTrace(const QString& path);
+
+        private:
+
+            static std::atomic<bool> s_enabled;
+        };
+
+        /**
+         * Records the time between its construction and its destruction (or a call to finish()) as a named span, if
+         * tracing was enabled when it was constructed.
+         */
+
+        class TraceSpan {
+
+        public:
+
+            /**
+             * Starts a span.
+             * @param name The name of the span, which must be a string literal or otherwise live for the lifetime of the
+             * program.
+             */
+
+            explicit TraceSpan(const char * const name)
+                : m_name{Tracer::isEnabled() ? name : nullptr},
+                  m_start{m_name ? Tracer::now() : 0} {
+            }
+
+            TraceSpan(const TraceSpan&) = delete;
+            TraceSpan& operator=(const TraceSpan&) = delete;
+
+            ~TraceSpan() {
+                finish();
+            }
+
+            /**
+             * Ends the span before the end of its scope. Subsequent calls have no effect.
+             */
+
+            void finish() {
+
+                if (m_name) {
+
+                    Tracer::record(m_name, m_start, Tracer::now());
+                    m_name = nullptr;
+                }
+            }
+
+        private:
+
+            const char * m_name;
+            const qint64 m_start;
+        };
+    }
+}
+
+#endif